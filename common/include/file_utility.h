@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string_view>
 
 struct FileBuffer {
@@ -14,8 +15,37 @@ struct FileBuffer {
   int size = 0;
 };
 
+// Read only view of a whole file mapped in memory, the OS reads its pages when
+// they are first accessed.
+class MappedFile {
+ public:
+  MappedFile() noexcept = default;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile& other) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  bool Open(std::string_view path) noexcept;
+  void Close() noexcept;
+
+  [[nodiscard]] const unsigned char* data() const noexcept { return data_; }
+  [[nodiscard]] std::size_t size() const noexcept { return size_; }
+  [[nodiscard]] bool is_open() const noexcept { return data_ != nullptr; }
+
+ private:
+  const unsigned char* data_ = nullptr;
+  std::size_t size_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif  // _WIN32
+};
+
 namespace file_utility {
   std::string LoadFile(std::string_view path);
   FileBuffer LoadFileBuffer(std::string_view path);
   void LoadFileInBuffer(std::string_view path, FileBuffer* file_buffer);
+  bool WriteFileBuffer(std::string_view path, const unsigned char* data,
+                       std::size_t size);
 }
\ No newline at end of file
@@ -1,6 +1,20 @@
 #include "file_utility.h"
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
 #include <fstream>
+#include <string>
+#include <utility>
 
 FileBuffer::FileBuffer(FileBuffer&& other) noexcept {
   std::swap(data, other.data);
@@ -25,6 +39,109 @@ FileBuffer::~FileBuffer() {
   size = 0;
 }
 
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  std::swap(data_, other.data_);
+  std::swap(size_, other.size_);
+#ifdef _WIN32
+  std::swap(file_, other.file_);
+  std::swap(mapping_, other.mapping_);
+#endif  // _WIN32
+
+  other.Close();
+
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(std::string_view path) noexcept {
+  Close();
+  const std::string path_string(path);
+
+#ifdef _WIN32
+  file_ = CreateFileA(path_string.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    file_ = nullptr;
+    return false;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) {
+    Close();
+    return false;
+  }
+
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ == nullptr) {
+    Close();
+    return false;
+  }
+
+  data_ = static_cast<const unsigned char*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  size_ = static_cast<std::size_t>(file_size.QuadPart);
+#else
+  const int file = open(path_string.c_str(), O_RDONLY);
+  if (file < 0) {
+    return false;
+  }
+
+  struct stat file_stat {};
+  if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(file);
+    return false;
+  }
+
+  // The mapping keeps its own reference to the file.
+  void* mapping = mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ,
+                       MAP_PRIVATE, file, 0);
+  close(file);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  data_ = static_cast<const unsigned char*>(mapping);
+  size_ = static_cast<std::size_t>(file_stat.st_size);
+#endif  // _WIN32
+
+  if (data_ == nullptr) {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void MappedFile::Close() noexcept {
+#ifdef _WIN32
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != nullptr) {
+    CloseHandle(file_);
+  }
+  mapping_ = nullptr;
+  file_ = nullptr;
+#else
+  if (data_ != nullptr) {
+    munmap(const_cast<unsigned char*>(data_), size_);
+  }
+#endif  // _WIN32
+
+  data_ = nullptr;
+  size_ = 0;
+}
+
 namespace file_utility {
 std::string LoadFile(std::string_view path) {
   std::string content;
@@ -76,4 +193,16 @@ void LoadFileInBuffer(std::string_view path, FileBuffer* file_buffer) {
   t.read(reinterpret_cast<char*>(file_buffer->data), file_buffer->size);
 }
 
+bool WriteFileBuffer(std::string_view path, const unsigned char* data,
+                     std::size_t size) {
+  std::ofstream t(path.data(), std::ios::binary | std::ios::trunc);
+  if (!t.is_open()) {
+    return false;
+  }
+
+  t.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+
+  return t.good();
+}
+
 }  // namespace file_utility
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+* @brief GPU block compression formats, every one of them encodes blocks of 4x4
+* texels with a fixed number of bytes.
+* BC1: RGB, 8 bytes per block (0.5 byte per texel).
+* BC4: one channel, 8 bytes per block.
+* BC5: two channels, two BC4 blocks (16 bytes), used for normal maps.
+* BC6H: unsigned half float RGB, 16 bytes per block, encoded with mode 11.
+* BC7: RGBA, 16 bytes per block, encoded with mode 6.
+*/
+enum class BlockFormat : std::uint8_t {
+  kBc1,
+  kBc4,
+  kBc5,
+  kBc6h,
+  kBc7,
+};
+
+static constexpr int kBlockDimension = 4;
+
+[[nodiscard]] std::size_t BlockByteSize(BlockFormat format) noexcept;
+
+/*
+* @brief Returns the size in bytes of an image of width x height texels
+* once compressed. Partial blocks on the borders are counted as full blocks.
+*/
+[[nodiscard]] std::size_t CompressedImageSize(BlockFormat format, int width,
+                                              int height) noexcept;
+
+/*
+* @brief Number of channels stored by a format, used to compare the source image
+* with its decompressed version.
+*/
+[[nodiscard]] int BlockFormatChannelCount(BlockFormat format) noexcept;
+
+[[nodiscard]] const char* BlockFormatName(BlockFormat format) noexcept;
+
+/*
+* @brief Compresses an 8 bits image of 1 to 4 channels. Block rows are encoded
+* in parallel, texel selection is vectorized with AVX2 (or SSE2 if AVX2 is not
+* enabled at compile time).
+* @param dst A buffer of at least CompressedImageSize(format, width, height) bytes.
+*/
+void CompressImage(BlockFormat format, const unsigned char* pixels, int width,
+                   int height, int channels, unsigned char* dst) noexcept;
+
+/*
+* @brief Compresses an HDR image of 1 to 4 float channels to BC6H (unsigned),
+* negative values are clamped to 0. Block rows are encoded in parallel.
+* @param dst A buffer of at least CompressedImageSize(BlockFormat::kBc6h, width, height) bytes.
+*/
+void CompressImageBc6h(const float* pixels, int width, int height, int channels,
+                       unsigned char* dst) noexcept;
+
+/*
+* @brief Decompresses a BC6H image to float RGB.
+* @param rgb A buffer of at least width * height * 3 floats.
+*/
+void DecompressImageBc6h(const unsigned char* src, int width, int height,
+                         float* rgb) noexcept;
+
+/*
+* @brief Decompresses an image to RGBA 8 bits (only BC6H mode 11 and BC7 mode 6
+* are decoded since they are the only modes written by the compressors).
+* @param rgba A buffer of at least width * height * 4 bytes.
+*/
+void DecompressImage(BlockFormat format, const unsigned char* src, int width,
+                     int height, unsigned char* rgba) noexcept;
+
+/*
+* @brief Peak signal-to-noise ratio in dB between the source pixels and the
+* decompressed RGBA image over the first compared_channels channels.
+*/
+[[nodiscard]] double CalculatePsnr(const unsigned char* pixels, int channels,
+                                   const unsigned char* rgba, int width, int height,
+                                   int compared_channels) noexcept;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "texture.h"
+
+#include <array>
+
+/*
+* @brief Number of grayscale maps merged in an ARM (ambient occlusion,
+* roughness, metallic) texture, in the order read by the ARM shaders.
+*/
+static constexpr int kArmChannelCount = 3;
+
+/*
+* @brief Merges the first channel of grayscale images into one RGB image.
+* Sources smaller than the largest one are bilinearly resampled, a null source
+* fills its channel with default_values.
+* The packed pixels are allocated with malloc, like the stb_image pixels, so
+* they are released by FreeImageBuffer.
+*/
+[[nodiscard]] bool PackChannels(
+    const std::array<const ImageBuffer*, kArmChannelCount>& sources,
+    const std::array<unsigned char, kArmChannelCount>& default_values,
+    ImageBuffer* packed) noexcept;
+
+// =============================================
+//            Multithreading Jobs.
+// =============================================
+
+/*
+* @brief ChannelPackingJob merges the decompressed occlusion, roughness and
+* metallic maps of a material into one ARM image and releases the sources.
+*/
+class ChannelPackingJob final : public Job {
+ public:
+  ChannelPackingJob() noexcept = default;
+  ChannelPackingJob(const std::array<ImageBuffer*, kArmChannelCount>& sources,
+                    ImageBuffer* packed) noexcept;
+  ChannelPackingJob(ChannelPackingJob&& other) noexcept = default;
+  ChannelPackingJob& operator=(ChannelPackingJob&& other) noexcept = default;
+  ChannelPackingJob(const ChannelPackingJob& other) noexcept = delete;
+  ChannelPackingJob& operator=(const ChannelPackingJob& other) noexcept = delete;
+  ~ChannelPackingJob() noexcept override = default;
+
+  void Work() noexcept override;
+
+ private:
+  // Shared with the image decompressing jobs.
+  std::array<ImageBuffer*, kArmChannelCount> sources_{};
+  // Shared with the texture cooking job.
+  ImageBuffer* packed_ = nullptr;
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+* @brief A cooked mesh (".cmsh" file) stores the meshes of a model in the layout
+* of their GPU buffers, so that loading it is only a memory mapping of the file
+* whose vertex and index ranges are given as they are to glBufferData.
+*
+* Layout: [CookedMeshHeader][CookedMeshRange * mesh_count][CookedMeshLod * lod_count]
+* [CookedMeshMeshlet * meshlet_count][CookedMeshTexture * texture_count]
+* [vertices][indices].
+* The vertices are the PackedVertex structures of all the meshes. The indices are
+* relative to the first vertex of their mesh and stored on 16 bits for the meshes
+* with few enough vertices, each mesh starting on 4 bytes. Both streams start on
+* kCookedMeshDataAlignment bytes from the start of the file.
+*/
+enum CookedMeshFlags : std::uint32_t {
+  kCookedMeshFlippedUvs = 1 << 0,
+  // The tangents were generated like MikkTSpace by the OBJ parser, not by Assimp.
+  kCookedMeshMikkTangents = 1 << 1,
+};
+
+struct CookedMeshHeader {
+  std::array<char, 8> identifier{};
+  std::uint32_t version = 0;
+  std::uint32_t vertex_stride = 0;  // sizeof(PackedVertex) when cooked.
+  std::uint32_t mesh_count = 0;
+  std::uint32_t texture_count = 0;
+  std::uint32_t flags = 0;
+  std::uint32_t lod_count = 0;
+  std::uint32_t meshlet_count = 0;
+  std::uint32_t padding = 0;
+  std::uint64_t vertex_count = 0;
+  std::uint64_t index_byte_length = 0;
+  std::uint64_t vertex_offset = 0;  // From the start of the file.
+  std::uint64_t index_offset = 0;   // From the start of the file.
+};
+
+struct CookedMeshRange {
+  std::uint64_t first_vertex = 0;
+  std::uint64_t vertex_count = 0;
+  std::uint64_t index_byte_offset = 0;  // From the start of the index stream.
+  std::uint64_t index_count = 0;
+  std::uint32_t index_type = 0;  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+  std::uint32_t first_texture = 0;
+  std::uint32_t texture_count = 0;
+  std::uint32_t first_lod = 0;
+  std::uint32_t lod_count = 0;
+  std::uint32_t first_meshlet = 0;
+  std::uint32_t meshlet_count = 0;
+  // Bounding sphere of the mesh, in model space.
+  std::array<float, 3> bounds_center{};
+  float bounds_radius = 0.f;
+};
+
+/*
+* @brief Level of detail of a mesh, see MeshLod. Its first index is relative to
+* the first index of its mesh.
+*/
+struct CookedMeshLod {
+  std::uint32_t first_index = 0;
+  std::uint32_t index_count = 0;
+  float error = 0.f;
+  std::uint32_t padding = 0;
+};
+
+/*
+* @brief Meshlet of the first level of detail of a mesh, see Meshlet. Its first
+* index is relative to the first index of its mesh.
+*/
+struct CookedMeshMeshlet {
+  std::uint32_t first_index = 0;
+  std::uint32_t index_count = 0;
+  std::array<float, 3> center{};
+  float radius = 0.f;
+  std::array<float, 3> cone_axis{};
+  float cone_cutoff = 1.f;
+};
+
+/*
+* @brief Texture of the material of a mesh, its path is relative to the
+* directory of the model.
+*/
+struct CookedMeshTexture {
+  static constexpr std::size_t kMaxTypeLength = 32;
+  static constexpr std::size_t kMaxPathLength = 224;
+
+  std::array<char, kMaxTypeLength> type{};
+  std::array<char, kMaxPathLength> path{};
+};
+
+static constexpr std::array<char, 8> kCookedMeshIdentifier = {
+    'C', 'M', 'S', 'H', ' ', '1', '\r', '\n'};
+static constexpr std::uint32_t kCookedMeshVersion = 5;
+static constexpr std::uint32_t kCookedMeshDataAlignment = 64;
+
+/*
+* @brief CookedMesh is a non-owning view over a cooked mesh file, usually mapped
+* in memory with a MappedFile.
+*/
+class CookedMesh {
+ public:
+  CookedMesh() noexcept = default;
+
+  /*
+  * @brief Validates the container and points the view to its ranges and streams.
+  * @return false if the buffer is not a cooked mesh this version can read, or
+  * was cooked with another vertex layout.
+  */
+  [[nodiscard]] bool Parse(const unsigned char* data, std::size_t size) noexcept;
+
+  [[nodiscard]] const CookedMeshHeader& header() const noexcept { return *header_; }
+  [[nodiscard]] const CookedMeshRange& range(std::uint32_t idx) const noexcept {
+    return ranges_[idx];
+  }
+  [[nodiscard]] const CookedMeshLod& lod(std::uint32_t idx) const noexcept {
+    return lods_[idx];
+  }
+  [[nodiscard]] const CookedMeshMeshlet& meshlet(std::uint32_t idx) const noexcept {
+    return meshlets_[idx];
+  }
+  [[nodiscard]] const CookedMeshTexture& texture(std::uint32_t idx) const noexcept {
+    return textures_[idx];
+  }
+  [[nodiscard]] const PackedVertex* vertices(
+      const CookedMeshRange& range) const noexcept {
+    return vertices_ + range.first_vertex;
+  }
+  [[nodiscard]] const void* indices(const CookedMeshRange& range) const noexcept {
+    return indices_ + range.index_byte_offset;
+  }
+
+ private:
+  const CookedMeshHeader* header_ = nullptr;
+  const CookedMeshRange* ranges_ = nullptr;
+  const CookedMeshLod* lods_ = nullptr;
+  const CookedMeshMeshlet* meshlets_ = nullptr;
+  const CookedMeshTexture* textures_ = nullptr;
+  const PackedVertex* vertices_ = nullptr;
+  const unsigned char* indices_ = nullptr;
+};
+
+/*
+* @brief Returns the path of the cooked version of a source model file.
+*/
+[[nodiscard]] std::string CookedMeshPath(std::string_view source_path);
+
+/*
+* @brief Checks that the cooked file exists, is newer than its source and was
+* cooked with the same uv flipping and tangents.
+*/
+[[nodiscard]] bool IsCookedMeshUpToDate(std::string_view source_path,
+                                        std::string_view cooked_path,
+                                        bool flip_uvs, bool mikk_tangents) noexcept;
+
+/*
+* @brief Packs the meshes of a model and writes them with their levels of detail,
+* their meshlets and the paths of their textures in a cooked mesh file. The bounding spheres of the meshes must be
+* generated.
+*/
+[[nodiscard]] bool CookMeshes(const std::vector<Mesh>& meshes, bool flip_uvs,
+                              bool mikk_tangents, std::string_view cooked_path) noexcept;
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "job_system.h"
+#include "file_utility.h"
+#include "texture.h"
+
+#include <GL/glew.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+* @brief A cooked texture (".ctex" file) is a KTX2-like container that stores
+* every mip level of a texture already converted to its final GPU format, so that
+* loading it is only a file read followed by one upload per level.
+*
+* Layout: [CookedTextureHeader][CookedLevelIndex * level_count][level data].
+* The level index goes from level 0 (largest) to the last mip but the level data
+* is stored from the smallest mip to the largest one, which keeps the mip tail
+* at the front of the file.
+*/
+enum class SuperCompressionScheme : std::uint32_t {
+  kNone = 0,
+};
+
+enum CookedTextureFlags : std::uint32_t {
+  kCookedTextureSrgb = 1 << 0,
+  kCookedTextureFlippedY = 1 << 1,
+  kCookedTextureCompressed = 1 << 2,
+};
+
+struct CookedTextureHeader {
+  std::array<char, 8> identifier{};
+  std::uint32_t version = 0;
+  std::uint32_t internal_format = 0;  // Sized OpenGL internal format.
+  std::uint32_t format = 0;           // OpenGL pixel format of the level data.
+  std::uint32_t type = 0;             // OpenGL pixel type of the level data.
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  std::uint32_t level_count = 0;
+  std::uint32_t channel_count = 0;
+  std::uint32_t flags = 0;
+  std::uint32_t compression = 0;      // TextureCompression requested when cooked.
+  SuperCompressionScheme supercompression = SuperCompressionScheme::kNone;
+  std::uint64_t source_hash = 0;      // HashFileIdentity of the source files.
+};
+
+struct CookedLevelIndex {
+  std::uint64_t byte_offset = 0;  // From the start of the file.
+  std::uint64_t byte_length = 0;
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+};
+
+static constexpr std::array<char, 8> kCookedTextureIdentifier = {
+    'C', 'T', 'E', 'X', ' ', '1', '\r', '\n'};
+static constexpr std::uint32_t kCookedTextureVersion = 6;
+static constexpr std::uint32_t kCookedTextureDataAlignment = 16;
+
+/*
+* @brief CookedTexture is a non-owning view over a cooked texture file loaded
+* in memory.
+*/
+class CookedTexture {
+ public:
+  CookedTexture() noexcept = default;
+
+  /*
+  * @brief Validates the container and points the view to its header and levels.
+  * The buffer may hold only the first levels of the file (the smallest ones).
+  * @return false if the buffer is not a cooked texture this version can read.
+  */
+  [[nodiscard]] bool Parse(const unsigned char* data, std::size_t size) noexcept;
+
+  [[nodiscard]] const CookedTextureHeader& header() const noexcept {
+    return *header_;
+  }
+  [[nodiscard]] const CookedLevelIndex& level(std::uint32_t idx) const noexcept {
+    return levels_[idx];
+  }
+  [[nodiscard]] const unsigned char* level_data(std::uint32_t idx) const noexcept {
+    return data_ + levels_[idx].byte_offset;
+  }
+  [[nodiscard]] bool is_compressed() const noexcept {
+    return header_->flags & kCookedTextureCompressed;
+  }
+  [[nodiscard]] bool is_level_loaded(std::uint32_t idx) const noexcept {
+    return levels_[idx].byte_offset + levels_[idx].byte_length <= size_;
+  }
+
+ private:
+  const unsigned char* data_ = nullptr;
+  std::size_t size_ = 0;
+  const CookedTextureHeader* header_ = nullptr;
+  const CookedLevelIndex* levels_ = nullptr;
+};
+
+/*
+* @brief Returns the path of the cooked version of a source image file.
+*/
+[[nodiscard]] std::string CookedTexturePath(std::string_view source_path);
+
+/*
+* @brief Checks that the cooked file exists, is newer than its source and was
+* cooked with the same parameters.
+* @param source_hash Receives the hash of the sources stored in the
+* cooked file, if it is up to date.
+*/
+[[nodiscard]] bool IsCookedTextureUpToDate(std::string_view source_path,
+                                           std::string_view cooked_path,
+                                           const TextureParameters& tex_param,
+                                           std::uint64_t* source_hash = nullptr) noexcept;
+
+/*
+* @brief Same as above for a texture built from several source files, like the
+* ARM textures packed from separate maps.
+*/
+[[nodiscard]] bool IsCookedTextureUpToDate(const std::vector<std::string_view>& source_paths,
+                                           std::string_view cooked_path,
+                                           const TextureParameters& tex_param,
+                                           std::uint64_t* source_hash = nullptr) noexcept;
+
+/*
+* @brief Reads the header, the level index and the levels whose width and height
+* are not bigger than max_level_size of a cooked texture. Since the smallest
+* levels are stored first, this mip tail is the beginning of the file.
+* The smallest level is always read.
+*/
+[[nodiscard]] bool LoadCookedMipTail(std::string_view cooked_path,
+                                     std::uint32_t max_level_size,
+                                     FileBuffer* buffer) noexcept;
+
+/*
+* @brief Reads the data of one level of a cooked texture from the disk.
+* @param data Destination of level.byte_length bytes, it can be a mapped buffer.
+*/
+[[nodiscard]] bool ReadCookedLevel(std::string_view cooked_path,
+                                   const CookedLevelIndex& level,
+                                   unsigned char* data) noexcept;
+
+/*
+* @brief Converts a decompressed image into a cooked texture stored in memory.
+* The whole mip chain is generated here, on the CPU, then block compressed
+* according to tex_param.compression.
+* @param source_hash HashFileIdentity of the source files, stored in the header.
+*/
+[[nodiscard]] bool CookTexture(const ImageBuffer& image_buffer,
+                               const TextureParameters& tex_param,
+                               std::uint64_t source_hash,
+                               FileBuffer* cooked_buffer) noexcept;
+
+/*
+* @brief Uploads the levels of a cooked texture present in the buffer to the GPU,
+* without decoding nor mipmap generation. The missing largest levels are
+* excluded with GL_TEXTURE_BASE_LEVEL.
+*/
+void LoadCookedTextureToGpu(const FileBuffer& cooked_buffer, GLuint* id,
+                            const TextureParameters& tex_param) noexcept;
+
+// =============================================
+//            Multithreading Jobs.
+// =============================================
+
+/*
+* @brief TextureCookingJob converts a decompressed image into a cooked texture and
+* writes it to the disk so that the next launches can skip the decompression.
+*/
+class TextureCookingJob final : public Job {
+ public:
+  TextureCookingJob() noexcept = default;
+  TextureCookingJob(ImageBuffer* img_buffer, FileBuffer* cooked_buffer,
+                    const TextureParameters& tex_param,
+                    std::string cooked_path, std::uint64_t source_hash) noexcept;
+  TextureCookingJob(TextureCookingJob&& other) noexcept = default;
+  TextureCookingJob& operator=(TextureCookingJob&& other) noexcept = default;
+  TextureCookingJob(const TextureCookingJob& other) noexcept = delete;
+  TextureCookingJob& operator=(const TextureCookingJob& other) noexcept = delete;
+  ~TextureCookingJob() noexcept override = default;
+
+  void Work() noexcept override;
+
+ private:
+  // Shared with the image decompressing job.
+  ImageBuffer* image_buffer_ = nullptr;
+  // Shared with the loading cooked texture to GPU job.
+  FileBuffer* cooked_buffer_ = nullptr;
+  TextureParameters texture_param_{};
+  std::string cooked_path_{};
+  std::uint64_t source_hash_ = 0;
+};
@@ -18,14 +18,20 @@ public:
   void Create() noexcept;
   void Bind() const noexcept;
   void SetData(const std::vector<GLuint>& indices) noexcept;
+  /*
+  * @param type GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+  */
+  void SetData(const void* indices, std::size_t count, GLenum type) noexcept;
   void UnBind() const noexcept;
   void Destroy() noexcept;
 
   [[nodiscard]] std::size_t element_count() const noexcept {
     return element_count_;
   }
+  [[nodiscard]] GLenum index_type() const noexcept { return index_type_; }
 
 private:
   GLuint id_ = 0;
   std::size_t element_count_ = 0;
+  GLenum index_type_ = GL_UNSIGNED_INT;
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/*
+* @brief FlatHashMap is an open addressing hash map with linear probing. The
+* keys and values are stored inline in one array, so a lookup touches a few
+* contiguous slots instead of chasing the nodes of std::unordered_map.
+* Erasing shifts the following slots of the probe sequence back, which keeps
+* the array free of tombstones.
+* The pointers to the values are invalidated by Insert and Erase.
+*/
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class FlatHashMap {
+ public:
+  FlatHashMap() noexcept = default;
+
+  [[nodiscard]] Value* Find(const Key& key) noexcept {
+    if (size_ == 0) {
+      return nullptr;
+    }
+
+    for (std::size_t i = IdealSlot(key);; i = NextSlot(i)) {
+      if (!slots_[i].is_full) {
+        return nullptr;
+      }
+      if (slots_[i].key == key) {
+        return &slots_[i].value;
+      }
+    }
+  }
+
+  /*
+  * @brief Inserts the value if the key is not in the map yet.
+  * @return The value of the key and true if it has been inserted.
+  */
+  std::pair<Value*, bool> Insert(const Key& key, Value value) noexcept {
+    if ((size_ + 1) * kMaxLoadDenominator > slots_.size() * kMaxLoadNumerator) {
+      Rehash(slots_.empty() ? kMinCapacity : slots_.size() * 2);
+    }
+
+    for (std::size_t i = IdealSlot(key);; i = NextSlot(i)) {
+      if (!slots_[i].is_full) {
+        slots_[i].key = key;
+        slots_[i].value = std::move(value);
+        slots_[i].is_full = true;
+        size_++;
+        return {&slots_[i].value, true};
+      }
+      if (slots_[i].key == key) {
+        return {&slots_[i].value, false};
+      }
+    }
+  }
+
+  bool Erase(const Key& key) noexcept {
+    if (size_ == 0) {
+      return false;
+    }
+
+    std::size_t hole = IdealSlot(key);
+    while (true) {
+      if (!slots_[hole].is_full) {
+        return false;
+      }
+      if (slots_[hole].key == key) {
+        break;
+      }
+      hole = NextSlot(hole);
+    }
+
+    // Moves back the slots whose probe sequence crosses the hole.
+    for (std::size_t i = NextSlot(hole); slots_[i].is_full; i = NextSlot(i)) {
+      const std::size_t ideal = IdealSlot(slots_[i].key);
+      const std::size_t distance_to_hole = (hole - ideal) & (slots_.size() - 1);
+      const std::size_t distance_to_slot = (i - ideal) & (slots_.size() - 1);
+      if (distance_to_hole < distance_to_slot) {
+        slots_[hole] = std::move(slots_[i]);
+        hole = i;
+      }
+    }
+
+    slots_[hole] = Slot{};
+    size_--;
+    return true;
+  }
+
+  [[nodiscard]] std::size_t size() const noexcept { return size_; }
+
+ private:
+  struct Slot {
+    Key key{};
+    Value value{};
+    bool is_full = false;
+  };
+
+  // Power of two, the slot of a hash is found with a mask.
+  static constexpr std::size_t kMinCapacity = 16;
+  static constexpr std::size_t kMaxLoadNumerator = 3;
+  static constexpr std::size_t kMaxLoadDenominator = 4;
+
+  std::vector<Slot> slots_{};
+  std::size_t size_ = 0;
+
+  [[nodiscard]] std::size_t IdealSlot(const Key& key) const noexcept {
+    return Hash{}(key) & (slots_.size() - 1);
+  }
+
+  [[nodiscard]] std::size_t NextSlot(std::size_t slot) const noexcept {
+    return (slot + 1) & (slots_.size() - 1);
+  }
+
+  void Rehash(std::size_t capacity) noexcept {
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+    size_ = 0;
+
+    for (auto& slot : old_slots) {
+      if (slot.is_full) {
+        Insert(slot.key, std::move(slot.value));
+      }
+    }
+  }
+};
@@ -98,4 +98,7 @@ private:
 
   void HandleColorAttachments();
   void HandleDepthStencilAttachment();
+  // Records the footprint of the attachment at the size of the specification.
+  void TrackColorAttachment(std::uint8_t idx) const noexcept;
+  void TrackDepthStencilAttachment() const noexcept;
 };
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/*
+* @brief FreeListAllocator sub-allocates ranges of a buffer it does not own. The
+* free ranges are kept sorted by offset, an allocation takes the first one large
+* enough and freeing a range merges it with its free neighbours.
+*/
+class FreeListAllocator {
+ public:
+  static constexpr std::size_t kInvalidOffset = std::numeric_limits<std::size_t>::max();
+
+  FreeListAllocator() noexcept = default;
+  explicit FreeListAllocator(std::size_t capacity);
+
+  /*
+  * @param alignment Power of two the offset is a multiple of.
+  * @return The offset of the range, kInvalidOffset if no free range is large
+  * enough, in which case the buffer can grow.
+  */
+  [[nodiscard]] std::size_t Allocate(std::size_t size, std::size_t alignment = 1);
+  void Free(std::size_t offset, std::size_t size);
+  /*
+  * @brief Adds the range between the current and the new capacity to the free
+  * ranges, the allocated ranges keep their offsets.
+  */
+  void Grow(std::size_t new_capacity);
+  void Clear() noexcept;
+
+  [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+  [[nodiscard]] std::size_t allocated_size() const noexcept { return allocated_size_; }
+
+ private:
+  struct FreeRange {
+    std::size_t offset = 0;
+    std::size_t size = 0;
+  };
+
+  std::vector<FreeRange> free_ranges_;
+  std::size_t capacity_ = 0;
+  std::size_t allocated_size_ = 0;
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "free_list_allocator.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct PackedVertex;
+class Mesh;
+
+/*
+* @brief Place of the vertices and indices of a mesh in a GeometryArena.
+* @param index_byte_offset Offset of the first index in the index buffer, a
+* multiple of the size of both index types.
+*/
+struct GeometryAllocation {
+  std::size_t first_vertex = FreeListAllocator::kInvalidOffset;
+  std::size_t vertex_count = 0;
+  std::size_t index_byte_offset = FreeListAllocator::kInvalidOffset;
+  std::size_t index_count = 0;
+  GLenum index_type = GL_UNSIGNED_INT;
+
+  [[nodiscard]] bool is_valid() const noexcept {
+    return first_vertex != FreeListAllocator::kInvalidOffset;
+  }
+};
+
+/*
+* @brief GeometryArena stores the vertices and indices of many meshes in one
+* vertex buffer and one index buffer, sub-allocated by free lists, behind a
+* single VAO with the PackedVertex layout. The meshes of the arena are drawn
+* with a base vertex, all of them with one indirect draw per index type by a
+* GeometryDrawList.
+* The buffers double when they are full, the content is copied on the GPU. They
+* are created by the first allocation, the allocations can be done by a thread
+* with a shared context. The VAO is not shared between contexts, it is created
+* and given the current buffers by UpdateVertexArray on the thread of the
+* context that draws.
+*/
+class GeometryArena {
+ public:
+  // The model matrix of each draw of a GeometryDrawList, a mat4 on 4 locations
+  // like the instanced pipelines.
+  static constexpr GLuint kDrawMatrixLocation = 4;
+  static constexpr GLuint kVertexBinding = 0;
+  static constexpr GLuint kDrawDataBinding = 1;
+
+  GeometryArena() noexcept = default;
+  GeometryArena(GeometryArena&& other) noexcept = delete;
+  GeometryArena& operator=(GeometryArena&& other) noexcept = delete;
+  GeometryArena(const GeometryArena& other) noexcept = delete;
+  GeometryArena& operator=(const GeometryArena& other) noexcept = delete;
+  ~GeometryArena() noexcept;
+
+  /*
+  * @param index_type GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+  */
+  [[nodiscard]] GeometryAllocation Allocate(const PackedVertex* vertices,
+                                            std::size_t vertex_count, const void* indices,
+                                            std::size_t index_count, GLenum index_type);
+  void Free(GeometryAllocation* allocation);
+  /*
+  * @brief Creates the VAO on the first call and attaches the buffers to it if
+  * they were created or grown since the last call. The allocations must be
+  * completed by the GPU before, when they are done by another context.
+  */
+  void UpdateVertexArray() noexcept;
+  void Destroy() noexcept;
+
+  [[nodiscard]] GLuint vao() const noexcept { return vao_; }
+  [[nodiscard]] std::size_t vertex_capacity() const noexcept {
+    return vertex_allocator_.capacity();
+  }
+  [[nodiscard]] std::size_t index_byte_capacity() const noexcept {
+    return index_allocator_.capacity();
+  }
+
+ private:
+  static constexpr std::size_t kInitialVertexCapacity = 1 << 18;
+  static constexpr std::size_t kInitialIndexByteCapacity = 1 << 22;
+
+  GLuint vao_ = 0;
+  GLuint vertex_buffer_ = 0;
+  GLuint index_buffer_ = 0;
+  // In vertices for the vertex buffer and in bytes for the index buffer.
+  FreeListAllocator vertex_allocator_{};
+  FreeListAllocator index_allocator_{};
+  // False once the buffers were replaced, until the VAO is given the new ones.
+  bool are_buffers_attached_ = false;
+
+  void CreateBuffers() noexcept;
+  void CreateVertexArray() noexcept;
+  /*
+  * @brief Replaces the buffer by one of new_size bytes holding its old content.
+  */
+  void GrowBuffer(GLuint* buffer, std::size_t old_size, std::size_t new_size) noexcept;
+};
+
+/*
+* @brief Layout of the commands of glMultiDrawElementsIndirect.
+*/
+struct DrawElementsIndirectCommand {
+  GLuint count = 0;
+  GLuint instance_count = 0;
+  GLuint first_index = 0;
+  GLint base_vertex = 0;
+  GLuint base_instance = 0;
+};
+
+/*
+* @brief GeometryDrawList collects the draws of meshes of a GeometryArena for a
+* pass and uploads them as indirect commands, each one with its model matrix.
+* The draws are submitted with one glMultiDrawElementsIndirect per index type,
+* see Renderer::DrawIndirect, whatever their count.
+* The model matrix of a draw is fetched by the instanced attribute at
+* kDrawMatrixLocation from its base instance, which is the index of the draw:
+* the shaders are GLSL ES and can not read gl_DrawID.
+*/
+class GeometryDrawList {
+ public:
+  GeometryDrawList() noexcept = default;
+  GeometryDrawList(GeometryDrawList&& other) noexcept = delete;
+  GeometryDrawList& operator=(GeometryDrawList&& other) noexcept = delete;
+  GeometryDrawList(const GeometryDrawList& other) noexcept = delete;
+  GeometryDrawList& operator=(const GeometryDrawList& other) noexcept = delete;
+  ~GeometryDrawList() noexcept;
+
+  void Clear() noexcept;
+  /*
+  * @brief Adds a draw of the level of detail lod of the mesh, which must be in a
+  * GeometryArena.
+  */
+  void Add(const Mesh& mesh, std::uint32_t lod, const glm::mat4& model_matrix);
+  /*
+  * @brief Uploads the commands and the matrices in new storages of the buffers,
+  * the draws of the previous upload can still be in flight. The list can then
+  * be submitted several times, for example for each face of a cube map.
+  */
+  void Upload() noexcept;
+  void Destroy() noexcept;
+
+  [[nodiscard]] GLuint command_buffer() const noexcept { return command_buffer_; }
+  [[nodiscard]] GLuint draw_data_buffer() const noexcept { return draw_data_buffer_; }
+  /*
+  * @brief The commands of the 16 bits indices come first in the command buffer,
+  * followed by the ones of the 32 bits indices.
+  */
+  [[nodiscard]] GLsizei short_command_count() const noexcept {
+    return static_cast<GLsizei>(short_commands_.size());
+  }
+  [[nodiscard]] GLsizei int_command_count() const noexcept {
+    return static_cast<GLsizei>(int_commands_.size());
+  }
+
+ private:
+  std::vector<DrawElementsIndirectCommand> short_commands_{};
+  std::vector<DrawElementsIndirectCommand> int_commands_{};
+  std::vector<glm::mat4> model_matrices_{};
+  // Both kinds of commands in the order of the command buffer.
+  std::vector<DrawElementsIndirectCommand> uploaded_commands_{};
+  GLuint command_buffer_ = 0;
+  GLuint draw_data_buffer_ = 0;
+};
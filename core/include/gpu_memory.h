@@ -0,0 +1,76 @@
+#pragma once
+
+#include "flat_hash_map.h"
+
+#include <GL/glew.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+enum class GpuMemoryCategory : std::uint8_t {
+  kTexture = 0,
+  kRenderTarget,
+  kBuffer,
+};
+
+inline constexpr std::size_t kGpuMemoryCategoryCount = 3;
+
+enum class GpuObjectType : std::uint8_t {
+  kTexture = 0,
+  kBuffer,
+  kRenderbuffer,
+};
+
+/*
+* @brief Bytes of a texture of level_count levels, depth is the number of layers
+* or cube map faces. The sizes are the ones of the usual drivers: the 3 channels
+* formats are padded to 4 channels.
+*/
+[[nodiscard]] std::size_t CalculateTextureSize(GLenum internal_format, GLsizei width,
+                                               GLsizei height, GLsizei depth = 1,
+                                               GLsizei level_count = 1,
+                                               GLsizei sample_count = 1) noexcept;
+
+/*
+* @brief GpuMemoryAccountant sums the footprint of the GPU objects, which is
+* recorded when they are allocated. Tracking an object again replaces its
+* previous footprint, so the reallocations of resized render targets are counted
+* once. It is thread safe.
+*/
+class GpuMemoryAccountant {
+ public:
+  GpuMemoryAccountant() noexcept = default;
+  GpuMemoryAccountant(GpuMemoryAccountant&& other) noexcept = delete;
+  GpuMemoryAccountant& operator=(GpuMemoryAccountant&& other) noexcept = delete;
+  GpuMemoryAccountant(const GpuMemoryAccountant& other) noexcept = delete;
+  GpuMemoryAccountant& operator=(const GpuMemoryAccountant& other) noexcept = delete;
+  ~GpuMemoryAccountant() noexcept = default;
+
+  void Track(GpuObjectType type, GLuint id, GpuMemoryCategory category,
+             std::size_t size) noexcept;
+  /*
+  * @brief Forgets the object, to call when it is deleted.
+  */
+  void Untrack(GpuObjectType type, GLuint id) noexcept;
+
+  [[nodiscard]] std::size_t used_size(GpuMemoryCategory category) const noexcept;
+  [[nodiscard]] std::size_t total_used_size() const noexcept;
+  [[nodiscard]] std::size_t object_count() const noexcept;
+
+ private:
+  struct Allocation {
+    GpuMemoryCategory category = GpuMemoryCategory::kTexture;
+    std::size_t size = 0;
+  };
+
+  mutable std::mutex mutex_{};
+  FlatHashMap<std::uint64_t, Allocation> allocations_{};
+  std::array<std::size_t, kGpuMemoryCategoryCount> used_sizes_{};
+};
+
+/*
+* @brief The accountant of all the GPU objects of the application.
+*/
+[[nodiscard]] GpuMemoryAccountant& GetGpuMemoryAccountant() noexcept;
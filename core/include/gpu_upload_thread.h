@@ -0,0 +1,75 @@
+#pragma once
+
+#include "job_system.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+/*
+* @brief SharedGlContext is an OpenGL context sharing its objects (textures,
+* buffers, programs and syncs) with the render context. The container objects
+* (vertex arrays and framebuffers) are not shared, they still have to be
+* created by the render thread.
+* It is created by the engine, the callbacks make it current or not on the
+* calling thread. make_current returns false if the context could not be made
+* current, the thread must then not issue GL commands.
+*/
+struct SharedGlContext {
+  std::function<bool()> make_current{};
+  std::function<void()> release{};
+};
+
+/*
+* @brief Blocks until the GPU has executed the commands issued on the current
+* context, the objects they write are then complete for the other contexts.
+*/
+void WaitForGpuCompletion() noexcept;
+
+/*
+* @brief GpuUploadThread executes the jobs of type kGpuUpload with a shared GL
+* context current, so that the uploads overlap the rendering of the main thread.
+* The jobs are executed in their submission order and wait for the GPU before
+* being done, the render thread can use their objects as soon as they are done.
+*/
+class GpuUploadThread {
+ public:
+  GpuUploadThread() noexcept = default;
+  GpuUploadThread(GpuUploadThread&& other) noexcept = delete;
+  GpuUploadThread& operator=(GpuUploadThread&& other) noexcept = delete;
+  GpuUploadThread(const GpuUploadThread& other) noexcept = delete;
+  GpuUploadThread& operator=(const GpuUploadThread& other) noexcept = delete;
+  ~GpuUploadThread() noexcept = default;
+
+  /*
+  * @brief Starts the thread and waits until it has made the context current.
+  * @return false if the context could not be made current, the thread is then
+  * joined and the uploads must be done by the render thread.
+  */
+  [[nodiscard]] bool Start(SharedGlContext context) noexcept;
+  void AddJob(Job* job) noexcept;
+  /*
+  * @brief Executes the remaining jobs, releases the context and joins the thread.
+  */
+  void Stop() noexcept;
+
+  [[nodiscard]] bool HasPendingJobs() const noexcept;
+  [[nodiscard]] bool is_running() const noexcept { return thread_.joinable(); }
+
+ private:
+  std::thread thread_{};
+  SharedGlContext context_{};
+
+  mutable std::mutex mutex_{};
+  std::condition_variable jobs_condition_{};
+  std::condition_variable started_condition_{};
+  std::queue<Job*> jobs_{};
+  bool is_executing_job_ = false;
+  bool is_stopping_ = false;
+  bool is_starting_ = false;
+  bool is_context_current_ = false;
+
+  void LoopOverJobs() noexcept;
+};
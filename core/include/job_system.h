@@ -1,8 +1,11 @@
 #pragma once
 
+#include <condition_variable>
+#include <functional>
 #include <vector>
 #include <thread>
 #include <future>
+#include <mutex>
 #include <queue>
 #include <shared_mutex>
 
@@ -20,6 +23,8 @@ enum class JobType : std::int16_t {
   kMeshCreating,
   kModelLoading,
   kMainThread,
+  // Executed by the GpuUploadThread with a shared GL context.
+  kGpuUpload,
 };
 
 class Job {
@@ -61,18 +66,99 @@ class Job {
 /**
  * \brief JobQueue is a thread safe queue which stores jobs.
  */
-// TODO finish to code it and use it instead of std::queue.
 class JobQueue {
  public:
-  void Push() noexcept;
-  void Pop() noexcept;
+  void Push(Job* job) noexcept;
+  /**
+   * \brief Pop removes the job at the front of the queue.
+   * \return The job at the front of the queue or nullptr if the queue is empty.
+   */
+  [[nodiscard]] Job* Pop() noexcept;
   [[nodiscard]] bool IsEmpty() const noexcept;
 
  private:
   std::queue<Job*> jobs_;
-  std::shared_mutex mutex_;
+  mutable std::shared_mutex mutex_;
+};
+
+/**
+ * \brief ParallelForJob executes a function over a range of indices.
+ */
+class ParallelForJob final : public Job {
+ public:
+  ParallelForJob() noexcept = default;
+  ParallelForJob(const std::function<void(std::size_t, std::size_t)>* func,
+                 std::size_t begin, std::size_t end) noexcept;
+  ParallelForJob(ParallelForJob&& other) noexcept = default;
+  ParallelForJob& operator=(ParallelForJob&& other) noexcept = default;
+  ParallelForJob(const ParallelForJob& other) noexcept = delete;
+  ParallelForJob& operator=(const ParallelForJob& other) noexcept = delete;
+  ~ParallelForJob() noexcept override = default;
+
+  void Work() noexcept override;
+
+ private:
+  // Owned by the ParallelFor call which waits for the job.
+  const std::function<void(std::size_t, std::size_t)>* function_ = nullptr;
+  std::size_t begin_ = 0, end_ = 0;
+};
+
+/**
+ * \brief WorkerPool is a set of threads started on its first use which execute
+ * the jobs of the ParallelFor calls until the end of the program, so that the
+ * calls don't pay for the creation of their threads.
+ */
+class WorkerPool {
+ public:
+  WorkerPool(const WorkerPool& other) = delete;
+  WorkerPool& operator=(const WorkerPool& other) = delete;
+  ~WorkerPool() noexcept;
+
+  [[nodiscard]] static WorkerPool& Instance() noexcept;
+
+  /**
+   * \brief Run queues the jobs and executes queued jobs on the calling thread
+   * too, which can include the jobs of other Run calls, until its own jobs are
+   * done.
+   */
+  void Run(std::vector<ParallelForJob>* jobs) noexcept;
+
+  /**
+   * \brief The number of threads which execute the jobs, the thread calling
+   * ParallelFor included.
+   */
+  [[nodiscard]] std::size_t thread_count() const noexcept { return threads_.size() + 1; }
+
+ private:
+  // A job with the count of the jobs of its Run call which are not done, which
+  // is only accessed with the mutex locked.
+  struct QueuedJob {
+    Job* job = nullptr;
+    std::size_t* pending_job_count = nullptr;
+  };
+
+  WorkerPool() noexcept;
+
+  std::vector<std::thread> threads_{};
+  std::queue<QueuedJob> jobs_{};
+  std::mutex mutex_{};
+  std::condition_variable job_condition_{};
+  std::condition_variable done_condition_{};
+  bool is_running_ = true;
+
+  void LoopOverJobs() noexcept;
+  void Execute(const QueuedJob& queued_job) noexcept;
 };
 
+/**
+ * \brief ParallelFor splits [0, count) into ranges of grain_size indices and
+ * executes them on the threads of the WorkerPool, the calling thread included.
+ * It returns once every range has been processed. The calls made by a range of
+ * another ParallelFor run serially on its thread.
+ */
+void ParallelFor(std::size_t count, std::size_t grain_size,
+                 const std::function<void(std::size_t, std::size_t)>& func) noexcept;
+
 class Worker {
  public:
   explicit Worker(std::queue<Job*>* jobs) noexcept;
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "flat_hash_map.h"
+#include "mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+* @brief Point of view the levels of detail are selected for: a camera or the
+* projection of a shadow map.
+* @param ortho_height Height of the view volume of an orthographic projection,
+* 0 for a perspective projection of vertical field of view fov_y (in radians).
+*/
+struct LodView {
+  glm::vec3 position{0.f};
+  float fov_y = 0.f;
+  float ortho_height = 0.f;
+  float viewport_height = 0.f;
+};
+
+/*
+* @brief LodSelector chooses the level of detail of the meshes drawn in each view
+* from the size on the screen of their simplification error: the coarsest level
+* whose error projects on less than max_pixel_error pixels.
+* The level kept for each mesh, view and instance gives some hysteresis so that
+* a mesh at the distance of a transition does not switch every frame: a finer
+* level is taken as soon as the error is too large, a coarser one only once its
+* error is below hysteresis times the maximum.
+*/
+class LodSelector {
+ public:
+  static constexpr float kDefaultMaxPixelError = 1.f;
+  static constexpr float kDefaultHysteresis = 0.75f;
+
+  LodSelector() noexcept = default;
+  LodSelector(LodSelector&& other) noexcept = delete;
+  LodSelector& operator=(LodSelector&& other) noexcept = delete;
+  LodSelector(const LodSelector& other) noexcept = delete;
+  LodSelector& operator=(const LodSelector& other) noexcept = delete;
+  ~LodSelector() noexcept = default;
+
+  /*
+  * @brief Sets the view of the next selections, the views are told apart by
+  * their index so that each one keeps the levels it selected.
+  */
+  void BeginView(std::uint32_t view_idx, const LodView& view) noexcept;
+
+  /*
+  * @brief Returns the level of detail to draw the mesh with in the current view.
+  * @param instance_idx Tells apart the instances of a mesh drawn in one view.
+  */
+  [[nodiscard]] std::uint32_t Select(const Mesh& mesh, const glm::mat4& model,
+                                     std::uint32_t instance_idx = 0) noexcept;
+
+  /*
+  * @brief Forgets the selected levels, for example once the meshes are destroyed.
+  */
+  void Clear() noexcept;
+
+  void set_max_pixel_error(float max_pixel_error) noexcept {
+    max_pixel_error_ = max_pixel_error;
+  }
+
+ private:
+  struct LodKey {
+    const Mesh* mesh = nullptr;
+    std::uint32_t view_idx = 0;
+    std::uint32_t instance_idx = 0;
+
+    bool operator==(const LodKey& other) const noexcept {
+      return mesh == other.mesh && view_idx == other.view_idx &&
+             instance_idx == other.instance_idx;
+    }
+  };
+
+  struct LodKeyHash {
+    std::size_t operator()(const LodKey& key) const noexcept;
+  };
+
+  FlatHashMap<LodKey, std::uint32_t, LodKeyHash> selected_lods_{};
+  LodView view_{};
+  std::uint32_t view_idx_ = 0;
+  float max_pixel_error_ = kDefaultMaxPixelError;
+  float hysteresis_ = kDefaultHysteresis;
+
+  /*
+  * @brief Pixels covered by one model unit of the mesh in the current view, at
+  * the nearest point of its bounding sphere.
+  */
+  [[nodiscard]] float CalculatePixelsPerUnit(const Mesh& mesh,
+                                             const glm::mat4& model) const noexcept;
+};
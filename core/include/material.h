@@ -1,24 +1,199 @@
 #pragma once
 
+#include "cooked_texture.h"
 #include "pipeline.h"
+#include "texture.h"
+#include "texture_streamer.h"
+#include "virtual_texture.h"
 
 #include <GL/glew.h>
 #include <glm/vec3.hpp>
 
-class Material {
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/*
+* @brief Maps of the ARM pipelines: albedo, normal, a packed map with the ambient
+* occlusion, roughness and metallic in its R, G and B channels, and the emissive
+* map of the emissive pipeline.
+*/
+enum class MaterialMap : std::uint8_t {
+  kAlbedo = 0,
+  kNormal,
+  kArm,
+  kEmissive,
+};
+
+inline constexpr std::size_t kMaterialMapCount = 4;
+
+/*
+* @brief Material references the textures of its maps by their index in the
+* MaterialSystem, kNoTexture for the maps it does not use.
+*/
+struct Material {
+  static constexpr std::int32_t kNoTexture = -1;
+
+  std::array<std::int32_t, kMaterialMapCount> textures{kNoTexture, kNoTexture,
+                                                      kNoTexture, kNoTexture};
+};
+
+/*
+* @brief MaterialSystem stores the material textures in GL_TEXTURE_2D_ARRAY
+* objects, one per format, size, level count and sampling. The layer of each map
+* of each material is stored in a uniform buffer indexed by the G-buffer shaders
+* with the material_index uniform.
+* Drawing with another material then only sets an integer, the arrays are only
+* rebound when the new material uses different ones.
+* The arrays are sampled through shared sampler objects, trilinear and
+* anisotropic, bound with them on the units of the maps during a pass.
+* A texture can instead be a virtual texture of a VirtualTextureSystem: its
+* physical cache and indirection are bound on the unit of the map and on the
+* indirection unit of the map, for the virtual texturing G-buffer shaders.
+* Until their layer is resident in the texture streamer, the maps sample a 1x1
+* placeholder array instead: a grey albedo, a flat normal, a rough dielectric
+* without occlusion and no emission.
+*/
+class MaterialSystem {
  public:
-  Material() noexcept = default;
-  ~Material() noexcept;
+  // Size of the layers array of the MaterialLayers uniform block.
+  static constexpr std::size_t kMaxMaterialCount = 64;
+  static constexpr GLuint kLayersBindingPoint = 0;
+  static constexpr float kDefaultMaxAnisotropy = 8.f;
+
+  MaterialSystem() noexcept = default;
+  MaterialSystem(MaterialSystem&& other) noexcept = delete;
+  MaterialSystem& operator=(MaterialSystem&& other) noexcept = delete;
+  MaterialSystem(const MaterialSystem& other) noexcept = delete;
+  MaterialSystem& operator=(const MaterialSystem& other) noexcept = delete;
+  ~MaterialSystem() noexcept;
+
+  /*
+  * @param virtual_texture_system Owner of the virtual textures added with
+  * AddVirtualTexture, nullptr if the materials only use texture arrays.
+  */
+  void Begin(std::size_t texture_count,
+             VirtualTextureSystem* virtual_texture_system = nullptr) noexcept;
+  void End() noexcept;
+
+  /*
+  * @brief Assigns a layer to the texture texture_idx in the array matching its
+  * format, size and sampling.
+  */
+  void AddTexture(std::size_t texture_idx, const CookedTextureHeader& header,
+                  const TextureParameters& tex_param) noexcept;
+
+  /*
+  * @brief Samples the texture texture_idx through the virtual texture
+  * virtual_texture_id instead of a layer of an array.
+  */
+  void AddVirtualTexture(std::size_t texture_idx, std::int32_t virtual_texture_id) noexcept;
+
+  /*
+  * @brief Creates the arrays in the texture streamer once all the textures are
+  * added, it allocates their storage and writes their layers.
+  */
+  void CreateArrays(TextureStreamer* texture_streamer) noexcept;
+
+  /*
+  * @return The index of the material, to pass to Bind.
+  */
+  std::size_t AddMaterial(const Material& material) noexcept;
+
+  /*
+  * @brief Switches the maps whose layer became resident in the streamer from
+  * the placeholder to their array.
+  * @return true if the layers must be written again with UploadMaterials.
+  */
+  bool UpdateResidency(const TextureStreamer& texture_streamer) noexcept;
+
+  /*
+  * @brief Writes the layers of the materials in the uniform buffer, and gives
+  * their virtual textures to the virtual texture system for its feedback.
+  */
+  void UploadMaterials() noexcept;
+
+  /*
+  * @brief Binds the uniform buffer of the layers and forgets the bound arrays,
+  * to call before the first Bind of a pass.
+  */
+  void BeginPass() noexcept;
+
+  /*
+  * @brief Unbinds the samplers of the maps, to call after the last Bind of a
+  * pass so that the next passes sample their textures with their own state.
+  */
+  void EndPass() noexcept;
+
+  /*
+  * @brief Binds the arrays of the material maps and their samplers, or their
+  * virtual textures, on the texture units 0 to 3 if they are not bound yet, and
+  * selects the material in the pipeline.
+  */
+  void Bind(std::size_t material_idx, const Pipeline& pipeline) noexcept;
+
+  /*
+  * @brief Anisotropy of the samplers of the arrays, clamped to the one of the GPU
+  * and snapped to a power of two. The samplers are only changed if the snapped
+  * anisotropy is.
+  */
+  void set_max_anisotropy(float max_anisotropy) noexcept;
+  [[nodiscard]] float max_anisotropy() const noexcept { return max_anisotropy_; }
+
+  /*
+  * @brief Address of the array holding the texture, stable after CreateArrays.
+  */
+  [[nodiscard]] GLuint* array_id(std::size_t texture_idx) noexcept {
+    return &arrays_[texture_layers_[texture_idx].array_idx].id;
+  }
+  [[nodiscard]] GLint layer(std::size_t texture_idx) const noexcept {
+    return texture_layers_[texture_idx].layer;
+  }
+  [[nodiscard]] bool has_texture(std::size_t texture_idx) const noexcept {
+    return texture_layers_[texture_idx].layer >= 0 || is_virtual(texture_idx);
+  }
+  [[nodiscard]] bool is_resident(std::size_t texture_idx) const noexcept {
+    return texture_layers_[texture_idx].is_resident;
+  }
+  [[nodiscard]] bool is_virtual(std::size_t texture_idx) const noexcept {
+    return virtual_texture_ids_[texture_idx] != VirtualTextureSystem::kNoVirtualTexture;
+  }
+  [[nodiscard]] std::size_t array_count() const noexcept { return arrays_.size(); }
+
+ private:
+  struct TextureArray {
+    GLuint id = 0;
+    // Format, size and level count of the layers.
+    CookedTextureHeader header{};
+    GLint wrapping_param = 0;
+    GLint filtering_param = 0;
+    GLsizei layer_count = 0;
+    // Owned by the sampler cache.
+    GLuint sampler = 0;
+  };
 
-  void Create(const GLuint & albedo, const GLuint & normal, const GLuint & metallic, 
-			  const GLuint & roughness, const GLuint & ao);
-  void Bind(GLenum gl_texture_idx) const noexcept;
+  struct TextureLayer {
+    std::uint32_t array_idx = 0;
+    GLint layer = -1;
+    // The maps sample the placeholder until the layer is resident.
+    bool is_resident = false;
+  };
 
-  void Destroy();
+  std::vector<TextureArray> arrays_{};
+  std::vector<TextureLayer> texture_layers_{};
+  std::vector<Material> materials_{};
+  std::vector<std::int32_t> virtual_texture_ids_{};
+  VirtualTextureSystem* virtual_texture_system_ = nullptr;
+  GLuint layers_buffer_ = 0;
+  // One layer per map, in the order of MaterialMap.
+  GLuint placeholder_array_ = 0;
+  GLuint placeholder_sampler_ = 0;
+  // Arrays and virtual textures bound on the units of the maps since the last
+  // BeginPass, the other one is 0 or kNoVirtualTexture.
+  std::array<GLuint, kMaterialMapCount> bound_arrays_{};
+  std::array<std::int32_t, kMaterialMapCount> bound_virtual_textures_{};
+  float max_anisotropy_ = kDefaultMaxAnisotropy;
 
-  GLuint albedo_map = 0;
-  GLuint normal_map = 0;
-  GLuint metallic_map = 0;
-  GLuint roughness_map = 0;
-  GLuint ao_map = 0;
-};
\ No newline at end of file
+  void AcquireSamplers() noexcept;
+  void CreatePlaceholders() noexcept;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "geometry_arena.h"
+#include "meshlet.h"
 #include "shapes.h"
 #include "texture.h"
 #include "vertex_array_object.h"
@@ -10,8 +12,11 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <utility>
 
 struct Vertex {
   glm::vec3 position;
@@ -21,12 +26,63 @@ struct Vertex {
   glm::vec3 bitangent;
 };
 
+/*
+* @brief Vertex layout of the GPU buffers, 24 bytes instead of the 56 of Vertex.
+* The normal is octahedral encoded in two 16 bits snorm, the uv is stored in half
+* floats and the tangent is octahedral encoded in two 8 bits snorm followed by the
+* sign of the bitangent, which the vertex shaders rebuild with cross(N, T).
+* The position stays in floats so that the model matrices are used as they are.
+*/
+struct PackedVertex {
+  glm::vec3 position;
+  std::array<std::int16_t, 2> normal;
+  std::array<std::uint16_t, 2> uv;
+  std::array<std::int8_t, 4> tangent;
+};
+
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex must be tightly packed.");
+
+[[nodiscard]] PackedVertex PackVertex(const Vertex& vertex) noexcept;
+[[nodiscard]] std::vector<PackedVertex> PackVertices(const Vertex* vertices,
+                                                     std::size_t count);
+
+/*
+* @brief Indices of meshes with less than 65537 vertices are stored on 16 bits.
+*/
+[[nodiscard]] GLenum ChooseIndexType(std::size_t vertex_count) noexcept;
+[[nodiscard]] std::vector<std::uint16_t> NarrowIndices(const GLuint* indices,
+                                                       std::size_t count);
+
+/*
+* @brief Level of detail of a mesh, a range of its indices. The first level is
+* the full mesh, the next ones are simplified more and more.
+* @param error Largest distance, in model units, between the surface of the
+* level and the one of the full mesh.
+*/
+struct MeshLod {
+  std::uint32_t first_index = 0;
+  std::uint32_t index_count = 0;
+  float error = 0.f;
+};
+
+inline constexpr std::size_t kMaxLodCount = 5;
+
 class Mesh {
 public:
   Mesh() noexcept = default;
-  Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
-  Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
-       const std::vector<Texture>& textures);
+  Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices);
+  Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices,
+       std::vector<Texture> textures);
+  /*
+  * @brief Mesh whose vertices and indices are not copied, they are uploaded from
+  * the given memory, for example a mapped cooked mesh, which must stay valid
+  * until LoadToGpu.
+  * @param index_type GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+  */
+  Mesh(const PackedVertex* vertices, std::size_t vertex_count, const void* indices,
+       std::size_t index_count, GLenum index_type, const std::vector<Texture>& textures,
+       const BoundingSphere& bounding_volume, const std::vector<MeshLod>& lods,
+       const std::vector<Meshlet>& meshlets);
   Mesh(const Mesh& other) = delete;
   Mesh(Mesh&& other) noexcept;
   Mesh& operator=(const Mesh&) = delete;
@@ -39,13 +95,31 @@ public:
   void CreateScreenQuad() noexcept;
   void CreateSphere() noexcept;
 
-  void LoadToGpu();
+  /*
+  * @brief Uploads the vertices and indices in their own buffers, or in the
+  * arena when there is one, in which case the mesh has no VAO of its own.
+  */
+  void LoadToGpu(GeometryArena* arena = nullptr);
 
+  /*
+  * @brief Only for the meshes with their own buffers, the ones of an arena get
+  * their model matrices from the draw lists.
+  */
   void SetupModelMatrixBuffer(const glm::mat4* model_matrix_data, 
                               const std::size_t& size, GLenum buffer_usage);
   void SetModelMatrixBufferSubData(const glm::mat4* model_matrix_data,
                                    const std::size_t& size) noexcept;
   void GenerateBoundingSphere();
+  /*
+  * @brief Sets the levels of detail, the indices of the mesh must contain them.
+  * A mesh without levels of detail gets a single one with all its indices when
+  * it is loaded to the GPU.
+  */
+  void SetLods(std::vector<MeshLod> lods) noexcept { lods_ = std::move(lods); }
+  /*
+  * @brief Sets the meshlets of the first level of detail, see BuildMeshlets.
+  */
+  void SetMeshlets(std::vector<Meshlet> meshlets);
 
   void Destroy() noexcept;
 
@@ -53,10 +127,47 @@ public:
     return textures_;
   }
 
+  [[nodiscard]] const std::vector<Vertex>& vertices() const noexcept {
+    return vertices_;
+  }
+  [[nodiscard]] const std::vector<GLuint>& indices() const noexcept {
+    return indices_;
+  }
+
   [[nodiscard]] const VertexArrayObject& vao() const noexcept { return vao_; }
 
   [[nodiscard]] const std::size_t elementCount() const noexcept {
-    return indices_.size();
+    return arena_ != nullptr ? arena_allocation_.index_count : ebo_.element_count();
+  }
+  [[nodiscard]] GLenum index_type() const noexcept {
+    return arena_ != nullptr ? arena_allocation_.index_type : ebo_.index_type();
+  }
+
+  /*
+  * @brief The arena holding the vertices and indices, nullptr for the meshes
+  * with their own buffers.
+  */
+  [[nodiscard]] const GeometryArena* arena() const noexcept { return arena_; }
+  /*
+  * @brief The vertex array to draw the mesh with, the one of its arena or its own.
+  */
+  [[nodiscard]] GLuint vao_id() const noexcept {
+    return arena_ != nullptr ? arena_->vao() : vao_.id();
+  }
+  [[nodiscard]] GLint base_vertex() const noexcept {
+    return arena_ != nullptr ? static_cast<GLint>(arena_allocation_.first_vertex) : 0;
+  }
+  [[nodiscard]] std::size_t index_byte_offset() const noexcept {
+    return arena_ != nullptr ? arena_allocation_.index_byte_offset : 0;
+  }
+
+  [[nodiscard]] const std::vector<MeshLod>& lods() const noexcept { return lods_; }
+  [[nodiscard]] std::size_t lod_count() const noexcept { return lods_.size(); }
+  [[nodiscard]] const std::vector<Meshlet>& meshlets() const noexcept {
+    return meshlets_;
+  }
+  [[nodiscard]] const MeshletBounds& meshlet_bounds() const noexcept {
+    return meshlet_bounds_;
   }
 
   [[nodiscard]] const BoundingSphere bounding_sphere() const noexcept {
@@ -72,9 +183,23 @@ private:
   std::vector<Vertex> vertices_;
   std::vector<GLuint> indices_;
   std::vector<Texture> textures_;
+  // Vertices and indices uploaded instead of the vectors, not owned.
+  const PackedVertex* external_vertices_ = nullptr;
+  std::size_t external_vertex_count_ = 0;
+  const void* external_indices_ = nullptr;
+  std::size_t external_index_count_ = 0;
+  GLenum external_index_type_ = GL_UNSIGNED_INT;
   VertexArrayObject vao_;
-  VertexBufferObject<Vertex> vbo_;
+  VertexBufferObject<PackedVertex> vbo_;
   VertexBufferObject<glm::mat4> model_matrix_buffer_;
   ElementBufferObject ebo_;
+  GeometryArena* arena_ = nullptr;
+  GeometryAllocation arena_allocation_{};
   BoundingSphere bounding_volume_;
+  std::vector<MeshLod> lods_;
+  std::vector<Meshlet> meshlets_;
+  MeshletBounds meshlet_bounds_;
+
+  void LoadToArena(GeometryArena* arena);
+  void ForgetExternalData() noexcept;
 };
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+/*
+* @brief Number of vertices of the FIFO post-transform cache simulated by the
+* optimizations and the ACMR measures.
+*/
+inline constexpr std::uint32_t kVertexCacheSize = 16;
+
+/*
+* @brief Average cache miss ratio of an indexed triangle list: the number of
+* vertices transformed per triangle with a FIFO cache of cache_size vertices.
+* It goes from 0.5 for a perfect order of a large grid to 3.
+*/
+[[nodiscard]] float CalculateAcmr(const std::vector<GLuint>& indices,
+                                  std::size_t vertex_count,
+                                  std::uint32_t cache_size = kVertexCacheSize) noexcept;
+
+/*
+* @brief Reorders the triangles for the post-transform cache with Tipsify
+* (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+* Reduced Overdraw").
+* @param clusters Receives the index of the first index of each cluster, the
+* triangles emitted after each dead end, to reorder for the overdraw.
+*/
+void OptimizeVertexCache(std::vector<GLuint>* indices, std::size_t vertex_count,
+                         std::vector<std::size_t>* clusters,
+                         std::uint32_t cache_size = kVertexCacheSize) noexcept;
+
+/*
+* @brief Sorts the clusters of OptimizeVertexCache so that the ones facing away
+* from the center of the mesh, which are more likely to occlude the others, are
+* drawn first. The order is kept if the ACMR grows more than acmr_threshold times.
+*/
+void OptimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<GLuint>* indices,
+                      const std::vector<std::size_t>& clusters,
+                      float acmr_threshold = 1.05f) noexcept;
+
+/*
+* @brief Reorders the vertices in their order of first use by the indices, so
+* that the vertex fetches follow the index order. The unused vertices are removed.
+*/
+void OptimizeVertexFetch(std::vector<Vertex>* vertices,
+                         std::vector<GLuint>* indices) noexcept;
+
+struct MeshOptimizationReport {
+  std::size_t triangle_count = 0;
+  // Vertices given by the importer, before the welding, and left at the end.
+  std::size_t imported_vertex_count = 0;
+  std::size_t vertex_count = 0;
+  // Sums of the ACMR of the meshes weighted by their triangle counts.
+  double weighted_acmr_before = 0.0;
+  double weighted_acmr_after = 0.0;
+
+  void Add(const MeshOptimizationReport& other) noexcept;
+
+  [[nodiscard]] float acmr_before() const noexcept;
+  [[nodiscard]] float acmr_after() const noexcept;
+};
+
+/*
+* @brief Runs the vertex cache, overdraw and vertex fetch optimizations on an
+* indexed triangle list.
+*/
+MeshOptimizationReport OptimizeMesh(std::vector<Vertex>* vertices,
+                                    std::vector<GLuint>* indices) noexcept;
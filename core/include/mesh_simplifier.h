@@ -0,0 +1,37 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+/*
+* @brief Simplifies an indexed triangle list with quadric error metrics
+* (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics")
+* by collapsing the edges whose error is the smallest, each position moving on
+* one of its neighbours so that the simplified triangles keep using the vertex
+* buffer of the mesh.
+* The vertices are welded by position, the positions on a border or on a seam
+* of the normals or uvs are never moved.
+* @param target_index_count The collapses stop once there are at most this many
+* indices left, or when the next collapse would move the surface more than
+* max_error.
+* @param error Receives the largest distance, in model units, that the surface
+* moved by.
+* @return The indices of the simplified triangles.
+*/
+[[nodiscard]] std::vector<GLuint> SimplifyMesh(const std::vector<Vertex>& vertices,
+                                               const std::vector<GLuint>& indices,
+                                               std::size_t target_index_count,
+                                               float max_error, float* error);
+
+/*
+* @brief Builds the LOD chain of a mesh: the levels after the first one halve
+* the triangle count of the previous level until kMaxLodCount levels are built
+* or the mesh can not be simplified enough. Their indices are appended to the
+* indices of the mesh, each level optimized for the vertex cache.
+*/
+void GenerateLods(const std::vector<Vertex>& vertices, std::vector<GLuint>* indices,
+                  std::vector<MeshLod>* lods);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <GL/glew.h>
+
+#include <vector>
+
+/*
+* @brief Largest differences between the attributes of two vertices that are
+* merged. The positions are quantized relative to the size of the mesh, the
+* other attributes on absolute grids, finer than the GPU formats of PackedVertex.
+* The values close to a cell boundary can fall in different cells, in which case
+* their vertices are kept apart.
+*/
+struct WeldTolerances {
+  // Times the largest extent of the bounding box.
+  float position = 1e-6f;
+  float normal = 1e-3f;
+  float uv = 1e-5f;
+  float tangent = 1e-2f;
+};
+
+/*
+* @brief Merges the vertices whose quantized attributes are all equal, the first
+* one of each group is kept in the order of the vertices, and rebuilds the
+* indices on the kept vertices. The triangles left with merged corners are
+* removed. The importers give each face its own vertices, welding lets the
+* post-transform cache reuse them.
+* The quantization and the hashing run in parallel on the large meshes, which
+* are then deduplicated by ranges of hashes in parallel.
+* @return The number of vertices left.
+*/
+std::size_t WeldVertices(std::vector<Vertex>* vertices, std::vector<GLuint>* indices,
+                         const WeldTolerances& tolerances = WeldTolerances{});
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Vertex;
+
+/*
+* @brief Largest number of triangles of a meshlet. Smaller meshlets are culled
+* more tightly, larger ones cost less draws once visible.
+*/
+inline constexpr std::size_t kMaxMeshletTriangleCount = 128;
+
+/*
+* @brief Meshlet is a cluster of neighbouring triangles of a mesh, a range of
+* its indices culled as a whole.
+* The normal cone bounds the normals of its triangles: they all face away from a
+* view position p when
+* dot(center - p, cone_axis) >= cone_cutoff * length(center - p) + radius.
+* A cone_cutoff of 1 disables the backface culling of the meshlet.
+*/
+struct Meshlet {
+  std::uint32_t first_index = 0;
+  std::uint32_t index_count = 0;
+  glm::vec3 center{0.f};
+  float radius = 0.f;
+  glm::vec3 cone_axis{0.f, 0.f, 1.f};
+  float cone_cutoff = 1.f;
+};
+
+/*
+* @brief Bounds of the meshlets of a mesh stored by component, so that the
+* culling tests four meshlets per SIMD instruction. The arrays are padded to a
+* multiple of four with empty meshlets.
+*/
+struct MeshletBounds {
+  static constexpr std::size_t kLaneCount = 4;
+
+  std::vector<float> center_x, center_y, center_z, radius;
+  std::vector<float> cone_axis_x, cone_axis_y, cone_axis_z, cone_cutoff;
+
+  void Build(const std::vector<Meshlet>& meshlets);
+  [[nodiscard]] std::size_t padded_count() const noexcept { return radius.size(); }
+};
+
+/*
+* @brief Splits the triangles of an indexed triangle list in meshlets of at most
+* kMaxMeshletTriangleCount triangles, grown over the triangles sharing positions
+* and preferring the ones whose normal is close to the normal of the meshlet.
+* The indices are reordered so that each meshlet is a contiguous range, the
+* triangles of a meshlet keep their relative order.
+*/
+void BuildMeshlets(const std::vector<Vertex>& vertices, std::vector<GLuint>* indices,
+                   std::vector<Meshlet>* meshlets);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "mesh.h"
+#include "shapes.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/*
+* @brief MeshletCuller culls the meshlets of the meshes drawn in a view against
+* its frustum and, for the meshes drawn with backface culling, against their
+* normal cones. The tests run in model space on four meshlets at a time, the
+* visible ones are merged in the draw ranges of a glMultiDrawElements.
+*/
+class MeshletCuller {
+ public:
+  MeshletCuller() noexcept = default;
+  MeshletCuller(MeshletCuller&& other) noexcept = delete;
+  MeshletCuller& operator=(MeshletCuller&& other) noexcept = delete;
+  MeshletCuller(const MeshletCuller& other) noexcept = delete;
+  MeshletCuller& operator=(const MeshletCuller& other) noexcept = delete;
+  ~MeshletCuller() noexcept = default;
+
+  /*
+  * @brief Enables the culling of the next draws for the view.
+  */
+  void BeginView(const Frustum& frustum, const glm::vec3& view_position) noexcept;
+  void EndView() noexcept { is_enabled_ = false; }
+
+  /*
+  * @brief Culls the meshlets of the mesh drawn with the model matrix.
+  * @return The number of draw ranges of the visible meshlets, given by counts(),
+  * offsets() and base_vertices(), the last ones for the meshes of an arena.
+  */
+  [[nodiscard]] std::size_t Cull(const Mesh& mesh, const glm::mat4& model) noexcept;
+
+  [[nodiscard]] bool is_enabled() const noexcept { return is_enabled_; }
+  [[nodiscard]] const std::vector<GLsizei>& counts() const noexcept { return counts_; }
+  [[nodiscard]] const std::vector<const void*>& offsets() const noexcept {
+    return offsets_;
+  }
+  [[nodiscard]] const std::vector<GLint>& base_vertices() const noexcept {
+    return base_vertices_;
+  }
+
+  /*
+  * @brief The meshes drawn without face culling must keep their back faces.
+  */
+  void set_cull_backfaces(bool cull_backfaces) noexcept {
+    cull_backfaces_ = cull_backfaces;
+  }
+
+ private:
+  // Planes of the frustum as (normal, -distance), a point is inside when its
+  // dot product with all of them is positive.
+  std::array<glm::vec4, 6> planes_{};
+  glm::vec3 view_position_{0.f};
+  bool is_enabled_ = false;
+  bool cull_backfaces_ = true;
+
+  std::vector<std::uint8_t> visibilities_;
+  std::vector<GLsizei> counts_;
+  std::vector<const void*> offsets_;
+  std::vector<GLint> base_vertices_;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+* @brief Filters used to downsample a mip level into the next one.
+* kBox averages the texels covered by the destination texel.
+* kKaiser and kLanczos are windowed sincs (3 texels radius) which keep the mips
+* sharper, their ringing is clamped.
+*/
+enum class MipFilter : std::uint8_t {
+  kBox,
+  kKaiser,
+  kLanczos,
+};
+
+struct MipGenerationParameters {
+  MipFilter filter = MipFilter::kKaiser;
+  // The color channels (not the alpha) are filtered in linear space.
+  bool srgb = false;
+  // The RGB channels store a normal in [0, 1] which is renormalized after
+  // the filtering.
+  bool normal_map = false;
+};
+
+template <typename T>
+struct MipLevel {
+  std::vector<T> pixels{};
+  int width = 0, height = 0;
+};
+
+/*
+* @brief Number of levels of a full mip chain, down to 1x1.
+*/
+[[nodiscard]] int CalculateMipLevelCount(int width, int height) noexcept;
+
+/*
+* @brief Generates the mip chain of an 8 bits image on the CPU. Every level is
+* downsampled from the previous one kept in float to avoid accumulating the
+* quantization errors. Destination rows are computed in parallel and the
+* filtering is vectorized with AVX2 or SSE2.
+* @return The levels 1 to N (the source image is the level 0).
+*/
+[[nodiscard]] std::vector<MipLevel<unsigned char>> GenerateMipChain(
+    const unsigned char* pixels, int width, int height, int channels,
+    const MipGenerationParameters& params) noexcept;
+
+/*
+* @brief Same as above for HDR images, the texels are only clamped to 0.
+*/
+[[nodiscard]] std::vector<MipLevel<float>> GenerateMipChain(
+    const float* pixels, int width, int height, int channels,
+    const MipGenerationParameters& params) noexcept;
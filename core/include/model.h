@@ -1,21 +1,49 @@
 #pragma once
 
+#include "file_utility.h"
 #include "mesh.h"
+#include "mesh_optimizer.h"
+#include "obj_parser.h"
 #include "texture.h"
+#include "texture_registry.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <cstdint>
 #include <string_view>
 #include <vector>
 
+/*
+* @brief Importer of the models which are not cooked yet. The OBJ files can be
+* read by the OBJ parser, which gives the same vertices and indices as Assimp
+* faster, see ParseObjFile. The other files are always imported by Assimp.
+*/
+enum class ModelImporter : std::int8_t {
+  kAssimp,
+  kObjParser,
+};
+
 class Model {
 public:
   Model() = default;
 
-  void Load(std::string_view path, bool gamma = false, bool flip_y = true);
-  void LoadToGpu() noexcept;
+  /*
+  * @brief Loads the meshes from the cooked mesh file of the model if it is up to
+  * date, otherwise imports the model, optimizes the order of its triangles and
+  * vertices (see OptimizeMesh) and cooks it for the next launches. The bounding
+  * spheres of the meshes are generated in both cases.
+  * The imported meshes are converted and optimized in parallel. Assimp imports
+  * the model if the OBJ parser can not.
+  */
+  void Load(std::string_view path, bool gamma = false, bool flip_y = true,
+            ModelImporter importer = ModelImporter::kObjParser);
+  /*
+  * @brief Uploads the meshes, from the mapped cooked file if they come from it,
+  * then unmaps it. The meshes are uploaded in the arena when there is one.
+  */
+  void LoadToGpu(GeometryArena* arena = nullptr) noexcept;
   void Destroy() noexcept;
   void SetupModelMatrixBuffer(const glm::mat4* model_matrix_data,
                               const std::size_t& size, GLenum buffer_usage);
@@ -23,21 +51,62 @@ public:
                                    const std::size_t& size) noexcept;
   void GenerateModelSphereBoundingVolume();
 
+  /*
+  * @brief Imports the OBJ file with Assimp and with the OBJ parser repeat_count
+  * times each, without the cooked file nor the textures, and prints the best
+  * time of each importer and the differences between their meshes.
+  * @return false if one of the importers failed.
+  */
+  static bool BenchmarkImporters(std::string_view path, bool flip_y, int repeat_count);
+
   [[nodiscard]] const std::vector<Mesh>& meshes() const noexcept {
     return meshes_;
   }
 
 private:
   // model data
-  std::vector<Texture> textures_loaded_;
+  // One handle per texture use, the textures are shared with the other models
+  // through the texture registry.
+  std::vector<TextureHandle> texture_handles_;
 
   std::vector<Mesh> meshes_;
   std::string directory_;
+  // Cooked mesh file whose vertices and indices are uploaded by LoadToGpu.
+  MappedFile cooked_file_;
+  // Optimizations of the meshes parsed by the last Load.
+  MeshOptimizationReport optimization_report_{};
 
-  
-  void ProcessNode(aiNode* node, const aiScene* scene, bool gamma = false, bool flip_y = true);
-  Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene, bool gamma = false, bool flip_y = true);
+  bool LoadCookedMeshes(std::string_view cooked_path, bool gamma, bool flip_y);
+  /*
+  * @brief Imports the meshes and their textures into meshes_ and sums their
+  * optimizations in optimization_report_.
+  */
+  bool ImportWithAssimp(std::string_view path, bool gamma, bool flip_y);
+  bool ImportWithObjParser(std::string_view path, bool gamma, bool flip_y);
+  /*
+  * @brief Gathers the meshes of the node and of its children, depth first.
+  */
+  static void CollectMeshes(const aiNode* node, const aiScene* scene,
+                            std::vector<const aiMesh*>* meshes);
+  /*
+  * @brief Copies the vertices and the indices of the triangulated mesh.
+  */
+  static void ConvertMesh(const aiMesh* mesh, std::vector<Vertex>* vertices,
+                          std::vector<GLuint>* indices);
+  /*
+  * @brief Welds, optimizes and splits in levels of detail and meshlets the
+  * vertices and indices of an imported mesh. It only touches its arguments,
+  * several meshes are processed at the same time.
+  */
+  static Mesh ProcessMesh(std::vector<Vertex> vertices, std::vector<GLuint> indices,
+                          std::vector<Texture> textures, MeshOptimizationReport* report);
+  std::vector<Texture> LoadMeshTextures(const aiMesh* mesh, const aiScene* scene,
+                                        bool gamma = false, bool flip_y = true);
   std::vector<Texture> LoadMaterialTextures(aiMaterial* mat, aiTextureType type,
                                             std::string typeName, bool gamma = false, 
                                             bool flip_y = true);
+  std::vector<Texture> LoadObjMaterialTextures(const ObjMaterial& material, bool gamma,
+                                               bool flip_y);
+  void LoadMaterialTexture(std::string_view relative_path, std::string_view type_name,
+                           bool gamma, bool flip_y, std::vector<Texture>* textures);
 };
\ No newline at end of file
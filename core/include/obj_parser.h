@@ -0,0 +1,65 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+* @brief Texture maps of a material of a MTL file, relative to the directory of
+* the OBJ file. The bump maps are the normal maps, which Assimp imports as
+* aiTextureType_HEIGHT.
+*/
+struct ObjMaterial {
+  std::string name;
+  std::vector<std::string> diffuse_maps;
+  std::vector<std::string> specular_maps;
+  std::vector<std::string> normal_maps;
+};
+
+/*
+* @brief Triangle list of the faces of an object using the same material, each
+* corner of a face has its own vertex like in the meshes of Assimp.
+*/
+struct ObjMesh {
+  static constexpr std::uint32_t kNoMaterial = ~0u;
+
+  std::vector<Vertex> vertices;
+  std::vector<GLuint> indices;
+  // Index in ObjScene::materials.
+  std::uint32_t material = kNoMaterial;
+};
+
+struct ObjScene {
+  std::vector<ObjMesh> meshes;
+  std::vector<ObjMaterial> materials;
+};
+
+/*
+* @brief Parses a Wavefront OBJ file and its MTL libraries into the meshes that
+* Assimp imports with aiProcess_Triangulate and aiProcess_CalcTangentSpace:
+* one mesh per object or group and material, in the same order, with the same
+* positions, normals, uvs and indices. The numbers are converted like the
+* fast_atof of Assimp to get the same floats. The quads are split on the same
+* diagonal, the larger polygons are fanned from their first corner.
+* The mapped file is split in chunks of lines parsed in parallel, the numbers
+* are read 16 digits at a time with SSE4.1.
+* The tangents are generated in parallel like MikkTSpace: the tangent of each
+* triangle is projected on the normal of each corner, weighted by the angle of
+* the corner and summed over the corners which share the vertex, its uv, its
+* normal and the orientation of the uvs. The bitangent is cross(N, T) times the
+* sign of the orientation.
+* @param flip_uvs Replaces the v of the uvs by 1 - v, like aiProcess_FlipUVs.
+* @return false if the file could not be read or has an invalid statement or
+* index, scene is then left empty.
+*/
+[[nodiscard]] bool ParseObjFile(std::string_view path, bool flip_uvs, ObjScene* scene);
+
+/*
+* @brief Whether the path ends with the .obj extension, in any case.
+*/
+[[nodiscard]] bool IsObjFilePath(std::string_view path) noexcept;
@@ -30,6 +30,8 @@ class Pipeline {
                             const glm::mat3& mat) const noexcept;
   void Pipeline::SetMatrix4(std::string_view name,
                             const glm::mat4& mat) const noexcept;
+  void SetUniformBlockBinding(std::string_view block_name,
+                              GLuint binding_point) const noexcept;
 
   [[nodiscard]] static const GLuint current_program() noexcept {
     return current_program_;
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <mutex>
+#include <queue>
+
+/*
+* @brief PixelBufferRing is a persistently mapped pixel unpack buffer used as a
+* staging ring for the texture uploads. Worker threads write the pixels
+* directly in the mapped memory, the GL thread then only issues buffer to
+* texture copies and fences them. The space of a copy is recycled once its
+* fence is signaled, in the allocation order.
+* Create, Destroy, Fence and Reclaim must be called by the GL thread, Allocate
+* can be called by any thread.
+*/
+class PixelBufferRing {
+ public:
+  struct Allocation {
+    std::size_t offset = 0;
+    // Bytes taken in the ring, including the end of the ring skipped on wrap.
+    std::size_t consumed_size = 0;
+    unsigned char* data = nullptr;
+  };
+
+  PixelBufferRing() noexcept = default;
+  PixelBufferRing(PixelBufferRing&& other) noexcept = delete;
+  PixelBufferRing& operator=(PixelBufferRing&& other) noexcept = delete;
+  PixelBufferRing(const PixelBufferRing& other) noexcept = delete;
+  PixelBufferRing& operator=(const PixelBufferRing& other) noexcept = delete;
+  ~PixelBufferRing() noexcept = default;
+
+  void Create(std::size_t capacity) noexcept;
+  void Destroy() noexcept;
+
+  /*
+  * @brief Reserves size bytes of contiguous space in the ring.
+  * @return false if the ring has not enough free space, the caller should then
+  * upload from client memory.
+  */
+  [[nodiscard]] bool Allocate(std::size_t size, Allocation* allocation) noexcept;
+
+  /*
+  * @brief Inserts a fence after the copies reading the allocation, its space is
+  * recycled once the fence is signaled. Every allocation must be fenced, in the
+  * allocation order.
+  */
+  void Fence(const Allocation& allocation) noexcept;
+
+  /*
+  * @brief Recycles the space of the copies completed by the GPU, without
+  * waiting for the others.
+  */
+  void Reclaim() noexcept;
+
+  [[nodiscard]] GLuint buffer() const noexcept { return buffer_; }
+
+ private:
+  struct FencedRegion {
+    GLsync fence = nullptr;
+    std::size_t consumed_size = 0;
+  };
+
+  // Allocations are aligned on the size of the largest texel block.
+  static constexpr std::size_t kAlignment = 16;
+
+  GLuint buffer_ = 0;
+  unsigned char* mapped_data_ = nullptr;
+  std::size_t capacity_ = 0;
+
+  std::mutex mutex_{};
+  std::size_t head_ = 0;
+  std::size_t tail_ = 0;
+  std::size_t used_size_ = 0;
+
+  // Only accessed by the GL thread.
+  std::queue<FencedRegion> fenced_regions_{};
+
+  void Release(std::size_t consumed_size) noexcept;
+};
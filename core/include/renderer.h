@@ -1,6 +1,9 @@
 #pragma once
 
+#include "geometry_arena.h"
+#include "lod_selector.h"
 #include "mesh.h"
+#include "meshlet_culler.h"
 #include "model.h"
 #include "material.h"
 #include "pipeline.h"
@@ -13,13 +16,65 @@
 
 class Renderer {
 public:
-  void DrawMesh(const Mesh& mesh, GLenum mode = GL_TRIANGLES) const noexcept;
-  void DrawInstancedMesh(const Mesh& mesh,
-                         GLuint instance_count, GLenum mode = GL_TRIANGLES) const noexcept;
+  /*
+  * @brief Draws the indices of the level of detail lod of the mesh.
+  */
+  void DrawMesh(const Mesh& mesh, GLenum mode = GL_TRIANGLES,
+                std::uint32_t lod = 0) const noexcept;
+  /*
+  * @brief Draws instance_count instances of the level lod of the mesh, whose
+  * model matrices start at base_instance in its model matrix buffer.
+  */
+  void DrawInstancedMesh(const Mesh& mesh, GLuint instance_count,
+                         GLenum mode = GL_TRIANGLES, std::uint32_t lod = 0,
+                         GLuint base_instance = 0) const noexcept;
+  /*
+  * @brief Draws all the draws of the list, whose meshes are in the arena, with
+  * one glMultiDrawElementsIndirect per index type. The pipeline reads the model
+  * matrix of each draw at GeometryArena::kDrawMatrixLocation.
+  */
+  void DrawIndirect(const GeometryArena& arena, const GeometryDrawList& draw_list,
+                    GLenum mode = GL_TRIANGLES) const noexcept;
   void DrawModel(const Model& model, GLenum mode = GL_TRIANGLES) const noexcept;
+  /*
+  * @brief Draws each mesh of the model with the level of detail the LOD selector
+  * chooses for the model matrix, or the full meshes without LOD selector. The
+  * full meshes are drawn by their visible meshlets while the meshlet culler is
+  * enabled.
+  */
+  void DrawModel(const Model& model, const glm::mat4& model_matrix,
+                 GLenum mode = GL_TRIANGLES) const noexcept;
   void DrawInstancedModel(const Model& model, GLuint instance_count,
                           GLenum mode = GL_TRIANGLES) const noexcept;
 
-  void DrawModelWithMaterials(const Model& model, const std::vector<GLuint>& textures, 
-                              int mat_offset, GLenum mode = GL_TRIANGLES);
-};
\ No newline at end of file
+  /*
+  * @brief Draws the meshes of the model, the mesh i with the material
+  * first_material + i * material_stride of the material system, with the levels
+  * of detail of the model matrix.
+  */
+  void DrawModelWithMaterials(const Model& model, const glm::mat4& model_matrix,
+                              MaterialSystem& material_system,
+                              const Pipeline& pipeline, std::size_t first_material,
+                              std::size_t material_stride, GLenum mode = GL_TRIANGLES);
+
+  void set_lod_selector(LodSelector* lod_selector) noexcept {
+    lod_selector_ = lod_selector;
+  }
+  void set_meshlet_culler(MeshletCuller* meshlet_culler) noexcept {
+    meshlet_culler_ = meshlet_culler;
+  }
+
+private:
+  LodSelector* lod_selector_ = nullptr;
+  MeshletCuller* meshlet_culler_ = nullptr;
+
+  /*
+  * @brief Draws the level of detail of the mesh selected for the model matrix,
+  * only its visible meshlets for the full level.
+  */
+  void DrawSelectedLod(const Mesh& mesh, const glm::mat4& model_matrix,
+                       GLenum mode) const noexcept;
+
+  [[nodiscard]] std::uint32_t SelectLod(const Mesh& mesh,
+                                        const glm::mat4& model_matrix) const noexcept;
+};
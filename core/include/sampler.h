@@ -0,0 +1,90 @@
+#pragma once
+
+#include "flat_hash_map.h"
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/*
+* @brief SamplerParameters is the filtering state of a sampler object, it is
+* kept out of the textures so that the textures sampled the same way share it.
+*/
+struct SamplerParameters {
+  GLint min_filter = GL_LINEAR_MIPMAP_LINEAR;
+  GLint mag_filter = GL_LINEAR;
+  GLint wrapping_param = GL_REPEAT;
+  // 1 disables the anisotropic filtering.
+  float max_anisotropy = 1.f;
+
+  bool operator==(const SamplerParameters& other) const noexcept;
+};
+
+struct SamplerParametersHash {
+  std::size_t operator()(const SamplerParameters& parameters) const noexcept;
+};
+
+/*
+* @brief Sampling of a texture created with filtering_param: the textures with
+* mips are sampled trilinear (or nearest between the nearest texels) and the
+* linear ones anisotropically.
+*/
+[[nodiscard]] SamplerParameters MakeSamplerParameters(GLint wrapping_param,
+                                                      GLint filtering_param,
+                                                      bool has_mips,
+                                                      float max_anisotropy) noexcept;
+
+/*
+* @brief Rounds the anisotropy down to the steps of the GPUs: 1, 2, 4, 8 or 16.
+*/
+[[nodiscard]] float SnapAnisotropy(float max_anisotropy) noexcept;
+
+/*
+* @brief SamplerCache creates one sampler object per set of parameters. The
+* samplers are bound on the texture units with glBindSampler, where they
+* override the filtering state of the textures.
+*/
+class SamplerCache {
+ public:
+  SamplerCache() noexcept = default;
+  SamplerCache(SamplerCache&& other) noexcept = delete;
+  SamplerCache& operator=(SamplerCache&& other) noexcept = delete;
+  SamplerCache(const SamplerCache& other) noexcept = delete;
+  SamplerCache& operator=(const SamplerCache& other) noexcept = delete;
+  ~SamplerCache() noexcept = default;
+
+  /*
+  * @brief Returns the sampler of the parameters, created on the first call.
+  * The anisotropy is clamped to the one supported by the GPU and rounded down
+  * to a power of two (see SnapAnisotropy), so that a few samplers are created
+  * whatever the requested values.
+  */
+  [[nodiscard]] GLuint Acquire(SamplerParameters parameters) noexcept;
+
+  /*
+  * @brief Deletes all the samplers, to call while the GL context is current.
+  */
+  void Clear() noexcept;
+
+  [[nodiscard]] std::size_t sampler_count() const noexcept;
+  /*
+  * @brief Largest anisotropy of the GPU, 1 without anisotropic filtering.
+  */
+  [[nodiscard]] float max_supported_anisotropy() noexcept;
+
+ private:
+  mutable std::mutex mutex_{};
+  FlatHashMap<SamplerParameters, GLuint, SamplerParametersHash> samplers_{};
+  // The samplers in their creation order, to delete them.
+  std::vector<GLuint> sampler_ids_{};
+  float max_supported_anisotropy_ = 0.f;
+
+  float QueryMaxAnisotropy() noexcept;
+};
+
+/*
+* @brief The samplers shared by the whole application.
+*/
+[[nodiscard]] SamplerCache& GetSamplerCache() noexcept;
@@ -54,6 +54,15 @@ public:
   [[nodiscard]] bool IsOnFrustum(const Frustum& cam_frustum,
                                  const glm::mat4& modelViewProjection) const override;
 
+  // Height in pixels of the sphere once projected on a viewport by a perspective
+  // projection of vertical field of view fov_y (in radians).
+  [[nodiscard]] float CalculateScreenSize(const glm::mat4& model,
+                                          const glm::vec3& view_position,
+                                          float fov_y, float viewport_height) const;
+
+  [[nodiscard]] const glm::vec3& center() const noexcept { return center_; }
+  [[nodiscard]] float radius() const noexcept { return radius_; }
+
 private:
   [[nodiscard]] bool IsOnOrForwardPlane(const Plane& plane) const override;
 
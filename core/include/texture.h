@@ -6,9 +6,52 @@
 #include <GL/glew.h>
 
 #include <array>
+#include <cstdint>
 #include <memory>
 #include <string_view>
 #include <variant>
+#include <vector>
+
+/*
+* @brief TextureCompression is the block compression requested for a texture
+* when it is cooked.
+* kAuto picks BC4 for one channel, BC5 for two channels, BC1 for RGB colors
+* and BC7 for RGB data maps and RGBA images.
+*/
+enum class TextureCompression : std::uint8_t {
+  kAuto,
+  kNone,
+  kBc1,
+  kBc4,
+  kBc5,
+  kBc7,
+};
+
+/*
+* @brief HdrPixelFormat is the format the HDR images are converted to by their
+* decompressing job, so that they are uploaded without conversion by the driver.
+* kRgb9E5 shares one exponent between the 3 channels (4 bytes per texel), the
+* images which do not have 3 channels are converted to kHalf instead.
+*/
+enum class HdrPixelFormat : std::uint8_t {
+  kFloat,
+  kHalf,
+  kRgb9E5,
+};
+
+/*
+* @brief PixelLayout is the layout the 8 bits RGB images are expanded to by
+* their decompressing job. The drivers repack 3 bytes texels on the CPU when
+* they are uploaded, 4 bytes texels are copied as they are.
+* kBgra is the native order of most desktop drivers.
+*/
+enum class PixelLayout : std::uint8_t {
+  kAsDecoded,
+  kRgba,
+  kBgra,
+};
+
+inline constexpr PixelLayout kPreferredPixelLayout = PixelLayout::kBgra;
 
 /*
 * @brief TextureParameters is a struct containing the various parameters required 
@@ -17,7 +60,8 @@ to create a texture on the GPU.
 struct TextureParameters {
   TextureParameters() noexcept = default;
   TextureParameters(std::string_view path, GLint wrap_param, GLint filter_param,
-                    bool gamma, bool flip_y, bool hdr = false) noexcept;
+                    bool gamma, bool flip_y, bool hdr = false,
+                    TextureCompression compression = TextureCompression::kAuto) noexcept;
 
   std::string image_file_path{};
   GLint wrapping_param = GL_CLAMP_TO_EDGE;
@@ -25,6 +69,7 @@ struct TextureParameters {
   bool gamma_corrected = false;
   bool flipped_y = false;
   bool hdr = false;
+  TextureCompression compression = TextureCompression::kAuto;
 };
 
 /*
@@ -32,9 +77,13 @@ struct TextureParameters {
 */
 struct ImageBuffer {
   // Image data can be stored either as unsigned char if it's a classic image, 
-  // or as float if it's an image in "hdr" format.
-  std::variant<unsigned char*, float*> data; // lifetime is managed by stb_image functions.
+  // or as float if it's an image in "hdr" format, packed in half floats or
+  // RGB9E5 texels if it was converted.
+  std::variant<unsigned char*, float*, std::uint16_t*, std::uint32_t*> data; // lifetime is managed by stb_image functions.
   int width = 0, height = 0, channels = 0;
+  // The red and blue channels are swapped, the pixels were expanded to
+  // PixelLayout::kBgra.
+  bool bgra = false;
 };
 
 /*
@@ -49,6 +98,82 @@ GLuint LoadCubeMap(const std::array<std::string, 6>& faces, GLint wrapping_param
 
 void LoadTextureToGpu(ImageBuffer* image_buffer, GLuint* id, const TextureParameters& tex_param) noexcept;
 
+/*
+* @brief Expands count RGB texels to 4 bytes texels with an opaque alpha, in
+* RGBA order or BGRA if bgra is set. Vectorized with SSSE3 or AVX2 shuffles.
+*/
+void ExpandRgbTexels(const unsigned char* rgb, unsigned char* dst, std::size_t count,
+                     bool bgra) noexcept;
+
+/*
+* @brief Expands the pixels of an 8 bits RGB image to 4 channels in the layout,
+* the other images are left as they are.
+*/
+void ExpandRgbImage(ImageBuffer* image_buffer, PixelLayout layout) noexcept;
+
+/*
+* @brief Largest GL_UNPACK_ALIGNMENT (8, 4, 2 or 1) dividing the size in bytes
+* of the rows of an image.
+*/
+[[nodiscard]] GLint CalculateUnpackAlignment(std::size_t row_size) noexcept;
+
+/*
+* @brief Largest power of two cubemap face resolution, not bigger than a quarter
+* of the equirectangular map width (90 degrees of 360), whose six faces and
+* mip chain fit in the memory budget.
+*/
+[[nodiscard]] GLsizei CalculateCubeMapResolution(GLsizei equirect_width,
+                                                 std::size_t memory_budget,
+                                                 float bytes_per_texel) noexcept;
+
+/*
+* @brief Bc6hCubeMapCompressor compresses the first levels of a float cubemap
+* to BC6H on the CPU, in steps which can run on different threads so that the
+* render thread only issues the readback:
+* ReadBack copies the levels in a pixel pack buffer and fences the copy (render
+* thread), Download waits for the fence and copies the buffer in memory and
+* Upload creates the compressed cubemap (thread with a shared GL context
+* current), Compress encodes the faces (any thread).
+* The source cubemap is left untouched, the caller replaces it once uploaded.
+*/
+class Bc6hCubeMapCompressor {
+ public:
+  Bc6hCubeMapCompressor() noexcept = default;
+  Bc6hCubeMapCompressor(Bc6hCubeMapCompressor&& other) noexcept = delete;
+  Bc6hCubeMapCompressor& operator=(Bc6hCubeMapCompressor&& other) noexcept = delete;
+  Bc6hCubeMapCompressor(const Bc6hCubeMapCompressor& other) noexcept = delete;
+  Bc6hCubeMapCompressor& operator=(const Bc6hCubeMapCompressor& other) noexcept = delete;
+  ~Bc6hCubeMapCompressor() noexcept = default;
+
+  void ReadBack(GLuint cubemap, GLsizei resolution, GLint level_count) noexcept;
+  void Download() noexcept;
+  void Compress() noexcept;
+  /*
+  * @brief Creates the compressed cubemap, its commands still have to be
+  * completed by the GPU before it is used by another context.
+  */
+  void Upload() noexcept;
+
+  [[nodiscard]] GLuint compressed_cubemap() const noexcept { return compressed_cubemap_; }
+
+ private:
+  GLuint pixel_buffer_ = 0;
+  GLsync readback_fence_ = nullptr;
+  GLsizei resolution_ = 0;
+  GLint level_count_ = 0;
+
+  // RGB float texels of the faces, level after level.
+  std::vector<float> pixels_{};
+  // BC6H blocks of the faces in the same order.
+  std::vector<unsigned char> compressed_pixels_{};
+  GLuint compressed_cubemap_ = 0;
+};
+
+/*
+* @brief Releases the pixels of an image decompressed by stb_image.
+*/
+void FreeImageBuffer(ImageBuffer* image_buffer) noexcept;
+
 // =============================================
 //            Multithreading Jobs.
 // =============================================
@@ -58,7 +183,9 @@ class ImageFileDecompressingJob final : public Job {
   ImageFileDecompressingJob() noexcept = default;
   ImageFileDecompressingJob(FileBuffer* file_buffer, 
                             ImageBuffer* img_buffer, 
-                            bool flip_y = false, bool hdr = false) noexcept;
+                            bool flip_y = false, bool hdr = false,
+                            HdrPixelFormat hdr_format = HdrPixelFormat::kFloat,
+                            PixelLayout pixel_layout = PixelLayout::kAsDecoded) noexcept;
   ImageFileDecompressingJob(ImageFileDecompressingJob&& other) noexcept = default;
   ImageFileDecompressingJob& operator=(ImageFileDecompressingJob&& other) noexcept = default;
   ImageFileDecompressingJob(const ImageFileDecompressingJob& other) noexcept = delete;
@@ -75,6 +202,11 @@ class ImageFileDecompressingJob final : public Job {
   ImageBuffer* image_buffer_ = nullptr;
   bool flip_y_ = false;
   bool hdr_ = false;
+  // Format the HDR pixels are converted to once decompressed.
+  HdrPixelFormat hdr_format_ = HdrPixelFormat::kFloat;
+  // Layout the RGB pixels are expanded to, the images which are cooked keep
+  // their decoded layout.
+  PixelLayout pixel_layout_ = PixelLayout::kAsDecoded;
 };
 
 
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "flat_hash_map.h"
+#include "texture.h"
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+/*
+* @brief Hashes bytes into a 64 bits hash, seed chains several buffers.
+*/
+[[nodiscard]] std::uint64_t HashContent(const unsigned char* data, std::size_t size,
+                                        std::uint64_t seed = 0) noexcept;
+
+/*
+* @brief Hashes the identity of a file: its normalized absolute path, its size
+* and its last write time, without reading it. The hash changes when the file
+* is modified.
+* @return false if the file does not exist.
+*/
+[[nodiscard]] bool HashFileIdentity(std::string_view path, std::uint64_t* hash,
+                                    std::uint64_t seed = 0) noexcept;
+
+/*
+* @brief TextureKey identifies a texture by the identity of its source files
+* (see HashFileIdentity) and the parameters it is created with. The paths which
+* lead to the same file share the same key.
+*/
+struct TextureKey {
+  TextureKey() noexcept = default;
+  TextureKey(std::uint64_t hash, const TextureParameters& tex_param) noexcept;
+
+  std::uint64_t source_hash = 0;
+  GLint wrapping_param = 0;
+  GLint filtering_param = 0;
+  bool gamma_corrected = false;
+  bool flipped_y = false;
+  bool hdr = false;
+  TextureCompression compression = TextureCompression::kAuto;
+
+  bool operator==(const TextureKey& other) const noexcept;
+};
+
+struct TextureKeyHash {
+  std::size_t operator()(const TextureKey& key) const noexcept;
+};
+
+class TextureRegistry;
+
+/*
+* @brief TextureHandle is a counted reference to a texture of the registry.
+* Copying the handle adds a reference, the texture is deleted from the GPU
+* when its last handle is released.
+*/
+class TextureHandle {
+ public:
+  TextureHandle() noexcept = default;
+  TextureHandle(TextureHandle&& other) noexcept;
+  TextureHandle& operator=(TextureHandle&& other) noexcept;
+  TextureHandle(const TextureHandle& other) noexcept;
+  TextureHandle& operator=(const TextureHandle& other) noexcept;
+  ~TextureHandle() noexcept;
+
+  void Release() noexcept;
+
+  [[nodiscard]] GLuint id() const noexcept;
+  /*
+  * @brief Address of the GPU object name, written by the job creating the
+  * texture. It stays valid as long as a handle references the texture.
+  */
+  [[nodiscard]] GLuint* id_address() const noexcept;
+
+  [[nodiscard]] explicit operator bool() const noexcept { return registry_ != nullptr; }
+  bool operator==(const TextureHandle& other) const noexcept {
+    return registry_ == other.registry_ && entry_idx_ == other.entry_idx_;
+  }
+
+ private:
+  friend class TextureRegistry;
+  TextureHandle(TextureRegistry* registry, std::uint32_t entry_idx) noexcept;
+
+  TextureRegistry* registry_ = nullptr;
+  std::uint32_t entry_idx_ = 0;
+};
+
+/*
+* @brief TextureRegistry shares the textures between the materials and the
+* models. A texture is created once per TextureKey, the next users get a new
+* handle on the same GPU object.
+* It is thread safe, but the last release of a texture deletes it so it must
+* happen on a thread owning a GL context.
+*/
+class TextureRegistry {
+ public:
+  TextureRegistry() noexcept = default;
+  TextureRegistry(TextureRegistry&& other) noexcept = delete;
+  TextureRegistry& operator=(TextureRegistry&& other) noexcept = delete;
+  TextureRegistry(const TextureRegistry& other) noexcept = delete;
+  TextureRegistry& operator=(const TextureRegistry& other) noexcept = delete;
+  ~TextureRegistry() noexcept = default;
+
+  /*
+  * @brief Returns a handle on the texture of the key, registering an empty one
+  * if it does not exist yet.
+  * @param is_new Set to true if the caller has to create the texture.
+  */
+  [[nodiscard]] TextureHandle Acquire(const TextureKey& key, bool* is_new) noexcept;
+
+  [[nodiscard]] std::size_t texture_count() const noexcept;
+
+ private:
+  friend class TextureHandle;
+
+  struct Entry {
+    TextureKey key{};
+    GLuint id = 0;
+    std::uint32_t reference_count = 0;
+  };
+
+  mutable std::mutex mutex_{};
+  FlatHashMap<TextureKey, std::uint32_t, TextureKeyHash> entry_indices_{};
+  // Deque so that the id addresses are stable.
+  std::deque<Entry> entries_{};
+  std::vector<std::uint32_t> free_entries_{};
+
+  void AddReference(std::uint32_t entry_idx) noexcept;
+  void RemoveReference(std::uint32_t entry_idx) noexcept;
+};
+
+/*
+* @brief The registry shared by all the texture loaders.
+*/
+[[nodiscard]] TextureRegistry& GetTextureRegistry() noexcept;
@@ -0,0 +1,313 @@
+#pragma once
+
+#include "cooked_texture.h"
+#include "gpu_upload_thread.h"
+#include "job_system.h"
+#include "pixel_buffer_ring.h"
+
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* @brief TextureStreamer uploads the cooked textures progressively. Only their
+* mip tail (the levels up to kMipTailSize texels) is uploaded before the first
+* frame, the higher levels are read from the disk by a background thread and
+* uploaded between frames, the textures that are the largest on screen compared
+* to their resident resolution first.
+* The storage only holds the levels from the finest streamed one, it is
+* reallocated with one more level when a finer one is requested. The samplers
+* are clamped to the resident levels with GL_TEXTURE_BASE_LEVEL.
+* The layers of texture arrays are streamed like textures, the base level of an
+* array is the coarsest resident level of its layers.
+* The textures are kept under a memory budget: when the textures of the
+* application exceed it, the finest level of the least recently visible storage
+* is evicted, down to its mip tail.
+* The reading thread writes the levels directly in a persistently mapped pixel
+* buffer ring, so the GL thread only issues buffer to texture copies. With a
+* shared GL context, the reading thread issues the copies itself and the main
+* thread only moves the base level of the textures.
+* Lazy layers are not resident at all until they are first visible: their mip
+* tail is then read in one request before any other level, and their material
+* samples a placeholder meanwhile. Unseen textures only cost their header.
+*/
+class TextureStreamer {
+ public:
+  static constexpr std::uint32_t kMipTailSize = 64;
+  static constexpr std::size_t kDefaultMemoryBudget = 256 * 1024 * 1024;
+
+  TextureStreamer() noexcept = default;
+  TextureStreamer(TextureStreamer&& other) noexcept = delete;
+  TextureStreamer& operator=(TextureStreamer&& other) noexcept = delete;
+  TextureStreamer(const TextureStreamer& other) noexcept = delete;
+  TextureStreamer& operator=(const TextureStreamer& other) noexcept = delete;
+  ~TextureStreamer() noexcept = default;
+
+  /*
+  * @brief Reserves the slots of the streamed textures, creates the pixel buffer
+  * ring and starts the disk reading thread.
+  * @param upload_context Context made current by the reading thread to upload
+  * the levels, without callbacks the levels are uploaded by Update.
+  */
+  void Begin(std::size_t texture_count, SharedGlContext upload_context = {}) noexcept;
+  void End() noexcept;
+
+  /*
+  * @brief Creates the texture of the slot texture_idx and uploads its mip tail.
+  * @param cooked_buffer The mip tail of the cooked file, or the whole file if
+  * the texture has just been cooked: the levels are then streamed from memory.
+  * It must outlive the streaming.
+  */
+  void AddTexture(std::size_t texture_idx, const FileBuffer* cooked_buffer,
+                  std::string cooked_path, GLuint* id,
+                  const TextureParameters& tex_param) noexcept;
+
+  /*
+  * @brief Streams the slot texture_idx in the layer of an array whose storage
+  * is already allocated, and uploads its mip tail.
+  * @param is_lazy The mip tail is only uploaded once the texture is visible,
+  * the cooked buffer can then only hold the header and the smallest level.
+  */
+  void AddArrayLayer(std::size_t texture_idx, const FileBuffer* cooked_buffer,
+                     std::string cooked_path, GLuint* array_id, GLint layer,
+                     bool is_lazy = false) noexcept;
+
+  /*
+  * @brief Creates the storage of a texture array with the mip tail of its
+  * layers, the layers are then added with AddArrayLayer.
+  * @param header Format, size and level count of the layers.
+  */
+  void AddArray(GLuint* array_id, const CookedTextureHeader& header,
+                GLsizei layer_count, GLint wrapping_param, GLint filtering_param) noexcept;
+
+  /*
+  * @brief First level of the mip tail, the coarse levels uploaded before the
+  * first frame and never evicted.
+  */
+  [[nodiscard]] static std::uint32_t CalculateMipTailLevel(
+      const CookedTextureHeader& header) noexcept;
+
+  /*
+  * @brief Height in pixels of an object using the texture this frame, the
+  * largest value of the frame is kept.
+  */
+  void RequestScreenSize(std::size_t texture_idx, float screen_size) noexcept;
+
+  /*
+  * @brief Uploads the levels read since the last call (within an upload budget),
+  * then requests the next levels of the textures which need them the most.
+  */
+  void Update() noexcept;
+
+  /*
+  * @brief Whether the mip tail of the texture is uploaded and can be sampled.
+  */
+  [[nodiscard]] bool is_resident(std::size_t texture_idx) const noexcept {
+    return textures_[texture_idx].is_resident;
+  }
+  [[nodiscard]] std::size_t resident_texture_count() const noexcept;
+  [[nodiscard]] std::size_t streamed_texture_count() const noexcept;
+
+  /*
+  * @brief Number of levels of the streamed textures which are not resident yet,
+  * without the lazy textures which have not been visible yet and the textures
+  * whose reads keep failing.
+  */
+  [[nodiscard]] std::size_t remaining_level_count() const noexcept {
+    return remaining_level_count_;
+  }
+
+  /*
+  * @brief Bytes of all the textures (GpuMemoryCategory::kTexture) above which
+  * the streamed levels are evicted.
+  */
+  void set_memory_budget(std::size_t memory_budget) noexcept {
+    memory_budget_ = memory_budget;
+  }
+  [[nodiscard]] std::size_t memory_budget() const noexcept { return memory_budget_; }
+  /*
+  * @brief Bytes of the storages of the streamed textures.
+  */
+  [[nodiscard]] std::size_t resident_size() const noexcept { return resident_size_; }
+  [[nodiscard]] std::size_t evicted_level_count() const noexcept {
+    return evicted_level_count_;
+  }
+
+ private:
+  // GL texture shared by the streamed textures of an array, or owned by one.
+  struct TextureStorage {
+    GLuint* id = nullptr;
+    GLenum target = GL_TEXTURE_2D;
+    CookedTextureHeader header{};
+    GLsizei layer_count = 1;
+    GLint wrapping_param = 0;
+    GLint filtering_param = 0;
+    // Cooked level stored in the GL level 0.
+    std::uint32_t first_level = 0;
+    std::uint32_t tail_level = 0;
+    std::size_t pending_request_count = 0;
+    std::uint64_t last_visible_frame = 0;
+  };
+
+  struct StreamedTexture {
+    std::size_t storage_idx = 0;
+    GLuint* id = nullptr;
+    // Layer in the array id, -1 for a 2D texture.
+    GLint layer = -1;
+    std::string cooked_path{};
+    CookedTextureHeader header{};
+    std::vector<CookedLevelIndex> levels{};
+    // Whole cooked file in memory, nullptr if the levels are read from the disk.
+    const unsigned char* cooked_data = nullptr;
+    // Finest level uploaded, level_count while the mip tail is not resident.
+    std::uint32_t resident_level = 0;
+    float screen_size = 0.f;
+    // Failed reads of the requested level, which is requested again from
+    // retry_frame until kMaxReadAttempts reads have failed.
+    std::uint32_t failed_read_count = 0;
+    std::uint64_t retry_frame = 0;
+    bool is_level_requested = false;
+    bool is_resident = false;
+  };
+
+  struct LevelRequest {
+    std::size_t texture_idx = 0;
+    // Finest of the level_count consecutive levels read, more than one for a
+    // mip tail.
+    std::uint32_t level = 0;
+    std::uint32_t level_count = 1;
+    // Level in the storage of the texture.
+    std::uint32_t storage_level = 0;
+    std::string cooked_path{};
+    // Bytes of all the levels read, the smallest levels are stored first.
+    CookedLevelIndex level_index{};
+    std::vector<CookedLevelIndex> levels{};
+    GLuint texture_id = 0;
+    GLint layer = -1;
+    CookedTextureHeader header{};
+    // Level in memory for the just cooked textures, nullptr to read the disk.
+    const unsigned char* source = nullptr;
+  };
+
+  struct LevelData {
+    std::size_t texture_idx = 0;
+    std::uint32_t level = 0;
+    std::uint32_t level_count = 1;
+    std::vector<unsigned char> bytes{};
+    // Points either to the pixel buffer ring, to bytes or to the cooked file in
+    // memory when the ring is full.
+    const unsigned char* data = nullptr;
+    PixelBufferRing::Allocation allocation{};
+    bool is_in_ring = false;
+    // Already uploaded by the reading thread.
+    bool is_uploaded = false;
+  };
+
+  // Bytes uploaded at most per frame, except for the first level.
+  static constexpr std::size_t kUploadBudgetPerFrame = 8 * 1024 * 1024;
+  static constexpr std::size_t kMaxPendingRequests = 4;
+  // The delay before a retry doubles after each failed read.
+  static constexpr std::uint32_t kMaxReadAttempts = 4;
+  static constexpr std::uint64_t kFirstRetryDelay = 30;
+  // Big enough for the pending requests of 2048x2048 BC7 levels.
+  static constexpr std::size_t kPixelBufferRingSize = 32 * 1024 * 1024;
+
+  std::vector<StreamedTexture> textures_{};
+  std::vector<TextureStorage> storages_{};
+  std::size_t pending_request_count_ = 0;
+  std::size_t remaining_level_count_ = 0;
+  std::size_t memory_budget_ = kDefaultMemoryBudget;
+  std::size_t resident_size_ = 0;
+  std::size_t evicted_level_count_ = 0;
+  std::uint64_t frame_ = 0;
+  PixelBufferRing pixel_buffer_ring_{};
+  SharedGlContext upload_context_{};
+  bool has_upload_context_ = false;
+
+  std::thread reading_thread_{};
+  std::mutex mutex_{};
+  std::condition_variable requests_condition_{};
+  std::queue<LevelRequest> requests_{};
+  std::queue<LevelData> loaded_levels_{};
+  bool is_running_ = false;
+  // Until the reading thread has tried to make the upload context current.
+  bool is_starting_ = false;
+
+  void ReadRequests() noexcept;
+  void RequestLevel(std::size_t texture_idx) noexcept;
+  /*
+  * @brief Parses the cooked buffer in the slot, uploads its mip tail in the
+  * texture or layer and makes it resident.
+  */
+  void AddStreamedTexture(std::size_t texture_idx, const FileBuffer* cooked_buffer,
+                          std::string cooked_path, GLuint* id, GLint layer,
+                          bool is_lazy = false) noexcept;
+  std::size_t AddStorage(GLuint* id, GLenum target, const CookedTextureHeader& header,
+                         GLsizei layer_count, GLint wrapping_param,
+                         GLint filtering_param) noexcept;
+  /*
+  * @brief Reallocates the storage from the level first_level and copies the
+  * resident levels it keeps. The storage must have no pending request.
+  */
+  void ResizeStorage(TextureStorage* storage, std::uint32_t first_level) noexcept;
+  [[nodiscard]] std::size_t CalculateStorageSize(const TextureStorage& storage,
+                                                 std::uint32_t first_level) const noexcept;
+  /*
+  * @brief Evicts the finest level of the least recently visible storage.
+  * @param max_visible_frame Only the storages not visible since are evicted.
+  * @param kept_storage_idx Storage which is never evicted.
+  * @return false if there is no storage to evict.
+  */
+  bool EvictLeastRecentlyVisibleLevel(std::uint64_t max_visible_frame,
+                                      std::size_t kept_storage_idx) noexcept;
+  void ApplyBaseLevel(const TextureStorage& storage) const noexcept;
+  // data is an offset in pixel_buffer if it is not 0.
+  void UploadLevel(GLuint texture_id, GLint layer, const CookedTextureHeader& header,
+                   std::uint32_t level, const CookedLevelIndex& level_index,
+                   const void* data, GLuint pixel_buffer) const noexcept;
+  // Uploads consecutive levels read in one block from block.byte_offset, the
+  // first of them in the storage level storage_level.
+  void UploadLevels(GLuint texture_id, GLint layer, const CookedTextureHeader& header,
+                    std::uint32_t storage_level, const CookedLevelIndex* levels,
+                    std::uint32_t level_count, const CookedLevelIndex& block,
+                    const unsigned char* data, GLuint pixel_buffer) const noexcept;
+  // Uploads a level read by the reading thread in its shared context.
+  void UploadReadLevel(const LevelRequest& request, LevelData* level_data) noexcept;
+  void SetResidentLevel(StreamedTexture* texture, std::uint32_t level) const noexcept;
+  [[nodiscard]] std::size_t texture_memory_size() const noexcept;
+};
+
+// =============================================
+//            Multithreading Jobs.
+// =============================================
+
+/*
+* @brief CookedMipTailLoadingJob reads the mip tail of a cooked texture.
+* A max_level_size of 0 only reads the header, the level index and the smallest
+* level, for the textures made resident when they are first visible.
+*/
+class CookedMipTailLoadingJob final : public Job {
+ public:
+  CookedMipTailLoadingJob() noexcept = default;
+  CookedMipTailLoadingJob(std::string cooked_path, FileBuffer* cooked_buffer,
+                          std::uint32_t max_level_size = TextureStreamer::kMipTailSize) noexcept;
+  CookedMipTailLoadingJob(CookedMipTailLoadingJob&& other) noexcept = default;
+  CookedMipTailLoadingJob& operator=(CookedMipTailLoadingJob&& other) noexcept = default;
+  CookedMipTailLoadingJob(const CookedMipTailLoadingJob& other) noexcept = delete;
+  CookedMipTailLoadingJob& operator=(const CookedMipTailLoadingJob& other) noexcept = delete;
+  ~CookedMipTailLoadingJob() noexcept override = default;
+
+  void Work() noexcept override;
+
+ private:
+  std::string cooked_path_{};
+  // Shared with the streamed texture creation job.
+  FileBuffer* cooked_buffer_ = nullptr;
+  std::uint32_t max_level_size_ = TextureStreamer::kMipTailSize;
+};
@@ -37,6 +37,12 @@ class VertexAttribute {
         return sizeof(GLfloat);
       case GL_INT:
         return sizeof(GLint);
+      case GL_HALF_FLOAT:
+        return sizeof(GLhalf);
+      case GL_SHORT:
+        return sizeof(GLshort);
+      case GL_BYTE:
+        return sizeof(GLbyte);
       default:
         LOG_ERROR("Incorrect vertex attribute type.");
     }
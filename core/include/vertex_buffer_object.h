@@ -1,6 +1,7 @@
 #pragma once
 
 #include "error.h"
+#include "gpu_memory.h"
 
 #include "GL/glew.h"
 
@@ -68,6 +69,8 @@ inline void VertexBufferObject<T>::SetData(const T* vertex_data,
                                            GLenum usage) noexcept {
   glBufferData(GL_ARRAY_BUFFER, sizeof(T) * size,
                vertex_data, usage);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, id_, GpuMemoryCategory::kBuffer,
+                                 sizeof(T) * size);
 }
 
 template <typename T>
@@ -84,6 +87,7 @@ inline void VertexBufferObject<T>::UnBind() const noexcept {
 
 template <typename T>
 inline void VertexBufferObject<T>::Destroy() noexcept {
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, id_);
   glDeleteBuffers(1, &id_);
   id_ = 0;
 }
@@ -0,0 +1,359 @@
+#pragma once
+
+#include "cooked_texture.h"
+#include "frame_buffer_object.h"
+#include "job_system.h"
+#include "pipeline.h"
+
+#include <GL/glew.h>
+#include <glm/vec2.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+* @brief A virtual texture (".vtex" file) stores the levels of a cooked texture
+* cut in pages of kVirtualPageSize x kVirtualPageSize texels. The outer
+* kVirtualPageBorder texels of a page are copied from its neighbours (wrapped or
+* clamped like the texture), so that the pages are filtered without seams in
+* the physical cache. Every page has the same byte size, a page is then read
+* with one seek.
+*
+* Layout: [VirtualTextureHeader][pages of level 0]...[pages of the last level].
+* The pages of a level are stored row by row. Only the levels up to the first
+* one which fits in a single page, the tail level, are paged.
+* The pages are copied from the cooked levels, the block compressed textures
+* are not encoded again.
+*/
+inline constexpr std::uint32_t kVirtualPageSize = 128;
+inline constexpr std::uint32_t kVirtualPageBorder = 4;
+inline constexpr std::uint32_t kVirtualPageContentSize =
+    kVirtualPageSize - 2 * kVirtualPageBorder;
+
+enum VirtualTextureFlags : std::uint32_t {
+  kVirtualTextureCompressed = 1 << 0,
+  kVirtualTextureRepeat = 1 << 1,
+};
+
+struct VirtualTextureHeader {
+  std::array<char, 8> identifier{};
+  std::uint32_t version = 0;
+  std::uint32_t internal_format = 0;  // Sized OpenGL internal format.
+  std::uint32_t format = 0;           // OpenGL pixel format of the pages.
+  std::uint32_t type = 0;             // OpenGL pixel type of the pages.
+  std::uint32_t flags = 0;
+  std::uint32_t width = 0;            // Of the level 0.
+  std::uint32_t height = 0;
+  std::uint32_t level_count = 0;      // Paged levels, the last one is the tail.
+  std::uint32_t page_byte_size = 0;
+  std::uint32_t page_count = 0;
+  std::uint64_t source_hash = 0;      // HashFileIdentity of the source files.
+};
+
+static constexpr std::array<char, 8> kVirtualTextureIdentifier = {
+    'V', 'T', 'E', 'X', ' ', '1', '\r', '\n'};
+static constexpr std::uint32_t kVirtualTextureVersion = 1;
+
+/*
+* @brief Returns the path of the virtual texture of a source image file.
+*/
+[[nodiscard]] std::string VirtualTexturePath(std::string_view source_path);
+
+/*
+* @brief Checks that the virtual texture exists and was tiled from a cooked
+* texture of the same sources.
+*/
+[[nodiscard]] bool IsVirtualTextureUpToDate(std::string_view vtex_path,
+                                            std::uint64_t source_hash) noexcept;
+
+/*
+* @brief Cuts the levels of a whole cooked texture in pages.
+* @param wrapping_param GL_REPEAT or GL_CLAMP_TO_EDGE, the border texels of the
+* pages on the edges of the levels are taken accordingly.
+* @return false if a level of the cooked texture is not in memory.
+*/
+[[nodiscard]] bool TileVirtualTexture(const CookedTexture& cooked_texture,
+                                      GLint wrapping_param,
+                                      std::vector<unsigned char>* vtex_data) noexcept;
+
+[[nodiscard]] bool ReadVirtualTextureHeader(std::string_view vtex_path,
+                                            VirtualTextureHeader* header) noexcept;
+
+/*
+* @brief Number of pages of a level along x and y, the level 0 being the finest.
+*/
+[[nodiscard]] glm::uvec2 CalculateVirtualPageCount(const VirtualTextureHeader& header,
+                                                   std::uint32_t level) noexcept;
+
+/*
+* @brief VirtualTextureSystem samples the virtual textures through physical
+* caches: one GL_TEXTURE_2D per internal format holding the resident pages,
+* whose size is derived from the resolution of the screen and not from the
+* size of the textures. Each virtual texture has an RGBA8 indirection texture,
+* with one texel per page and one level per paged level, giving the position in
+* the cache of the page, or of its finest resident ancestor, and its level.
+*
+* The pages to load are found with a feedback pass: the objects are drawn at a
+* fraction of the resolution, writing their material, texture coordinates and
+* mip level. The feedback is read back asynchronously, a few frames later, and
+* the missing pages are loaded by worker threads, the coarsest first. The pages
+* which are not used anymore are replaced in the least recently used order, the
+* tail page of every texture stays resident so that any texel can be sampled.
+*/
+class VirtualTextureSystem {
+ public:
+  static constexpr std::int32_t kNoVirtualTexture = -1;
+  // The feedback is rendered at 1 / kFeedbackScale of the screen resolution.
+  static constexpr std::uint32_t kFeedbackScale = 8;
+  static constexpr int kDefaultWorkerCount = 2;
+
+  VirtualTextureSystem() noexcept = default;
+  VirtualTextureSystem(VirtualTextureSystem&& other) noexcept = delete;
+  VirtualTextureSystem& operator=(VirtualTextureSystem&& other) noexcept = delete;
+  VirtualTextureSystem(const VirtualTextureSystem& other) noexcept = delete;
+  VirtualTextureSystem& operator=(const VirtualTextureSystem& other) noexcept = delete;
+  ~VirtualTextureSystem() noexcept;
+
+  /*
+  * @brief Sizes the physical caches for the screen and starts the page loading
+  * threads, the GL objects are created later.
+  */
+  void Begin(glm::uvec2 screen_size, int worker_count = kDefaultWorkerCount) noexcept;
+  void End() noexcept;
+
+  /*
+  * @brief Creates the indirection texture of a virtual texture and uploads its
+  * tail page, it can be called with a shared GL context.
+  * @return The id of the virtual texture, kNoVirtualTexture on failure.
+  */
+  [[nodiscard]] std::int32_t AddTexture(std::string vtex_path) noexcept;
+
+  /*
+  * @brief Virtual textures of the maps of a material, for the feedback.
+  */
+  void SetMaterialTextures(std::uint32_t material_idx,
+                           const std::array<std::int32_t, 4>& textures) noexcept;
+
+  /*
+  * @brief Creates the feedback frame buffer and its readback buffers, on the
+  * main context since frame buffers are not shared.
+  */
+  void CreateFeedbackBuffer(glm::uvec2 screen_size) noexcept;
+  void Resize(glm::uvec2 screen_size) noexcept;
+
+  /*
+  * @brief Binds and clears the feedback frame buffer, the objects using the
+  * virtual textures are then drawn with the feedback pipeline.
+  */
+  void BeginFeedbackPass(const Pipeline& feedback_pipeline) noexcept;
+  /*
+  * @brief Starts the readback of the feedback, the viewport and the frame
+  * buffer are left to the caller.
+  */
+  void EndFeedbackPass() noexcept;
+
+  /*
+  * @brief Binds the physical cache and the indirection of the virtual texture
+  * on the units map and kIndirectionFirstUnit + map, and sets its parameters.
+  */
+  void Bind(std::int32_t texture_id, std::size_t map, const Pipeline& pipeline) noexcept;
+
+  /*
+  * @brief Reads the oldest completed feedback, requests the missing pages,
+  * uploads the loaded ones within the frame budget and updates the
+  * indirection textures which changed.
+  */
+  void Update() noexcept;
+
+  [[nodiscard]] std::size_t texture_count() const noexcept { return textures_.size(); }
+  [[nodiscard]] std::size_t resident_page_count() const noexcept;
+  [[nodiscard]] std::size_t page_capacity() const noexcept;
+  [[nodiscard]] std::size_t pending_page_count() const noexcept {
+    return loading_pages_.size();
+  }
+  [[nodiscard]] std::size_t loaded_page_count() const noexcept {
+    return loaded_page_count_;
+  }
+  [[nodiscard]] std::uint32_t cache_page_count_per_side() const noexcept {
+    return cache_page_count_per_side_;
+  }
+
+  static constexpr GLenum kIndirectionFirstUnit = 4;
+
+ private:
+  /*
+  * @brief VirtualPageLoadingJob reads one page of a virtual texture from the disk.
+  */
+  class PageLoadingJob final : public Job {
+   public:
+    PageLoadingJob() noexcept = default;
+    PageLoadingJob(std::string_view vtex_path, std::int32_t texture_id,
+                   std::uint32_t page_idx, std::uint64_t page_offset,
+                   std::uint32_t page_byte_size) noexcept;
+    PageLoadingJob(PageLoadingJob&& other) noexcept = default;
+    PageLoadingJob& operator=(PageLoadingJob&& other) noexcept = default;
+    PageLoadingJob(const PageLoadingJob& other) noexcept = delete;
+    PageLoadingJob& operator=(const PageLoadingJob& other) noexcept = delete;
+    ~PageLoadingJob() noexcept override = default;
+
+    void Work() noexcept override;
+
+    [[nodiscard]] std::int32_t texture_id() const noexcept { return texture_id_; }
+    [[nodiscard]] std::uint32_t page_idx() const noexcept { return page_idx_; }
+    [[nodiscard]] bool is_loaded() const noexcept { return is_loaded_; }
+    [[nodiscard]] const unsigned char* data() const noexcept { return data_.data(); }
+
+   private:
+    std::string vtex_path_{};
+    std::int32_t texture_id_ = kNoVirtualTexture;
+    std::uint32_t page_idx_ = 0;
+    std::uint64_t page_offset_ = 0;
+    std::vector<unsigned char> data_{};
+    bool is_loaded_ = false;
+  };
+
+  enum class PageState : std::uint8_t {
+    kNotResident = 0,
+    kLoading,
+    kResident,
+  };
+
+  struct PhysicalCache {
+    struct Slot {
+      std::int32_t texture_id = kNoVirtualTexture;
+      std::uint32_t page_idx = 0;
+      std::uint64_t last_used_frame = 0;
+      bool is_pinned = false;
+    };
+
+    GLuint id = 0;
+    GLenum internal_format = 0;
+    std::vector<Slot> slots{};
+    std::size_t used_slot_count = 0;
+  };
+
+  struct VirtualTexture {
+    std::string vtex_path{};
+    VirtualTextureHeader header{};
+    std::size_t cache_idx = 0;
+    GLuint indirection_id = 0;
+    // Size of the level 0 of the indirection, a power of two per axis so that
+    // the parent of a page is always at the half of its coordinates.
+    glm::uvec2 indirection_size{};
+    // First page of each paged level in the file.
+    std::vector<std::uint32_t> level_first_pages{};
+    std::vector<PageState> page_states{};
+    // Slot in the physical cache of the resident pages.
+    std::vector<std::uint32_t> page_slots{};
+    // Frame of the last feedback using the page.
+    std::vector<std::uint64_t> page_used_frames{};
+    bool is_indirection_dirty = false;
+  };
+
+  struct PageRequest {
+    std::int32_t texture_id = kNoVirtualTexture;
+    std::uint32_t page_idx = 0;
+    std::uint32_t level = 0;
+  };
+
+  struct FeedbackReadback {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+  };
+
+  // Pages loaded at most per frame, each one is 16 KB for BC7.
+  static constexpr std::size_t kMaxUploadsPerFrame = 16;
+  static constexpr std::size_t kMaxPendingPages = 64;
+  // Screen pixels per resident texel of the caches, with the overdraw, the
+  // border and the coarser levels of the visible pages.
+  static constexpr float kCacheOversizeFactor = 4.f;
+  static constexpr std::uint32_t kMinCachePageCountPerSide = 8;
+  // The indirection stores the position of the pages in 8 bits.
+  static constexpr std::uint32_t kMaxCachePageCountPerSide = 64;
+  static constexpr std::size_t kFeedbackReadbackCount = 3;
+  static constexpr std::uint32_t kEmptyFeedback = 0xFFFFFFFF;
+
+  std::vector<VirtualTexture> textures_{};
+  std::vector<PhysicalCache> caches_{};
+  std::vector<std::array<std::int32_t, 4>> material_textures_{};
+  std::uint32_t cache_page_count_per_side_ = kMinCachePageCountPerSide;
+  std::uint64_t frame_ = 0;
+  // Frame of the last feedback read.
+  std::uint64_t feedback_frame_ = 0;
+  std::size_t loaded_page_count_ = 0;
+
+  FrameBufferObject feedback_fbo_{};
+  glm::uvec2 feedback_size_{};
+  std::array<FeedbackReadback, kFeedbackReadbackCount> readbacks_{};
+  std::size_t next_readback_ = 0;
+  std::vector<std::uint32_t> feedback_{};
+  // Pages used by the last feedback, with their ancestors.
+  std::vector<PageRequest> requested_pages_{};
+
+  std::vector<std::unique_ptr<PageLoadingJob>> loading_pages_{};
+
+  std::vector<std::thread> workers_{};
+  std::mutex mutex_{};
+  std::condition_variable jobs_condition_{};
+  std::queue<Job*> jobs_{};
+  bool is_running_ = false;
+
+  void LoopOverJobs() noexcept;
+  std::size_t FindCache(GLenum internal_format) noexcept;
+  /*
+  * @brief Finds a free slot or the least recently used one not used this frame.
+  * @return false if every slot is pinned or used this frame.
+  */
+  bool AllocateSlot(PhysicalCache* cache, std::uint32_t* slot_idx) noexcept;
+  void UploadPage(const VirtualTexture& texture, const PhysicalCache& cache,
+                  std::uint32_t slot_idx, const unsigned char* data) const noexcept;
+  [[nodiscard]] bool MakePageResident(std::int32_t texture_id, std::uint32_t page_idx,
+                                      const unsigned char* data, bool is_pinned) noexcept;
+  void ReadFeedback() noexcept;
+  // Marks the page and its ancestors as used by the feedback.
+  void RequestPage(std::int32_t texture_id, std::uint32_t level, glm::uvec2 page) noexcept;
+  void RequestPages() noexcept;
+  void UploadLoadedPages() noexcept;
+  void UpdateIndirection(VirtualTexture* texture) const noexcept;
+  [[nodiscard]] std::uint32_t PageIndex(const VirtualTexture& texture,
+                                        std::uint32_t level, glm::uvec2 page) const noexcept;
+};
+
+// =============================================
+//            Multithreading Jobs.
+// =============================================
+
+/*
+* @brief VirtualTextureTilingJob cuts a cooked texture in pages and writes the
+* virtual texture to the disk. The cooked file is read again when the cooked
+* buffer only holds its mip tail.
+*/
+class VirtualTextureTilingJob final : public Job {
+ public:
+  VirtualTextureTilingJob() noexcept = default;
+  VirtualTextureTilingJob(const FileBuffer* cooked_buffer, std::string cooked_path,
+                          GLint wrapping_param, std::string vtex_path) noexcept;
+  VirtualTextureTilingJob(VirtualTextureTilingJob&& other) noexcept = default;
+  VirtualTextureTilingJob& operator=(VirtualTextureTilingJob&& other) noexcept = default;
+  VirtualTextureTilingJob(const VirtualTextureTilingJob& other) noexcept = delete;
+  VirtualTextureTilingJob& operator=(const VirtualTextureTilingJob& other) noexcept = delete;
+  ~VirtualTextureTilingJob() noexcept override = default;
+
+  void Work() noexcept override;
+
+ private:
+  // Shared with the cooking or the mip tail loading job, nullptr to read the
+  // cooked file.
+  const FileBuffer* cooked_buffer_ = nullptr;
+  std::string cooked_path_{};
+  GLint wrapping_param_ = GL_REPEAT;
+  std::string vtex_path_{};
+};
@@ -0,0 +1,1100 @@
+#include "block_compression.h"
+#include "job_system.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BLOCK_COMPRESSION_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCK_COMPRESSION_SSE2
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr int kBlockTexelCount = kBlockDimension * kBlockDimension;
+// Number of block rows encoded by one job of the parallel for.
+constexpr std::size_t kBlockRowsPerJob = 8;
+
+// Texels of a block stored channel by channel so that 8 texels fit in
+// an AVX register.
+struct alignas(32) Block {
+  float channels[4][kBlockTexelCount];
+};
+
+using Color = std::array<float, 4>;
+
+std::array<unsigned char, 4> ExpandTexel(const unsigned char* texel,
+                                         int channels) noexcept {
+  switch (channels) {
+    case 1:
+      return {texel[0], texel[0], texel[0], 255};
+    case 2:
+      return {texel[0], texel[1], 0, 255};
+    case 3:
+      return {texel[0], texel[1], texel[2], 255};
+    default:
+      return {texel[0], texel[1], texel[2], texel[3]};
+  }
+}
+
+// Texels outside of the image are clamped to the border.
+void FetchBlock(const unsigned char* pixels, int width, int height, int channels,
+                int block_x, int block_y, Block* block) noexcept {
+  for (int y = 0; y < kBlockDimension; y++) {
+    const int py = std::min(block_y * kBlockDimension + y, height - 1);
+
+    for (int x = 0; x < kBlockDimension; x++) {
+      const int px = std::min(block_x * kBlockDimension + x, width - 1);
+      const auto texel = ExpandTexel(
+          pixels + (static_cast<std::size_t>(py) * width + px) * channels, channels);
+
+      for (int c = 0; c < 4; c++) {
+        block->channels[c][y * kBlockDimension + x] = texel[c];
+      }
+    }
+  }
+}
+
+/*
+* @brief Finds the closest palette entry of every texel of the block.
+* @return The sum of the squared errors.
+*/
+float SelectIndices(const Block& block, int first_channel, int channel_count,
+                    const Color* palette, int palette_size,
+                    std::uint8_t* indices) noexcept {
+  float error = 0.f;
+
+#if defined(BLOCK_COMPRESSION_AVX2)
+  for (int i = 0; i < kBlockTexelCount; i += 8) {
+    __m256 best_error = _mm256_set1_ps(std::numeric_limits<float>::max());
+    __m256i best_index = _mm256_setzero_si256();
+
+    for (int p = 0; p < palette_size; p++) {
+      __m256 distance = _mm256_setzero_ps();
+      for (int c = 0; c < channel_count; c++) {
+        const __m256 texels = _mm256_load_ps(&block.channels[first_channel + c][i]);
+        const __m256 delta = _mm256_sub_ps(texels, _mm256_set1_ps(palette[p][c]));
+        distance = _mm256_add_ps(distance, _mm256_mul_ps(delta, delta));
+      }
+
+      const __m256 closer = _mm256_cmp_ps(distance, best_error, _CMP_LT_OQ);
+      best_error = _mm256_blendv_ps(best_error, distance, closer);
+      best_index = _mm256_blendv_epi8(best_index, _mm256_set1_epi32(p),
+                                      _mm256_castps_si256(closer));
+    }
+
+    alignas(32) std::int32_t best_indices[8];
+    alignas(32) float best_errors[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(best_indices), best_index);
+    _mm256_store_ps(best_errors, best_error);
+    for (int j = 0; j < 8; j++) {
+      indices[i + j] = static_cast<std::uint8_t>(best_indices[j]);
+      error += best_errors[j];
+    }
+  }
+#elif defined(BLOCK_COMPRESSION_SSE2)
+  for (int i = 0; i < kBlockTexelCount; i += 4) {
+    __m128 best_error = _mm_set1_ps(std::numeric_limits<float>::max());
+    __m128i best_index = _mm_setzero_si128();
+
+    for (int p = 0; p < palette_size; p++) {
+      __m128 distance = _mm_setzero_ps();
+      for (int c = 0; c < channel_count; c++) {
+        const __m128 texels = _mm_load_ps(&block.channels[first_channel + c][i]);
+        const __m128 delta = _mm_sub_ps(texels, _mm_set1_ps(palette[p][c]));
+        distance = _mm_add_ps(distance, _mm_mul_ps(delta, delta));
+      }
+
+      const __m128 closer = _mm_cmplt_ps(distance, best_error);
+      const __m128i closer_mask = _mm_castps_si128(closer);
+      best_error = _mm_or_ps(_mm_and_ps(closer, distance),
+                             _mm_andnot_ps(closer, best_error));
+      best_index = _mm_or_si128(_mm_and_si128(closer_mask, _mm_set1_epi32(p)),
+                                _mm_andnot_si128(closer_mask, best_index));
+    }
+
+    alignas(16) std::int32_t best_indices[4];
+    alignas(16) float best_errors[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(best_indices), best_index);
+    _mm_store_ps(best_errors, best_error);
+    for (int j = 0; j < 4; j++) {
+      indices[i + j] = static_cast<std::uint8_t>(best_indices[j]);
+      error += best_errors[j];
+    }
+  }
+#else
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    float best_error = std::numeric_limits<float>::max();
+    for (int p = 0; p < palette_size; p++) {
+      float distance = 0.f;
+      for (int c = 0; c < channel_count; c++) {
+        const float delta = block.channels[first_channel + c][i] - palette[p][c];
+        distance += delta * delta;
+      }
+      if (distance < best_error) {
+        best_error = distance;
+        indices[i] = static_cast<std::uint8_t>(p);
+      }
+    }
+    error += best_error;
+  }
+#endif
+
+  return error;
+}
+
+Color ClampColor(Color color, float max_value) noexcept {
+  for (auto& c : color) {
+    c = std::clamp(c, 0.f, max_value);
+  }
+  return color;
+}
+
+/*
+* @brief Endpoints of the segment fitting the texels the best, found with the
+* principal axis of their covariance matrix.
+*/
+void ComputeEndpoints(const Block& block, int channel_count, Color* end0,
+                      Color* end1, float max_value = 255.f) noexcept {
+  Color mean{};
+  for (int c = 0; c < channel_count; c++) {
+    for (int i = 0; i < kBlockTexelCount; i++) {
+      mean[c] += block.channels[c][i];
+    }
+    mean[c] /= kBlockTexelCount;
+  }
+
+  float covariance[4][4]{};
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    for (int a = 0; a < channel_count; a++) {
+      const float da = block.channels[a][i] - mean[a];
+      for (int b = a; b < channel_count; b++) {
+        covariance[a][b] += da * (block.channels[b][i] - mean[b]);
+      }
+    }
+  }
+
+  int max_variance_channel = 0;
+  for (int a = 0; a < channel_count; a++) {
+    for (int b = 0; b < a; b++) {
+      covariance[a][b] = covariance[b][a];
+    }
+    if (covariance[a][a] > covariance[max_variance_channel][max_variance_channel]) {
+      max_variance_channel = a;
+    }
+  }
+
+  // Power iteration starting from the column of the channel with the most
+  // variance, which can not be orthogonal to the principal axis.
+  Color axis{};
+  for (int c = 0; c < channel_count; c++) {
+    axis[c] = covariance[c][max_variance_channel];
+  }
+
+  constexpr int kPowerIterationCount = 8;
+  for (int iteration = 0; iteration < kPowerIterationCount; iteration++) {
+    Color next_axis{};
+    float max_component = 0.f;
+    for (int a = 0; a < channel_count; a++) {
+      for (int b = 0; b < channel_count; b++) {
+        next_axis[a] += covariance[a][b] * axis[b];
+      }
+      max_component = std::max(max_component, std::abs(next_axis[a]));
+    }
+
+    if (max_component < std::numeric_limits<float>::epsilon()) {
+      break;
+    }
+    for (int c = 0; c < channel_count; c++) {
+      axis[c] = next_axis[c] / max_component;
+    }
+  }
+
+  float length = 0.f;
+  for (int c = 0; c < channel_count; c++) {
+    length += axis[c] * axis[c];
+  }
+
+  if (length < std::numeric_limits<float>::epsilon()) {
+    *end0 = mean;
+    *end1 = mean;
+    return;
+  }
+
+  length = std::sqrt(length);
+  for (int c = 0; c < channel_count; c++) {
+    axis[c] /= length;
+  }
+
+  float min_t = std::numeric_limits<float>::max();
+  float max_t = std::numeric_limits<float>::lowest();
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    float t = 0.f;
+    for (int c = 0; c < channel_count; c++) {
+      t += (block.channels[c][i] - mean[c]) * axis[c];
+    }
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+
+  for (int c = 0; c < channel_count; c++) {
+    (*end0)[c] = mean[c] + axis[c] * min_t;
+    (*end1)[c] = mean[c] + axis[c] * max_t;
+  }
+  *end0 = ClampColor(*end0, max_value);
+  *end1 = ClampColor(*end1, max_value);
+}
+
+/*
+* @brief Least squares endpoints for the selected indices.
+* @param weights The interpolation weight of end1 for each palette index.
+* @return false if the indices do not constrain both endpoints.
+*/
+bool RefitEndpoints(const Block& block, int channel_count,
+                    const std::uint8_t* indices, const float* weights,
+                    Color* end0, Color* end1, float max_value = 255.f) noexcept {
+  float aa = 0.f, ab = 0.f, bb = 0.f;
+  Color ax{}, bx{};
+
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    const float b = weights[indices[i]];
+    const float a = 1.f - b;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c < channel_count; c++) {
+      ax[c] += a * block.channels[c][i];
+      bx[c] += b * block.channels[c][i];
+    }
+  }
+
+  const float determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) < 1e-6f) {
+    return false;
+  }
+
+  for (int c = 0; c < channel_count; c++) {
+    (*end0)[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+    (*end1)[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+  }
+  *end0 = ClampColor(*end0, max_value);
+  *end1 = ClampColor(*end1, max_value);
+
+  return true;
+}
+
+// =============================================
+//                    BC1.
+// =============================================
+
+std::uint16_t PackRgb565(const Color& color) noexcept {
+  const auto r = static_cast<std::uint16_t>(std::lround(color[0] * 31.f / 255.f));
+  const auto g = static_cast<std::uint16_t>(std::lround(color[1] * 63.f / 255.f));
+  const auto b = static_cast<std::uint16_t>(std::lround(color[2] * 31.f / 255.f));
+  return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+}
+
+std::array<int, 3> UnpackRgb565(std::uint16_t color) noexcept {
+  const int r = (color >> 11) & 31;
+  const int g = (color >> 5) & 63;
+  const int b = color & 31;
+  return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+}
+
+// The palette is {color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1}.
+constexpr float kBc1Weights[4] = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f};
+
+float EncodeBc1Endpoints(const Block& block, const Color& end0, const Color& end1,
+                         std::uint16_t* color0, std::uint16_t* color1,
+                         std::uint8_t* indices) noexcept {
+  *color0 = PackRgb565(end0);
+  *color1 = PackRgb565(end1);
+  // color0 > color1 selects the 4 colors mode.
+  if (*color0 < *color1) {
+    std::swap(*color0, *color1);
+  }
+
+  const auto c0 = UnpackRgb565(*color0);
+  const auto c1 = UnpackRgb565(*color1);
+
+  std::array<Color, 4> palette{};
+  for (int p = 0; p < 4; p++) {
+    for (int c = 0; c < 3; c++) {
+      palette[p][c] = c0[c] + (c1[c] - c0[c]) * kBc1Weights[p];
+    }
+  }
+
+  const int palette_size = *color0 == *color1 ? 1 : 4;
+  return SelectIndices(block, 0, 3, palette.data(), palette_size, indices);
+}
+
+void EncodeBc1Block(const Block& block, unsigned char* dst) noexcept {
+  Color end0{}, end1{};
+  ComputeEndpoints(block, 3, &end0, &end1);
+
+  std::uint16_t color0 = 0, color1 = 0;
+  std::uint8_t indices[kBlockTexelCount]{};
+  const float error = EncodeBc1Endpoints(block, end0, end1, &color0, &color1, indices);
+
+  if (color0 != color1) {
+    const auto c0 = UnpackRgb565(color0);
+    const auto c1 = UnpackRgb565(color1);
+    Color refit0 = {static_cast<float>(c0[0]), static_cast<float>(c0[1]),
+                    static_cast<float>(c0[2]), 0.f};
+    Color refit1 = {static_cast<float>(c1[0]), static_cast<float>(c1[1]),
+                    static_cast<float>(c1[2]), 0.f};
+
+    if (RefitEndpoints(block, 3, indices, kBc1Weights, &refit0, &refit1)) {
+      std::uint16_t refit_color0 = 0, refit_color1 = 0;
+      std::uint8_t refit_indices[kBlockTexelCount]{};
+      const float refit_error = EncodeBc1Endpoints(block, refit0, refit1, &refit_color0,
+                                                   &refit_color1, refit_indices);
+      if (refit_error < error) {
+        color0 = refit_color0;
+        color1 = refit_color1;
+        std::copy_n(refit_indices, kBlockTexelCount, indices);
+      }
+    }
+  }
+
+  std::uint32_t index_bits = 0;
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    index_bits |= static_cast<std::uint32_t>(indices[i]) << (2 * i);
+  }
+
+  dst[0] = static_cast<unsigned char>(color0 & 0xFF);
+  dst[1] = static_cast<unsigned char>(color0 >> 8);
+  dst[2] = static_cast<unsigned char>(color1 & 0xFF);
+  dst[3] = static_cast<unsigned char>(color1 >> 8);
+  for (int i = 0; i < 4; i++) {
+    dst[4 + i] = static_cast<unsigned char>(index_bits >> (8 * i));
+  }
+}
+
+void DecodeBc1Block(const unsigned char* src, unsigned char texels[16][4]) noexcept {
+  const auto color0 = static_cast<std::uint16_t>(src[0] | (src[1] << 8));
+  const auto color1 = static_cast<std::uint16_t>(src[2] | (src[3] << 8));
+  const auto c0 = UnpackRgb565(color0);
+  const auto c1 = UnpackRgb565(color1);
+
+  std::array<std::array<int, 4>, 4> palette{};
+  palette[0] = {c0[0], c0[1], c0[2], 255};
+  palette[1] = {c1[0], c1[1], c1[2], 255};
+  for (int c = 0; c < 3; c++) {
+    if (color0 > color1) {
+      palette[2][c] = (2 * c0[c] + c1[c]) / 3;
+      palette[3][c] = (c0[c] + 2 * c1[c]) / 3;
+    }
+    else {
+      palette[2][c] = (c0[c] + c1[c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+  palette[2][3] = 255;
+  palette[3][3] = color0 > color1 ? 255 : 0;
+
+  const std::uint32_t index_bits = src[4] | (src[5] << 8) | (src[6] << 16) |
+                                   (static_cast<std::uint32_t>(src[7]) << 24);
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    const auto& color = palette[(index_bits >> (2 * i)) & 3];
+    for (int c = 0; c < 4; c++) {
+      texels[i][c] = static_cast<unsigned char>(color[c]);
+    }
+  }
+}
+
+// =============================================
+//                    BC4.
+// =============================================
+
+void EncodeBc4Block(const Block& block, int channel, unsigned char* dst) noexcept {
+  const float* values = block.channels[channel];
+  const float min_value = *std::min_element(values, values + kBlockTexelCount);
+  const float max_value = *std::max_element(values, values + kBlockTexelCount);
+
+  // red0 > red1 selects the 8 values mode.
+  const auto red0 = static_cast<unsigned char>(max_value);
+  const auto red1 = static_cast<unsigned char>(min_value);
+
+  std::uint8_t indices[kBlockTexelCount]{};
+  if (red0 != red1) {
+    std::array<Color, 8> palette{};
+    palette[0][0] = red0;
+    palette[1][0] = red1;
+    for (int p = 2; p < 8; p++) {
+      palette[p][0] = ((8 - p) * red0 + (p - 1) * red1) / 7.f;
+    }
+    SelectIndices(block, channel, 1, palette.data(), 8, indices);
+  }
+
+  std::uint64_t index_bits = 0;
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    index_bits |= static_cast<std::uint64_t>(indices[i]) << (3 * i);
+  }
+
+  dst[0] = red0;
+  dst[1] = red1;
+  for (int i = 0; i < 6; i++) {
+    dst[2 + i] = static_cast<unsigned char>(index_bits >> (8 * i));
+  }
+}
+
+void DecodeBc4Block(const unsigned char* src, unsigned char texels[16][4],
+                    int channel) noexcept {
+  const int red0 = src[0];
+  const int red1 = src[1];
+
+  std::array<int, 8> palette{red0, red1};
+  if (red0 > red1) {
+    for (int p = 2; p < 8; p++) {
+      palette[p] = ((8 - p) * red0 + (p - 1) * red1 + 3) / 7;
+    }
+  }
+  else {
+    for (int p = 2; p < 6; p++) {
+      palette[p] = ((6 - p) * red0 + (p - 1) * red1 + 2) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  std::uint64_t index_bits = 0;
+  for (int i = 0; i < 6; i++) {
+    index_bits |= static_cast<std::uint64_t>(src[2 + i]) << (8 * i);
+  }
+
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    texels[i][channel] = static_cast<unsigned char>(palette[(index_bits >> (3 * i)) & 7]);
+  }
+}
+
+// =============================================
+//                BC7 mode 6.
+// =============================================
+
+// Mode 6: 1 subset, RGBA endpoints of 7 bits + 1 unique p-bit each, 4 bits indices.
+constexpr int kBc7Mode6Weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                      34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Bc7Endpoint {
+  std::array<int, 4> value{};  // 8 bits value: (quantized << 1) | p_bit.
+  int p_bit = 0;
+};
+
+Bc7Endpoint QuantizeBc7Endpoint(const Color& color) noexcept {
+  Bc7Endpoint best{};
+  float best_error = std::numeric_limits<float>::max();
+
+  for (int p_bit = 0; p_bit < 2; p_bit++) {
+    Bc7Endpoint endpoint{};
+    endpoint.p_bit = p_bit;
+    float error = 0.f;
+    for (int c = 0; c < 4; c++) {
+      const int quantized = std::clamp(
+          static_cast<int>(std::lround((color[c] - p_bit) / 2.f)), 0, 127);
+      endpoint.value[c] = (quantized << 1) | p_bit;
+      const float delta = endpoint.value[c] - color[c];
+      error += delta * delta;
+    }
+
+    if (error < best_error) {
+      best_error = error;
+      best = endpoint;
+    }
+  }
+
+  return best;
+}
+
+float EncodeBc7Endpoints(const Block& block, const Color& end0, const Color& end1,
+                         Bc7Endpoint* endpoint0, Bc7Endpoint* endpoint1,
+                         std::uint8_t* indices) noexcept {
+  *endpoint0 = QuantizeBc7Endpoint(end0);
+  *endpoint1 = QuantizeBc7Endpoint(end1);
+
+  std::array<Color, 16> palette{};
+  for (int p = 0; p < 16; p++) {
+    const int w = kBc7Mode6Weights[p];
+    for (int c = 0; c < 4; c++) {
+      palette[p][c] = static_cast<float>(
+          ((64 - w) * endpoint0->value[c] + w * endpoint1->value[c] + 32) >> 6);
+    }
+  }
+
+  return SelectIndices(block, 0, 4, palette.data(), 16, indices);
+}
+
+class BitWriter {
+ public:
+  explicit BitWriter(unsigned char* dst) noexcept : dst_(dst) {
+    std::fill_n(dst_, 16, 0);
+  }
+
+  void Write(std::uint32_t value, int bit_count) noexcept {
+    for (int i = 0; i < bit_count; i++, position_++) {
+      dst_[position_ >> 3] |= static_cast<unsigned char>(((value >> i) & 1)
+                                                         << (position_ & 7));
+    }
+  }
+
+ private:
+  unsigned char* dst_ = nullptr;
+  int position_ = 0;
+};
+
+class BitReader {
+ public:
+  explicit BitReader(const unsigned char* src) noexcept : src_(src) {}
+
+  std::uint32_t Read(int bit_count) noexcept {
+    std::uint32_t value = 0;
+    for (int i = 0; i < bit_count; i++, position_++) {
+      value |= static_cast<std::uint32_t>((src_[position_ >> 3] >> (position_ & 7)) & 1) << i;
+    }
+    return value;
+  }
+
+ private:
+  const unsigned char* src_ = nullptr;
+  int position_ = 0;
+};
+
+void EncodeBc7Block(const Block& block, unsigned char* dst) noexcept {
+  Color end0{}, end1{};
+  ComputeEndpoints(block, 4, &end0, &end1);
+
+  Bc7Endpoint endpoint0{}, endpoint1{};
+  std::uint8_t indices[kBlockTexelCount]{};
+  const float error = EncodeBc7Endpoints(block, end0, end1, &endpoint0, &endpoint1,
+                                         indices);
+
+  float weights[16];
+  for (int p = 0; p < 16; p++) {
+    weights[p] = kBc7Mode6Weights[p] / 64.f;
+  }
+
+  Color refit0{}, refit1{};
+  if (error > 0.f &&
+      RefitEndpoints(block, 4, indices, weights, &refit0, &refit1)) {
+    Bc7Endpoint refit_endpoint0{}, refit_endpoint1{};
+    std::uint8_t refit_indices[kBlockTexelCount]{};
+    const float refit_error = EncodeBc7Endpoints(block, refit0, refit1, &refit_endpoint0,
+                                                 &refit_endpoint1, refit_indices);
+    if (refit_error < error) {
+      endpoint0 = refit_endpoint0;
+      endpoint1 = refit_endpoint1;
+      std::copy_n(refit_indices, kBlockTexelCount, indices);
+    }
+  }
+
+  // The most significant bit of the first index is implicitly 0.
+  if (indices[0] & 8) {
+    std::swap(endpoint0, endpoint1);
+    for (auto& index : indices) {
+      index = static_cast<std::uint8_t>(15 - index);
+    }
+  }
+
+  BitWriter writer(dst);
+  writer.Write(1 << 6, 7);  // Mode 6.
+  for (int c = 0; c < 4; c++) {
+    writer.Write(endpoint0.value[c] >> 1, 7);
+    writer.Write(endpoint1.value[c] >> 1, 7);
+  }
+  writer.Write(endpoint0.p_bit, 1);
+  writer.Write(endpoint1.p_bit, 1);
+  writer.Write(indices[0], 3);
+  for (int i = 1; i < kBlockTexelCount; i++) {
+    writer.Write(indices[i], 4);
+  }
+}
+
+void DecodeBc7Block(const unsigned char* src, unsigned char texels[16][4]) noexcept {
+  BitReader reader(src);
+  if (reader.Read(7) != 1 << 6) {
+    for (int i = 0; i < kBlockTexelCount; i++) {
+      std::fill_n(texels[i], 4, static_cast<unsigned char>(0));
+    }
+    return;
+  }
+
+  std::array<int, 4> value0{}, value1{};
+  for (int c = 0; c < 4; c++) {
+    value0[c] = static_cast<int>(reader.Read(7)) << 1;
+    value1[c] = static_cast<int>(reader.Read(7)) << 1;
+  }
+  const int p_bit0 = static_cast<int>(reader.Read(1));
+  const int p_bit1 = static_cast<int>(reader.Read(1));
+
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    const int w = kBc7Mode6Weights[reader.Read(i == 0 ? 3 : 4)];
+    for (int c = 0; c < 4; c++) {
+      texels[i][c] = static_cast<unsigned char>(
+          ((64 - w) * (value0[c] | p_bit0) + w * (value1[c] | p_bit1) + 32) >> 6);
+    }
+  }
+}
+
+// =============================================
+//                BC6H mode 11.
+// =============================================
+
+// BC6H works on the bits of half floats, which are close to a logarithmic
+// encoding of the values, so the errors are measured on these bits.
+constexpr float kMaxHalfBits = 0x7BFF;  // Largest finite half float.
+
+std::uint16_t FloatToHalf(float value) noexcept {
+  std::uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(float));
+
+  const auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+  bits &= 0x7FFFFFFFu;
+
+  // Infinity or NaN.
+  if (bits >= 0x7F800000u) {
+    return sign | (bits > 0x7F800000u ? 0x7E00u : 0x7C00u);
+  }
+  // Rounds to infinity.
+  if (bits >= 0x477FF000u) {
+    return sign | 0x7C00u;
+  }
+  // Denormal half float.
+  if (bits < 0x38800000u) {
+    if (bits < 0x33000000u) {
+      return sign;
+    }
+    const std::uint32_t mantissa = (bits & 0x7FFFFFu) | 0x800000u;
+    const std::uint32_t shift = 126u - (bits >> 23);
+    std::uint32_t half = mantissa >> shift;
+    const std::uint32_t remainder = mantissa & ((1u << shift) - 1u);
+    const std::uint32_t halfway = 1u << (shift - 1u);
+    if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+      half++;
+    }
+    return static_cast<std::uint16_t>(sign | half);
+  }
+
+  // Rebias the exponent and round the mantissa to nearest even.
+  std::uint32_t half = bits - 0x38000000u;
+  half = (half + 0x0FFFu + ((half >> 13) & 1u)) >> 13;
+  return static_cast<std::uint16_t>(sign | half);
+}
+
+float HalfToFloat(std::uint16_t half) noexcept {
+  const std::uint32_t sign = static_cast<std::uint32_t>(half & 0x8000u) << 16;
+  std::uint32_t exponent = (half >> 10) & 0x1Fu;
+  std::uint32_t mantissa = half & 0x3FFu;
+
+  std::uint32_t bits = sign;
+  if (exponent == 0) {
+    if (mantissa != 0) {
+      exponent = 113;
+      while (!(mantissa & 0x400u)) {
+        mantissa <<= 1;
+        exponent--;
+      }
+      bits |= (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+    }
+  }
+  else if (exponent == 31) {
+    bits |= 0x7F800000u | (mantissa << 13);
+  }
+  else {
+    bits |= ((exponent + 112) << 23) | (mantissa << 13);
+  }
+
+  float value = 0.f;
+  std::memcpy(&value, &bits, sizeof(float));
+  return value;
+}
+
+float ToBc6hHalfBits(float value) noexcept {
+  // Unsigned format: negative values and NaNs become 0.
+  if (!(value > 0.f)) {
+    return 0.f;
+  }
+  return std::min(static_cast<float>(FloatToHalf(value)), kMaxHalfBits);
+}
+
+// Inverse of the unquantization of 10 bits endpoints.
+int QuantizeBc6hEndpoint(float half_bits) noexcept {
+  return std::clamp(static_cast<int>(std::lround((half_bits - 15.f) / 31.f)), 0, 1023);
+}
+
+int UnquantizeBc6hEndpoint(int quantized) noexcept {
+  if (quantized == 0) {
+    return 0;
+  }
+  if (quantized == 1023) {
+    return 0xFFFF;
+  }
+  return ((quantized << 16) + 0x8000) >> 10;
+}
+
+// Interpolated values are scaled by 31/64 to get the half float bits.
+int InterpolateBc6h(int end0, int end1, int weight) noexcept {
+  return ((((64 - weight) * end0 + weight * end1 + 32) >> 6) * 31) >> 6;
+}
+
+float EncodeBc6hEndpoints(const Block& block, const Color& end0, const Color& end1,
+                          std::array<int, 3>* quantized0,
+                          std::array<int, 3>* quantized1,
+                          std::uint8_t* indices) noexcept {
+  for (int c = 0; c < 3; c++) {
+    (*quantized0)[c] = QuantizeBc6hEndpoint(end0[c]);
+    (*quantized1)[c] = QuantizeBc6hEndpoint(end1[c]);
+  }
+
+  std::array<Color, 16> palette{};
+  for (int p = 0; p < 16; p++) {
+    for (int c = 0; c < 3; c++) {
+      palette[p][c] = static_cast<float>(InterpolateBc6h(
+          UnquantizeBc6hEndpoint((*quantized0)[c]),
+          UnquantizeBc6hEndpoint((*quantized1)[c]), kBc7Mode6Weights[p]));
+    }
+  }
+
+  return SelectIndices(block, 0, 3, palette.data(), 16, indices);
+}
+
+// Mode 11: 1 region, RGB endpoints of 10 bits without delta, 4 bits indices.
+void EncodeBc6hBlock(const Block& block, unsigned char* dst) noexcept {
+  Color end0{}, end1{};
+  ComputeEndpoints(block, 3, &end0, &end1, kMaxHalfBits);
+
+  std::array<int, 3> quantized0{}, quantized1{};
+  std::uint8_t indices[kBlockTexelCount]{};
+  const float error = EncodeBc6hEndpoints(block, end0, end1, &quantized0, &quantized1,
+                                          indices);
+
+  float weights[16];
+  for (int p = 0; p < 16; p++) {
+    weights[p] = kBc7Mode6Weights[p] / 64.f;
+  }
+
+  Color refit0{}, refit1{};
+  if (error > 0.f &&
+      RefitEndpoints(block, 3, indices, weights, &refit0, &refit1, kMaxHalfBits)) {
+    std::array<int, 3> refit_quantized0{}, refit_quantized1{};
+    std::uint8_t refit_indices[kBlockTexelCount]{};
+    const float refit_error = EncodeBc6hEndpoints(
+        block, refit0, refit1, &refit_quantized0, &refit_quantized1, refit_indices);
+    if (refit_error < error) {
+      quantized0 = refit_quantized0;
+      quantized1 = refit_quantized1;
+      std::copy_n(refit_indices, kBlockTexelCount, indices);
+    }
+  }
+
+  // The most significant bit of the first index is implicitly 0.
+  if (indices[0] & 8) {
+    std::swap(quantized0, quantized1);
+    for (auto& index : indices) {
+      index = static_cast<std::uint8_t>(15 - index);
+    }
+  }
+
+  BitWriter writer(dst);
+  writer.Write(0x03, 5);  // Mode 11.
+  for (int c = 0; c < 3; c++) {
+    writer.Write(quantized0[c], 10);
+  }
+  for (int c = 0; c < 3; c++) {
+    writer.Write(quantized1[c], 10);
+  }
+  writer.Write(indices[0], 3);
+  for (int i = 1; i < kBlockTexelCount; i++) {
+    writer.Write(indices[i], 4);
+  }
+}
+
+void DecodeBc6hBlock(const unsigned char* src, std::uint16_t texels[16][3]) noexcept {
+  BitReader reader(src);
+  if (reader.Read(5) != 0x03) {
+    for (int i = 0; i < kBlockTexelCount; i++) {
+      std::fill_n(texels[i], 3, static_cast<std::uint16_t>(0));
+    }
+    return;
+  }
+
+  std::array<int, 3> end0{}, end1{};
+  for (int c = 0; c < 3; c++) {
+    end0[c] = UnquantizeBc6hEndpoint(static_cast<int>(reader.Read(10)));
+  }
+  for (int c = 0; c < 3; c++) {
+    end1[c] = UnquantizeBc6hEndpoint(static_cast<int>(reader.Read(10)));
+  }
+
+  for (int i = 0; i < kBlockTexelCount; i++) {
+    const int weight = kBc7Mode6Weights[reader.Read(i == 0 ? 3 : 4)];
+    for (int c = 0; c < 3; c++) {
+      texels[i][c] = static_cast<std::uint16_t>(InterpolateBc6h(end0[c], end1[c], weight));
+    }
+  }
+}
+
+void EncodeBlock(BlockFormat format, const Block& block, unsigned char* dst) noexcept {
+  switch (format) {
+    case BlockFormat::kBc1:
+      EncodeBc1Block(block, dst);
+      break;
+    case BlockFormat::kBc4:
+      EncodeBc4Block(block, 0, dst);
+      break;
+    case BlockFormat::kBc5:
+      EncodeBc4Block(block, 0, dst);
+      EncodeBc4Block(block, 1, dst + 8);
+      break;
+    case BlockFormat::kBc7:
+      EncodeBc7Block(block, dst);
+      break;
+    case BlockFormat::kBc6h: {
+      // 8 bits images are encoded as half floats between 0 and 1.
+      Block half_block{};
+      for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < kBlockTexelCount; i++) {
+          half_block.channels[c][i] = ToBc6hHalfBits(block.channels[c][i] / 255.f);
+        }
+      }
+      EncodeBc6hBlock(half_block, dst);
+      break;
+    }
+  }
+}
+
+void DecodeBlock(BlockFormat format, const unsigned char* src,
+                 unsigned char texels[16][4]) noexcept {
+  switch (format) {
+    case BlockFormat::kBc1:
+      DecodeBc1Block(src, texels);
+      break;
+    case BlockFormat::kBc4:
+      for (int i = 0; i < kBlockTexelCount; i++) {
+        texels[i][1] = texels[i][2] = 0;
+        texels[i][3] = 255;
+      }
+      DecodeBc4Block(src, texels, 0);
+      break;
+    case BlockFormat::kBc5:
+      for (int i = 0; i < kBlockTexelCount; i++) {
+        texels[i][2] = 0;
+        texels[i][3] = 255;
+      }
+      DecodeBc4Block(src, texels, 0);
+      DecodeBc4Block(src + 8, texels, 1);
+      break;
+    case BlockFormat::kBc7:
+      DecodeBc7Block(src, texels);
+      break;
+    case BlockFormat::kBc6h: {
+      std::uint16_t half_texels[kBlockTexelCount][3]{};
+      DecodeBc6hBlock(src, half_texels);
+      for (int i = 0; i < kBlockTexelCount; i++) {
+        for (int c = 0; c < 3; c++) {
+          texels[i][c] = static_cast<unsigned char>(std::lround(
+              std::clamp(HalfToFloat(half_texels[i][c]), 0.f, 1.f) * 255.f));
+        }
+        texels[i][3] = 255;
+      }
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+std::size_t BlockByteSize(BlockFormat format) noexcept {
+  switch (format) {
+    case BlockFormat::kBc1:
+    case BlockFormat::kBc4:
+      return 8;
+    case BlockFormat::kBc5:
+    case BlockFormat::kBc6h:
+    case BlockFormat::kBc7:
+    default:
+      return 16;
+  }
+}
+
+std::size_t CompressedImageSize(BlockFormat format, int width, int height) noexcept {
+  const std::size_t blocks_x = (width + kBlockDimension - 1) / kBlockDimension;
+  const std::size_t blocks_y = (height + kBlockDimension - 1) / kBlockDimension;
+  return blocks_x * blocks_y * BlockByteSize(format);
+}
+
+int BlockFormatChannelCount(BlockFormat format) noexcept {
+  switch (format) {
+    case BlockFormat::kBc1:
+    case BlockFormat::kBc6h:
+      return 3;
+    case BlockFormat::kBc4:
+      return 1;
+    case BlockFormat::kBc5:
+      return 2;
+    case BlockFormat::kBc7:
+    default:
+      return 4;
+  }
+}
+
+const char* BlockFormatName(BlockFormat format) noexcept {
+  switch (format) {
+    case BlockFormat::kBc1:
+      return "BC1";
+    case BlockFormat::kBc4:
+      return "BC4";
+    case BlockFormat::kBc5:
+      return "BC5";
+    case BlockFormat::kBc6h:
+      return "BC6H";
+    case BlockFormat::kBc7:
+    default:
+      return "BC7";
+  }
+}
+
+void CompressImage(BlockFormat format, const unsigned char* pixels, int width,
+                   int height, int channels, unsigned char* dst) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const int blocks_x = (width + kBlockDimension - 1) / kBlockDimension;
+  const int blocks_y = (height + kBlockDimension - 1) / kBlockDimension;
+  const std::size_t block_size = BlockByteSize(format);
+
+  ParallelFor(blocks_y, kBlockRowsPerJob, [&](std::size_t begin, std::size_t end) {
+    Block block{};
+    for (auto block_y = static_cast<int>(begin); block_y < static_cast<int>(end); block_y++) {
+      for (int block_x = 0; block_x < blocks_x; block_x++) {
+        FetchBlock(pixels, width, height, channels, block_x, block_y, &block);
+        EncodeBlock(format, block,
+                    dst + (static_cast<std::size_t>(block_y) * blocks_x + block_x) * block_size);
+      }
+    }
+  });
+}
+
+void CompressImageBc6h(const float* pixels, int width, int height, int channels,
+                       unsigned char* dst) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const int blocks_x = (width + kBlockDimension - 1) / kBlockDimension;
+  const int blocks_y = (height + kBlockDimension - 1) / kBlockDimension;
+  const std::size_t block_size = BlockByteSize(BlockFormat::kBc6h);
+
+  ParallelFor(blocks_y, kBlockRowsPerJob, [&](std::size_t begin, std::size_t end) {
+    Block block{};
+    for (auto block_y = static_cast<int>(begin); block_y < static_cast<int>(end); block_y++) {
+      for (int block_x = 0; block_x < blocks_x; block_x++) {
+        for (int y = 0; y < kBlockDimension; y++) {
+          const int py = std::min(block_y * kBlockDimension + y, height - 1);
+          for (int x = 0; x < kBlockDimension; x++) {
+            const int px = std::min(block_x * kBlockDimension + x, width - 1);
+            const float* texel = pixels + (static_cast<std::size_t>(py) * width + px) * channels;
+            for (int c = 0; c < 3; c++) {
+              block.channels[c][y * kBlockDimension + x] =
+                  ToBc6hHalfBits(texel[std::min(c, channels - 1)]);
+            }
+          }
+        }
+
+        EncodeBc6hBlock(block,
+                        dst + (static_cast<std::size_t>(block_y) * blocks_x + block_x) * block_size);
+      }
+    }
+  });
+}
+
+void DecompressImageBc6h(const unsigned char* src, int width, int height,
+                         float* rgb) noexcept {
+  const int blocks_x = (width + kBlockDimension - 1) / kBlockDimension;
+  const int blocks_y = (height + kBlockDimension - 1) / kBlockDimension;
+  const std::size_t block_size = BlockByteSize(BlockFormat::kBc6h);
+
+  std::uint16_t texels[kBlockTexelCount][3]{};
+  for (int block_y = 0; block_y < blocks_y; block_y++) {
+    for (int block_x = 0; block_x < blocks_x; block_x++) {
+      DecodeBc6hBlock(src + (static_cast<std::size_t>(block_y) * blocks_x + block_x) * block_size,
+                      texels);
+
+      for (int y = 0; y < kBlockDimension; y++) {
+        const int py = block_y * kBlockDimension + y;
+        for (int x = 0; x < kBlockDimension; x++) {
+          const int px = block_x * kBlockDimension + x;
+          if (px >= width || py >= height) {
+            continue;
+          }
+          for (int c = 0; c < 3; c++) {
+            rgb[(static_cast<std::size_t>(py) * width + px) * 3 + c] =
+                HalfToFloat(texels[y * kBlockDimension + x][c]);
+          }
+        }
+      }
+    }
+  }
+}
+
+void DecompressImage(BlockFormat format, const unsigned char* src, int width,
+                     int height, unsigned char* rgba) noexcept {
+  const int blocks_x = (width + kBlockDimension - 1) / kBlockDimension;
+  const int blocks_y = (height + kBlockDimension - 1) / kBlockDimension;
+  const std::size_t block_size = BlockByteSize(format);
+
+  unsigned char texels[kBlockTexelCount][4]{};
+  for (int block_y = 0; block_y < blocks_y; block_y++) {
+    for (int block_x = 0; block_x < blocks_x; block_x++) {
+      DecodeBlock(format,
+                  src + (static_cast<std::size_t>(block_y) * blocks_x + block_x) * block_size,
+                  texels);
+
+      for (int y = 0; y < kBlockDimension; y++) {
+        const int py = block_y * kBlockDimension + y;
+        for (int x = 0; x < kBlockDimension; x++) {
+          const int px = block_x * kBlockDimension + x;
+          if (px >= width || py >= height) {
+            continue;
+          }
+          std::copy_n(texels[y * kBlockDimension + x], 4,
+                      rgba + (static_cast<std::size_t>(py) * width + px) * 4);
+        }
+      }
+    }
+  }
+}
+
+double CalculatePsnr(const unsigned char* pixels, int channels,
+                     const unsigned char* rgba, int width, int height,
+                     int compared_channels) noexcept {
+  const std::size_t texel_count = static_cast<std::size_t>(width) * height;
+
+  double squared_error_sum = 0.0;
+  for (std::size_t i = 0; i < texel_count; i++) {
+    const auto texel = ExpandTexel(pixels + i * channels, channels);
+    for (int c = 0; c < compared_channels; c++) {
+      const double delta = static_cast<double>(texel[c]) - rgba[i * 4 + c];
+      squared_error_sum += delta * delta;
+    }
+  }
+
+  const double mse = squared_error_sum / (static_cast<double>(texel_count) * compared_channels);
+  if (mse <= 0.0) {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
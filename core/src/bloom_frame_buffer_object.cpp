@@ -1,4 +1,5 @@
 #include "bloom_frame_buffer_object.h"
+#include "gpu_memory.h"
 
 bool BloomFrameBufferObject::Init(GLuint window_width, GLuint window_height,
                                   GLuint mip_chain_length) {
@@ -23,6 +24,10 @@ bool BloomFrameBufferObject::Init(GLuint window_width, GLuint window_height,
     // we are downscaling an HDR color buffer, so we need a float texture format.
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, mip_size.x, mip_size.y, 0, GL_RGB,
                  GL_FLOAT, nullptr);
+    GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, mip.texture,
+        GpuMemoryCategory::kRenderTarget,
+        CalculateTextureSize(GL_RGB16F, static_cast<GLsizei>(mip_size.x),
+                             static_cast<GLsizei>(mip_size.y)));
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -64,6 +69,7 @@ void BloomFrameBufferObject::Resize(glm::uvec2 new_size) noexcept {
 
 void BloomFrameBufferObject::Destroy() {
   for (int i = 0; i < mip_chain_.size(); i++) {
+    GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, mip_chain_[i].texture);
     glDeleteTextures(1, &mip_chain_[i].texture);
     mip_chain_[i].texture = 0;
   }
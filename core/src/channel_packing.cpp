@@ -0,0 +1,143 @@
+#include "channel_packing.h"
+#include "job_system.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+// Number of rows packed by one job of the parallel for.
+constexpr std::size_t kRowsPerJob = 32;
+
+// Bilinear fetch of the first channel, (u, v) in texels of the source.
+unsigned char SampleFirstChannel(const ImageBuffer& image, float u, float v) noexcept {
+  const auto* pixels = std::get<unsigned char*>(image.data);
+
+  const float x = std::clamp(u - 0.5f, 0.f, static_cast<float>(image.width - 1));
+  const float y = std::clamp(v - 0.5f, 0.f, static_cast<float>(image.height - 1));
+  const int x0 = static_cast<int>(x);
+  const int y0 = static_cast<int>(y);
+  const int x1 = std::min(x0 + 1, image.width - 1);
+  const int y1 = std::min(y0 + 1, image.height - 1);
+  const float tx = x - static_cast<float>(x0);
+  const float ty = y - static_cast<float>(y0);
+
+  const auto texel = [&](int tex_x, int tex_y) {
+    return static_cast<float>(
+        pixels[(static_cast<std::size_t>(tex_y) * image.width + tex_x) * image.channels]);
+  };
+
+  const float top = texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * tx;
+  const float bottom = texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * tx;
+  return static_cast<unsigned char>(top + (bottom - top) * ty + 0.5f);
+}
+
+bool IsValidSource(const ImageBuffer* source) noexcept {
+  return source != nullptr && std::holds_alternative<unsigned char*>(source->data) &&
+         std::get<unsigned char*>(source->data) != nullptr && source->width > 0 &&
+         source->height > 0;
+}
+
+}  // namespace
+
+bool PackChannels(const std::array<const ImageBuffer*, kArmChannelCount>& sources,
+                  const std::array<unsigned char, kArmChannelCount>& default_values,
+                  ImageBuffer* packed) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  int width = 0, height = 0;
+  for (const auto* source : sources) {
+    if (IsValidSource(source)) {
+      width = std::max(width, source->width);
+      height = std::max(height, source->height);
+    }
+  }
+
+  if (width == 0 || height == 0) {
+    return false;
+  }
+
+  const std::size_t size = static_cast<std::size_t>(width) * height * kArmChannelCount;
+  auto* pixels = static_cast<unsigned char*>(std::malloc(size));
+  if (pixels == nullptr) {
+    return false;
+  }
+
+  ParallelFor(height, kRowsPerJob, [&](std::size_t begin, std::size_t end) {
+    for (int c = 0; c < kArmChannelCount; c++) {
+      const ImageBuffer* source = sources[c];
+
+      for (std::size_t y = begin; y < end; y++) {
+        unsigned char* row = pixels + y * width * kArmChannelCount;
+
+        if (!IsValidSource(source)) {
+          for (int x = 0; x < width; x++) {
+            row[x * kArmChannelCount + c] = default_values[c];
+          }
+        }
+        else if (source->width == width && source->height == height) {
+          const auto* src_row = std::get<unsigned char*>(source->data) +
+                                y * width * source->channels;
+          for (int x = 0; x < width; x++) {
+            row[x * kArmChannelCount + c] = src_row[x * source->channels];
+          }
+        }
+        else {
+          const float scale_x = static_cast<float>(source->width) / width;
+          const float scale_y = static_cast<float>(source->height) / height;
+          const float v = (static_cast<float>(y) + 0.5f) * scale_y;
+          for (int x = 0; x < width; x++) {
+            const float u = (static_cast<float>(x) + 0.5f) * scale_x;
+            row[x * kArmChannelCount + c] = SampleFirstChannel(*source, u, v);
+          }
+        }
+      }
+    }
+  });
+
+  FreeImageBuffer(packed);
+  packed->data = pixels;
+  packed->width = width;
+  packed->height = height;
+  packed->channels = kArmChannelCount;
+
+  return true;
+}
+
+ChannelPackingJob::ChannelPackingJob(
+    const std::array<ImageBuffer*, kArmChannelCount>& sources,
+    ImageBuffer* packed) noexcept
+    : Job(JobType::kImageFileDecompressing),
+      sources_(sources),
+      packed_(packed)
+{
+}
+
+void ChannelPackingJob::Work() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // Missing maps are replaced by no occlusion, fully rough and dielectric.
+  constexpr std::array<unsigned char, kArmChannelCount> kDefaultValues = {255, 255, 0};
+
+  const bool packed = PackChannels({sources_[0], sources_[1], sources_[2]},
+                                   kDefaultValues, packed_);
+
+  for (auto* source : sources_) {
+    FreeImageBuffer(source);
+  }
+
+  if (!packed) {
+    std::cerr << "Error in packing the occlusion, roughness and metallic maps.\n";
+  }
+}
@@ -0,0 +1,288 @@
+#include "cooked_mesh.h"
+#include "file_utility.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment) noexcept {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+std::uint64_t IndexSize(std::uint32_t index_type) noexcept {
+  switch (index_type) {
+    case GL_UNSIGNED_SHORT:
+      return sizeof(GLushort);
+    case GL_UNSIGNED_INT:
+      return sizeof(GLuint);
+    default:
+      return 0;
+  }
+}
+
+template <std::size_t Size>
+bool CopyString(std::string_view string, std::array<char, Size>* dst) noexcept {
+  // Keeps the last character for the null terminator.
+  if (string.size() >= Size) {
+    return false;
+  }
+  dst->fill('\0');
+  std::memcpy(dst->data(), string.data(), string.size());
+  return true;
+}
+
+}  // namespace
+
+bool CookedMesh::Parse(const unsigned char* data, std::size_t size) noexcept {
+  header_ = nullptr;
+  ranges_ = nullptr;
+  lods_ = nullptr;
+  meshlets_ = nullptr;
+  textures_ = nullptr;
+  vertices_ = nullptr;
+  indices_ = nullptr;
+
+  if (data == nullptr || size < sizeof(CookedMeshHeader)) {
+    return false;
+  }
+
+  const auto* header = reinterpret_cast<const CookedMeshHeader*>(data);
+  if (header->identifier != kCookedMeshIdentifier ||
+      header->version != kCookedMeshVersion ||
+      header->vertex_stride != sizeof(PackedVertex)) {
+    return false;
+  }
+
+  const auto lods_offset = sizeof(CookedMeshHeader) +
+                           sizeof(CookedMeshRange) * header->mesh_count;
+  const auto meshlets_offset = lods_offset + sizeof(CookedMeshLod) * header->lod_count;
+  const auto textures_offset = meshlets_offset +
+                               sizeof(CookedMeshMeshlet) * header->meshlet_count;
+  const auto textures_end = textures_offset +
+                            sizeof(CookedMeshTexture) * header->texture_count;
+  const auto vertices_end = header->vertex_offset +
+                            sizeof(PackedVertex) * header->vertex_count;
+  const auto indices_end = header->index_offset + header->index_byte_length;
+  if (textures_end > header->vertex_offset || vertices_end > header->index_offset ||
+      indices_end > size || header->vertex_offset % kCookedMeshDataAlignment != 0 ||
+      header->index_offset % kCookedMeshDataAlignment != 0) {
+    return false;
+  }
+
+  const auto* ranges = reinterpret_cast<const CookedMeshRange*>(
+      data + sizeof(CookedMeshHeader));
+  const auto* lods = reinterpret_cast<const CookedMeshLod*>(data + lods_offset);
+  const auto* meshlets = reinterpret_cast<const CookedMeshMeshlet*>(
+      data + meshlets_offset);
+  for (std::uint32_t i = 0; i < header->mesh_count; i++) {
+    const auto& range = ranges[i];
+    const auto index_size = IndexSize(range.index_type);
+    if (index_size == 0 ||
+        range.first_vertex + range.vertex_count > header->vertex_count ||
+        range.index_byte_offset + index_size * range.index_count >
+            header->index_byte_length ||
+        range.first_texture + range.texture_count > header->texture_count ||
+        range.first_lod + range.lod_count > header->lod_count ||
+        range.first_meshlet + range.meshlet_count > header->meshlet_count) {
+      return false;
+    }
+    for (std::uint32_t j = 0; j < range.lod_count; j++) {
+      const auto& lod = lods[range.first_lod + j];
+      if (static_cast<std::uint64_t>(lod.first_index) + lod.index_count >
+          range.index_count) {
+        return false;
+      }
+    }
+    for (std::uint32_t j = 0; j < range.meshlet_count; j++) {
+      const auto& meshlet = meshlets[range.first_meshlet + j];
+      if (static_cast<std::uint64_t>(meshlet.first_index) + meshlet.index_count >
+          range.index_count) {
+        return false;
+      }
+    }
+  }
+
+  header_ = header;
+  ranges_ = ranges;
+  lods_ = lods;
+  meshlets_ = meshlets;
+  textures_ = reinterpret_cast<const CookedMeshTexture*>(data + textures_offset);
+  vertices_ = reinterpret_cast<const PackedVertex*>(data + header->vertex_offset);
+  indices_ = data + header->index_offset;
+
+  return true;
+}
+
+std::string CookedMeshPath(std::string_view source_path) {
+  return std::string(source_path) + ".cmsh";
+}
+
+bool IsCookedMeshUpToDate(std::string_view source_path, std::string_view cooked_path,
+                          bool flip_uvs, bool mikk_tangents) noexcept {
+  std::error_code error;
+  if (!std::filesystem::exists(cooked_path, error)) {
+    return false;
+  }
+
+  // A cooked mesh shipped without its source is always valid.
+  if (std::filesystem::exists(source_path, error)) {
+    const auto source_time = std::filesystem::last_write_time(source_path, error);
+    const auto cooked_time = std::filesystem::last_write_time(cooked_path, error);
+    if (error || cooked_time < source_time) {
+      return false;
+    }
+  }
+
+  std::ifstream file(cooked_path.data(), std::ios::binary);
+  CookedMeshHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(CookedMeshHeader));
+  if (!file.good() || header.identifier != kCookedMeshIdentifier ||
+      header.version != kCookedMeshVersion ||
+      header.vertex_stride != sizeof(PackedVertex)) {
+    return false;
+  }
+
+  const bool flipped_uvs = header.flags & kCookedMeshFlippedUvs;
+  const bool has_mikk_tangents = header.flags & kCookedMeshMikkTangents;
+  return flipped_uvs == flip_uvs && has_mikk_tangents == mikk_tangents;
+}
+
+bool CookMeshes(const std::vector<Mesh>& meshes, bool flip_uvs, bool mikk_tangents,
+                std::string_view cooked_path) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  CookedMeshHeader header{};
+  header.identifier = kCookedMeshIdentifier;
+  header.version = kCookedMeshVersion;
+  header.vertex_stride = sizeof(PackedVertex);
+  header.mesh_count = static_cast<std::uint32_t>(meshes.size());
+  header.flags = (flip_uvs ? static_cast<std::uint32_t>(kCookedMeshFlippedUvs) : 0u) |
+                 (mikk_tangents ? static_cast<std::uint32_t>(kCookedMeshMikkTangents) : 0u);
+
+  std::vector<CookedMeshRange> ranges(meshes.size());
+  std::vector<CookedMeshLod> lods;
+  std::vector<CookedMeshMeshlet> meshlets;
+  std::vector<CookedMeshTexture> textures;
+  for (std::size_t i = 0; i < meshes.size(); i++) {
+    const auto& mesh = meshes[i];
+    auto& range = ranges[i];
+    range.first_vertex = header.vertex_count;
+    range.vertex_count = mesh.vertices().size();
+    range.index_byte_offset = header.index_byte_length;
+    range.index_count = mesh.indices().size();
+    range.index_type = ChooseIndexType(mesh.vertices().size());
+    range.first_texture = static_cast<std::uint32_t>(textures.size());
+    range.texture_count = static_cast<std::uint32_t>(mesh.textures().size());
+    range.first_lod = static_cast<std::uint32_t>(lods.size());
+    range.lod_count = static_cast<std::uint32_t>(mesh.lods().size());
+
+    for (const auto& lod : mesh.lods()) {
+      lods.push_back(CookedMeshLod{lod.first_index, lod.index_count, lod.error});
+    }
+
+    range.first_meshlet = static_cast<std::uint32_t>(meshlets.size());
+    range.meshlet_count = static_cast<std::uint32_t>(mesh.meshlets().size());
+    for (const auto& meshlet : mesh.meshlets()) {
+      meshlets.push_back(CookedMeshMeshlet{
+          meshlet.first_index, meshlet.index_count,
+          {meshlet.center.x, meshlet.center.y, meshlet.center.z}, meshlet.radius,
+          {meshlet.cone_axis.x, meshlet.cone_axis.y, meshlet.cone_axis.z},
+          meshlet.cone_cutoff});
+    }
+
+    const auto& bounding_sphere = mesh.bounding_sphere();
+    range.bounds_center = {bounding_sphere.center().x, bounding_sphere.center().y,
+                           bounding_sphere.center().z};
+    range.bounds_radius = bounding_sphere.radius();
+
+    for (const auto& texture : mesh.textures()) {
+      CookedMeshTexture cooked_texture;
+      if (!CopyString(texture.type, &cooked_texture.type) ||
+          !CopyString(texture.path, &cooked_texture.path)) {
+        std::cerr << "Texture path too long to be cooked: " << texture.path << '\n';
+        return false;
+      }
+      textures.push_back(cooked_texture);
+    }
+
+    header.vertex_count += range.vertex_count;
+    header.index_byte_length = AlignUp(
+        header.index_byte_length + IndexSize(range.index_type) * range.index_count,
+        sizeof(GLuint));
+  }
+  header.lod_count = static_cast<std::uint32_t>(lods.size());
+  header.meshlet_count = static_cast<std::uint32_t>(meshlets.size());
+  header.texture_count = static_cast<std::uint32_t>(textures.size());
+
+  const std::uint64_t lods_offset = sizeof(CookedMeshHeader) +
+                                    sizeof(CookedMeshRange) * ranges.size();
+  const std::uint64_t meshlets_offset = lods_offset +
+                                        sizeof(CookedMeshLod) * lods.size();
+  const std::uint64_t textures_offset = meshlets_offset +
+                                        sizeof(CookedMeshMeshlet) * meshlets.size();
+  header.vertex_offset = AlignUp(textures_offset +
+                                 sizeof(CookedMeshTexture) * textures.size(),
+                                 kCookedMeshDataAlignment);
+  header.index_offset = AlignUp(header.vertex_offset +
+                                sizeof(PackedVertex) * header.vertex_count,
+                                kCookedMeshDataAlignment);
+  const std::uint64_t size = header.index_offset + header.index_byte_length;
+
+  std::vector<unsigned char> cooked_data(size, 0);
+  std::memcpy(cooked_data.data(), &header, sizeof(CookedMeshHeader));
+  std::memcpy(cooked_data.data() + sizeof(CookedMeshHeader), ranges.data(),
+              sizeof(CookedMeshRange) * ranges.size());
+  if (!lods.empty()) {
+    std::memcpy(cooked_data.data() + lods_offset, lods.data(),
+                sizeof(CookedMeshLod) * lods.size());
+  }
+  if (!meshlets.empty()) {
+    std::memcpy(cooked_data.data() + meshlets_offset, meshlets.data(),
+                sizeof(CookedMeshMeshlet) * meshlets.size());
+  }
+  if (!textures.empty()) {
+    std::memcpy(cooked_data.data() + textures_offset, textures.data(),
+                sizeof(CookedMeshTexture) * textures.size());
+  }
+
+  for (std::size_t i = 0; i < meshes.size(); i++) {
+    const auto& mesh = meshes[i];
+    const auto& range = ranges[i];
+    if (!mesh.vertices().empty()) {
+      const auto packed_vertices = PackVertices(mesh.vertices().data(),
+                                                mesh.vertices().size());
+      std::memcpy(cooked_data.data() + header.vertex_offset +
+                  sizeof(PackedVertex) * range.first_vertex,
+                  packed_vertices.data(), sizeof(PackedVertex) * range.vertex_count);
+    }
+
+    unsigned char* indices = cooked_data.data() + header.index_offset +
+                             range.index_byte_offset;
+    if (mesh.indices().empty()) {
+      continue;
+    }
+    if (range.index_type == GL_UNSIGNED_SHORT) {
+      const auto narrow_indices = NarrowIndices(mesh.indices().data(),
+                                                mesh.indices().size());
+      std::memcpy(indices, narrow_indices.data(), sizeof(GLushort) * range.index_count);
+    }
+    else {
+      std::memcpy(indices, mesh.indices().data(), sizeof(GLuint) * range.index_count);
+    }
+  }
+
+  return file_utility::WriteFileBuffer(cooked_path, cooked_data.data(),
+                                       cooked_data.size());
+}
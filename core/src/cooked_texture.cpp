@@ -0,0 +1,439 @@
+#include "cooked_texture.h"
+#include "block_compression.h"
+#include "gpu_memory.h"
+#include "mip_generator.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+namespace {
+
+struct UncompressedFormat {
+  GLenum internal_format = GL_RGBA8;
+  GLenum format = GL_RGBA;
+};
+
+UncompressedFormat ChooseUncompressedFormat(int channels, bool srgb) noexcept {
+  switch (channels) {
+    case 1:
+      return {GL_R8, GL_RED};
+    case 2:
+      return {GL_RG8, GL_RG};
+    case 3:
+      // Expanded to 4 bytes texels when cooked, the drivers repack the RGB
+      // texels on the CPU.
+    case 4:
+    default:
+      return {static_cast<GLenum>(srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8), GL_RGBA};
+  }
+}
+
+std::optional<BlockFormat> ChooseBlockFormat(TextureCompression compression,
+                                             int channels, bool srgb) noexcept {
+  switch (compression) {
+    case TextureCompression::kNone:
+      return std::nullopt;
+    case TextureCompression::kBc1:
+      return BlockFormat::kBc1;
+    case TextureCompression::kBc4:
+      return BlockFormat::kBc4;
+    case TextureCompression::kBc5:
+      return BlockFormat::kBc5;
+    case TextureCompression::kBc7:
+      return BlockFormat::kBc7;
+    case TextureCompression::kAuto:
+    default:
+      break;
+  }
+
+  switch (channels) {
+    case 1:
+      return BlockFormat::kBc4;
+    case 2:
+      return BlockFormat::kBc5;
+    case 3:
+      // BC1 shares the error between the channels which is fine for colors
+      // but not for independent data channels.
+      return srgb ? BlockFormat::kBc1 : BlockFormat::kBc7;
+    case 4:
+    default:
+      return BlockFormat::kBc7;
+  }
+}
+
+GLenum CompressedInternalFormat(BlockFormat format, bool srgb) noexcept {
+  switch (format) {
+    case BlockFormat::kBc1:
+      return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockFormat::kBc4:
+      return GL_COMPRESSED_RED_RGTC1;
+    case BlockFormat::kBc5:
+      return GL_COMPRESSED_RG_RGTC2;
+    case BlockFormat::kBc7:
+    default:
+      return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+  }
+}
+
+std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment) noexcept {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}  // namespace
+
+bool CookedTexture::Parse(const unsigned char* data, std::size_t size) noexcept {
+  data_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  levels_ = nullptr;
+
+  if (data == nullptr || size < sizeof(CookedTextureHeader)) {
+    return false;
+  }
+
+  const auto* header = reinterpret_cast<const CookedTextureHeader*>(data);
+  if (header->identifier != kCookedTextureIdentifier ||
+      header->version != kCookedTextureVersion) {
+    return false;
+  }
+
+  if (header->supercompression != SuperCompressionScheme::kNone) {
+    std::cerr << "Unsupported cooked texture supercompression scheme.\n";
+    return false;
+  }
+
+  constexpr std::uint32_t kMaxLevelCount = 16;
+  const auto index_end = sizeof(CookedTextureHeader) +
+                         sizeof(CookedLevelIndex) * header->level_count;
+  if (header->level_count == 0 || header->level_count > kMaxLevelCount ||
+      index_end > size) {
+    return false;
+  }
+
+  // The buffer can be truncated after the mip tail (see LoadCookedMipTail)
+  // but the smallest level, stored first, must be there.
+  const auto* levels = reinterpret_cast<const CookedLevelIndex*>(
+      data + sizeof(CookedTextureHeader));
+  const auto& smallest_level = levels[header->level_count - 1];
+  if (smallest_level.byte_offset + smallest_level.byte_length > size) {
+    return false;
+  }
+
+  data_ = data;
+  size_ = size;
+  header_ = header;
+  levels_ = levels;
+
+  return true;
+}
+
+std::string CookedTexturePath(std::string_view source_path) {
+  return std::string(source_path) + ".ctex";
+}
+
+bool IsCookedTextureUpToDate(std::string_view source_path,
+                             std::string_view cooked_path,
+                             const TextureParameters& tex_param,
+                             std::uint64_t* source_hash) noexcept {
+  return IsCookedTextureUpToDate(std::vector<std::string_view>{source_path},
+                                 cooked_path, tex_param, source_hash);
+}
+
+bool IsCookedTextureUpToDate(const std::vector<std::string_view>& source_paths,
+                             std::string_view cooked_path,
+                             const TextureParameters& tex_param,
+                             std::uint64_t* source_hash) noexcept {
+  std::error_code error;
+  if (!std::filesystem::exists(cooked_path, error)) {
+    return false;
+  }
+
+  // A cooked texture shipped without its sources is always valid.
+  for (const auto source_path : source_paths) {
+    if (std::filesystem::exists(source_path, error)) {
+      const auto source_time = std::filesystem::last_write_time(source_path, error);
+      const auto cooked_time = std::filesystem::last_write_time(cooked_path, error);
+      if (error || cooked_time < source_time) {
+        return false;
+      }
+    }
+  }
+
+  std::ifstream file(cooked_path.data(), std::ios::binary);
+  CookedTextureHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(CookedTextureHeader));
+  if (!file.good() || header.identifier != kCookedTextureIdentifier ||
+      header.version != kCookedTextureVersion) {
+    return false;
+  }
+
+  const bool srgb = header.flags & kCookedTextureSrgb;
+  const bool flipped_y = header.flags & kCookedTextureFlippedY;
+
+  const bool is_up_to_date =
+      srgb == tex_param.gamma_corrected && flipped_y == tex_param.flipped_y &&
+      header.compression == static_cast<std::uint32_t>(tex_param.compression);
+
+  if (is_up_to_date && source_hash != nullptr) {
+    *source_hash = header.source_hash;
+  }
+
+  return is_up_to_date;
+}
+
+bool LoadCookedMipTail(std::string_view cooked_path, std::uint32_t max_level_size,
+                       FileBuffer* buffer) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  std::ifstream file(cooked_path.data(), std::ios::binary);
+  CookedTextureHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(CookedTextureHeader));
+  if (!file.good() || header.identifier != kCookedTextureIdentifier ||
+      header.version != kCookedTextureVersion || header.level_count == 0) {
+    return false;
+  }
+
+  std::vector<CookedLevelIndex> levels(header.level_count);
+  file.read(reinterpret_cast<char*>(levels.data()),
+            sizeof(CookedLevelIndex) * header.level_count);
+  if (!file.good()) {
+    return false;
+  }
+
+  std::uint64_t tail_end = levels.back().byte_offset + levels.back().byte_length;
+  for (const auto& level : levels) {
+    if (level.width <= max_level_size && level.height <= max_level_size) {
+      tail_end = std::max(tail_end, level.byte_offset + level.byte_length);
+    }
+  }
+
+  delete[] buffer->data;
+  buffer->size = static_cast<int>(tail_end);
+  buffer->data = new unsigned char[buffer->size];
+
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(buffer->data), buffer->size);
+
+  return file.good();
+}
+
+bool ReadCookedLevel(std::string_view cooked_path, const CookedLevelIndex& level,
+                     unsigned char* data) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  std::ifstream file(cooked_path.data(), std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(level.byte_offset));
+
+  file.read(reinterpret_cast<char*>(data),
+            static_cast<std::streamsize>(level.byte_length));
+
+  return file.good();
+}
+
+bool CookTexture(const ImageBuffer& image_buffer, const TextureParameters& tex_param,
+                 std::uint64_t source_hash, FileBuffer* cooked_buffer) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // HDR images keep their dedicated float upload path.
+  if (tex_param.hdr || !std::holds_alternative<unsigned char*>(image_buffer.data)) {
+    return false;
+  }
+
+  const unsigned char* pixels = std::get<unsigned char*>(image_buffer.data);
+  if (pixels == nullptr || image_buffer.width <= 0 || image_buffer.height <= 0) {
+    return false;
+  }
+
+  const int channels = image_buffer.channels;
+  const auto width = static_cast<std::uint32_t>(image_buffer.width);
+  const auto height = static_cast<std::uint32_t>(image_buffer.height);
+  const auto level_count = static_cast<std::uint32_t>(
+      CalculateMipLevelCount(image_buffer.width, image_buffer.height));
+  const auto gl_format = ChooseUncompressedFormat(channels, tex_param.gamma_corrected);
+  const auto block_format = ChooseBlockFormat(tex_param.compression, channels,
+                                              tex_param.gamma_corrected);
+
+  CookedTextureHeader header{};
+  header.identifier = kCookedTextureIdentifier;
+  header.version = kCookedTextureVersion;
+  header.internal_format = block_format.has_value()
+      ? CompressedInternalFormat(*block_format, tex_param.gamma_corrected)
+      : gl_format.internal_format;
+  header.format = gl_format.format;
+  header.type = GL_UNSIGNED_BYTE;
+  header.width = width;
+  header.height = height;
+  header.level_count = level_count;
+  header.channel_count = channels;
+  header.flags =
+      (tex_param.gamma_corrected ? static_cast<std::uint32_t>(kCookedTextureSrgb) : 0u) |
+      (tex_param.flipped_y ? static_cast<std::uint32_t>(kCookedTextureFlippedY) : 0u) |
+      (block_format.has_value() ? static_cast<std::uint32_t>(kCookedTextureCompressed)
+                                : 0u);
+  header.compression = static_cast<std::uint32_t>(tex_param.compression);
+  header.supercompression = SuperCompressionScheme::kNone;
+  header.source_hash = source_hash;
+
+  // Uncompressed mip chain, the level 0 is the source image. BC5 textures are
+  // the normal maps, their mips are renormalized.
+  MipGenerationParameters mip_params;
+  mip_params.filter = MipFilter::kKaiser;
+  mip_params.srgb = tex_param.gamma_corrected;
+  mip_params.normal_map = block_format == BlockFormat::kBc5;
+  const auto mips = GenerateMipChain(pixels, image_buffer.width, image_buffer.height,
+                                     channels, mip_params);
+
+  std::vector<CookedLevelIndex> levels(level_count);
+  for (std::uint32_t i = 0; i < level_count; i++) {
+    const auto w = static_cast<std::uint32_t>(i == 0 ? width : mips[i - 1].width);
+    const auto h = static_cast<std::uint32_t>(i == 0 ? height : mips[i - 1].height);
+    levels[i].width = w;
+    levels[i].height = h;
+    levels[i].byte_length = block_format.has_value()
+        ? CompressedImageSize(*block_format, w, h)
+        : static_cast<std::uint64_t>(w) * h * (channels == 3 ? 4 : channels);
+  }
+
+  // Store the smallest mips first.
+  std::uint64_t offset = sizeof(CookedTextureHeader) +
+                         sizeof(CookedLevelIndex) * level_count;
+  for (std::int32_t i = static_cast<std::int32_t>(level_count) - 1; i >= 0; i--) {
+    offset = AlignUp(offset, kCookedTextureDataAlignment);
+    levels[i].byte_offset = offset;
+    offset += levels[i].byte_length;
+  }
+
+  delete[] cooked_buffer->data;
+  cooked_buffer->size = static_cast<int>(offset);
+  cooked_buffer->data = new unsigned char[cooked_buffer->size]{};
+
+  std::memcpy(cooked_buffer->data, &header, sizeof(CookedTextureHeader));
+  std::memcpy(cooked_buffer->data + sizeof(CookedTextureHeader), levels.data(),
+              sizeof(CookedLevelIndex) * level_count);
+
+  for (std::uint32_t i = 0; i < level_count; i++) {
+    const unsigned char* level_pixels = i == 0 ? pixels : mips[i - 1].pixels.data();
+    unsigned char* dst = cooked_buffer->data + levels[i].byte_offset;
+
+    if (block_format.has_value()) {
+      CompressImage(*block_format, level_pixels, levels[i].width, levels[i].height,
+                    channels, dst);
+    }
+    else if (channels == 3) {
+      ExpandRgbTexels(level_pixels, dst, static_cast<std::size_t>(levels[i].width) *
+                                         levels[i].height, false);
+    }
+    else {
+      std::memcpy(dst, level_pixels, levels[i].byte_length);
+    }
+  }
+
+  return true;
+}
+
+void LoadCookedTextureToGpu(const FileBuffer& cooked_buffer, GLuint* id,
+                            const TextureParameters& tex_param) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  CookedTexture cooked_texture;
+  if (!cooked_texture.Parse(cooked_buffer.data, cooked_buffer.size)) {
+    std::cerr << "Invalid cooked texture for " << tex_param.image_file_path << '\n';
+    return;
+  }
+
+  const auto& header = cooked_texture.header();
+
+  glGenTextures(1, id);
+  glBindTexture(GL_TEXTURE_2D, *id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, tex_param.wrapping_param);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tex_param.wrapping_param);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex_param.filtering_param);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tex_param.filtering_param);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.level_count - 1);
+
+  // Rows of the small mips of RGB textures are not 4 bytes aligned.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  // Only the levels in the buffer are used.
+  std::uint32_t base_level = 0;
+  while (!cooked_texture.is_level_loaded(base_level)) {
+    base_level++;
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base_level);
+
+  std::size_t texture_size = 0;
+  for (std::uint32_t i = base_level; i < header.level_count; i++) {
+    const auto& level = cooked_texture.level(i);
+    texture_size += CalculateTextureSize(header.internal_format, level.width, level.height);
+
+    if (cooked_texture.is_compressed()) {
+      glCompressedTexImage2D(GL_TEXTURE_2D, i, header.internal_format, level.width,
+                             level.height, 0, static_cast<GLsizei>(level.byte_length),
+                             cooked_texture.level_data(i));
+    }
+    else {
+      glTexImage2D(GL_TEXTURE_2D, i, header.internal_format, level.width,
+                   level.height, 0, header.format, header.type,
+                   cooked_texture.level_data(i));
+    }
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, *id, GpuMemoryCategory::kTexture,
+                                 texture_size);
+}
+
+TextureCookingJob::TextureCookingJob(ImageBuffer* img_buffer, FileBuffer* cooked_buffer,
+                                     const TextureParameters& tex_param,
+                                     std::string cooked_path,
+                                     std::uint64_t source_hash) noexcept
+    : Job(JobType::kImageFileDecompressing),
+      image_buffer_(img_buffer),
+      cooked_buffer_(cooked_buffer),
+      texture_param_(tex_param),
+      cooked_path_(std::move(cooked_path)),
+      source_hash_(source_hash)
+{
+}
+
+void TextureCookingJob::Work() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+  ZoneText(cooked_path_.data(), cooked_path_.size());
+#endif  // TRACY_ENABLE
+
+  const bool cooked = CookTexture(*image_buffer_, texture_param_, source_hash_,
+                                  cooked_buffer_);
+  FreeImageBuffer(image_buffer_);
+
+  if (!cooked) {
+    std::cerr << "Error in cooking the image at path "
+              << texture_param_.image_file_path << '\n';
+    return;
+  }
+
+  if (!file_utility::WriteFileBuffer(cooked_path_, cooked_buffer_->data,
+                                     cooked_buffer_->size)) {
+    std::cerr << "Could not write the cooked texture " << cooked_path_ << '\n';
+  }
+}
@@ -1,8 +1,10 @@
 #include "element_buffer_object.h"
+#include "gpu_memory.h"
 
 ElementBufferObject::ElementBufferObject(ElementBufferObject&& other) noexcept {
   id_ = other.id_;
   element_count_ = other.element_count_;
+  index_type_ = other.index_type_;
 
   other.id_ = 0;
   other.element_count_ = 0;
@@ -12,6 +14,7 @@ ElementBufferObject& ElementBufferObject::operator=(
     ElementBufferObject&& other) noexcept {
   id_ = other.id_;
   element_count_ = other.element_count_;
+  index_type_ = other.index_type_;
 
   other.id_ = 0;
   other.element_count_ = 0;
@@ -33,10 +36,19 @@ void ElementBufferObject::Bind() const noexcept {
 }
 
 void ElementBufferObject::SetData(const std::vector<GLuint>& indices) noexcept {
-  element_count_ = indices.size();
+  SetData(indices.data(), indices.size(), GL_UNSIGNED_INT);
+}
+
+void ElementBufferObject::SetData(const void* indices, std::size_t count,
+                                  GLenum type) noexcept {
+  element_count_ = count;
+  index_type_ = type;
+  const std::size_t size = (type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)) *
+                           element_count_;
   Bind();
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * element_count_,
-               indices.data(), GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, indices, GL_STATIC_DRAW);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, id_, GpuMemoryCategory::kBuffer,
+                                 size);
 }
 
 void ElementBufferObject::UnBind() const noexcept {
@@ -44,7 +56,9 @@ void ElementBufferObject::UnBind() const noexcept {
 }
 
 void ElementBufferObject::Destroy() noexcept { 
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, id_);
   glDeleteBuffers(1, &id_);
   id_ = 0;
   element_count_ = 0;
+  index_type_ = GL_UNSIGNED_INT;
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "frame_buffer_object.h"
 #include "error.h"
+#include "gpu_memory.h"
 
 #include <iostream>
 
@@ -79,6 +80,7 @@ void FrameBufferObject::Resize(glm::uvec2 new_size) noexcept {
     glBindRenderbuffer(GL_RENDERBUFFER, render_buffer_id_);
     glRenderbufferStorage(GL_RENDERBUFFER, render_buffer_internal_format,
                           new_size.x, new_size.y);
+    TrackDepthStencilAttachment();
   }
 
   for (std::uint8_t i = 0; i < color_buffer_count_; i++) {
@@ -86,6 +88,7 @@ void FrameBufferObject::Resize(glm::uvec2 new_size) noexcept {
     const auto& color_attachment = specification_.GetColorAttachment(i);
     glTexImage2D(GL_TEXTURE_2D, 0, color_attachment.internal_format, new_size.x,
                  new_size.y, 0, color_attachment.format, GL_UNSIGNED_BYTE, NULL);
+    TrackColorAttachment(i);
 
     GL_CHECK_ERROR();
   }
@@ -96,9 +99,36 @@ void FrameBufferObject::UnBind() const noexcept {
 }
 
 void FrameBufferObject::Destroy() noexcept {
+  auto& accountant = GetGpuMemoryAccountant();
+  for (std::uint8_t i = 0; i < color_buffer_count_; i++) {
+    accountant.Untrack(GpuObjectType::kTexture, color_buffer_ids_[i]);
+  }
+  accountant.Untrack(GpuObjectType::kRenderbuffer, render_buffer_id_);
+
+  glDeleteTextures(color_buffer_count_, color_buffer_ids_.data());
   glDeleteFramebuffers(1, &id_);
   glDeleteRenderbuffers(1, &render_buffer_id_);
   id_ = 0;
+  render_buffer_id_ = 0;
+  color_buffer_count_ = 0;
+}
+
+void FrameBufferObject::TrackColorAttachment(std::uint8_t idx) const noexcept {
+  const auto size = specification_.size();
+  const auto& color_attachment = specification_.GetColorAttachment(idx);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, color_buffer_ids_[idx],
+      GpuMemoryCategory::kRenderTarget,
+      CalculateTextureSize(color_attachment.internal_format, size.x, size.y, 1, 1,
+                           color_attachment.sample_count));
+}
+
+void FrameBufferObject::TrackDepthStencilAttachment() const noexcept {
+  const auto size = specification_.size();
+  const auto& depth_stencil_attachment = specification_.depth_stencil_attachment();
+  GetGpuMemoryAccountant().Track(GpuObjectType::kRenderbuffer, render_buffer_id_,
+      GpuMemoryCategory::kRenderTarget,
+      CalculateTextureSize(depth_stencil_attachment.internal_format, size.x, size.y, 1, 1,
+                           depth_stencil_attachment.sample_count));
 }
 
 void FrameBufferObject::HandleColorAttachments() {
@@ -138,6 +168,7 @@ void FrameBufferObject::HandleColorAttachments() {
       default:
         break;
     }
+    TrackColorAttachment(i);
 
     glFramebufferTexture2D(GL_FRAMEBUFFER,
                            static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i),
@@ -180,6 +211,7 @@ void FrameBufferObject::HandleDepthStencilAttachment() {
     glRenderbufferStorageMultisample(GL_RENDERBUFFER, depth_stencil_attachment.sample_count,
                                      depth_stencil_attachment.internal_format, size.x, size.y);
   }
+  TrackDepthStencilAttachment();
 
   glFramebufferRenderbuffer(GL_FRAMEBUFFER, depth_stencil_attachment.format,
                             GL_RENDERBUFFER, render_buffer_id_);
@@ -0,0 +1,96 @@
+#include "free_list_allocator.h"
+
+#include <algorithm>
+#include <iterator>
+
+FreeListAllocator::FreeListAllocator(std::size_t capacity) {
+  Grow(capacity);
+}
+
+std::size_t FreeListAllocator::Allocate(std::size_t size, std::size_t alignment) {
+  if (size == 0) {
+    return kInvalidOffset;
+  }
+
+  for (std::size_t i = 0; i < free_ranges_.size(); i++) {
+    const auto range = free_ranges_[i];
+    const std::size_t offset = (range.offset + alignment - 1) & ~(alignment - 1);
+    const std::size_t padding = offset - range.offset;
+    if (padding + size > range.size) {
+      continue;
+    }
+
+    // The padding before the aligned offset and the rest after the allocation
+    // stay free.
+    const FreeRange rest{offset + size, range.size - padding - size};
+    if (padding > 0) {
+      free_ranges_[i].size = padding;
+      if (rest.size > 0) {
+        free_ranges_.insert(free_ranges_.begin() + i + 1, rest);
+      }
+    }
+    else if (rest.size > 0) {
+      free_ranges_[i] = rest;
+    }
+    else {
+      free_ranges_.erase(free_ranges_.begin() + i);
+    }
+
+    allocated_size_ += size;
+    return offset;
+  }
+
+  return kInvalidOffset;
+}
+
+void FreeListAllocator::Free(std::size_t offset, std::size_t size) {
+  if (size == 0 || offset == kInvalidOffset) {
+    return;
+  }
+  allocated_size_ -= size;
+
+  auto next = std::lower_bound(
+      free_ranges_.begin(), free_ranges_.end(), offset,
+      [](const FreeRange& range, std::size_t value) { return range.offset < value; });
+
+  const bool merges_previous = next != free_ranges_.begin() &&
+                               std::prev(next)->offset + std::prev(next)->size == offset;
+  const bool merges_next = next != free_ranges_.end() && offset + size == next->offset;
+
+  if (merges_previous && merges_next) {
+    std::prev(next)->size += size + next->size;
+    free_ranges_.erase(next);
+  }
+  else if (merges_previous) {
+    std::prev(next)->size += size;
+  }
+  else if (merges_next) {
+    next->offset = offset;
+    next->size += size;
+  }
+  else {
+    free_ranges_.insert(next, FreeRange{offset, size});
+  }
+}
+
+void FreeListAllocator::Grow(std::size_t new_capacity) {
+  if (new_capacity <= capacity_) {
+    return;
+  }
+
+  const std::size_t added_size = new_capacity - capacity_;
+  if (!free_ranges_.empty() &&
+      free_ranges_.back().offset + free_ranges_.back().size == capacity_) {
+    free_ranges_.back().size += added_size;
+  }
+  else {
+    free_ranges_.push_back(FreeRange{capacity_, added_size});
+  }
+  capacity_ = new_capacity;
+}
+
+void FreeListAllocator::Clear() noexcept {
+  free_ranges_.clear();
+  capacity_ = 0;
+  allocated_size_ = 0;
+}
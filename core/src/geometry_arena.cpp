@@ -0,0 +1,280 @@
+#include "geometry_arena.h"
+#include "error.h"
+#include "gpu_memory.h"
+#include "mesh.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <cstddef>
+#include <iterator>
+
+namespace {
+
+// Both index types start on a multiple of their size.
+constexpr std::size_t kIndexAlignment = sizeof(GLuint);
+
+std::size_t IndexSize(GLenum index_type) noexcept {
+  return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+// Capacity doubled until the allocator has room for size more units.
+std::size_t GrownCapacity(const FreeListAllocator& allocator, std::size_t size) noexcept {
+  std::size_t capacity = allocator.capacity();
+  do {
+    capacity *= 2;
+  } while (capacity - allocator.capacity() < size);
+  return capacity;
+}
+
+void UploadStreamBuffer(GLuint buffer, const void* data, std::size_t size) noexcept {
+  // A new storage each upload, the driver keeps the previous one alive for the
+  // draws still using it.
+  glNamedBufferData(buffer, static_cast<GLsizeiptr>(size), data, GL_STREAM_DRAW);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, buffer, GpuMemoryCategory::kBuffer,
+                                 size);
+}
+
+}  // namespace
+
+GeometryArena::~GeometryArena() noexcept {
+  if (vertex_buffer_ != 0 || vao_ != 0) {
+    LOG_ERROR("Geometry arena was not destroyed.");
+  }
+}
+
+void GeometryArena::CreateBuffers() noexcept {
+  glCreateBuffers(1, &vertex_buffer_);
+  glCreateBuffers(1, &index_buffer_);
+
+  vertex_allocator_.Grow(kInitialVertexCapacity);
+  index_allocator_.Grow(kInitialIndexByteCapacity);
+  glNamedBufferData(vertex_buffer_, kInitialVertexCapacity * sizeof(PackedVertex), nullptr,
+                    GL_STATIC_DRAW);
+  glNamedBufferData(index_buffer_, kInitialIndexByteCapacity, nullptr, GL_STATIC_DRAW);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, vertex_buffer_,
+                                 GpuMemoryCategory::kBuffer,
+                                 kInitialVertexCapacity * sizeof(PackedVertex));
+  GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, index_buffer_,
+                                 GpuMemoryCategory::kBuffer, kInitialIndexByteCapacity);
+  are_buffers_attached_ = false;
+}
+
+void GeometryArena::CreateVertexArray() noexcept {
+  glCreateVertexArrays(1, &vao_);
+
+  // The input vertex layout, see PackedVertex.
+  struct AttributeFormat {
+    GLint count;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+  };
+  constexpr AttributeFormat kAttributeFormats[] = {
+      {3, GL_FLOAT, GL_FALSE, offsetof(PackedVertex, position)},
+      {2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal)},
+      {2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, uv)},
+      {4, GL_BYTE, GL_TRUE, offsetof(PackedVertex, tangent)},
+  };
+  for (GLuint location = 0; location < std::size(kAttributeFormats); location++) {
+    const auto& format = kAttributeFormats[location];
+    glEnableVertexArrayAttrib(vao_, location);
+    glVertexArrayAttribFormat(vao_, location, format.count, format.type, format.normalized,
+                              format.offset);
+    glVertexArrayAttribBinding(vao_, location, kVertexBinding);
+  }
+
+  // The model matrix of each draw, enabled while a draw list is submitted.
+  for (GLuint column = 0; column < 4; column++) {
+    const GLuint location = kDrawMatrixLocation + column;
+    glVertexArrayAttribFormat(vao_, location, 4, GL_FLOAT, GL_FALSE,
+                              column * sizeof(glm::vec4));
+    glVertexArrayAttribBinding(vao_, location, kDrawDataBinding);
+  }
+  glVertexArrayBindingDivisor(vao_, kDrawDataBinding, 1);
+}
+
+GeometryAllocation GeometryArena::Allocate(const PackedVertex* vertices,
+                                           std::size_t vertex_count, const void* indices,
+                                           std::size_t index_count, GLenum index_type) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  if (vertex_buffer_ == 0) {
+    CreateBuffers();
+  }
+
+  GeometryAllocation allocation;
+  allocation.vertex_count = vertex_count;
+  allocation.index_count = index_count;
+  allocation.index_type = index_type;
+  const std::size_t index_byte_size = index_count * IndexSize(index_type);
+
+  allocation.first_vertex = vertex_allocator_.Allocate(vertex_count);
+  if (allocation.first_vertex == FreeListAllocator::kInvalidOffset) {
+    const auto old_capacity = vertex_allocator_.capacity();
+    const auto new_capacity = GrownCapacity(vertex_allocator_, vertex_count);
+    GrowBuffer(&vertex_buffer_, old_capacity * sizeof(PackedVertex),
+               new_capacity * sizeof(PackedVertex));
+    vertex_allocator_.Grow(new_capacity);
+    allocation.first_vertex = vertex_allocator_.Allocate(vertex_count);
+  }
+
+  allocation.index_byte_offset = index_allocator_.Allocate(index_byte_size, kIndexAlignment);
+  if (allocation.index_byte_offset == FreeListAllocator::kInvalidOffset) {
+    const auto old_capacity = index_allocator_.capacity();
+    const auto new_capacity = GrownCapacity(index_allocator_,
+                                            index_byte_size + kIndexAlignment);
+    GrowBuffer(&index_buffer_, old_capacity, new_capacity);
+    index_allocator_.Grow(new_capacity);
+    allocation.index_byte_offset = index_allocator_.Allocate(index_byte_size,
+                                                             kIndexAlignment);
+  }
+
+  glNamedBufferSubData(vertex_buffer_,
+                       static_cast<GLintptr>(allocation.first_vertex * sizeof(PackedVertex)),
+                       static_cast<GLsizeiptr>(vertex_count * sizeof(PackedVertex)),
+                       vertices);
+  glNamedBufferSubData(index_buffer_, static_cast<GLintptr>(allocation.index_byte_offset),
+                       static_cast<GLsizeiptr>(index_byte_size), indices);
+
+  return allocation;
+}
+
+void GeometryArena::Free(GeometryAllocation* allocation) {
+  if (!allocation->is_valid()) {
+    return;
+  }
+
+  vertex_allocator_.Free(allocation->first_vertex, allocation->vertex_count);
+  index_allocator_.Free(allocation->index_byte_offset,
+                        allocation->index_count * IndexSize(allocation->index_type));
+  *allocation = GeometryAllocation{};
+}
+
+void GeometryArena::GrowBuffer(GLuint* buffer, std::size_t old_size,
+                               std::size_t new_size) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  GLuint new_buffer = 0;
+  glCreateBuffers(1, &new_buffer);
+  glNamedBufferData(new_buffer, static_cast<GLsizeiptr>(new_size), nullptr, GL_STATIC_DRAW);
+  glCopyNamedBufferSubData(*buffer, new_buffer, 0, 0, static_cast<GLsizeiptr>(old_size));
+
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, *buffer);
+  glDeleteBuffers(1, buffer);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, new_buffer,
+                                 GpuMemoryCategory::kBuffer, new_size);
+  *buffer = new_buffer;
+  are_buffers_attached_ = false;
+}
+
+void GeometryArena::UpdateVertexArray() noexcept {
+  if (vao_ == 0) {
+    CreateVertexArray();
+  }
+  if (are_buffers_attached_ || vertex_buffer_ == 0) {
+    return;
+  }
+
+  glVertexArrayVertexBuffer(vao_, kVertexBinding, vertex_buffer_, 0, sizeof(PackedVertex));
+  glVertexArrayElementBuffer(vao_, index_buffer_);
+  are_buffers_attached_ = true;
+}
+
+void GeometryArena::Destroy() noexcept {
+  if (vertex_buffer_ == 0 && vao_ == 0) {
+    return;
+  }
+
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, vertex_buffer_);
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, index_buffer_);
+  glDeleteBuffers(1, &vertex_buffer_);
+  glDeleteBuffers(1, &index_buffer_);
+  glDeleteVertexArrays(1, &vao_);
+  vertex_buffer_ = 0;
+  index_buffer_ = 0;
+  vao_ = 0;
+
+  vertex_allocator_.Clear();
+  index_allocator_.Clear();
+}
+
+GeometryDrawList::~GeometryDrawList() noexcept {
+  if (command_buffer_ != 0) {
+    LOG_ERROR("Geometry draw list was not destroyed.");
+  }
+}
+
+void GeometryDrawList::Clear() noexcept {
+  short_commands_.clear();
+  int_commands_.clear();
+  model_matrices_.clear();
+}
+
+void GeometryDrawList::Add(const Mesh& mesh, std::uint32_t lod,
+                           const glm::mat4& model_matrix) {
+  if (mesh.arena() == nullptr) {
+    LOG_ERROR("Only the meshes of a geometry arena can be drawn indirectly.");
+    return;
+  }
+
+  DrawElementsIndirectCommand command;
+  command.instance_count = 1;
+  command.base_vertex = static_cast<GLint>(mesh.base_vertex());
+  command.base_instance = static_cast<GLuint>(model_matrices_.size());
+
+  const std::size_t index_size = IndexSize(mesh.index_type());
+  command.first_index = static_cast<GLuint>(mesh.index_byte_offset() / index_size);
+  if (lod < mesh.lod_count()) {
+    command.first_index += mesh.lods()[lod].first_index;
+    command.count = mesh.lods()[lod].index_count;
+  }
+  else {
+    command.count = static_cast<GLuint>(mesh.elementCount());
+  }
+
+  auto& commands = mesh.index_type() == GL_UNSIGNED_SHORT ? short_commands_ : int_commands_;
+  commands.push_back(command);
+  model_matrices_.push_back(model_matrix);
+}
+
+void GeometryDrawList::Upload() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  if (command_buffer_ == 0) {
+    glCreateBuffers(1, &command_buffer_);
+    glCreateBuffers(1, &draw_data_buffer_);
+  }
+
+  uploaded_commands_.assign(short_commands_.begin(), short_commands_.end());
+  uploaded_commands_.insert(uploaded_commands_.end(), int_commands_.begin(),
+                            int_commands_.end());
+
+  UploadStreamBuffer(command_buffer_, uploaded_commands_.data(),
+                     uploaded_commands_.size() * sizeof(DrawElementsIndirectCommand));
+  UploadStreamBuffer(draw_data_buffer_, model_matrices_.data(),
+                     model_matrices_.size() * sizeof(glm::mat4));
+}
+
+void GeometryDrawList::Destroy() noexcept {
+  if (command_buffer_ == 0) {
+    return;
+  }
+
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, command_buffer_);
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, draw_data_buffer_);
+  glDeleteBuffers(1, &command_buffer_);
+  glDeleteBuffers(1, &draw_data_buffer_);
+  command_buffer_ = 0;
+  draw_data_buffer_ = 0;
+  Clear();
+}
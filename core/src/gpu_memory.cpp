@@ -0,0 +1,142 @@
+#include "gpu_memory.h"
+
+#include <algorithm>
+
+namespace {
+
+// Bytes of a 4x4 block of the compressed formats, 0 for the other formats.
+std::size_t CalculateBlockSize(GLenum internal_format) noexcept {
+  switch (internal_format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_SIGNED_RED_RGTC1:
+      return 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RG_RGTC2:
+    case GL_COMPRESSED_SIGNED_RG_RGTC2:
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+    case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+    case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+std::size_t CalculateTexelSize(GLenum internal_format) noexcept {
+  switch (internal_format) {
+    case GL_R8:
+    case GL_RED:
+      return 1;
+    case GL_RG8:
+    case GL_RG:
+    case GL_R16F:
+    case GL_DEPTH_COMPONENT16:
+      return 2;
+    case GL_RG16F:
+    case GL_R32F:
+    case GL_R11F_G11F_B10F:
+    case GL_RGB9_E5:
+    case GL_DEPTH_COMPONENT:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+      return 4;
+    case GL_RGB16F:
+    case GL_RGBA16F:
+    case GL_RG32F:
+    case GL_DEPTH32F_STENCIL8:
+      return 8;
+    case GL_RGB32F:
+    case GL_RGBA32F:
+      return 16;
+    default:
+      // The 8 bits RGB and RGBA formats.
+      return 4;
+  }
+}
+
+std::uint64_t ObjectKey(GpuObjectType type, GLuint id) noexcept {
+  return (static_cast<std::uint64_t>(type) << 32) | id;
+}
+
+}  // namespace
+
+std::size_t CalculateTextureSize(GLenum internal_format, GLsizei width, GLsizei height,
+                                 GLsizei depth, GLsizei level_count,
+                                 GLsizei sample_count) noexcept {
+  const std::size_t block_size = CalculateBlockSize(internal_format);
+  const std::size_t texel_size = CalculateTexelSize(internal_format);
+
+  std::size_t size = 0;
+  for (GLsizei level = 0; level < level_count; level++) {
+    const std::size_t level_width = std::max(width >> level, 1);
+    const std::size_t level_height = std::max(height >> level, 1);
+
+    if (block_size != 0) {
+      size += ((level_width + 3) / 4) * ((level_height + 3) / 4) * block_size;
+    }
+    else {
+      size += level_width * level_height * texel_size;
+    }
+  }
+
+  return size * static_cast<std::size_t>(depth) * static_cast<std::size_t>(sample_count);
+}
+
+void GpuMemoryAccountant::Track(GpuObjectType type, GLuint id,
+                                GpuMemoryCategory category, std::size_t size) noexcept {
+  std::lock_guard lock(mutex_);
+
+  const auto [allocation, is_new] =
+      allocations_.Insert(ObjectKey(type, id), Allocation{category, size});
+  if (!is_new) {
+    used_sizes_[static_cast<std::size_t>(allocation->category)] -= allocation->size;
+    *allocation = Allocation{category, size};
+  }
+  used_sizes_[static_cast<std::size_t>(category)] += size;
+}
+
+void GpuMemoryAccountant::Untrack(GpuObjectType type, GLuint id) noexcept {
+  std::lock_guard lock(mutex_);
+
+  const auto key = ObjectKey(type, id);
+  const auto* allocation = allocations_.Find(key);
+  if (allocation == nullptr) {
+    return;
+  }
+
+  used_sizes_[static_cast<std::size_t>(allocation->category)] -= allocation->size;
+  allocations_.Erase(key);
+}
+
+std::size_t GpuMemoryAccountant::used_size(GpuMemoryCategory category) const noexcept {
+  std::lock_guard lock(mutex_);
+  return used_sizes_[static_cast<std::size_t>(category)];
+}
+
+std::size_t GpuMemoryAccountant::total_used_size() const noexcept {
+  std::lock_guard lock(mutex_);
+  std::size_t total = 0;
+  for (const auto size : used_sizes_) {
+    total += size;
+  }
+  return total;
+}
+
+std::size_t GpuMemoryAccountant::object_count() const noexcept {
+  std::lock_guard lock(mutex_);
+  return allocations_.size();
+}
+
+GpuMemoryAccountant& GetGpuMemoryAccountant() noexcept {
+  static GpuMemoryAccountant accountant;
+  return accountant;
+}
@@ -0,0 +1,111 @@
+#include "gpu_upload_thread.h"
+
+#include <GL/glew.h>
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <iostream>
+
+void WaitForGpuCompletion() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // One second, the wait is repeated until the fence is signaled.
+  constexpr GLuint64 kTimeout = 1'000'000'000;
+
+  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  // The flush bit sends the commands of this context to the GPU, otherwise
+  // the fence could never be reached.
+  while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kTimeout) ==
+         GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(fence);
+}
+
+bool GpuUploadThread::Start(SharedGlContext context) noexcept {
+  context_ = std::move(context);
+  is_stopping_ = false;
+  is_starting_ = true;
+  thread_ = std::thread(&GpuUploadThread::LoopOverJobs, this);
+
+  // The jobs are only given to the thread once its context is current.
+  bool is_context_current = false;
+  {
+    std::unique_lock lock(mutex_);
+    started_condition_.wait(lock, [this]() { return !is_starting_; });
+    is_context_current = is_context_current_;
+  }
+
+  if (!is_context_current) {
+    thread_.join();
+    std::cerr << "The GPU uploads are done by the render thread.\n";
+  }
+  return is_context_current;
+}
+
+void GpuUploadThread::AddJob(Job* job) noexcept {
+  {
+    std::lock_guard lock(mutex_);
+    jobs_.push(job);
+  }
+  jobs_condition_.notify_one();
+}
+
+void GpuUploadThread::Stop() noexcept {
+  {
+    std::lock_guard lock(mutex_);
+    is_stopping_ = true;
+  }
+  jobs_condition_.notify_one();
+
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool GpuUploadThread::HasPendingJobs() const noexcept {
+  std::lock_guard lock(mutex_);
+  return !jobs_.empty() || is_executing_job_;
+}
+
+void GpuUploadThread::LoopOverJobs() noexcept {
+  const bool is_context_current = context_.make_current();
+  {
+    std::lock_guard lock(mutex_);
+    is_starting_ = false;
+    is_context_current_ = is_context_current;
+  }
+  started_condition_.notify_one();
+
+  if (!is_context_current) {
+    return;
+  }
+
+  while (true) {
+    Job* job = nullptr;
+    {
+      std::unique_lock lock(mutex_);
+      jobs_condition_.wait(lock, [this]() { return is_stopping_ || !jobs_.empty(); });
+
+      if (jobs_.empty()) {
+        break;
+      }
+
+      job = jobs_.front();
+      jobs_.pop();
+      is_executing_job_ = true;
+    }
+
+    job->Execute();
+
+    std::lock_guard lock(mutex_);
+    is_executing_job_ = false;
+  }
+
+  context_.release();
+}
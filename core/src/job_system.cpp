@@ -6,6 +6,18 @@
 #include <Tracy.hpp>
 #endif  // TRACY_ENABLE
 
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+
+namespace {
+
+// Set while a thread executes a ParallelForJob, the ParallelFor calls nested in
+// it run serially instead of queuing jobs.
+thread_local bool is_executing_parallel_for_job = false;
+
+}  // namespace
+
 void Job::Execute() noexcept {
   // Synchronization with all dependencies.
   // -------------------------------------
@@ -45,6 +57,154 @@ void Job::AddDependency(const Job* dependency) noexcept {
   dependencies_.push_back(dependency);
 }
 
+void JobQueue::Push(Job* job) noexcept {
+  std::unique_lock lock(mutex_);
+  jobs_.push(job);
+}
+
+Job* JobQueue::Pop() noexcept {
+  std::unique_lock lock(mutex_);
+  if (jobs_.empty()) {
+    return nullptr;
+  }
+
+  Job* job = jobs_.front();
+  jobs_.pop();
+  return job;
+}
+
+bool JobQueue::IsEmpty() const noexcept {
+  std::shared_lock lock(mutex_);
+  return jobs_.empty();
+}
+
+ParallelForJob::ParallelForJob(
+    const std::function<void(std::size_t, std::size_t)>* func,
+    std::size_t begin, std::size_t end) noexcept
+    : Job(JobType::kNone), function_(func), begin_(begin), end_(end)
+{
+}
+
+void ParallelForJob::Work() noexcept {
+  const bool was_executing_parallel_for_job = is_executing_parallel_for_job;
+  is_executing_parallel_for_job = true;
+  (*function_)(begin_, end_);
+  is_executing_parallel_for_job = was_executing_parallel_for_job;
+}
+
+WorkerPool::WorkerPool() noexcept {
+  const unsigned worker_count = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+  threads_.reserve(worker_count);
+  for (unsigned i = 0; i < worker_count; i++) {
+    // The calling threads execute the jobs too, the pool works with fewer workers.
+    try {
+      threads_.emplace_back(&WorkerPool::LoopOverJobs, this);
+    }
+    catch (const std::system_error& error) {
+      std::cerr << "Could only start " << threads_.size()
+                << " ParallelFor workers: " << error.what() << '\n';
+      break;
+    }
+  }
+}
+
+WorkerPool::~WorkerPool() noexcept {
+  {
+    std::unique_lock lock(mutex_);
+    is_running_ = false;
+  }
+  job_condition_.notify_all();
+
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+WorkerPool& WorkerPool::Instance() noexcept {
+  static WorkerPool pool;
+  return pool;
+}
+
+void WorkerPool::Run(std::vector<ParallelForJob>* jobs) noexcept {
+  std::size_t pending_job_count = jobs->size();
+  {
+    std::unique_lock lock(mutex_);
+    for (auto& job : *jobs) {
+      jobs_.push(QueuedJob{&job, &pending_job_count});
+    }
+  }
+  job_condition_.notify_all();
+
+  std::unique_lock lock(mutex_);
+  while (pending_job_count > 0) {
+    if (jobs_.empty()) {
+      done_condition_.wait(lock);
+      continue;
+    }
+
+    const QueuedJob queued_job = jobs_.front();
+    jobs_.pop();
+    lock.unlock();
+    Execute(queued_job);
+    lock.lock();
+  }
+}
+
+void WorkerPool::LoopOverJobs() noexcept {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    job_condition_.wait(lock, [this]() { return !is_running_ || !jobs_.empty(); });
+    if (jobs_.empty()) {
+      return;
+    }
+
+    const QueuedJob queued_job = jobs_.front();
+    jobs_.pop();
+    lock.unlock();
+    Execute(queued_job);
+    lock.lock();
+  }
+}
+
+void WorkerPool::Execute(const QueuedJob& queued_job) noexcept {
+  queued_job.job->Execute();
+
+  // The Run call can return and destroy its jobs as soon as the count is 0.
+  std::unique_lock lock(mutex_);
+  if (--*queued_job.pending_job_count == 0) {
+    done_condition_.notify_all();
+  }
+}
+
+void ParallelFor(std::size_t count, std::size_t grain_size,
+                 const std::function<void(std::size_t, std::size_t)>& func) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  grain_size = std::max<std::size_t>(grain_size, 1);
+  const std::size_t job_count = (count + grain_size - 1) / grain_size;
+  auto& pool = WorkerPool::Instance();
+  const std::size_t thread_count = std::min(pool.thread_count(), job_count);
+
+  // Not worth waking other threads, or nested in a job whose siblings already
+  // occupy them.
+  if (thread_count <= 1 || is_executing_parallel_for_job) {
+    if (count > 0) {
+      func(0, count);
+    }
+    return;
+  }
+
+  std::vector<ParallelForJob> jobs;
+  jobs.reserve(job_count);
+  for (std::size_t begin = 0; begin < count; begin += grain_size) {
+    jobs.emplace_back(&func, begin, std::min(begin + grain_size, count));
+  }
+
+  pool.Run(&jobs);
+}
+
 Worker::Worker(std::queue<Job*>* jobs) noexcept : jobs_(jobs){}
 
 void Worker::Start() noexcept { 
@@ -112,6 +272,7 @@ void JobSystem::LaunchWorkers(const int worker_count) noexcept {
         break;
       case JobType::kNone:
       case JobType::kMainThread:
+      case JobType::kGpuUpload:
         break;
     }
   }
@@ -163,6 +324,7 @@ void JobSystem::AddJob(Job* job) noexcept {
       main_thread_jobs_.push_back(job);
       break;
     case JobType::kNone:
+    case JobType::kGpuUpload:
       break;
   }
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "lod_selector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+std::size_t LodSelector::LodKeyHash::operator()(const LodKey& key) const noexcept {
+  auto hash = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(key.mesh));
+  hash = (hash ^ key.view_idx) * 0x100000001B3ull;
+  hash = (hash ^ key.instance_idx) * 0x100000001B3ull;
+  return static_cast<std::size_t>(hash ^ (hash >> 29));
+}
+
+void LodSelector::BeginView(std::uint32_t view_idx, const LodView& view) noexcept {
+  view_idx_ = view_idx;
+  view_ = view;
+}
+
+float LodSelector::CalculatePixelsPerUnit(const Mesh& mesh,
+                                          const glm::mat4& model) const noexcept {
+  const float scale = std::max(std::max(glm::length(model[0]), glm::length(model[1])),
+                               glm::length(model[2]));
+
+  if (view_.ortho_height > 0.f) {
+    return scale * view_.viewport_height / view_.ortho_height;
+  }
+
+  // The error is measured at the nearest point of the bounding sphere, a mesh
+  // around the view is drawn with its full level.
+  const auto& bounding_sphere = mesh.bounding_sphere();
+  const glm::vec3 center(model * glm::vec4(bounding_sphere.center(), 1.f));
+  const float distance = glm::length(center - view_.position) -
+                         bounding_sphere.radius() * scale;
+  if (distance <= 0.f) {
+    return std::numeric_limits<float>::max();
+  }
+
+  return scale * view_.viewport_height * 0.5f /
+         (distance * std::tan(view_.fov_y * 0.5f));
+}
+
+std::uint32_t LodSelector::Select(const Mesh& mesh, const glm::mat4& model,
+                                  std::uint32_t instance_idx) noexcept {
+  const auto& lods = mesh.lods();
+  if (lods.size() <= 1) {
+    return 0;
+  }
+
+  const float pixels_per_unit = CalculatePixelsPerUnit(mesh, model);
+  const auto coarsest_lod = [&lods, pixels_per_unit](float max_pixel_error) {
+    // The errors grow with the levels.
+    std::uint32_t lod = 0;
+    while (lod + 1 < lods.size() &&
+           lods[lod + 1].error * pixels_per_unit <= max_pixel_error) {
+      lod++;
+    }
+    return lod;
+  };
+
+  const auto [selected_lod, is_new] = selected_lods_.Insert(
+      LodKey{&mesh, view_idx_, instance_idx}, 0);
+  const auto lod = coarsest_lod(max_pixel_error_);
+  if (is_new || lod < *selected_lod) {
+    *selected_lod = lod;
+  }
+  else if (lod > *selected_lod) {
+    *selected_lod = std::max(*selected_lod, coarsest_lod(max_pixel_error_ * hysteresis_));
+  }
+
+  return *selected_lod;
+}
+
+void LodSelector::Clear() noexcept {
+  selected_lods_ = FlatHashMap<LodKey, std::uint32_t, LodKeyHash>{};
+}
@@ -1,47 +1,257 @@
 #include "material.h"
 #include "error.h"
+#include "gpu_memory.h"
+#include "sampler.h"
 
-Material::~Material() noexcept {
-  const auto not_destroyed = albedo_map != 0 || normal_map != 0 ||
-                             metallic_map != 0 || roughness_map != 0 ||
-                             ao_map != 0;
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <iostream>
+
+MaterialSystem::~MaterialSystem() noexcept {
+  const auto not_destroyed = layers_buffer_ != 0 || placeholder_array_ != 0 ||
+      std::any_of(arrays_.begin(), arrays_.end(),
+                  [](const TextureArray& array) { return array.id != 0; });
   if (not_destroyed) {
-    LOG_ERROR("Material not destroyed !");
-  }
-}
-
-void Material::Create(const GLuint & albedo, const GLuint & normal, const GLuint & metallic, 
-                      const GLuint & roughness, const GLuint & ao) {
-  albedo_map = std::move(albedo);
-  normal_map = std::move(normal);
-  metallic_map = std::move(metallic);
-  roughness_map = std::move(roughness);
-  ao_map = std::move(ao);
-}
-
-void Material::Bind(GLenum gl_texture_idx) const noexcept {
-  glActiveTexture(gl_texture_idx);
-  glBindTexture(GL_TEXTURE_2D, albedo_map);
-  glActiveTexture(gl_texture_idx + 1);
-  glBindTexture(GL_TEXTURE_2D, normal_map);
-  glActiveTexture(gl_texture_idx + 2);
-  glBindTexture(GL_TEXTURE_2D, metallic_map);
-  glActiveTexture(gl_texture_idx + 3);
-  glBindTexture(GL_TEXTURE_2D, roughness_map);
-  glActiveTexture(gl_texture_idx + 4);
-  glBindTexture(GL_TEXTURE_2D, ao_map);
-}
-
-void Material::Destroy() { 
-  glDeleteTextures(1, &albedo_map);
-  glDeleteTextures(1, &normal_map);
-  glDeleteTextures(1, &metallic_map);
-  glDeleteTextures(1, &roughness_map);
-  glDeleteTextures(1, &ao_map);
-
-  albedo_map = 0;
-  normal_map = 0;
-  metallic_map = 0;
-  roughness_map = 0;
-  ao_map = 0;
+    LOG_ERROR("Material system not destroyed !");
+  }
+}
+
+void MaterialSystem::Begin(std::size_t texture_count,
+                           VirtualTextureSystem* virtual_texture_system) noexcept {
+  texture_layers_.assign(texture_count, TextureLayer{});
+  virtual_texture_ids_.assign(texture_count, VirtualTextureSystem::kNoVirtualTexture);
+  virtual_texture_system_ = virtual_texture_system;
+  materials_.reserve(kMaxMaterialCount);
+  bound_virtual_textures_.fill(VirtualTextureSystem::kNoVirtualTexture);
+}
+
+void MaterialSystem::End() noexcept {
+  for (auto& array : arrays_) {
+    GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, array.id);
+    glDeleteTextures(1, &array.id);
+    array.id = 0;
+  }
+  glDeleteBuffers(1, &layers_buffer_);
+  layers_buffer_ = 0;
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, placeholder_array_);
+  glDeleteTextures(1, &placeholder_array_);
+  placeholder_array_ = 0;
+
+  arrays_.clear();
+  texture_layers_.clear();
+  virtual_texture_ids_.clear();
+  virtual_texture_system_ = nullptr;
+  materials_.clear();
+  bound_arrays_.fill(0);
+  bound_virtual_textures_.fill(VirtualTextureSystem::kNoVirtualTexture);
+}
+
+void MaterialSystem::AddTexture(std::size_t texture_idx,
+                                const CookedTextureHeader& header,
+                                const TextureParameters& tex_param) noexcept {
+  auto array = std::find_if(arrays_.begin(), arrays_.end(),
+      [&header, &tex_param](const TextureArray& array) {
+        return array.header.internal_format == header.internal_format &&
+               array.header.width == header.width &&
+               array.header.height == header.height &&
+               array.header.level_count == header.level_count &&
+               array.wrapping_param == tex_param.wrapping_param &&
+               array.filtering_param == tex_param.filtering_param;
+      });
+
+  if (array == arrays_.end()) {
+    arrays_.push_back(TextureArray{0, header, tex_param.wrapping_param,
+                                   tex_param.filtering_param, 0});
+    array = arrays_.end() - 1;
+  }
+
+  texture_layers_[texture_idx] = TextureLayer{
+      static_cast<std::uint32_t>(array - arrays_.begin()), array->layer_count};
+  array->layer_count++;
+}
+
+void MaterialSystem::AddVirtualTexture(std::size_t texture_idx,
+                                       std::int32_t virtual_texture_id) noexcept {
+  virtual_texture_ids_[texture_idx] = virtual_texture_id;
+}
+
+void MaterialSystem::CreateArrays(TextureStreamer* texture_streamer) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // The streamer only allocates the mip tail of the layers, the storage grows
+  // with the streamed levels and shrinks when they are evicted.
+  for (auto& array : arrays_) {
+    texture_streamer->AddArray(&array.id, array.header, array.layer_count,
+                               array.wrapping_param, array.filtering_param);
+  }
+  CreatePlaceholders();
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  AcquireSamplers();
+}
+
+void MaterialSystem::CreatePlaceholders() noexcept {
+  // Linear RGBA8 texels of the albedo, normal, ARM and emissive maps.
+  constexpr std::array<std::uint8_t, kMaterialMapCount * 4> kPlaceholderTexels{
+      128, 128, 128, 255,
+      128, 128, 255, 255,
+      255, 255, 0, 255,
+      0, 0, 0, 255};
+
+  glGenTextures(1, &placeholder_array_);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, placeholder_array_);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, 1, 1, kMaterialMapCount);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, 1, 1, kMaterialMapCount, GL_RGBA,
+                  GL_UNSIGNED_BYTE, kPlaceholderTexels.data());
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, placeholder_array_,
+                                 GpuMemoryCategory::kTexture,
+                                 CalculateTextureSize(GL_RGBA8, 1, 1, kMaterialMapCount));
+}
+
+void MaterialSystem::AcquireSamplers() noexcept {
+  // The filtering parameter of the textures only chooses between linear and
+  // nearest, the mips of the arrays are always sampled.
+  for (auto& array : arrays_) {
+    array.sampler = GetSamplerCache().Acquire(
+        MakeSamplerParameters(array.wrapping_param, array.filtering_param,
+                              array.header.level_count > 1, max_anisotropy_));
+  }
+  placeholder_sampler_ = GetSamplerCache().Acquire(
+      MakeSamplerParameters(GL_REPEAT, GL_NEAREST, false, 1.f));
+}
+
+void MaterialSystem::set_max_anisotropy(float max_anisotropy) noexcept {
+  max_anisotropy = SnapAnisotropy(
+      std::min(max_anisotropy, GetSamplerCache().max_supported_anisotropy()));
+  if (max_anisotropy == max_anisotropy_) {
+    return;
+  }
+  max_anisotropy_ = max_anisotropy;
+  AcquireSamplers();
+  bound_arrays_.fill(0);
+}
+
+std::size_t MaterialSystem::AddMaterial(const Material& material) noexcept {
+  if (materials_.size() >= kMaxMaterialCount) {
+    std::cerr << "Too many materials, the material " << materials_.size()
+              << " uses the first one.\n";
+    return 0;
+  }
+
+  materials_.push_back(material);
+  return materials_.size() - 1;
+}
+
+bool MaterialSystem::UpdateResidency(const TextureStreamer& texture_streamer) noexcept {
+  bool is_changed = false;
+  for (std::size_t i = 0; i < texture_layers_.size(); i++) {
+    auto& texture_layer = texture_layers_[i];
+    if (texture_layer.layer >= 0 && !texture_layer.is_resident &&
+        texture_streamer.is_resident(i)) {
+      texture_layer.is_resident = true;
+      is_changed = true;
+    }
+  }
+  return is_changed;
+}
+
+void MaterialSystem::UploadMaterials() noexcept {
+  // std140 layout: one ivec4 of layers per material. The maps which are not
+  // resident use the layer of their map in the placeholder array.
+  std::vector<GLint> layers(kMaxMaterialCount * kMaterialMapCount, -1);
+  for (std::size_t i = 0; i < materials_.size(); i++) {
+    for (std::size_t map = 0; map < kMaterialMapCount; map++) {
+      const auto texture_idx = materials_[i].textures[map];
+      if (texture_idx != Material::kNoTexture) {
+        const auto& texture_layer = texture_layers_[texture_idx];
+        layers[i * kMaterialMapCount + map] = texture_layer.is_resident
+                                                  ? texture_layer.layer
+                                                  : static_cast<GLint>(map);
+      }
+    }
+  }
+
+  if (virtual_texture_system_ != nullptr) {
+    for (std::size_t i = 0; i < materials_.size(); i++) {
+      std::array<std::int32_t, kMaterialMapCount> virtual_textures;
+      for (std::size_t map = 0; map < kMaterialMapCount; map++) {
+        const auto texture_idx = materials_[i].textures[map];
+        virtual_textures[map] = texture_idx != Material::kNoTexture
+                                    ? virtual_texture_ids_[texture_idx]
+                                    : VirtualTextureSystem::kNoVirtualTexture;
+      }
+      virtual_texture_system_->SetMaterialTextures(static_cast<std::uint32_t>(i),
+                                                   virtual_textures);
+    }
+  }
+
+  if (layers_buffer_ == 0) {
+    glGenBuffers(1, &layers_buffer_);
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, layers_buffer_);
+  glBufferData(GL_UNIFORM_BUFFER, layers.size() * sizeof(GLint), layers.data(),
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void MaterialSystem::BeginPass() noexcept {
+  glBindBufferBase(GL_UNIFORM_BUFFER, kLayersBindingPoint, layers_buffer_);
+  bound_arrays_.fill(0);
+  bound_virtual_textures_.fill(VirtualTextureSystem::kNoVirtualTexture);
+}
+
+void MaterialSystem::EndPass() noexcept {
+  for (std::size_t map = 0; map < kMaterialMapCount; map++) {
+    glBindSampler(static_cast<GLuint>(map), 0);
+  }
+  bound_arrays_.fill(0);
+  bound_virtual_textures_.fill(VirtualTextureSystem::kNoVirtualTexture);
+}
+
+void MaterialSystem::Bind(std::size_t material_idx, const Pipeline& pipeline) noexcept {
+  const auto& material = materials_[material_idx];
+
+  for (std::size_t map = 0; map < kMaterialMapCount; map++) {
+    const auto texture_idx = material.textures[map];
+    if (texture_idx == Material::kNoTexture) {
+      continue;
+    }
+
+    // The virtual textures unbind the sampler of the unit, the arrays then
+    // bind it again.
+    const auto virtual_texture_id = virtual_texture_ids_[texture_idx];
+    if (virtual_texture_id != VirtualTextureSystem::kNoVirtualTexture) {
+      if (bound_virtual_textures_[map] != virtual_texture_id) {
+        virtual_texture_system_->Bind(virtual_texture_id, map, pipeline);
+        bound_virtual_textures_[map] = virtual_texture_id;
+        bound_arrays_[map] = 0;
+      }
+      continue;
+    }
+
+    // The textures which are not resident yet, or could not be loaded and
+    // have no layer, sample their placeholder.
+    const auto& texture_layer = texture_layers_[texture_idx];
+    const bool is_placeholder = texture_layer.layer < 0 || !texture_layer.is_resident;
+    const GLuint array_id = is_placeholder ? placeholder_array_
+                                           : arrays_[texture_layer.array_idx].id;
+    if (bound_arrays_[map] != array_id) {
+      glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(map));
+      glBindTexture(GL_TEXTURE_2D_ARRAY, array_id);
+      glBindSampler(static_cast<GLuint>(map),
+                    is_placeholder ? placeholder_sampler_
+                                   : arrays_[texture_layer.array_idx].sampler);
+      bound_arrays_[map] = array_id;
+      bound_virtual_textures_[map] = VirtualTextureSystem::kNoVirtualTexture;
+    }
+  }
+
+  pipeline.SetInt("material_index", static_cast<int>(material_idx));
 }
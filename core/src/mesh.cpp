@@ -1,36 +1,110 @@
 #include "mesh.h"
 #include "error.h"
 
+#include <glm/gtc/packing.hpp>
+
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <string>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 
-Mesh::Mesh(const std::vector<Vertex>& vertices,
-           const std::vector<GLuint>& indices) {
-  vertices_ = vertices;
-  indices_ = indices;
+namespace {
+
+// Projects the direction on the octahedron |x| + |y| + |z| = 1 whose lower half
+// is folded over the upper one, decoded by DecodeOctahedral in the vertex
+// shaders. A null vector is encoded as +Z.
+glm::vec2 EncodeOctahedral(const glm::vec3& direction) noexcept {
+  const float sum = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+  if (sum <= 0.f) {
+    return glm::vec2(0.f);
+  }
+
+  const glm::vec3 n = direction / sum;
+  if (n.z >= 0.f) {
+    return glm::vec2(n.x, n.y);
+  }
+
+  return glm::vec2((1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f),
+                   (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f));
 }
 
-Mesh::Mesh(const std::vector<Vertex>& vertices,
-           const std::vector<GLuint>& indices,
-           const std::vector<Texture>& textures) {
-  vertices_ = vertices;
-  indices_ = indices;
-  textures_ = textures;
+}  // namespace
+
+PackedVertex PackVertex(const Vertex& vertex) noexcept {
+  PackedVertex packed_vertex;
+  packed_vertex.position = vertex.position;
+
+  const auto normal = EncodeOctahedral(vertex.normal);
+  packed_vertex.normal = {static_cast<std::int16_t>(glm::packSnorm1x16(normal.x)),
+                          static_cast<std::int16_t>(glm::packSnorm1x16(normal.y))};
+
+  packed_vertex.uv = {glm::packHalf1x16(vertex.uv.x), glm::packHalf1x16(vertex.uv.y)};
+
+  // The meshes without bitangents keep the right handed frame.
+  const auto tangent = EncodeOctahedral(vertex.tangent);
+  const bool is_mirrored =
+      glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.bitangent) < 0.f;
+  packed_vertex.tangent = {static_cast<std::int8_t>(glm::packSnorm1x8(tangent.x)),
+                           static_cast<std::int8_t>(glm::packSnorm1x8(tangent.y)),
+                           static_cast<std::int8_t>(is_mirrored ? -127 : 127), 0};
+
+  return packed_vertex;
 }
 
-Mesh::Mesh(Mesh&& other) noexcept {
-  // Transfer ownership of data.
-  vertices_ = std::move(other.vertices_);
-  indices_ = std::move(other.indices_);
-  textures_ = std::move(other.textures_);
+std::vector<PackedVertex> PackVertices(const Vertex* vertices, std::size_t count) {
+  std::vector<PackedVertex> packed_vertices(count);
+  for (std::size_t i = 0; i < count; i++) {
+    packed_vertices[i] = PackVertex(vertices[i]);
+  }
+  return packed_vertices;
+}
 
-  vao_ = std::move(other.vao_);
-  vbo_ = std::move(other.vbo_);
-  ebo_ = std::move(other.ebo_);
+GLenum ChooseIndexType(std::size_t vertex_count) noexcept {
+  return vertex_count <= std::numeric_limits<std::uint16_t>::max() + std::size_t{1}
+             ? GL_UNSIGNED_SHORT
+             : GL_UNSIGNED_INT;
+}
+
+std::vector<std::uint16_t> NarrowIndices(const GLuint* indices, std::size_t count) {
+  std::vector<std::uint16_t> narrow_indices(count);
+  for (std::size_t i = 0; i < count; i++) {
+    narrow_indices[i] = static_cast<std::uint16_t>(indices[i]);
+  }
+  return narrow_indices;
+}
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices)
+    : vertices_(std::move(vertices)), indices_(std::move(indices)) {}
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices,
+           std::vector<Texture> textures)
+    : vertices_(std::move(vertices)),
+      indices_(std::move(indices)),
+      textures_(std::move(textures)) {}
+
+Mesh::Mesh(const PackedVertex* vertices, std::size_t vertex_count, const void* indices,
+           std::size_t index_count, GLenum index_type,
+           const std::vector<Texture>& textures,
+           const BoundingSphere& bounding_volume, const std::vector<MeshLod>& lods,
+           const std::vector<Meshlet>& meshlets)
+    : textures_(textures),
+      external_vertices_(vertices),
+      external_vertex_count_(vertex_count),
+      external_indices_(indices),
+      external_index_count_(index_count),
+      external_index_type_(index_type),
+      bounding_volume_(bounding_volume),
+      lods_(lods)
+{
+  SetMeshlets(meshlets);
+}
+
+Mesh::Mesh(Mesh&& other) noexcept {
+  *this = std::move(other);
 }
 
 Mesh& Mesh::operator=(Mesh&& other) noexcept {
@@ -38,10 +112,23 @@ Mesh& Mesh::operator=(Mesh&& other) noexcept {
   vertices_ = std::move(other.vertices_);
   indices_ = std::move(other.indices_);
   textures_ = std::move(other.textures_);
+  external_vertices_ = other.external_vertices_;
+  external_vertex_count_ = other.external_vertex_count_;
+  external_indices_ = other.external_indices_;
+  external_index_count_ = other.external_index_count_;
+  external_index_type_ = other.external_index_type_;
 
   vao_ = std::move(other.vao_);
   vbo_ = std::move(other.vbo_);
   ebo_ = std::move(other.ebo_);
+  arena_ = other.arena_;
+  arena_allocation_ = other.arena_allocation_;
+  other.arena_ = nullptr;
+  other.arena_allocation_ = GeometryAllocation{};
+  bounding_volume_ = other.bounding_volume_;
+  lods_ = std::move(other.lods_);
+  meshlets_ = std::move(other.meshlets_);
+  meshlet_bounds_ = std::move(other.meshlet_bounds_);
 
   return *this;
 }
@@ -304,66 +391,89 @@ void Mesh::CreateScreenQuad() noexcept {
 }
 
 void Mesh::CreateSphere() noexcept {
-  constexpr std::uint8_t kSegmentsX = 64;
-  constexpr std::uint8_t kSegmentsY = 64;
-
-  vertices_.reserve((kSegmentsX + 1) * (kSegmentsY + 1));
-
-  for (std::uint8_t x = 0; x <= kSegmentsX; x++) {
-    for (std::uint8_t y = 0; y <= kSegmentsY; y++) {
-      float x_segment = static_cast<float>(x) / static_cast<float>(kSegmentsX);
-      float y_segment = static_cast<float>(y) / static_cast<float>(kSegmentsY);
-
-      // Calculate vertex attributs in spherical coordinates.
-      // ----------------------------------------------------
-      float theta = 2.0f * M_PI * x_segment;
-      float phi = M_PI * y_segment;
-
-      float xPos = std::sin(phi) * std::cos(theta);
-      float yPos = std::cos(phi);
-      float zPos = std::sin(phi) * std::sin(theta);
-
-      const auto position = glm::vec3(xPos, yPos, zPos);
-      const auto normal = glm::normalize(position);
-      const auto uv = glm::vec2(x_segment, y_segment);
-      glm::vec3 tangent(0.f);
-      tangent.x = std::sin(theta) * std::cos(phi);
-      tangent.y = std::sin(theta) * std::sin(phi);
-      tangent.z = std::cos(theta);
-
-      Vertex v = {
-          position,
-          normal,  
-          uv, 
-          tangent,
-          // bitangent is calculated in the vertex shader.
-      };
-
-      vertices_.push_back(v);
-    }
-  }
+  // The levels of detail are spheres with less segments, their vertices and
+  // triangle strips follow the ones of the full sphere.
+  constexpr std::array<std::uint8_t, 4> kLodSegments = {64, 32, 16, 8};
 
-  indices_.reserve(2 * vertices_.size());
-  bool odd_row = false;
-  for (std::uint8_t y = 0; y < kSegmentsY; y++) {
-    if (!odd_row)
-    {
-      for (std::uint8_t x = 0; x <= kSegmentsX; x++) {
-        indices_.push_back(y * (kSegmentsX + 1) + x);
-        indices_.push_back((y + 1) * (kSegmentsX + 1) + x);
+  std::size_t vertex_count = 0;
+  for (const auto segments : kLodSegments) {
+    vertex_count += (segments + 1) * (segments + 1);
+  }
+  vertices_.reserve(vertex_count);
+  indices_.reserve(2 * vertex_count);
+  lods_.clear();
+
+  for (const auto segments : kLodSegments) {
+    const auto first_vertex = static_cast<GLuint>(vertices_.size());
+    const auto first_index = static_cast<std::uint32_t>(indices_.size());
+
+    for (std::uint8_t x = 0; x <= segments; x++) {
+      for (std::uint8_t y = 0; y <= segments; y++) {
+        float x_segment = static_cast<float>(x) / static_cast<float>(segments);
+        float y_segment = static_cast<float>(y) / static_cast<float>(segments);
+
+        // Calculate vertex attributs in spherical coordinates.
+        // ----------------------------------------------------
+        float theta = 2.0f * M_PI * x_segment;
+        float phi = M_PI * y_segment;
+
+        float xPos = std::sin(phi) * std::cos(theta);
+        float yPos = std::cos(phi);
+        float zPos = std::sin(phi) * std::sin(theta);
+
+        const auto position = glm::vec3(xPos, yPos, zPos);
+        const auto normal = glm::normalize(position);
+        const auto uv = glm::vec2(x_segment, y_segment);
+        glm::vec3 tangent(0.f);
+        tangent.x = std::sin(theta) * std::cos(phi);
+        tangent.y = std::sin(theta) * std::sin(phi);
+        tangent.z = std::cos(theta);
+
+        Vertex v = {
+            position,
+            normal,  
+            uv, 
+            tangent,
+            // bitangent is calculated in the vertex shader.
+        };
+
+        vertices_.push_back(v);
       }
-    } 
-    else {
-      for (std::int8_t x = kSegmentsX; x >= 0; --x) {
-        indices_.push_back((y + 1) * (kSegmentsX + 1) + x);
-        indices_.push_back(y * (kSegmentsX + 1) + x);
+    }
+
+    bool odd_row = false;
+    for (std::uint8_t y = 0; y < segments; y++) {
+      if (!odd_row)
+      {
+        for (std::uint8_t x = 0; x <= segments; x++) {
+          indices_.push_back(first_vertex + y * (segments + 1) + x);
+          indices_.push_back(first_vertex + (y + 1) * (segments + 1) + x);
+        }
+      } 
+      else {
+        for (std::int16_t x = segments; x >= 0; --x) {
+          indices_.push_back(first_vertex + (y + 1) * (segments + 1) + x);
+          indices_.push_back(first_vertex + y * (segments + 1) + x);
+        }
       }
+      odd_row = !odd_row;
     }
-    odd_row = !odd_row;
+
+    // Distance between an arc of the unit circle and its chord.
+    const float error = segments == kLodSegments.front()
+                            ? 0.f
+                            : 1.f - std::cos(static_cast<float>(M_PI) / segments);
+    lods_.push_back(MeshLod{first_index,
+                            static_cast<std::uint32_t>(indices_.size()) - first_index,
+                            error});
   }
 }
 
 void Mesh::Destroy() noexcept {
+  if (arena_ != nullptr) {
+    arena_->Free(&arena_allocation_);
+    arena_ = nullptr;
+  }
   vao_.Destroy();
   vbo_.Destroy();
   model_matrix_buffer_.Destroy();
@@ -372,6 +482,11 @@ void Mesh::Destroy() noexcept {
 
 void Mesh::SetupModelMatrixBuffer(const glm::mat4* model_matrix_data,
                                   const std::size_t& size, GLenum buffer_usage) {
+  if (arena_ != nullptr) {
+    LOG_ERROR("The meshes of a geometry arena have no model matrix buffer.");
+    return;
+  }
+
   model_matrix_buffer_.Create();
 
   vao_.Bind();
@@ -391,6 +506,42 @@ void Mesh::SetupModelMatrixBuffer(const glm::mat4* model_matrix_data,
   vao_.UnBind();
 }
 
+void Mesh::LoadToArena(GeometryArena* arena) {
+  if (external_vertices_ != nullptr) {
+    arena_allocation_ = arena->Allocate(external_vertices_, external_vertex_count_,
+                                        external_indices_, external_index_count_,
+                                        external_index_type_);
+  }
+  else {
+    const auto packed_vertices = PackVertices(vertices_.data(), vertices_.size());
+    if (ChooseIndexType(vertices_.size()) == GL_UNSIGNED_SHORT) {
+      const auto narrow_indices = NarrowIndices(indices_.data(), indices_.size());
+      arena_allocation_ = arena->Allocate(packed_vertices.data(), packed_vertices.size(),
+                                          narrow_indices.data(), narrow_indices.size(),
+                                          GL_UNSIGNED_SHORT);
+    }
+    else {
+      arena_allocation_ = arena->Allocate(packed_vertices.data(), packed_vertices.size(),
+                                          indices_.data(), indices_.size(),
+                                          GL_UNSIGNED_INT);
+    }
+  }
+  arena_ = arena;
+  ForgetExternalData();
+
+  if (lods_.empty()) {
+    lods_.push_back(
+        MeshLod{0, static_cast<std::uint32_t>(arena_allocation_.index_count), 0.f});
+  }
+}
+
+void Mesh::ForgetExternalData() noexcept {
+  external_vertices_ = nullptr;
+  external_vertex_count_ = 0;
+  external_indices_ = nullptr;
+  external_index_count_ = 0;
+}
+
 void Mesh::SetModelMatrixBufferSubData(const glm::mat4* model_matrix_data, 
                                        const std::size_t& size) noexcept {
   model_matrix_buffer_.Bind();
@@ -418,29 +569,58 @@ void Mesh::GenerateBoundingSphere() {
   bounding_volume_ = BoundingSphere(center, radius);
 }
 
-void Mesh::LoadToGpu() {
+void Mesh::SetMeshlets(std::vector<Meshlet> meshlets) {
+  meshlets_ = std::move(meshlets);
+  meshlet_bounds_.Build(meshlets_);
+}
+
+void Mesh::LoadToGpu(GeometryArena* arena) {
+  if (arena != nullptr) {
+    LoadToArena(arena);
+    return;
+  }
+
   vao_.Create();
   vbo_.Create();
   ebo_.Create();
 
-  // Bind vbo and set its data.
+  // Bind vbo and set its data. The external vertices and indices are given to
+  // the driver as they are, they are forgotten once uploaded.
   vao_.AttachVBO(vbo_);
-  vbo_.SetData(vertices_.data(), vertices_.size(), GL_STATIC_DRAW);
+  if (external_vertices_ != nullptr) {
+    vbo_.SetData(external_vertices_, external_vertex_count_, GL_STATIC_DRAW);
+  }
+  else {
+    const auto packed_vertices = PackVertices(vertices_.data(), vertices_.size());
+    vbo_.SetData(packed_vertices.data(), packed_vertices.size(), GL_STATIC_DRAW);
+  }
 
   // Bind ebo and set its data.
   vao_.AttachEBO(ebo_);
-  ebo_.SetData(indices_);
+  if (external_indices_ != nullptr) {
+    ebo_.SetData(external_indices_, external_index_count_, external_index_type_);
+  }
+  else if (ChooseIndexType(vertices_.size()) == GL_UNSIGNED_SHORT) {
+    const auto narrow_indices = NarrowIndices(indices_.data(), indices_.size());
+    ebo_.SetData(narrow_indices.data(), narrow_indices.size(), GL_UNSIGNED_SHORT);
+  }
+  else {
+    ebo_.SetData(indices_);
+  }
+  ForgetExternalData();
 
-  // Create the input vertex layout.
+  if (lods_.empty()) {
+    lods_.push_back(MeshLod{0, static_cast<std::uint32_t>(ebo_.element_count()), 0.f});
+  }
+
+  // Create the input vertex layout, see PackedVertex.
   VertexAttributeLayout vertex_layout;
   vertex_layout.PushAttribute(VertexAttribute(3, GL_FLOAT, GL_FALSE));  // positions.
   vertex_layout.PushAttribute(
-      VertexAttribute(3, GL_FLOAT, GL_FALSE));  // normals.
-  vertex_layout.PushAttribute(VertexAttribute(2, GL_FLOAT, GL_FALSE));  // uv.
-  vertex_layout.PushAttribute(
-      VertexAttribute(3, GL_FLOAT, GL_FALSE));  // tangents.
+      VertexAttribute(2, GL_SHORT, GL_TRUE));  // octahedral normals.
+  vertex_layout.PushAttribute(VertexAttribute(2, GL_HALF_FLOAT, GL_FALSE));  // uv.
   vertex_layout.PushAttribute(
-      VertexAttribute(3, GL_FLOAT, GL_FALSE));  // bitangents.
+      VertexAttribute(4, GL_BYTE, GL_TRUE));  // octahedral tangents and sign.
 
   vao_.SetupVertexAttributes(vertex_layout);
 
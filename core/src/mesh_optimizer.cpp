@@ -0,0 +1,318 @@
+#include "mesh_optimizer.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+constexpr std::int64_t kNoVertex = -1;
+
+// Next vertex to fan around after a dead end: the last emitted vertex which
+// still has triangles, otherwise the next one in the input order.
+std::int64_t SkipDeadEnd(const std::vector<std::uint32_t>& live_triangle_counts,
+                         std::vector<GLuint>* dead_ends, std::size_t* cursor) noexcept {
+  while (!dead_ends->empty()) {
+    const auto vertex = dead_ends->back();
+    dead_ends->pop_back();
+    if (live_triangle_counts[vertex] > 0) {
+      return vertex;
+    }
+  }
+
+  for (; *cursor < live_triangle_counts.size(); (*cursor)++) {
+    if (live_triangle_counts[*cursor] > 0) {
+      return static_cast<std::int64_t>(*cursor);
+    }
+  }
+
+  return kNoVertex;
+}
+
+}  // namespace
+
+float CalculateAcmr(const std::vector<GLuint>& indices, std::size_t vertex_count,
+                    std::uint32_t cache_size) noexcept {
+  const std::size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) {
+    return 0.f;
+  }
+
+  // Miss count when the vertex entered the cache, 0 if it never did. The
+  // vertex leaves the FIFO after cache_size other misses.
+  std::vector<std::size_t> insertions(vertex_count, 0);
+  std::size_t miss_count = 0;
+  for (const auto index : indices) {
+    if (insertions[index] == 0 || miss_count - insertions[index] >= cache_size) {
+      miss_count++;
+      insertions[index] = miss_count;
+    }
+  }
+
+  return static_cast<float>(miss_count) / static_cast<float>(triangle_count);
+}
+
+void OptimizeVertexCache(std::vector<GLuint>* indices, std::size_t vertex_count,
+                         std::vector<std::size_t>* clusters,
+                         std::uint32_t cache_size) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  clusters->clear();
+  const auto& input = *indices;
+  const std::size_t triangle_count = input.size() / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // Triangles using each vertex, a triangle appears once per corner.
+  std::vector<std::uint32_t> live_triangle_counts(vertex_count, 0);
+  for (const auto index : input) {
+    live_triangle_counts[index]++;
+  }
+
+  std::vector<std::size_t> adjacency_offsets(vertex_count + 1, 0);
+  for (std::size_t v = 0; v < vertex_count; v++) {
+    adjacency_offsets[v + 1] = adjacency_offsets[v] + live_triangle_counts[v];
+  }
+
+  std::vector<std::uint32_t> adjacency(input.size());
+  std::vector<std::size_t> adjacency_ends(adjacency_offsets.begin(),
+                                          adjacency_offsets.end() - 1);
+  for (std::size_t i = 0; i < input.size(); i++) {
+    adjacency[adjacency_ends[input[i]]++] = static_cast<std::uint32_t>(i / 3);
+  }
+
+  // Time stamps of the vertices in the simulated cache, a vertex is in the cache
+  // while time - cache_times[v] <= cache_size.
+  std::vector<std::size_t> cache_times(vertex_count, 0);
+  std::size_t time = cache_size + 1;
+
+  std::vector<bool> is_emitted(triangle_count, false);
+  std::vector<GLuint> dead_ends;
+  std::vector<GLuint> candidates;
+  std::vector<GLuint> output;
+  output.reserve(triangle_count * 3);
+  std::size_t cursor = 0;
+
+  auto fanning_vertex = SkipDeadEnd(live_triangle_counts, &dead_ends, &cursor);
+  bool is_dead_end = true;
+  while (fanning_vertex != kNoVertex) {
+    if (is_dead_end) {
+      clusters->push_back(output.size());
+    }
+
+    // Emits all the remaining triangles around the fanning vertex.
+    candidates.clear();
+    const auto fanning_idx = static_cast<std::size_t>(fanning_vertex);
+    for (std::size_t a = adjacency_offsets[fanning_idx];
+         a < adjacency_offsets[fanning_idx + 1]; a++) {
+      const auto triangle = adjacency[a];
+      if (is_emitted[triangle]) {
+        continue;
+      }
+
+      for (std::size_t corner = 0; corner < 3; corner++) {
+        const auto vertex = input[triangle * 3 + corner];
+        output.push_back(vertex);
+        dead_ends.push_back(vertex);
+        candidates.push_back(vertex);
+        live_triangle_counts[vertex]--;
+
+        if (time - cache_times[vertex] > cache_size) {
+          cache_times[vertex] = time;
+          time++;
+        }
+      }
+      is_emitted[triangle] = true;
+    }
+
+    // The next fanning vertex is the oldest candidate which will still be in
+    // the cache once all its triangles are emitted, or any candidate with
+    // triangles left.
+    fanning_vertex = kNoVertex;
+    std::int64_t best_priority = -1;
+    for (const auto vertex : candidates) {
+      if (live_triangle_counts[vertex] == 0) {
+        continue;
+      }
+
+      std::int64_t priority = 0;
+      const auto age = time - cache_times[vertex];
+      if (age + 2 * live_triangle_counts[vertex] <= cache_size) {
+        priority = static_cast<std::int64_t>(age);
+      }
+      if (priority > best_priority) {
+        best_priority = priority;
+        fanning_vertex = vertex;
+      }
+    }
+
+    is_dead_end = fanning_vertex == kNoVertex;
+    if (is_dead_end) {
+      fanning_vertex = SkipDeadEnd(live_triangle_counts, &dead_ends, &cursor);
+    }
+  }
+
+  indices->swap(output);
+}
+
+void OptimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<GLuint>* indices,
+                      const std::vector<std::size_t>& clusters,
+                      float acmr_threshold) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const auto& input = *indices;
+  if (clusters.size() <= 1) {
+    return;
+  }
+
+  // Area weighted centroids and normals of the clusters and of the mesh.
+  struct Cluster {
+    std::size_t begin = 0, end = 0;
+    glm::vec3 centroid{0.f};
+    glm::vec3 normal{0.f};
+    float area = 0.f;
+    float sort_key = 0.f;
+  };
+
+  std::vector<Cluster> sorted_clusters(clusters.size());
+  glm::vec3 mesh_centroid(0.f);
+  float mesh_area = 0.f;
+  for (std::size_t c = 0; c < clusters.size(); c++) {
+    auto& cluster = sorted_clusters[c];
+    cluster.begin = clusters[c];
+    cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : input.size();
+
+    for (std::size_t i = cluster.begin; i < cluster.end; i += 3) {
+      const auto& p0 = vertices[input[i]].position;
+      const auto& p1 = vertices[input[i + 1]].position;
+      const auto& p2 = vertices[input[i + 2]].position;
+      const auto normal = glm::cross(p1 - p0, p2 - p0);
+      const float area = glm::length(normal) * 0.5f;
+
+      cluster.centroid += (p0 + p1 + p2) * (area / 3.f);
+      cluster.normal += normal;
+      cluster.area += area;
+    }
+
+    mesh_centroid += cluster.centroid;
+    mesh_area += cluster.area;
+    if (cluster.area > 0.f) {
+      cluster.centroid /= cluster.area;
+    }
+  }
+  if (mesh_area > 0.f) {
+    mesh_centroid /= mesh_area;
+  }
+
+  for (auto& cluster : sorted_clusters) {
+    const float normal_length = glm::length(cluster.normal);
+    if (cluster.area > 0.f && normal_length > 0.f) {
+      cluster.sort_key = glm::dot(cluster.centroid - mesh_centroid,
+                                  cluster.normal / normal_length);
+    }
+  }
+
+  std::stable_sort(sorted_clusters.begin(), sorted_clusters.end(),
+                   [](const Cluster& lhs, const Cluster& rhs) {
+                     return lhs.sort_key > rhs.sort_key;
+                   });
+
+  std::vector<GLuint> output;
+  output.reserve(input.size());
+  for (const auto& cluster : sorted_clusters) {
+    output.insert(output.end(), input.begin() + cluster.begin,
+                  input.begin() + cluster.end);
+  }
+
+  // The clusters start with a cache flush most of the time, moving them around
+  // can still cost a few misses on their boundaries.
+  if (CalculateAcmr(output, vertices.size()) >
+      CalculateAcmr(input, vertices.size()) * acmr_threshold) {
+    return;
+  }
+
+  indices->swap(output);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>* vertices,
+                         std::vector<GLuint>* indices) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  constexpr GLuint kNotRemapped = std::numeric_limits<GLuint>::max();
+  std::vector<GLuint> remap(vertices->size(), kNotRemapped);
+  std::vector<Vertex> output;
+  output.reserve(vertices->size());
+
+  for (auto& index : *indices) {
+    if (remap[index] == kNotRemapped) {
+      remap[index] = static_cast<GLuint>(output.size());
+      output.push_back((*vertices)[index]);
+    }
+    index = remap[index];
+  }
+
+  vertices->swap(output);
+}
+
+void MeshOptimizationReport::Add(const MeshOptimizationReport& other) noexcept {
+  triangle_count += other.triangle_count;
+  imported_vertex_count += other.imported_vertex_count;
+  vertex_count += other.vertex_count;
+  weighted_acmr_before += other.weighted_acmr_before;
+  weighted_acmr_after += other.weighted_acmr_after;
+}
+
+float MeshOptimizationReport::acmr_before() const noexcept {
+  return triangle_count > 0
+             ? static_cast<float>(weighted_acmr_before / triangle_count)
+             : 0.f;
+}
+
+float MeshOptimizationReport::acmr_after() const noexcept {
+  return triangle_count > 0
+             ? static_cast<float>(weighted_acmr_after / triangle_count)
+             : 0.f;
+}
+
+MeshOptimizationReport OptimizeMesh(std::vector<Vertex>* vertices,
+                                    std::vector<GLuint>* indices) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  MeshOptimizationReport report;
+  report.imported_vertex_count = vertices->size();
+  report.vertex_count = vertices->size();
+  report.triangle_count = indices->size() / 3;
+  if (report.triangle_count == 0 || indices->size() % 3 != 0) {
+    report.triangle_count = 0;
+    return report;
+  }
+
+  const float acmr_before = CalculateAcmr(*indices, vertices->size());
+
+  std::vector<std::size_t> clusters;
+  OptimizeVertexCache(indices, vertices->size(), &clusters);
+  OptimizeOverdraw(*vertices, indices, clusters);
+  OptimizeVertexFetch(vertices, indices);
+
+  const float acmr_after = CalculateAcmr(*indices, vertices->size());
+  report.vertex_count = vertices->size();
+
+  report.weighted_acmr_before = static_cast<double>(acmr_before) * report.triangle_count;
+  report.weighted_acmr_after = static_cast<double>(acmr_after) * report.triangle_count;
+  return report;
+}
@@ -0,0 +1,484 @@
+#include "mesh_simplifier.h"
+#include "flat_hash_map.h"
+#include "mesh_optimizer.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+
+namespace {
+
+// The levels must remove at least this part of the triangles of the previous one.
+constexpr float kMinLodReduction = 0.2f;
+// Largest simplification error of a level, relative to the radius of the mesh.
+// The levels are selected on their projected error, a coarse level is only
+// drawn when the mesh is small on the screen.
+constexpr float kMaxLodRelativeError = 0.25f;
+constexpr std::size_t kMinLodTriangleCount = 16;
+
+// Vertices sharing a position but whose attributes differ more are on a seam.
+constexpr float kSeamUvEpsilon = 1e-4f;
+constexpr float kSeamNormalCosine = 0.999f;
+
+// Symmetric 4x4 matrix of the sum of the squared distances to planes.
+struct Quadric {
+  double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+  double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+  double a22 = 0.0, a23 = 0.0;
+  double a33 = 0.0;
+
+  void AddPlane(const glm::vec3& normal, float distance) noexcept {
+    const double a = normal.x, b = normal.y, c = normal.z, d = distance;
+    a00 += a * a; a01 += a * b; a02 += a * c; a03 += a * d;
+    a11 += b * b; a12 += b * c; a13 += b * d;
+    a22 += c * c; a23 += c * d;
+    a33 += d * d;
+  }
+
+  void Add(const Quadric& other) noexcept {
+    a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+    a11 += other.a11; a12 += other.a12; a13 += other.a13;
+    a22 += other.a22; a23 += other.a23;
+    a33 += other.a33;
+  }
+
+  [[nodiscard]] double Evaluate(const glm::vec3& position) const noexcept {
+    const double x = position.x, y = position.y, z = position.z;
+    const double error = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z +
+                         2.0 * a03 * x + a11 * y * y + 2.0 * a12 * y * z +
+                         2.0 * a13 * y + a22 * z * z + 2.0 * a23 * z + a33;
+    return std::max(error, 0.0);
+  }
+};
+
+struct PositionKey {
+  std::array<std::uint32_t, 3> bits{};
+
+  bool operator==(const PositionKey& other) const noexcept { return bits == other.bits; }
+};
+
+struct PositionKeyHash {
+  std::size_t operator()(const PositionKey& key) const noexcept {
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    for (const auto value : key.bits) {
+      hash = (hash ^ value) * 0x100000001B3ull;
+    }
+    return static_cast<std::size_t>(hash ^ (hash >> 32));
+  }
+};
+
+// The edge keys only differ in their low bits, they are mixed before the masking
+// of the open addressing.
+struct EdgeKeyHash {
+  std::size_t operator()(std::uint64_t key) const noexcept {
+    key = (key ^ (key >> 33)) * 0xFF51AFD7ED558CCDull;
+    return static_cast<std::size_t>(key ^ (key >> 29));
+  }
+};
+
+struct Collapse {
+  double cost = 0.0;
+  std::uint32_t from = 0;
+  std::uint32_t to = 0;
+  std::uint32_t to_version = 0;
+
+  bool operator>(const Collapse& other) const noexcept { return cost > other.cost; }
+};
+
+std::uint64_t EdgeKey(std::uint32_t a, std::uint32_t b) noexcept {
+  return a < b ? (static_cast<std::uint64_t>(a) << 32) | b
+               : (static_cast<std::uint64_t>(b) << 32) | a;
+}
+
+/*
+* @brief Mesh welded by position, whose edges are collapsed one by one.
+*/
+class Simplifier {
+ public:
+  Simplifier(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+
+  std::vector<GLuint> Simplify(std::size_t target_index_count, float max_error,
+                               float* error);
+
+ private:
+  const std::vector<Vertex>& vertices_;
+  std::vector<std::uint32_t> vertex_positions_;
+  std::vector<glm::vec3> positions_;
+  // Vertices at each position, the range position_vertex_offsets_[p] to
+  // positions_vertex_offsets_[p + 1] of position_vertices_.
+  std::vector<std::size_t> position_vertex_offsets_;
+  std::vector<GLuint> position_vertices_;
+  std::vector<Quadric> quadrics_;
+  std::vector<std::vector<std::uint32_t>> position_triangles_;
+  std::vector<bool> is_locked_;
+  std::vector<bool> is_removed_;
+  std::vector<std::uint32_t> versions_;
+
+  // Vertices of the corners of the triangles.
+  std::vector<std::array<GLuint, 3>> triangles_;
+  std::vector<bool> is_triangle_alive_;
+  std::size_t alive_triangle_count_ = 0;
+
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses_;
+
+  [[nodiscard]] std::uint32_t position(const std::array<GLuint, 3>& triangle,
+                                       std::size_t corner) const noexcept {
+    return vertex_positions_[triangle[corner]];
+  }
+
+  void WeldPositions();
+  void LockBordersAndSeams();
+  void PushCollapse(std::uint32_t from, std::uint32_t to);
+  [[nodiscard]] bool IsCollapseValid(std::uint32_t from, std::uint32_t to) const;
+  void ApplyCollapse(std::uint32_t from, std::uint32_t to);
+  [[nodiscard]] GLuint FindClosestVertex(std::uint32_t position, GLuint vertex) const noexcept;
+};
+
+Simplifier::Simplifier(const std::vector<Vertex>& vertices,
+                       const std::vector<GLuint>& indices)
+    : vertices_(vertices)
+{
+  WeldPositions();
+
+  // Triangles degenerated by the welding are dropped.
+  position_triangles_.resize(positions_.size());
+  quadrics_.resize(positions_.size());
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const std::array<GLuint, 3> triangle{indices[i], indices[i + 1], indices[i + 2]};
+    const auto p0 = position(triangle, 0);
+    const auto p1 = position(triangle, 1);
+    const auto p2 = position(triangle, 2);
+    if (p0 == p1 || p1 == p2 || p0 == p2) {
+      continue;
+    }
+
+    const auto triangle_idx = static_cast<std::uint32_t>(triangles_.size());
+    triangles_.push_back(triangle);
+    position_triangles_[p0].push_back(triangle_idx);
+    position_triangles_[p1].push_back(triangle_idx);
+    position_triangles_[p2].push_back(triangle_idx);
+
+    const auto normal = glm::cross(positions_[p1] - positions_[p0],
+                                   positions_[p2] - positions_[p0]);
+    const float length = glm::length(normal);
+    if (length > 0.f) {
+      const auto unit_normal = normal / length;
+      const float distance = -glm::dot(unit_normal, positions_[p0]);
+      quadrics_[p0].AddPlane(unit_normal, distance);
+      quadrics_[p1].AddPlane(unit_normal, distance);
+      quadrics_[p2].AddPlane(unit_normal, distance);
+    }
+  }
+  is_triangle_alive_.assign(triangles_.size(), true);
+  alive_triangle_count_ = triangles_.size();
+
+  is_removed_.assign(positions_.size(), false);
+  versions_.assign(positions_.size(), 0);
+  LockBordersAndSeams();
+
+  for (const auto& triangle : triangles_) {
+    for (std::size_t corner = 0; corner < 3; corner++) {
+      const auto a = position(triangle, corner);
+      const auto b = position(triangle, (corner + 1) % 3);
+      PushCollapse(a, b);
+      PushCollapse(b, a);
+    }
+  }
+}
+
+void Simplifier::WeldPositions() {
+  FlatHashMap<PositionKey, std::uint32_t, PositionKeyHash> position_indices;
+  vertex_positions_.resize(vertices_.size());
+  std::vector<std::uint32_t> position_vertex_counts;
+
+  for (std::size_t v = 0; v < vertices_.size(); v++) {
+    PositionKey key;
+    std::memcpy(key.bits.data(), &vertices_[v].position, sizeof(key.bits));
+
+    const auto [position_idx, is_new] = position_indices.Insert(
+        key, static_cast<std::uint32_t>(positions_.size()));
+    if (is_new) {
+      positions_.push_back(vertices_[v].position);
+      position_vertex_counts.push_back(0);
+    }
+    vertex_positions_[v] = *position_idx;
+    position_vertex_counts[*position_idx]++;
+  }
+
+  position_vertex_offsets_.assign(positions_.size() + 1, 0);
+  for (std::size_t p = 0; p < positions_.size(); p++) {
+    position_vertex_offsets_[p + 1] = position_vertex_offsets_[p] + position_vertex_counts[p];
+  }
+
+  position_vertices_.resize(vertices_.size());
+  std::vector<std::size_t> ends(position_vertex_offsets_.begin(),
+                                position_vertex_offsets_.end() - 1);
+  for (std::size_t v = 0; v < vertices_.size(); v++) {
+    position_vertices_[ends[vertex_positions_[v]]++] = static_cast<GLuint>(v);
+  }
+}
+
+void Simplifier::LockBordersAndSeams() {
+  is_locked_.assign(positions_.size(), false);
+
+  // The border edges are used by only one triangle.
+  FlatHashMap<std::uint64_t, std::uint32_t, EdgeKeyHash> edge_triangle_counts;
+  for (const auto& triangle : triangles_) {
+    for (std::size_t corner = 0; corner < 3; corner++) {
+      const auto key = EdgeKey(position(triangle, corner), position(triangle, (corner + 1) % 3));
+      (*edge_triangle_counts.Insert(key, 0).first)++;
+    }
+  }
+  for (const auto& triangle : triangles_) {
+    for (std::size_t corner = 0; corner < 3; corner++) {
+      const auto a = position(triangle, corner);
+      const auto b = position(triangle, (corner + 1) % 3);
+      if (*edge_triangle_counts.Find(EdgeKey(a, b)) == 1) {
+        is_locked_[a] = true;
+        is_locked_[b] = true;
+      }
+    }
+  }
+
+  for (std::size_t p = 0; p < positions_.size(); p++) {
+    const auto& first = vertices_[position_vertices_[position_vertex_offsets_[p]]];
+    for (std::size_t i = position_vertex_offsets_[p] + 1; i < position_vertex_offsets_[p + 1];
+         i++) {
+      const auto& vertex = vertices_[position_vertices_[i]];
+      const auto uv_delta = glm::abs(vertex.uv - first.uv);
+      if (uv_delta.x > kSeamUvEpsilon || uv_delta.y > kSeamUvEpsilon ||
+          glm::dot(vertex.normal, first.normal) < kSeamNormalCosine) {
+        is_locked_[p] = true;
+        break;
+      }
+    }
+  }
+}
+
+void Simplifier::PushCollapse(std::uint32_t from, std::uint32_t to) {
+  if (is_locked_[from] || is_removed_[from] || is_removed_[to]) {
+    return;
+  }
+
+  Quadric quadric = quadrics_[from];
+  quadric.Add(quadrics_[to]);
+  collapses_.push(Collapse{quadric.Evaluate(positions_[to]), from, to, versions_[to]});
+}
+
+bool Simplifier::IsCollapseValid(std::uint32_t from, std::uint32_t to) const {
+  // Link condition: the edge must be shared by at most two triangles, otherwise
+  // the collapse pinches the surface.
+  std::size_t shared_triangle_count = 0;
+  for (const auto triangle_idx : position_triangles_[from]) {
+    if (!is_triangle_alive_[triangle_idx]) {
+      continue;
+    }
+
+    const auto& triangle = triangles_[triangle_idx];
+    std::size_t from_corner = 3;
+    bool has_to = false;
+    for (std::size_t corner = 0; corner < 3; corner++) {
+      const auto p = position(triangle, corner);
+      from_corner = p == from ? corner : from_corner;
+      has_to = has_to || p == to;
+    }
+    if (has_to) {
+      shared_triangle_count++;
+      continue;
+    }
+
+    // The triangles moving with the collapse must not flip.
+    std::array<glm::vec3, 3> corners;
+    for (std::size_t corner = 0; corner < 3; corner++) {
+      corners[corner] = positions_[position(triangle, corner)];
+    }
+    const auto old_normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+    corners[from_corner] = positions_[to];
+    const auto new_normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+    if (glm::dot(old_normal, new_normal) <= 0.f) {
+      return false;
+    }
+  }
+
+  return shared_triangle_count > 0 && shared_triangle_count <= 2;
+}
+
+GLuint Simplifier::FindClosestVertex(std::uint32_t position, GLuint vertex) const noexcept {
+  const auto& reference = vertices_[vertex];
+  GLuint closest_vertex = position_vertices_[position_vertex_offsets_[position]];
+  float closest_distance = std::numeric_limits<float>::max();
+
+  for (std::size_t i = position_vertex_offsets_[position];
+       i < position_vertex_offsets_[position + 1]; i++) {
+    const auto& candidate = vertices_[position_vertices_[i]];
+    const auto uv_delta = candidate.uv - reference.uv;
+    const float distance = glm::dot(uv_delta, uv_delta) +
+                           (1.f - glm::dot(candidate.normal, reference.normal));
+    if (distance < closest_distance) {
+      closest_distance = distance;
+      closest_vertex = position_vertices_[i];
+    }
+  }
+
+  return closest_vertex;
+}
+
+void Simplifier::ApplyCollapse(std::uint32_t from, std::uint32_t to) {
+  auto& to_triangles = position_triangles_[to];
+  for (const auto triangle_idx : position_triangles_[from]) {
+    if (!is_triangle_alive_[triangle_idx]) {
+      continue;
+    }
+
+    auto& triangle = triangles_[triangle_idx];
+    bool has_to = false;
+    for (std::size_t corner = 0; corner < 3; corner++) {
+      has_to = has_to || position(triangle, corner) == to;
+    }
+    if (has_to) {
+      is_triangle_alive_[triangle_idx] = false;
+      alive_triangle_count_--;
+      continue;
+    }
+
+    for (std::size_t corner = 0; corner < 3; corner++) {
+      if (position(triangle, corner) == from) {
+        triangle[corner] = FindClosestVertex(to, triangle[corner]);
+      }
+    }
+    to_triangles.push_back(triangle_idx);
+  }
+
+  position_triangles_[from].clear();
+  to_triangles.erase(std::remove_if(to_triangles.begin(), to_triangles.end(),
+                                    [this](std::uint32_t triangle_idx) {
+                                      return !is_triangle_alive_[triangle_idx];
+                                    }),
+                     to_triangles.end());
+
+  quadrics_[to].Add(quadrics_[from]);
+  is_removed_[from] = true;
+  versions_[to]++;
+
+  // The collapses around the position use its new quadric.
+  for (const auto triangle_idx : to_triangles) {
+    const auto& triangle = triangles_[triangle_idx];
+    for (std::size_t corner = 0; corner < 3; corner++) {
+      const auto p = position(triangle, corner);
+      if (p != to) {
+        PushCollapse(to, p);
+        PushCollapse(p, to);
+      }
+    }
+  }
+}
+
+std::vector<GLuint> Simplifier::Simplify(std::size_t target_index_count, float max_error,
+                                         float* error) {
+  const double max_cost = static_cast<double>(max_error) * max_error;
+  double largest_cost = 0.0;
+
+  while (alive_triangle_count_ * 3 > target_index_count && !collapses_.empty()) {
+    const auto collapse = collapses_.top();
+    collapses_.pop();
+
+    // Skips the collapses whose positions changed since they were pushed.
+    if (is_removed_[collapse.from] || is_removed_[collapse.to] ||
+        collapse.to_version != versions_[collapse.to]) {
+      continue;
+    }
+    if (collapse.cost > max_cost) {
+      break;
+    }
+    if (!IsCollapseValid(collapse.from, collapse.to)) {
+      continue;
+    }
+
+    ApplyCollapse(collapse.from, collapse.to);
+    largest_cost = std::max(largest_cost, collapse.cost);
+  }
+
+  std::vector<GLuint> indices;
+  indices.reserve(alive_triangle_count_ * 3);
+  for (std::size_t i = 0; i < triangles_.size(); i++) {
+    if (is_triangle_alive_[i]) {
+      indices.insert(indices.end(), triangles_[i].begin(), triangles_[i].end());
+    }
+  }
+
+  *error = static_cast<float>(std::sqrt(largest_cost));
+  return indices;
+}
+
+}  // namespace
+
+std::vector<GLuint> SimplifyMesh(const std::vector<Vertex>& vertices,
+                                 const std::vector<GLuint>& indices,
+                                 std::size_t target_index_count, float max_error,
+                                 float* error) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  Simplifier simplifier(vertices, indices);
+  return simplifier.Simplify(target_index_count, max_error, error);
+}
+
+void GenerateLods(const std::vector<Vertex>& vertices, std::vector<GLuint>* indices,
+                  std::vector<MeshLod>* lods) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  lods->clear();
+  lods->push_back(MeshLod{0, static_cast<std::uint32_t>(indices->size()), 0.f});
+  if (indices->size() < kMinLodTriangleCount * 3 * 2 || vertices.empty()) {
+    return;
+  }
+
+  glm::vec3 min_position(std::numeric_limits<float>::max());
+  glm::vec3 max_position(std::numeric_limits<float>::lowest());
+  for (const auto& vertex : vertices) {
+    min_position = glm::min(min_position, vertex.position);
+    max_position = glm::max(max_position, vertex.position);
+  }
+  const float max_error = glm::length(max_position - min_position) * 0.5f *
+                          kMaxLodRelativeError;
+
+  // Every level is simplified from the full mesh, the quadrics of a level
+  // simplified from the previous one would forget the error already made.
+  const std::vector<GLuint> full_indices = *indices;
+  std::size_t previous_index_count = full_indices.size();
+  while (lods->size() < kMaxLodCount) {
+    const std::size_t target_index_count = previous_index_count / 6 * 3;
+    if (target_index_count < kMinLodTriangleCount * 3) {
+      break;
+    }
+
+    float error = 0.f;
+    auto lod_indices = SimplifyMesh(vertices, full_indices, target_index_count,
+                                    max_error, &error);
+    if (static_cast<float>(lod_indices.size()) >
+        static_cast<float>(previous_index_count) * (1.f - kMinLodReduction)) {
+      break;
+    }
+
+    std::vector<std::size_t> clusters;
+    OptimizeVertexCache(&lod_indices, vertices.size(), &clusters);
+
+    lods->push_back(MeshLod{static_cast<std::uint32_t>(indices->size()),
+                            static_cast<std::uint32_t>(lod_indices.size()),
+                            std::max(error, lods->back().error)});
+    indices->insert(indices->end(), lod_indices.begin(), lod_indices.end());
+    previous_index_count = lod_indices.size();
+  }
+}
@@ -0,0 +1,266 @@
+#include "mesh_welder.h"
+#include "flat_hash_map.h"
+#include "job_system.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WELD_SSE
+#endif
+
+// MSVC exposes the CRC32 instructions with /arch:AVX2.
+#if defined(__SSE4_2__) || defined(__AVX2__)
+#include <nmmintrin.h>
+#define WELD_CRC32
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+namespace {
+
+// The vertices are read as 14 contiguous floats.
+static_assert(sizeof(Vertex) == 14 * sizeof(float), "Vertex must be tightly packed.");
+
+// Below this count the vertices are welded on the calling thread.
+constexpr std::size_t kMinParallelVertexCount = 1 << 15;
+constexpr std::size_t kVerticesPerJob = 1 << 13;
+constexpr std::size_t kMaxPartitionCount = 16;
+
+/*
+* The quantized attributes: the position relative to the bounding box, the
+* normal and the uv on 32 bits, the tangent and the bitangent packed on 16 bits.
+*/
+struct WeldKey {
+  std::array<std::uint32_t, 12> values{};
+};
+
+// A key with its hash, which is computed once for the insertion and the rehashes.
+struct WeldKeyRef {
+  const WeldKey* key = nullptr;
+  std::uint64_t hash = 0;
+
+  bool operator==(const WeldKeyRef& other) const noexcept {
+    return hash == other.hash && key->values == other.key->values;
+  }
+};
+
+struct WeldKeyRefHash {
+  std::size_t operator()(const WeldKeyRef& key_ref) const noexcept {
+    return static_cast<std::size_t>(key_ref.hash);
+  }
+};
+
+struct QuantizationScales {
+  glm::vec3 position_offset{0.f};
+  float position = 1.f;
+  float normal = 1.f;
+  float uv = 1.f;
+  float tangent = 1.f;
+};
+
+QuantizationScales CalculateScales(const std::vector<Vertex>& vertices,
+                                   const WeldTolerances& tolerances) noexcept {
+  glm::vec3 min_position(std::numeric_limits<float>::max());
+  glm::vec3 max_position(std::numeric_limits<float>::lowest());
+  for (const auto& vertex : vertices) {
+    min_position = glm::min(min_position, vertex.position);
+    max_position = glm::max(max_position, vertex.position);
+  }
+
+  const glm::vec3 extent = max_position - min_position;
+  const float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+  const float position_tolerance = std::max(max_extent * tolerances.position,
+                                            std::numeric_limits<float>::min());
+
+  QuantizationScales scales;
+  scales.position_offset = min_position;
+  scales.position = 1.f / position_tolerance;
+  scales.normal = 1.f / tolerances.normal;
+  scales.uv = 1.f / tolerances.uv;
+  scales.tangent = 1.f / tolerances.tangent;
+  return scales;
+}
+
+WeldKey QuantizeVertex(const Vertex& vertex, const QuantizationScales& scales) noexcept {
+  WeldKey key;
+  const float* attributes = &vertex.position.x;
+
+#ifdef WELD_SSE
+  const __m128 offset = _mm_setr_ps(scales.position_offset.x, scales.position_offset.y,
+                                    scales.position_offset.z, 0.f);
+  const __m128 position_normal_scale = _mm_setr_ps(scales.position, scales.position,
+                                                   scales.position, scales.normal);
+  const __m128 normal_uv_scale = _mm_setr_ps(scales.normal, scales.normal, scales.uv,
+                                             scales.uv);
+  const __m128 tangent_scale = _mm_set1_ps(scales.tangent);
+
+  // position.xyz normal.x | normal.yz uv.xy | tangent.xyz bitangent.x | bitangent.yz
+  const __m128i position_normal = _mm_cvtps_epi32(_mm_mul_ps(
+      _mm_sub_ps(_mm_loadu_ps(attributes), offset), position_normal_scale));
+  const __m128i normal_uv = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(attributes + 4),
+                                                       normal_uv_scale));
+  const __m128i tangent = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(attributes + 8),
+                                                     tangent_scale));
+  const __m128i bitangent = _mm_cvtps_epi32(_mm_mul_ps(
+      _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(attributes + 12)),
+      tangent_scale));
+
+  auto* values = reinterpret_cast<__m128i*>(key.values.data());
+  _mm_storeu_si128(values, position_normal);
+  _mm_storeu_si128(values + 1, normal_uv);
+  _mm_storeu_si128(values + 2, _mm_packs_epi32(tangent, bitangent));
+#else
+  const auto quantize = [](float value) noexcept {
+    return static_cast<std::uint32_t>(static_cast<std::int32_t>(std::lrint(value)));
+  };
+  const auto quantize_short = [](float value) noexcept {
+    const long quantized = std::clamp(std::lrint(value), -32768l, 32767l);
+    return static_cast<std::uint32_t>(static_cast<std::uint16_t>(quantized));
+  };
+
+  for (std::size_t i = 0; i < 3; i++) {
+    key.values[i] = quantize((attributes[i] - scales.position_offset[i]) * scales.position);
+  }
+  key.values[3] = quantize(attributes[3] * scales.normal);
+  key.values[4] = quantize(attributes[4] * scales.normal);
+  key.values[5] = quantize(attributes[5] * scales.normal);
+  key.values[6] = quantize(attributes[6] * scales.uv);
+  key.values[7] = quantize(attributes[7] * scales.uv);
+  for (std::size_t i = 0; i < 6; i += 2) {
+    key.values[8 + i / 2] = quantize_short(attributes[8 + i] * scales.tangent) |
+                            quantize_short(attributes[9 + i] * scales.tangent) << 16;
+  }
+  key.values[11] = 0;
+#endif  // WELD_SSE
+
+  return key;
+}
+
+std::uint64_t HashKey(const WeldKey& key) noexcept {
+#ifdef WELD_CRC32
+  std::uint64_t crc = 0;
+  for (std::size_t i = 0; i < key.values.size(); i += 2) {
+    std::uint64_t value;
+    std::memcpy(&value, key.values.data() + i, sizeof(value));
+    crc = _mm_crc32_u64(crc, value);
+  }
+  // Spreads the 32 bits of the CRC over the high bits, which pick the partition.
+  return crc * 0x9E3779B97F4A7C15ull;
+#else
+  std::uint64_t hash = 0xCBF29CE484222325ull;
+  for (const auto value : key.values) {
+    hash = (hash ^ value) * 0x100000001B3ull;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  return hash ^ (hash >> 33);
+#endif  // WELD_CRC32
+}
+
+}  // namespace
+
+std::size_t WeldVertices(std::vector<Vertex>* vertices, std::vector<GLuint>* indices,
+                         const WeldTolerances& tolerances) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const std::size_t vertex_count = vertices->size();
+  if (vertex_count == 0) {
+    return 0;
+  }
+
+  const bool is_parallel = vertex_count >= kMinParallelVertexCount;
+  const std::size_t grain_size = is_parallel ? kVerticesPerJob : vertex_count;
+  const auto scales = CalculateScales(*vertices, tolerances);
+
+  std::vector<WeldKey> keys(vertex_count);
+  std::vector<std::uint64_t> hashes(vertex_count);
+  ParallelFor(vertex_count, grain_size, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t v = begin; v < end; v++) {
+      keys[v] = QuantizeVertex((*vertices)[v], scales);
+      hashes[v] = HashKey(keys[v]);
+    }
+  });
+
+  // The vertices are split by the high bits of their hashes, the equal keys are
+  // in the same partition and each partition is deduplicated by one job, in the
+  // order of the vertices.
+  const std::size_t partition_count =
+      is_parallel ? std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1,
+                                            kMaxPartitionCount)
+                  : 1;
+  const auto partition_of = [partition_count](std::uint64_t hash) noexcept {
+    return static_cast<std::size_t>((hash >> 40) % partition_count);
+  };
+
+  std::vector<std::size_t> partition_offsets(partition_count + 1, 0);
+  for (const auto hash : hashes) {
+    partition_offsets[partition_of(hash) + 1]++;
+  }
+  for (std::size_t p = 0; p < partition_count; p++) {
+    partition_offsets[p + 1] += partition_offsets[p];
+  }
+  std::vector<std::uint32_t> partition_vertices(vertex_count);
+  std::vector<std::size_t> partition_ends(partition_offsets.begin(),
+                                          partition_offsets.end() - 1);
+  for (std::size_t v = 0; v < vertex_count; v++) {
+    partition_vertices[partition_ends[partition_of(hashes[v])]++] =
+        static_cast<std::uint32_t>(v);
+  }
+
+  // The first vertex with the same key, which is the vertex itself if it is kept.
+  std::vector<std::uint32_t> first_vertices(vertex_count);
+  ParallelFor(partition_count, 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t p = begin; p < end; p++) {
+      FlatHashMap<WeldKeyRef, std::uint32_t, WeldKeyRefHash> first_vertex_of_keys;
+      for (std::size_t i = partition_offsets[p]; i < partition_offsets[p + 1]; i++) {
+        const auto v = partition_vertices[i];
+        first_vertices[v] = *first_vertex_of_keys.Insert(WeldKeyRef{&keys[v], hashes[v]},
+                                                         v).first;
+      }
+    }
+  });
+
+  std::vector<GLuint> remap(vertex_count);
+  std::vector<Vertex> welded_vertices;
+  welded_vertices.reserve(vertex_count);
+  for (std::size_t v = 0; v < vertex_count; v++) {
+    if (first_vertices[v] == v) {
+      remap[v] = static_cast<GLuint>(welded_vertices.size());
+      welded_vertices.push_back((*vertices)[v]);
+    }
+    else {
+      remap[v] = remap[first_vertices[v]];
+    }
+  }
+
+  // The triangles whose corners have been merged are removed.
+  std::size_t index_count = 0;
+  for (std::size_t i = 0; i + 2 < indices->size(); i += 3) {
+    const GLuint i0 = remap[(*indices)[i]];
+    const GLuint i1 = remap[(*indices)[i + 1]];
+    const GLuint i2 = remap[(*indices)[i + 2]];
+    if (i0 == i1 || i1 == i2 || i2 == i0) {
+      continue;
+    }
+    (*indices)[index_count++] = i0;
+    (*indices)[index_count++] = i1;
+    (*indices)[index_count++] = i2;
+  }
+  indices->resize(index_count);
+
+  vertices->swap(welded_vertices);
+  return vertices->size();
+}
@@ -0,0 +1,282 @@
+#include "meshlet.h"
+#include "flat_hash_map.h"
+#include "mesh.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr std::uint32_t kNoMeshlet = std::numeric_limits<std::uint32_t>::max();
+// Below this spread of the normals the cone is too wide to cull anything.
+constexpr float kMinConeDot = 0.1f;
+
+struct PositionKey {
+  std::array<std::uint32_t, 3> bits{};
+
+  bool operator==(const PositionKey& other) const noexcept { return bits == other.bits; }
+};
+
+struct PositionKeyHash {
+  std::size_t operator()(const PositionKey& key) const noexcept {
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    for (const auto value : key.bits) {
+      hash = (hash ^ value) * 0x100000001B3ull;
+    }
+    return static_cast<std::size_t>(hash ^ (hash >> 32));
+  }
+};
+
+// Index of the position of each vertex, the vertices duplicated for their uvs
+// or normals share it.
+std::vector<std::uint32_t> WeldPositions(const std::vector<Vertex>& vertices,
+                                         std::size_t* position_count) {
+  FlatHashMap<PositionKey, std::uint32_t, PositionKeyHash> position_indices;
+  std::vector<std::uint32_t> vertex_positions(vertices.size());
+  std::uint32_t count = 0;
+
+  for (std::size_t v = 0; v < vertices.size(); v++) {
+    PositionKey key;
+    std::memcpy(key.bits.data(), &vertices[v].position, sizeof(key.bits));
+    const auto [position_idx, is_new] = position_indices.Insert(key, count);
+    count += is_new ? 1 : 0;
+    vertex_positions[v] = *position_idx;
+  }
+
+  *position_count = count;
+  return vertex_positions;
+}
+
+void ComputeMeshletBounds(const std::vector<Vertex>& vertices,
+                          const std::vector<GLuint>& indices, Meshlet* meshlet) noexcept {
+  const std::size_t end = meshlet->first_index + meshlet->index_count;
+
+  glm::vec3 min_position(std::numeric_limits<float>::max());
+  glm::vec3 max_position(std::numeric_limits<float>::lowest());
+  glm::vec3 axis(0.f);
+  for (std::size_t i = meshlet->first_index; i < end; i += 3) {
+    const auto& p0 = vertices[indices[i]].position;
+    const auto& p1 = vertices[indices[i + 1]].position;
+    const auto& p2 = vertices[indices[i + 2]].position;
+    min_position = glm::min(min_position, glm::min(p0, glm::min(p1, p2)));
+    max_position = glm::max(max_position, glm::max(p0, glm::max(p1, p2)));
+
+    const auto normal = glm::cross(p1 - p0, p2 - p0);
+    const float length = glm::length(normal);
+    if (length > 0.f) {
+      axis += normal / length;
+    }
+  }
+
+  meshlet->center = (min_position + max_position) * 0.5f;
+  float radius = 0.f;
+  float min_dot = 1.f;
+  const float axis_length = glm::length(axis);
+  if (axis_length > 0.f) {
+    axis /= axis_length;
+  }
+
+  for (std::size_t i = meshlet->first_index; i < end; i += 3) {
+    const auto& p0 = vertices[indices[i]].position;
+    const auto& p1 = vertices[indices[i + 1]].position;
+    const auto& p2 = vertices[indices[i + 2]].position;
+    radius = std::max(radius, glm::length(p0 - meshlet->center));
+    radius = std::max(radius, glm::length(p1 - meshlet->center));
+    radius = std::max(radius, glm::length(p2 - meshlet->center));
+
+    const auto normal = glm::cross(p1 - p0, p2 - p0);
+    const float length = glm::length(normal);
+    if (length > 0.f) {
+      min_dot = std::min(min_dot, glm::dot(normal / length, axis));
+    }
+  }
+  meshlet->radius = radius;
+
+  // The normals are within acos(min_dot) of the axis, the triangles all face
+  // away from the directions within asin(min_dot) of it.
+  if (axis_length <= 0.f || min_dot <= kMinConeDot) {
+    meshlet->cone_axis = glm::vec3(0.f, 0.f, 1.f);
+    meshlet->cone_cutoff = 1.f;
+  }
+  else {
+    meshlet->cone_axis = axis;
+    meshlet->cone_cutoff = std::sqrt(1.f - min_dot * min_dot);
+  }
+}
+
+}  // namespace
+
+void MeshletBounds::Build(const std::vector<Meshlet>& meshlets) {
+  const std::size_t padded_count = (meshlets.size() + kLaneCount - 1) / kLaneCount *
+                                   kLaneCount;
+  // The results of the padding lanes are ignored by the culling.
+  center_x.assign(padded_count, 0.f);
+  center_y.assign(padded_count, 0.f);
+  center_z.assign(padded_count, 0.f);
+  radius.assign(padded_count, 0.f);
+  cone_axis_x.assign(padded_count, 0.f);
+  cone_axis_y.assign(padded_count, 0.f);
+  cone_axis_z.assign(padded_count, 1.f);
+  cone_cutoff.assign(padded_count, 1.f);
+
+  for (std::size_t i = 0; i < meshlets.size(); i++) {
+    const auto& meshlet = meshlets[i];
+    center_x[i] = meshlet.center.x;
+    center_y[i] = meshlet.center.y;
+    center_z[i] = meshlet.center.z;
+    radius[i] = meshlet.radius;
+    cone_axis_x[i] = meshlet.cone_axis.x;
+    cone_axis_y[i] = meshlet.cone_axis.y;
+    cone_axis_z[i] = meshlet.cone_axis.z;
+    cone_cutoff[i] = meshlet.cone_cutoff;
+  }
+}
+
+void BuildMeshlets(const std::vector<Vertex>& vertices, std::vector<GLuint>* indices,
+                   std::vector<Meshlet>* meshlets) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  meshlets->clear();
+  const auto& input = *indices;
+  const std::size_t triangle_count = input.size() / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  std::size_t position_count = 0;
+  const auto vertex_positions = WeldPositions(vertices, &position_count);
+
+  // Triangles around each position.
+  std::vector<std::size_t> adjacency_offsets(position_count + 1, 0);
+  for (const auto index : input) {
+    adjacency_offsets[vertex_positions[index] + 1]++;
+  }
+  for (std::size_t p = 0; p < position_count; p++) {
+    adjacency_offsets[p + 1] += adjacency_offsets[p];
+  }
+  std::vector<std::uint32_t> adjacency(input.size());
+  std::vector<std::size_t> adjacency_ends(adjacency_offsets.begin(),
+                                          adjacency_offsets.end() - 1);
+  for (std::size_t i = 0; i < input.size(); i++) {
+    adjacency[adjacency_ends[vertex_positions[input[i]]]++] =
+        static_cast<std::uint32_t>(i / 3);
+  }
+
+  std::vector<glm::vec3> triangle_normals(triangle_count, glm::vec3(0.f));
+  std::vector<glm::vec3> triangle_centers(triangle_count);
+  for (std::size_t t = 0; t < triangle_count; t++) {
+    const auto& p0 = vertices[input[t * 3]].position;
+    const auto& p1 = vertices[input[t * 3 + 1]].position;
+    const auto& p2 = vertices[input[t * 3 + 2]].position;
+    const auto normal = glm::cross(p1 - p0, p2 - p0);
+    const float length = glm::length(normal);
+    if (length > 0.f) {
+      triangle_normals[t] = normal / length;
+    }
+    triangle_centers[t] = (p0 + p1 + p2) / 3.f;
+  }
+
+  std::vector<std::uint32_t> triangle_meshlets(triangle_count, kNoMeshlet);
+  std::vector<std::uint32_t> meshlet_triangles;
+  std::vector<std::uint32_t> candidates;
+  std::vector<GLuint> output;
+  output.reserve(input.size());
+  std::size_t cursor = 0;
+
+  while (true) {
+    // Each meshlet starts from the first free triangle in the input order.
+    while (cursor < triangle_count && triangle_meshlets[cursor] != kNoMeshlet) {
+      cursor++;
+    }
+    if (cursor == triangle_count) {
+      break;
+    }
+
+    const auto meshlet_idx = static_cast<std::uint32_t>(meshlets->size());
+    meshlet_triangles.clear();
+    candidates.clear();
+    glm::vec3 normal_sum(0.f);
+    glm::vec3 center_sum(0.f);
+
+    auto triangle = static_cast<std::uint32_t>(cursor);
+    while (true) {
+      triangle_meshlets[triangle] = meshlet_idx;
+      meshlet_triangles.push_back(triangle);
+      normal_sum += triangle_normals[triangle];
+      center_sum += triangle_centers[triangle];
+      if (meshlet_triangles.size() == kMaxMeshletTriangleCount) {
+        break;
+      }
+
+      for (std::size_t corner = 0; corner < 3; corner++) {
+        const auto position = vertex_positions[input[triangle * 3 + corner]];
+        for (std::size_t a = adjacency_offsets[position];
+             a < adjacency_offsets[position + 1]; a++) {
+          if (triangle_meshlets[adjacency[a]] == kNoMeshlet) {
+            candidates.push_back(adjacency[a]);
+          }
+        }
+      }
+
+      // The next triangle is the free neighbour closest to the meshlet, the
+      // distance being stretched for the normals far from the meshlet's one.
+      const float normal_length = glm::length(normal_sum);
+      const glm::vec3 normal = normal_length > 0.f ? normal_sum / normal_length
+                                                   : glm::vec3(0.f);
+      const glm::vec3 center = center_sum / static_cast<float>(meshlet_triangles.size());
+      float best_cost = std::numeric_limits<float>::max();
+      std::size_t best_candidate = candidates.size();
+      std::size_t free_count = 0;
+      for (std::size_t c = 0; c < candidates.size(); c++) {
+        const auto candidate = candidates[c];
+        if (triangle_meshlets[candidate] != kNoMeshlet) {
+          continue;
+        }
+        candidates[free_count] = candidate;
+
+        const auto offset = triangle_centers[candidate] - center;
+        const float cost = glm::dot(offset, offset) *
+                           (2.f - glm::dot(triangle_normals[candidate], normal));
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_candidate = free_count;
+        }
+        free_count++;
+      }
+      candidates.resize(free_count);
+
+      if (best_candidate == candidates.size()) {
+        break;
+      }
+      triangle = candidates[best_candidate];
+    }
+
+    // The triangles keep the order of the vertex cache optimization.
+    std::sort(meshlet_triangles.begin(), meshlet_triangles.end());
+
+    Meshlet meshlet;
+    meshlet.first_index = static_cast<std::uint32_t>(output.size());
+    meshlet.index_count = static_cast<std::uint32_t>(meshlet_triangles.size() * 3);
+    for (const auto meshlet_triangle : meshlet_triangles) {
+      output.insert(output.end(), input.begin() + meshlet_triangle * 3,
+                    input.begin() + meshlet_triangle * 3 + 3);
+    }
+    meshlets->push_back(meshlet);
+  }
+
+  indices->swap(output);
+  for (auto& meshlet : *meshlets) {
+    ComputeMeshletBounds(vertices, *indices, &meshlet);
+  }
+}
@@ -0,0 +1,158 @@
+#include "meshlet_culler.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESHLET_SSE
+#endif
+
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+glm::vec4 PlaneEquation(const Plane& plane) noexcept {
+  return glm::vec4(plane.normal_, -plane.distance_);
+}
+
+std::size_t IndexSize(GLenum index_type) noexcept {
+  return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+}  // namespace
+
+void MeshletCuller::BeginView(const Frustum& frustum,
+                              const glm::vec3& view_position) noexcept {
+  planes_ = {PlaneEquation(frustum.left_face), PlaneEquation(frustum.right_face),
+             PlaneEquation(frustum.far_face), PlaneEquation(frustum.near_face),
+             PlaneEquation(frustum.top_face), PlaneEquation(frustum.bottom_face)};
+  view_position_ = view_position;
+  is_enabled_ = true;
+}
+
+std::size_t MeshletCuller::Cull(const Mesh& mesh, const glm::mat4& model) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  counts_.clear();
+  offsets_.clear();
+  base_vertices_.clear();
+
+  const auto& meshlets = mesh.meshlets();
+  const auto& bounds = mesh.meshlet_bounds();
+  if (meshlets.empty()) {
+    return 0;
+  }
+
+  // The planes and the view position are brought in model space, where the
+  // spheres stay spheres and the back faces stay back faces whatever the scale
+  // of the model matrix.
+  const glm::mat4 transposed_model = glm::transpose(model);
+  std::array<glm::vec4, 6> planes;
+  for (std::size_t p = 0; p < planes.size(); p++) {
+    planes[p] = transposed_model * planes_[p];
+    const float length = glm::length(glm::vec3(planes[p]));
+    if (length > 0.f) {
+      planes[p] = planes[p] / length;
+    }
+  }
+  const glm::vec3 view_position(glm::inverse(model) * glm::vec4(view_position_, 1.f));
+
+  visibilities_.resize(bounds.padded_count());
+  std::size_t i = 0;
+
+#ifdef MESHLET_SSE
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 view_x = _mm_set1_ps(view_position.x);
+  const __m128 view_y = _mm_set1_ps(view_position.y);
+  const __m128 view_z = _mm_set1_ps(view_position.z);
+  for (; i < bounds.padded_count(); i += MeshletBounds::kLaneCount) {
+    const __m128 center_x = _mm_loadu_ps(bounds.center_x.data() + i);
+    const __m128 center_y = _mm_loadu_ps(bounds.center_y.data() + i);
+    const __m128 center_z = _mm_loadu_ps(bounds.center_z.data() + i);
+    const __m128 radius = _mm_loadu_ps(bounds.radius.data() + i);
+    const __m128 negative_radius = _mm_sub_ps(zero, radius);
+
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto& plane : planes) {
+      const __m128 distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), center_x),
+                     _mm_mul_ps(_mm_set1_ps(plane.y), center_y)),
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), center_z), _mm_set1_ps(plane.w)));
+      visible = _mm_and_ps(visible, _mm_cmpgt_ps(distance, negative_radius));
+    }
+
+    if (cull_backfaces_) {
+      const __m128 to_center_x = _mm_sub_ps(center_x, view_x);
+      const __m128 to_center_y = _mm_sub_ps(center_y, view_y);
+      const __m128 to_center_z = _mm_sub_ps(center_z, view_z);
+      const __m128 distance = _mm_sqrt_ps(_mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(to_center_x, to_center_x),
+                     _mm_mul_ps(to_center_y, to_center_y)),
+          _mm_mul_ps(to_center_z, to_center_z)));
+      const __m128 axis_dot = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(to_center_x, _mm_loadu_ps(bounds.cone_axis_x.data() + i)),
+                     _mm_mul_ps(to_center_y, _mm_loadu_ps(bounds.cone_axis_y.data() + i))),
+          _mm_mul_ps(to_center_z, _mm_loadu_ps(bounds.cone_axis_z.data() + i)));
+      const __m128 cutoff = _mm_add_ps(
+          _mm_mul_ps(_mm_loadu_ps(bounds.cone_cutoff.data() + i), distance), radius);
+      visible = _mm_andnot_ps(_mm_cmpge_ps(axis_dot, cutoff), visible);
+    }
+
+    const int mask = _mm_movemask_ps(visible);
+    for (std::size_t lane = 0; lane < MeshletBounds::kLaneCount; lane++) {
+      visibilities_[i + lane] = (mask >> lane) & 1;
+    }
+  }
+#endif  // MESHLET_SSE
+
+  for (; i < bounds.padded_count(); i++) {
+    const glm::vec3 center(bounds.center_x[i], bounds.center_y[i], bounds.center_z[i]);
+    bool visible = true;
+    for (const auto& plane : planes) {
+      visible = visible && glm::dot(glm::vec3(plane), center) + plane.w > -bounds.radius[i];
+    }
+
+    if (cull_backfaces_) {
+      const glm::vec3 to_center = center - view_position;
+      const glm::vec3 axis(bounds.cone_axis_x[i], bounds.cone_axis_y[i],
+                           bounds.cone_axis_z[i]);
+      visible = visible && glm::dot(to_center, axis) <
+                               bounds.cone_cutoff[i] * glm::length(to_center) +
+                                   bounds.radius[i];
+    }
+    visibilities_[i] = visible;
+  }
+
+  // The meshlets are contiguous in the index buffer, the consecutive visible
+  // ones are drawn as one range.
+  const std::size_t index_size = IndexSize(mesh.index_type());
+  const std::size_t index_byte_offset = mesh.index_byte_offset();
+  bool is_previous_visible = false;
+  for (std::size_t m = 0; m < meshlets.size(); m++) {
+    if (!visibilities_[m]) {
+      is_previous_visible = false;
+      continue;
+    }
+
+    const auto& meshlet = meshlets[m];
+    if (is_previous_visible) {
+      counts_.back() += static_cast<GLsizei>(meshlet.index_count);
+    }
+    else {
+      counts_.push_back(static_cast<GLsizei>(meshlet.index_count));
+      offsets_.push_back(reinterpret_cast<const void*>(
+          index_byte_offset + static_cast<std::uintptr_t>(meshlet.first_index) * index_size));
+    }
+    is_previous_visible = true;
+  }
+
+  base_vertices_.assign(counts_.size(), mesh.base_vertex());
+  return counts_.size();
+}
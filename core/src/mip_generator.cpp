@@ -0,0 +1,377 @@
+#include "mip_generator.h"
+#include "job_system.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIP_GENERATOR_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Radius in destination texels of the windowed sinc filters.
+constexpr float kFilterRadius = 3.f;
+constexpr float kKaiserAlpha = 4.f;
+constexpr float kPi = 3.14159265359f;
+// Number of destination rows computed by one job of the parallel for.
+constexpr std::size_t kRowsPerJob = 16;
+
+class SrgbTables {
+ public:
+  SrgbTables() noexcept {
+    for (int i = 0; i < 256; i++) {
+      const float c = static_cast<float>(i) / 255.f;
+      to_linear_[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for (int i = 0; i < kEncodeTableSize; i++) {
+      const float l = static_cast<float>(i) / (kEncodeTableSize - 1);
+      const float c = l <= 0.0031308f ? l * 12.92f
+                                      : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+      to_srgb_[i] = static_cast<unsigned char>(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+    }
+  }
+
+  [[nodiscard]] float ToLinear(unsigned char c) const noexcept { return to_linear_[c]; }
+  [[nodiscard]] unsigned char ToSrgb(float l) const noexcept {
+    const auto idx = static_cast<int>(std::clamp(l, 0.f, 1.f) * (kEncodeTableSize - 1) + 0.5f);
+    return to_srgb_[idx];
+  }
+
+ private:
+  // Fine enough to keep the rounding exact in the steep dark part of the curve.
+  static constexpr int kEncodeTableSize = 16384;
+  std::array<float, 256> to_linear_{};
+  std::array<unsigned char, kEncodeTableSize> to_srgb_{};
+};
+
+const SrgbTables& GetSrgbTables() noexcept {
+  static const SrgbTables tables;
+  return tables;
+}
+
+float Sinc(float x) noexcept {
+  if (std::abs(x) < 1e-5f) {
+    return 1.f;
+  }
+  const float pi_x = kPi * x;
+  return std::sin(pi_x) / pi_x;
+}
+
+// Modified Bessel function of the first kind of order 0.
+float BesselI0(float x) noexcept {
+  float sum = 1.f;
+  float term = 1.f;
+  const float half_x = x * 0.5f;
+  for (int k = 1; k < 32; k++) {
+    const float factor = half_x / static_cast<float>(k);
+    term *= factor * factor;
+    sum += term;
+    if (term < sum * 1e-7f) {
+      break;
+    }
+  }
+  return sum;
+}
+
+float EvaluateFilter(MipFilter filter, float x) noexcept {
+  if (std::abs(x) >= kFilterRadius) {
+    return 0.f;
+  }
+
+  switch (filter) {
+    case MipFilter::kLanczos:
+      return Sinc(x) * Sinc(x / kFilterRadius);
+    case MipFilter::kKaiser:
+    default: {
+      const float t = x / kFilterRadius;
+      return Sinc(x) * BesselI0(kKaiserAlpha * std::sqrt(1.f - t * t)) /
+             BesselI0(kKaiserAlpha);
+    }
+  }
+}
+
+/*
+* @brief Source texels and weights contributing to a destination texel,
+* along one axis.
+*/
+struct FilterTaps {
+  int first = 0;
+  std::vector<float> weights{};
+};
+
+std::vector<FilterTaps> ComputeFilterTaps(int src_size, int dst_size,
+                                          MipFilter filter) noexcept {
+  const float scale = static_cast<float>(src_size) / static_cast<float>(dst_size);
+  std::vector<FilterTaps> taps(dst_size);
+
+  for (int x = 0; x < dst_size; x++) {
+    auto& tap = taps[x];
+    const float center = (static_cast<float>(x) + 0.5f) * scale;
+
+    if (filter == MipFilter::kBox) {
+      // Weights are the coverage of the source texels.
+      const float begin = center - scale * 0.5f;
+      const float end = center + scale * 0.5f;
+      tap.first = static_cast<int>(std::floor(begin));
+      const int last = static_cast<int>(std::ceil(end)) - 1;
+      for (int i = tap.first; i <= last; i++) {
+        const float coverage = std::min(end, static_cast<float>(i + 1)) -
+                               std::max(begin, static_cast<float>(i));
+        tap.weights.push_back(std::max(coverage, 0.f));
+      }
+    }
+    else {
+      const float support = kFilterRadius * scale;
+      tap.first = static_cast<int>(std::floor(center - support));
+      const int last = static_cast<int>(std::ceil(center + support));
+      for (int i = tap.first; i <= last; i++) {
+        tap.weights.push_back(
+            EvaluateFilter(filter, (static_cast<float>(i) + 0.5f - center) / scale));
+      }
+    }
+
+    float weight_sum = 0.f;
+    for (const float weight : tap.weights) {
+      weight_sum += weight;
+    }
+    for (float& weight : tap.weights) {
+      weight /= weight_sum;
+    }
+  }
+
+  return taps;
+}
+
+// dst += src * weight.
+void AccumulateRow(float* dst, const float* src, float weight, std::size_t count) noexcept {
+  std::size_t i = 0;
+
+#if defined(MIP_GENERATOR_AVX2)
+  const __m256 weight_8 = _mm256_set1_ps(weight);
+  for (; i + 8 <= count; i += 8) {
+    const __m256 sum = _mm256_add_ps(_mm256_loadu_ps(dst + i),
+                                     _mm256_mul_ps(_mm256_loadu_ps(src + i), weight_8));
+    _mm256_storeu_ps(dst + i, sum);
+  }
+#elif defined(MIP_GENERATOR_SSE2)
+  const __m128 weight_4 = _mm_set1_ps(weight);
+  for (; i + 4 <= count; i += 4) {
+    const __m128 sum = _mm_add_ps(_mm_loadu_ps(dst + i),
+                                  _mm_mul_ps(_mm_loadu_ps(src + i), weight_4));
+    _mm_storeu_ps(dst + i, sum);
+  }
+#endif
+
+  for (; i < count; i++) {
+    dst[i] += src[i] * weight;
+  }
+}
+
+// Horizontal pass over a row already filtered vertically.
+void FilterRow(const float* row, int src_width, int channels,
+               const std::vector<FilterTaps>& column_taps, float* dst) noexcept {
+  const int dst_width = static_cast<int>(column_taps.size());
+
+  for (int x = 0; x < dst_width; x++) {
+    const auto& tap = column_taps[x];
+    const int tap_count = static_cast<int>(tap.weights.size());
+    float* out = dst + static_cast<std::size_t>(x) * channels;
+
+#if defined(MIP_GENERATOR_AVX2) || defined(MIP_GENERATOR_SSE2)
+    if (channels == 4) {
+      __m128 sum = _mm_setzero_ps();
+      for (int k = 0; k < tap_count; k++) {
+        const int src_x = std::clamp(tap.first + k, 0, src_width - 1);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + src_x * 4),
+                                         _mm_set1_ps(tap.weights[k])));
+      }
+      _mm_storeu_ps(out, sum);
+      continue;
+    }
+#endif
+
+    for (int c = 0; c < channels; c++) {
+      out[c] = 0.f;
+    }
+    for (int k = 0; k < tap_count; k++) {
+      const int src_x = std::clamp(tap.first + k, 0, src_width - 1);
+      const float weight = tap.weights[k];
+      for (int c = 0; c < channels; c++) {
+        out[c] += row[src_x * channels + c] * weight;
+      }
+    }
+  }
+}
+
+void RenormalizeNormals(float* texels, std::size_t texel_count, int channels) noexcept {
+  for (std::size_t i = 0; i < texel_count; i++) {
+    float* texel = texels + i * channels;
+    const int normal_channels = std::min(channels, 3);
+
+    float length_sqr = 0.f;
+    for (int c = 0; c < normal_channels; c++) {
+      const float n = texel[c] * 2.f - 1.f;
+      length_sqr += n * n;
+    }
+
+    // Two channels normals only need to stay in the unit disk.
+    if (length_sqr < 1e-8f || (normal_channels < 3 && length_sqr <= 1.f)) {
+      continue;
+    }
+
+    const float inv_length = 1.f / std::sqrt(length_sqr);
+    for (int c = 0; c < normal_channels; c++) {
+      texel[c] = (texel[c] * 2.f - 1.f) * inv_length * 0.5f + 0.5f;
+    }
+  }
+}
+
+void DownsampleLevel(const MipLevel<float>& src, MipLevel<float>* dst, int channels,
+                     const MipGenerationParameters& params, float max_value) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  dst->width = std::max(1, src.width / 2);
+  dst->height = std::max(1, src.height / 2);
+  dst->pixels.resize(static_cast<std::size_t>(dst->width) * dst->height * channels);
+
+  const auto column_taps = ComputeFilterTaps(src.width, dst->width, params.filter);
+  const auto row_taps = ComputeFilterTaps(src.height, dst->height, params.filter);
+  const std::size_t src_row_size = static_cast<std::size_t>(src.width) * channels;
+  const std::size_t dst_row_size = static_cast<std::size_t>(dst->width) * channels;
+
+  ParallelFor(dst->height, kRowsPerJob, [&](std::size_t begin, std::size_t end) {
+    std::vector<float> row(src_row_size);
+
+    for (std::size_t y = begin; y < end; y++) {
+      // Vertical pass.
+      std::fill(row.begin(), row.end(), 0.f);
+      const auto& tap = row_taps[y];
+      for (std::size_t k = 0; k < tap.weights.size(); k++) {
+        const int src_y = std::clamp(tap.first + static_cast<int>(k), 0, src.height - 1);
+        AccumulateRow(row.data(), src.pixels.data() + src_y * src_row_size,
+                      tap.weights[k], src_row_size);
+      }
+
+      // Horizontal pass.
+      float* dst_row = dst->pixels.data() + y * dst_row_size;
+      FilterRow(row.data(), src.width, channels, column_taps, dst_row);
+
+      // Clamps the ringing of the sinc filters.
+      for (std::size_t i = 0; i < dst_row_size; i++) {
+        dst_row[i] = std::clamp(dst_row[i], 0.f, max_value);
+      }
+
+      if (params.normal_map) {
+        RenormalizeNormals(dst_row, dst->width, channels);
+      }
+    }
+  });
+}
+
+template <typename T, typename ConvertLevel>
+std::vector<MipLevel<T>> GenerateMipChain(MipLevel<float> level, int channels,
+                                          const MipGenerationParameters& params,
+                                          float max_value,
+                                          ConvertLevel convert_level) noexcept {
+  const int level_count = CalculateMipLevelCount(level.width, level.height);
+  std::vector<MipLevel<T>> mips(level_count - 1);
+
+  for (auto& mip : mips) {
+    MipLevel<float> next_level;
+    DownsampleLevel(level, &next_level, channels, params, max_value);
+
+    mip.width = next_level.width;
+    mip.height = next_level.height;
+    mip.pixels.resize(next_level.pixels.size());
+    convert_level(next_level, &mip);
+
+    level = std::move(next_level);
+  }
+
+  return mips;
+}
+
+}  // namespace
+
+int CalculateMipLevelCount(int width, int height) noexcept {
+  int level_count = 1;
+  while (width > 1 || height > 1) {
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+    level_count++;
+  }
+  return level_count;
+}
+
+std::vector<MipLevel<unsigned char>> GenerateMipChain(
+    const unsigned char* pixels, int width, int height, int channels,
+    const MipGenerationParameters& params) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const auto& srgb_tables = GetSrgbTables();
+  // Alpha is never gamma encoded.
+  const int color_channels = channels == 4 ? 3 : channels;
+
+  MipLevel<float> level_0;
+  level_0.width = width;
+  level_0.height = height;
+  level_0.pixels.resize(static_cast<std::size_t>(width) * height * channels);
+
+  const std::size_t row_size = static_cast<std::size_t>(width) * channels;
+  ParallelFor(height, kRowsPerJob, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin * row_size; i < end * row_size; i++) {
+      const bool linearize = params.srgb && static_cast<int>(i % channels) < color_channels;
+      level_0.pixels[i] = linearize ? srgb_tables.ToLinear(pixels[i])
+                                    : static_cast<float>(pixels[i]) / 255.f;
+    }
+  });
+
+  return GenerateMipChain<unsigned char>(
+      std::move(level_0), channels, params, 1.f,
+      [&](const MipLevel<float>& src, MipLevel<unsigned char>* dst) {
+        const std::size_t level_row_size = static_cast<std::size_t>(src.width) * channels;
+        ParallelFor(src.height, kRowsPerJob, [&](std::size_t begin, std::size_t end) {
+          for (std::size_t i = begin * level_row_size; i < end * level_row_size; i++) {
+            const bool encode = params.srgb && static_cast<int>(i % channels) < color_channels;
+            dst->pixels[i] = encode ? srgb_tables.ToSrgb(src.pixels[i])
+                                    : static_cast<unsigned char>(src.pixels[i] * 255.f + 0.5f);
+          }
+        });
+      });
+}
+
+std::vector<MipLevel<float>> GenerateMipChain(const float* pixels, int width,
+                                              int height, int channels,
+                                              const MipGenerationParameters& params) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  MipLevel<float> level_0;
+  level_0.width = width;
+  level_0.height = height;
+  level_0.pixels.assign(pixels, pixels + static_cast<std::size_t>(width) * height * channels);
+
+  return GenerateMipChain<float>(
+      std::move(level_0), channels, params, std::numeric_limits<float>::max(),
+      [](const MipLevel<float>& src, MipLevel<float>* dst) {
+        dst->pixels = src.pixels;
+      });
+}
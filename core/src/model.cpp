@@ -1,20 +1,51 @@
 #include "model.h"
+#include "cooked_mesh.h"
+#include "job_system.h"
+#include "mesh_simplifier.h"
+#include "mesh_welder.h"
 
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <limits>
+
+namespace {
+
+unsigned AssimpImportFlags(bool flip_y) noexcept {
+  unsigned flags = aiProcess_Triangulate | aiProcess_CalcTangentSpace;
+  if (flip_y) {
+    flags |= aiProcess_FlipUVs;
+  }
+  return flags;
+}
+
+MeshOptimizationReport SumReports(const std::vector<MeshOptimizationReport>& reports) noexcept {
+  MeshOptimizationReport sum;
+  for (const auto& report : reports) {
+    sum.Add(report);
+  }
+  return sum;
+}
+
+}  // namespace
 
 void Model::Destroy() noexcept {
   for (auto& mesh : meshes_) {
     mesh.Destroy();
   }
 
-  for (auto& texture : textures_loaded_) {
-    //glDeleteTextures(1, &texture.id);
-    texture.Destroy();
-  }
-
-  textures_loaded_.clear();
+  texture_handles_.clear();
   meshes_.clear();
   directory_ = "";
+  cooked_file_.Close();
 }
 
 void Model::SetupModelMatrixBuffer(const glm::mat4* model_matrix_data,
@@ -39,52 +70,308 @@ void Model::GenerateModelSphereBoundingVolume() {
   }
 }
 
-void Model::Load(std::string_view path, bool gamma, bool flip_y) {
-  Assimp::Importer import;
-  auto flags = aiProcess_Triangulate | aiProcess_CalcTangentSpace;
- 
-  if (flip_y) {
-    flags = flags | aiProcess_FlipUVs;
+void Model::Load(std::string_view path, bool gamma, bool flip_y, ModelImporter importer) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  directory_ = path.substr(0, path.find_last_of('/'));
+
+  const bool is_obj_parsed = importer == ModelImporter::kObjParser && IsObjFilePath(path);
+  const auto cooked_path = CookedMeshPath(path);
+  if (IsCookedMeshUpToDate(path, cooked_path, flip_y, is_obj_parsed) &&
+      LoadCookedMeshes(cooked_path, gamma, flip_y)) {
+    return;
+  }
+
+  bool mikk_tangents = false;
+  if (is_obj_parsed) {
+    mikk_tangents = ImportWithObjParser(path, gamma, flip_y);
+    if (!mikk_tangents) {
+      std::cerr << "The OBJ parser could not read " << path << ", importing it with Assimp.\n";
+    }
+  }
+  if (!mikk_tangents && !ImportWithAssimp(path, gamma, flip_y)) {
+    return;
   }
-  
-  const aiScene* scene = import.ReadFile(path.data(), flags);
+
+  std::cout << path << ": " << optimization_report_.triangle_count << " triangles, "
+            << optimization_report_.imported_vertex_count << " -> "
+            << optimization_report_.vertex_count << " vertices once welded, ACMR "
+            << optimization_report_.acmr_before() << " -> "
+            << optimization_report_.acmr_after() << " with a " << kVertexCacheSize
+            << " vertices cache.\n";
+
+  if (!CookMeshes(meshes_, flip_y, mikk_tangents, cooked_path)) {
+    std::cerr << "Failed to cook the meshes of " << path << '\n';
+  }
+}
+
+bool Model::ImportWithAssimp(std::string_view path, bool gamma, bool flip_y) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  Assimp::Importer import;
+  const aiScene* scene = import.ReadFile(path.data(), AssimpImportFlags(flip_y));
 
   if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
     std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << '\n';
-    return;
+    return false;
   }
 
-  directory_ = path.substr(0, path.find_last_of('/'));
+  std::vector<const aiMesh*> scene_meshes;
+  CollectMeshes(scene->mRootNode, scene, &scene_meshes);
+
+  // The textures go through the texture registry one mesh after the other, then
+  // the meshes are converted in parallel, each one in its own slot.
+  std::vector<std::vector<Texture>> mesh_textures(scene_meshes.size());
+  for (std::size_t i = 0; i < scene_meshes.size(); i++) {
+    mesh_textures[i] = LoadMeshTextures(scene_meshes[i], scene, gamma, flip_y);
+  }
+
+  meshes_.resize(scene_meshes.size());
+  std::vector<MeshOptimizationReport> reports(scene_meshes.size());
+  ParallelFor(scene_meshes.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+      std::vector<Vertex> vertices;
+      std::vector<GLuint> indices;
+      ConvertMesh(scene_meshes[i], &vertices, &indices);
+      meshes_[i] = ProcessMesh(std::move(vertices), std::move(indices),
+                               std::move(mesh_textures[i]), &reports[i]);
+      meshes_[i].GenerateBoundingSphere();
+    }
+  });
+
+  optimization_report_ = SumReports(reports);
+  return true;
+}
+
+bool Model::ImportWithObjParser(std::string_view path, bool gamma, bool flip_y) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  ObjScene scene;
+  if (!ParseObjFile(path, flip_y, &scene)) {
+    return false;
+  }
+
+  std::vector<std::vector<Texture>> mesh_textures(scene.meshes.size());
+  for (std::size_t i = 0; i < scene.meshes.size(); i++) {
+    if (scene.meshes[i].material != ObjMesh::kNoMaterial) {
+      mesh_textures[i] = LoadObjMaterialTextures(scene.materials[scene.meshes[i].material],
+                                                 gamma, flip_y);
+    }
+  }
+
+  meshes_.resize(scene.meshes.size());
+  std::vector<MeshOptimizationReport> reports(scene.meshes.size());
+  ParallelFor(scene.meshes.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+      meshes_[i] = ProcessMesh(std::move(scene.meshes[i].vertices),
+                               std::move(scene.meshes[i].indices),
+                               std::move(mesh_textures[i]), &reports[i]);
+      meshes_[i].GenerateBoundingSphere();
+    }
+  });
+
+  optimization_report_ = SumReports(reports);
+  return true;
+}
+
+bool Model::BenchmarkImporters(std::string_view path, bool flip_y, int repeat_count) {
+  using Clock = std::chrono::steady_clock;
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+
+  double assimp_time = std::numeric_limits<double>::max();
+  double obj_parser_time = std::numeric_limits<double>::max();
+  std::vector<std::vector<Vertex>> assimp_vertices;
+  std::vector<std::vector<GLuint>> assimp_indices;
+  ObjScene obj_scene;
+
+  for (int i = 0; i < repeat_count; i++) {
+    // Assimp reads the file then the meshes are converted in parallel, like in
+    // ImportWithAssimp.
+    auto start = Clock::now();
+    {
+      Assimp::Importer import;
+      const aiScene* scene = import.ReadFile(path.data(), AssimpImportFlags(flip_y));
+      if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << '\n';
+        return false;
+      }
+
+      std::vector<const aiMesh*> scene_meshes;
+      CollectMeshes(scene->mRootNode, scene, &scene_meshes);
+      assimp_vertices.assign(scene_meshes.size(), {});
+      assimp_indices.assign(scene_meshes.size(), {});
+      ParallelFor(scene_meshes.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t m = begin; m < end; m++) {
+          ConvertMesh(scene_meshes[m], &assimp_vertices[m], &assimp_indices[m]);
+        }
+      });
+    }
+    assimp_time = std::min(assimp_time, Milliseconds(Clock::now() - start).count());
+
+    start = Clock::now();
+    if (!ParseObjFile(path, flip_y, &obj_scene)) {
+      return false;
+    }
+    obj_parser_time = std::min(obj_parser_time, Milliseconds(Clock::now() - start).count());
+  }
+
+  // The positions, normals and uvs must be the same bits, the tangents only
+  // follow the same conventions.
+  const bool have_same_meshes = assimp_vertices.size() == obj_scene.meshes.size();
+  std::size_t vertex_count = 0;
+  std::size_t different_vertex_count = 0;
+  std::size_t different_index_mesh_count = 0;
+  std::size_t flipped_bitangent_count = 0;
+  float max_tangent_angle = 0.f;
+  for (std::size_t m = 0; have_same_meshes && m < assimp_vertices.size(); m++) {
+    const auto& vertices = assimp_vertices[m];
+    const auto& obj_mesh = obj_scene.meshes[m];
+    if (assimp_indices[m] != obj_mesh.indices) {
+      different_index_mesh_count++;
+    }
+
+    vertex_count += vertices.size();
+    if (vertices.size() != obj_mesh.vertices.size()) {
+      different_vertex_count += vertices.size();
+      continue;
+    }
+    for (std::size_t v = 0; v < vertices.size(); v++) {
+      const auto& vertex = vertices[v];
+      const auto& obj_vertex = obj_mesh.vertices[v];
+      if (std::memcmp(&vertex.position, &obj_vertex.position, sizeof(glm::vec3)) != 0 ||
+          std::memcmp(&vertex.normal, &obj_vertex.normal, sizeof(glm::vec3)) != 0 ||
+          std::memcmp(&vertex.uv, &obj_vertex.uv, sizeof(glm::vec2)) != 0) {
+        different_vertex_count++;
+      }
+
+      const float cosine = glm::dot(vertex.tangent, obj_vertex.tangent);
+      max_tangent_angle = std::max(max_tangent_angle,
+                                   std::acos(std::clamp(cosine, -1.f, 1.f)));
+      const bool is_right_handed =
+          glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.bitangent) >= 0.f;
+      const bool is_obj_right_handed =
+          glm::dot(glm::cross(obj_vertex.normal, obj_vertex.tangent),
+                   obj_vertex.bitangent) >= 0.f;
+      if (is_right_handed != is_obj_right_handed) {
+        flipped_bitangent_count++;
+      }
+    }
+  }
+
+  std::cout << path << ": Assimp " << assimp_time << " ms, OBJ parser " << obj_parser_time
+            << " ms (" << assimp_time / obj_parser_time << "x), best of " << repeat_count
+            << ".\n";
+  if (!have_same_meshes) {
+    std::cout << "  " << assimp_vertices.size() << " meshes with Assimp, "
+              << obj_scene.meshes.size() << " with the OBJ parser.\n";
+    return true;
+  }
+  std::cout << "  " << obj_scene.meshes.size() << " meshes, " << different_vertex_count
+            << " of " << vertex_count << " vertices and the indices of "
+            << different_index_mesh_count << " meshes differ, tangents within "
+            << glm::degrees(max_tangent_angle) << " degrees, " << flipped_bitangent_count
+            << " flipped bitangents.\n";
+  return true;
+}
 
-  ProcessNode(scene->mRootNode, scene, gamma, flip_y);
+bool Model::LoadCookedMeshes(std::string_view cooked_path, bool gamma, bool flip_y) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  if (!cooked_file_.Open(cooked_path)) {
+    return false;
+  }
+
+  CookedMesh cooked_mesh;
+  if (!cooked_mesh.Parse(cooked_file_.data(), cooked_file_.size())) {
+    std::cerr << "Invalid cooked mesh " << cooked_path << '\n';
+    cooked_file_.Close();
+    return false;
+  }
+
+  // The meshes point to their ranges in the mapping, the pages are read by the
+  // driver when LoadToGpu uploads them.
+  const auto& header = cooked_mesh.header();
+  meshes_.reserve(header.mesh_count);
+  for (std::uint32_t i = 0; i < header.mesh_count; i++) {
+    const auto& range = cooked_mesh.range(i);
+
+    std::vector<Texture> textures;
+    for (std::uint32_t j = 0; j < range.texture_count; j++) {
+      const auto& texture = cooked_mesh.texture(range.first_texture + j);
+      const std::string_view type_name(
+          texture.type.data(), strnlen(texture.type.data(), texture.type.size()));
+      const std::string_view relative_path(
+          texture.path.data(), strnlen(texture.path.data(), texture.path.size()));
+      LoadMaterialTexture(relative_path, type_name,
+                          gamma && type_name == "texture_diffuse", flip_y, &textures);
+    }
+
+    std::vector<MeshLod> lods(range.lod_count);
+    for (std::uint32_t j = 0; j < range.lod_count; j++) {
+      const auto& lod = cooked_mesh.lod(range.first_lod + j);
+      lods[j] = MeshLod{lod.first_index, lod.index_count, lod.error};
+    }
+
+    std::vector<Meshlet> meshlets(range.meshlet_count);
+    for (std::uint32_t j = 0; j < range.meshlet_count; j++) {
+      const auto& meshlet = cooked_mesh.meshlet(range.first_meshlet + j);
+      meshlets[j].first_index = meshlet.first_index;
+      meshlets[j].index_count = meshlet.index_count;
+      meshlets[j].center = glm::vec3(meshlet.center[0], meshlet.center[1],
+                                     meshlet.center[2]);
+      meshlets[j].radius = meshlet.radius;
+      meshlets[j].cone_axis = glm::vec3(meshlet.cone_axis[0], meshlet.cone_axis[1],
+                                        meshlet.cone_axis[2]);
+      meshlets[j].cone_cutoff = meshlet.cone_cutoff;
+    }
+
+    const BoundingSphere bounding_volume(
+        glm::vec3(range.bounds_center[0], range.bounds_center[1], range.bounds_center[2]),
+        range.bounds_radius);
+    meshes_.emplace_back(cooked_mesh.vertices(range), range.vertex_count,
+                         cooked_mesh.indices(range), range.index_count,
+                         static_cast<GLenum>(range.index_type), textures,
+                         bounding_volume, lods, meshlets);
+  }
+
+  return true;
 }
 
-void Model::LoadToGpu() noexcept {
+void Model::LoadToGpu(GeometryArena* arena) noexcept {
   for (auto& mesh : meshes_) {
-    mesh.LoadToGpu();
+    mesh.LoadToGpu(arena);
   }
+  cooked_file_.Close();
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene, bool gamma, bool flip_y) {
+void Model::CollectMeshes(const aiNode* node, const aiScene* scene,
+                          std::vector<const aiMesh*>* meshes) {
   // I don't iterates throw all the meshes of the scene directly to be able to
   // set certain mesh as parent of other ones.
 
-  // Process all the node's meshes (if any).
+  // Collect all the node's meshes (if any).
   for (std::size_t i = 0; i < node->mNumMeshes; i++) {
-    aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-    meshes_.emplace_back(ProcessMesh(mesh, scene, gamma, flip_y));
+    meshes->push_back(scene->mMeshes[node->mMeshes[i]]);
   }
 
   // Do the same for each of its children.
   for (std::size_t i = 0; i < node->mNumChildren; i++) {
-    ProcessNode(node->mChildren[i], scene, gamma, flip_y);
+    CollectMeshes(node->mChildren[i], scene, meshes);
   }
 }
 
-Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene, bool gamma, bool flip_y) { 
-  std::vector<Vertex> vertices;
-  std::vector<GLuint> indices;
-  std::vector<Texture> textures;
+void Model::ConvertMesh(const aiMesh* mesh, std::vector<Vertex>* vertices,
+                        std::vector<GLuint>* indices) {
+  vertices->reserve(mesh->mNumVertices);
+  indices->reserve(static_cast<std::size_t>(mesh->mNumFaces) * 3);
   
   for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
     // Process vertex positions, normals and texture coordinates.
@@ -122,17 +409,53 @@ Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene, bool gamma, bool fli
 
     vertex.bitangent = glm::normalize(vertex.bitangent);
 
-    vertices.push_back(vertex);
+    vertices->push_back(vertex);
   }
 
   // Process indices (each faces has a number of indices).
   for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-    aiFace face = mesh->mFaces[i];
+    const aiFace& face = mesh->mFaces[i];
 
     for (unsigned int j = 0; j < face.mNumIndices; j++) {
-      indices.push_back(face.mIndices[j]);
+      indices->push_back(face.mIndices[j]);
     }
   }
+}
+
+Mesh Model::ProcessMesh(std::vector<Vertex> vertices, std::vector<GLuint> indices,
+                        std::vector<Texture> textures, MeshOptimizationReport* report) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // The importer gives each face its own vertices, the identical ones are
+  // merged before the optimizations so that the triangles share them.
+  const std::size_t imported_vertex_count = vertices.size();
+  WeldVertices(&vertices, &indices);
+
+  // The scene draws the models in several passes per frame, their triangles
+  // are reordered once here then cooked.
+  *report = OptimizeMesh(&vertices, &indices);
+  report->imported_vertex_count = imported_vertex_count;
+
+  // The full level is culled by meshlets, their triangles keep the order of the
+  // optimization inside each one.
+  std::vector<Meshlet> meshlets;
+  BuildMeshlets(vertices, &indices, &meshlets);
+
+  // The simplified levels are appended to the indices and share the vertices.
+  std::vector<MeshLod> lods;
+  GenerateLods(vertices, &indices, &lods);
+
+  Mesh processed_mesh(std::move(vertices), std::move(indices), std::move(textures));
+  processed_mesh.SetLods(std::move(lods));
+  processed_mesh.SetMeshlets(std::move(meshlets));
+  return processed_mesh;
+}
+
+std::vector<Texture> Model::LoadMeshTextures(const aiMesh* mesh, const aiScene* scene,
+                                             bool gamma, bool flip_y) {
+  std::vector<Texture> textures;
 
   // Process material.
   if (mesh->mMaterialIndex >= 0) {
@@ -162,10 +485,9 @@ Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene, bool gamma, bool fli
     textures.insert(textures.end(), 
                     std::make_move_iterator(normalMaps.begin()),
                     std::make_move_iterator(normalMaps.end()));
-  } 
-  
-  return std::move(Mesh(std::move(vertices), std::move(indices), 
-                        std::move(textures)));
+  }
+
+  return textures;
 }
 
 std::vector<Texture> Model::LoadMaterialTextures(aiMaterial* mat,
@@ -176,27 +498,51 @@ std::vector<Texture> Model::LoadMaterialTextures(aiMaterial* mat,
   for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
     aiString str;
     mat->GetTexture(type, i, &str);
+    LoadMaterialTexture(str.C_Str(), type_name, gamma, flip_y, &textures);
+  }
+  return textures;
+}
 
-    bool skip = false;
-    for (unsigned int j = 0; j < textures_loaded_.size(); j++) {
-      if (std::strcmp(textures_loaded_[j].path.data(), str.C_Str()) == 0) {
-        textures.push_back(textures_loaded_[j]);
-        skip = true;
-        break;
-      }
-    }
-
-     // If texture hasn't been loaded already, load it.
-    if (!skip) {
-      std::string texture_path = str.C_Str();
-      Texture texture;
-      texture.Create(directory_ + '/' + texture_path,
-                     GL_REPEAT, GL_LINEAR, gamma, flip_y);
-      texture.type = type_name;
-      texture.path = texture_path;
-      textures_loaded_.push_back(texture);
-      textures.push_back(std::move(texture));
-    }
+std::vector<Texture> Model::LoadObjMaterialTextures(const ObjMaterial& material,
+                                                    bool gamma, bool flip_y) {
+  // In the order of LoadMeshTextures.
+  std::vector<Texture> textures;
+  for (const auto& path : material.diffuse_maps) {
+    LoadMaterialTexture(path, "texture_diffuse", gamma, flip_y, &textures);
+  }
+  for (const auto& path : material.specular_maps) {
+    LoadMaterialTexture(path, "texture_specular", false, flip_y, &textures);
+  }
+  for (const auto& path : material.normal_maps) {
+    LoadMaterialTexture(path, "texture_normal", false, flip_y, &textures);
   }
   return textures;
+}
+
+void Model::LoadMaterialTexture(std::string_view relative_path,
+                                std::string_view type_name, bool gamma, bool flip_y,
+                                std::vector<Texture>* textures) {
+  const std::string texture_path = directory_ + '/' + std::string(relative_path);
+  const TextureParameters tex_param(texture_path, GL_REPEAT, GL_LINEAR, gamma, flip_y);
+
+  // The file is only read if the texture hasn't been loaded already by any model.
+  std::uint64_t source_hash = 0;
+  if (!HashFileIdentity(texture_path, &source_hash)) {
+    std::cerr << "Error in loading the image at path " << texture_path << '\n';
+    return;
+  }
+
+  bool is_new_texture = false;
+  auto handle = GetTextureRegistry().Acquire(TextureKey(source_hash, tex_param),
+                                             &is_new_texture);
+  if (is_new_texture) {
+    *handle.id_address() = LoadTexture(texture_path, GL_REPEAT, GL_LINEAR, gamma, flip_y);
+  }
+
+  Texture texture;
+  texture.id = handle.id();
+  texture.type = type_name;
+  texture.path = relative_path;
+  texture_handles_.push_back(std::move(handle));
+  textures->push_back(std::move(texture));
 }
\ No newline at end of file
@@ -0,0 +1,1164 @@
+#include "obj_parser.h"
+#include "file_utility.h"
+#include "job_system.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+// MSVC exposes SSE4.1 with /arch:AVX2.
+#if defined(__SSE4_1__) || defined(__AVX2__)
+#include <smmintrin.h>
+#define OBJ_SSE41
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif  // _MSC_VER
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+namespace {
+
+// The files are split in chunks of lines of at least this size, a few per thread.
+constexpr std::size_t kMinChunkSize = 1 << 18;
+constexpr std::size_t kChunksPerThread = 4;
+constexpr std::size_t kFacesPerJob = 1 << 13;
+constexpr std::size_t kTrianglesPerJob = 1 << 13;
+constexpr std::size_t kPositionsPerJob = 1 << 12;
+
+// Like the fast_atof of Assimp, at most 15 decimals are read and scaled by these
+// values, the following ones are skipped.
+constexpr unsigned kMaxFractionDigitCount = 15;
+constexpr double kFractionScales[kMaxFractionDigitCount + 1] = {
+    0.0,        0.1,         0.01,         0.001,         0.0001,         0.00001,
+    0.000001,   0.0000001,   0.00000001,   0.000000001,   0.0000000001,   0.00000000001,
+    0.000000000001, 0.0000000000001, 0.00000000000001, 0.000000000000001,
+};
+// Enough to see the indices which overflow an int32.
+constexpr unsigned kMaxIndexDigitCount = 18;
+
+constexpr std::int32_t kMissingIndex = std::numeric_limits<std::int32_t>::min();
+constexpr std::uint32_t kNoMesh = ~0u;
+constexpr float kPi = 3.14159265358979323846f;
+
+// The 0 based indices of the attributes of a face corner in the whole file.
+struct ObjCorner {
+  std::int32_t position = kMissingIndex;
+  std::int32_t uv = kMissingIndex;
+  std::int32_t normal = kMissingIndex;
+};
+
+// A corner with negative indices, which are relative to the attributes parsed
+// before. They are counted from the first attribute of the chunk until the
+// number of attributes of the previous chunks is known.
+struct RelativeCorner {
+  static constexpr std::uint8_t kPosition = 1 << 0;
+  static constexpr std::uint8_t kUv = 1 << 1;
+  static constexpr std::uint8_t kNormal = 1 << 2;
+
+  std::uint32_t corner = 0;
+  std::uint8_t attributes = 0;
+};
+
+enum class ObjStatementType : std::uint8_t {
+  kObject,
+  kGroup,
+  kUseMaterial,
+  kMaterialLibrary,
+};
+
+// A statement which changes the mesh of the following faces.
+struct ObjStatement {
+  ObjStatementType type = ObjStatementType::kObject;
+  std::string_view name{};
+  // Faces of the chunk before the statement.
+  std::uint32_t face_count = 0;
+};
+
+struct ObjChunk {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> normals;
+  std::vector<ObjCorner> corners;
+  // Offset of the first corner of each face, followed by the number of corners.
+  std::vector<std::uint32_t> face_offsets = {0};
+  std::vector<RelativeCorner> relative_corners;
+  std::vector<ObjStatement> statements;
+  // The first line which could not be parsed, the rest of the chunk is skipped.
+  std::string_view invalid_line{};
+
+  [[nodiscard]] std::uint32_t face_count() const noexcept {
+    return static_cast<std::uint32_t>(face_offsets.size() - 1);
+  }
+};
+
+bool IsSpace(char c) noexcept {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool IsDigit(char c) noexcept {
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+void SkipSpaces(const char** it, const char* end) noexcept {
+  while (*it < end && IsSpace(**it)) {
+    ++*it;
+  }
+}
+
+std::string_view ReadToken(const char** it, const char* end) noexcept {
+  const char* begin = *it;
+  while (*it < end && !IsSpace(**it)) {
+    ++*it;
+  }
+  return std::string_view(begin, static_cast<std::size_t>(*it - begin));
+}
+
+// The rest of the line without its surrounding spaces, the names can contain spaces.
+std::string_view ReadName(const char* it, const char* end) noexcept {
+  SkipSpaces(&it, end);
+  while (end > it && IsSpace(end[-1])) {
+    end--;
+  }
+  return std::string_view(it, static_cast<std::size_t>(end - it));
+}
+
+#ifdef OBJ_SSE41
+unsigned CountTrailingZeros(unsigned value) noexcept {
+#ifdef _MSC_VER
+  unsigned long index = 0;
+  _BitScanForward(&index, value);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(value));
+#endif  // _MSC_VER
+}
+
+// Shuffles moving the first n bytes of a vector to its end and zeroing the others.
+struct DigitShuffles {
+  alignas(16) std::int8_t masks[17][16];
+};
+
+constexpr DigitShuffles MakeDigitShuffles() noexcept {
+  DigitShuffles shuffles{};
+  for (int count = 0; count <= 16; count++) {
+    for (int lane = 0; lane < 16; lane++) {
+      const int source = lane - (16 - count);
+      shuffles.masks[count][lane] = static_cast<std::int8_t>(source >= 0 ? source : -128);
+    }
+  }
+  return shuffles;
+}
+
+constexpr DigitShuffles kDigitShuffles = MakeDigitShuffles();
+
+// Value of the first count digits, from 0 to 9, of the vector.
+std::uint64_t CombineDigits(__m128i digits, unsigned count) noexcept {
+  const __m128i aligned = _mm_shuffle_epi8(
+      digits, _mm_load_si128(reinterpret_cast<const __m128i*>(kDigitShuffles.masks[count])));
+  // 16 digits -> 8 numbers of 2 digits -> 4 of 4 digits -> 2 of 8 digits.
+  const __m128i pairs = _mm_maddubs_epi16(aligned, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1,
+                                                                 10, 1, 10, 1, 10, 1, 10, 1));
+  const __m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+  const __m128i octs = _mm_madd_epi16(_mm_packus_epi32(quads, quads),
+                                      _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+  const auto high = static_cast<std::uint64_t>(_mm_cvtsi128_si32(octs));
+  const auto low = static_cast<std::uint64_t>(_mm_extract_epi32(octs, 1));
+  return high * 100000000ull + low;
+}
+#endif  // OBJ_SSE41
+
+/*
+* Reads the digits at it, the ones after the first max_count are skipped like
+* the strtoul10_64 of Assimp. Up to 16 digits are converted at once when 16
+* bytes can be loaded before limit.
+* Returns the number of digits read, at most max_count.
+*/
+unsigned ParseDigits(const char** it, const char* limit, unsigned max_count,
+                     std::uint64_t* value) noexcept {
+  const char* cursor = *it;
+  std::uint64_t result = 0;
+  unsigned count = 0;
+
+#ifdef OBJ_SSE41
+  if (limit - cursor >= 16) {
+    const __m128i digits = _mm_sub_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor)), _mm_set1_epi8('0'));
+    // The other characters wrap around to values above 9.
+    const __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    const unsigned non_digits = ~static_cast<unsigned>(_mm_movemask_epi8(is_digit));
+    count = std::min(CountTrailingZeros(non_digits), max_count);
+    result = CombineDigits(digits, count);
+    cursor += count;
+  }
+#endif  // OBJ_SSE41
+
+  for (; cursor < limit && IsDigit(*cursor); cursor++) {
+    if (count < max_count) {
+      result = result * 10 + static_cast<std::uint64_t>(*cursor - '0');
+      count++;
+    }
+  }
+
+  *it = cursor;
+  *value = result;
+  return count;
+}
+
+/*
+* Converts a number like the fast_atoreal_move of Assimp, in the same float
+* operations, so that both importers give the same values.
+*/
+bool ParseFloat(const char** it, const char* limit, float* value) noexcept {
+  const char* cursor = *it;
+  const bool is_negative = cursor < limit && *cursor == '-';
+  if (is_negative || (cursor < limit && *cursor == '+')) {
+    cursor++;
+  }
+
+  const auto has_fraction = [&cursor, limit]() noexcept {
+    return limit - cursor >= 2 && cursor[0] == '.' && IsDigit(cursor[1]);
+  };
+  if (!(cursor < limit && IsDigit(*cursor)) && !has_fraction()) {
+    return false;
+  }
+
+  float result = 0.f;
+  std::uint64_t digits = 0;
+  if (*cursor != '.') {
+    ParseDigits(&cursor, limit, UINT_MAX, &digits);
+    result = static_cast<float>(digits);
+  }
+  if (has_fraction()) {
+    cursor++;
+    const unsigned count = ParseDigits(&cursor, limit, kMaxFractionDigitCount, &digits);
+    result += static_cast<float>(static_cast<double>(digits) * kFractionScales[count]);
+  }
+  else if (cursor < limit && *cursor == '.') {
+    cursor++;
+  }
+
+  if (cursor < limit && (*cursor == 'e' || *cursor == 'E')) {
+    cursor++;
+    const bool is_exponent_negative = cursor < limit && *cursor == '-';
+    if (is_exponent_negative || (cursor < limit && *cursor == '+')) {
+      cursor++;
+    }
+    if (!(cursor < limit && IsDigit(*cursor))) {
+      return false;
+    }
+    ParseDigits(&cursor, limit, UINT_MAX, &digits);
+    float exponent = static_cast<float>(digits);
+    if (is_exponent_negative) {
+      exponent = -exponent;
+    }
+    result *= std::pow(10.f, exponent);
+  }
+
+  *value = is_negative ? -result : result;
+  *it = cursor;
+  return true;
+}
+
+/*
+* Parses the numbers until the end of the line, the first max_count ones are
+* stored in values.
+* Returns the number of numbers of the line, -1 if one is invalid.
+*/
+int ParseFloats(const char** it, const char* line_end, const char* limit, float* values,
+                int max_count) noexcept {
+  int count = 0;
+  for (;;) {
+    SkipSpaces(it, line_end);
+    if (*it >= line_end) {
+      return count;
+    }
+
+    float value = 0.f;
+    if (!ParseFloat(it, limit, &value) || (*it < line_end && !IsSpace(**it))) {
+      return -1;
+    }
+    if (count < max_count) {
+      values[count] = value;
+    }
+    count++;
+  }
+}
+
+bool ParseIndex(const char** it, const char* limit, std::size_t parsed_count,
+                std::uint8_t attribute, std::int32_t* index,
+                std::uint8_t* relative_attributes) noexcept {
+  const bool is_relative = *it < limit && **it == '-';
+  if (is_relative) {
+    ++*it;
+  }
+  if (!(*it < limit && IsDigit(**it))) {
+    return false;
+  }
+
+  std::uint64_t value = 0;
+  ParseDigits(it, limit, kMaxIndexDigitCount, &value);
+  if (value == 0 || value > static_cast<std::uint64_t>(INT32_MAX)) {
+    return false;
+  }
+
+  if (is_relative) {
+    *index = static_cast<std::int32_t>(static_cast<std::int64_t>(parsed_count) -
+                                       static_cast<std::int64_t>(value));
+    *relative_attributes |= attribute;
+  }
+  else {
+    *index = static_cast<std::int32_t>(value - 1);
+  }
+  return true;
+}
+
+/*
+* Parses the corners of a face: v, v/vt, v//vn or v/vt/vn. The faces of less
+* than 3 corners are ignored.
+*/
+bool ParseFace(const char** it, const char* line_end, const char* limit,
+               ObjChunk* chunk) noexcept {
+  const std::size_t first_corner = chunk->corners.size();
+  for (;;) {
+    SkipSpaces(it, line_end);
+    if (*it >= line_end) {
+      break;
+    }
+
+    ObjCorner corner;
+    std::uint8_t relative_attributes = 0;
+    if (!ParseIndex(it, limit, chunk->positions.size(), RelativeCorner::kPosition,
+                    &corner.position, &relative_attributes)) {
+      return false;
+    }
+    if (*it < line_end && **it == '/') {
+      ++*it;
+      if (*it < line_end && **it != '/' &&
+          !ParseIndex(it, limit, chunk->uvs.size(), RelativeCorner::kUv, &corner.uv,
+                      &relative_attributes)) {
+        return false;
+      }
+      if (*it < line_end && **it == '/') {
+        ++*it;
+        if (!ParseIndex(it, limit, chunk->normals.size(), RelativeCorner::kNormal,
+                        &corner.normal, &relative_attributes)) {
+          return false;
+        }
+      }
+    }
+    if (*it < line_end && !IsSpace(**it)) {
+      return false;
+    }
+
+    if (relative_attributes != 0) {
+      chunk->relative_corners.push_back(
+          RelativeCorner{static_cast<std::uint32_t>(chunk->corners.size()),
+                         relative_attributes});
+    }
+    chunk->corners.push_back(corner);
+  }
+
+  if (chunk->corners.size() - first_corner < 3) {
+    chunk->corners.resize(first_corner);
+    while (!chunk->relative_corners.empty() &&
+           chunk->relative_corners.back().corner >= first_corner) {
+      chunk->relative_corners.pop_back();
+    }
+    return true;
+  }
+
+  chunk->face_offsets.push_back(static_cast<std::uint32_t>(chunk->corners.size()));
+  return true;
+}
+
+bool ParseLine(const char* it, const char* line_end, const char* limit,
+               ObjChunk* chunk) noexcept {
+  SkipSpaces(&it, line_end);
+  const std::string_view keyword = ReadToken(&it, line_end);
+  if (keyword.empty() || keyword[0] == '#') {
+    return true;
+  }
+
+  float values[4];
+  if (keyword == "v") {
+    const int count = ParseFloats(&it, line_end, limit, values, 4);
+    if (count < 3) {
+      return false;
+    }
+    // x y z w, the other counts of numbers are x y z with or without a color.
+    if (count == 4) {
+      if (values[3] == 0.f) {
+        return false;
+      }
+      chunk->positions.emplace_back(values[0] / values[3], values[1] / values[3],
+                                    values[2] / values[3]);
+    }
+    else {
+      chunk->positions.emplace_back(values[0], values[1], values[2]);
+    }
+  }
+  else if (keyword == "vt") {
+    const int count = ParseFloats(&it, line_end, limit, values, 3);
+    if (count != 2 && count != 3) {
+      return false;
+    }
+    chunk->uvs.emplace_back(values[0], values[1]);
+  }
+  else if (keyword == "vn") {
+    if (ParseFloats(&it, line_end, limit, values, 3) < 3) {
+      return false;
+    }
+    chunk->normals.emplace_back(values[0], values[1], values[2]);
+  }
+  else if (keyword == "f") {
+    return ParseFace(&it, line_end, limit, chunk);
+  }
+  else {
+    ObjStatementType type;
+    if (keyword == "o") {
+      type = ObjStatementType::kObject;
+    }
+    else if (keyword == "g") {
+      type = ObjStatementType::kGroup;
+    }
+    else if (keyword == "usemtl") {
+      type = ObjStatementType::kUseMaterial;
+    }
+    else if (keyword == "mtllib") {
+      type = ObjStatementType::kMaterialLibrary;
+    }
+    else {
+      // The smoothing groups, lines, points and curves are not imported.
+      return true;
+    }
+    chunk->statements.push_back(ObjStatement{type, ReadName(it, line_end),
+                                             chunk->face_count()});
+  }
+
+  return true;
+}
+
+void ParseChunk(const char* begin, const char* end, ObjChunk* chunk) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  for (const char* line = begin; line < end;) {
+    const auto* line_end = static_cast<const char*>(
+        std::memchr(line, '\n', static_cast<std::size_t>(end - line)));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+
+    if (!ParseLine(line, line_end, end, chunk)) {
+      chunk->invalid_line = ReadName(line, line_end);
+      return;
+    }
+    line = line_end + 1;
+  }
+}
+
+/*
+* Splits the file in chunks which start at the beginning of a line.
+* Returns the beginning of each chunk followed by the end of the file.
+*/
+std::vector<const char*> SplitInChunks(const char* data, std::size_t size) {
+  const std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+  const std::size_t chunk_count = std::clamp<std::size_t>(size / kMinChunkSize, 1,
+                                                          thread_count * kChunksPerThread);
+  const char* end = data + size;
+
+  std::vector<const char*> boundaries = {data};
+  for (std::size_t i = 1; i < chunk_count; i++) {
+    const char* boundary = data + size * i / chunk_count;
+    if (boundary <= boundaries.back()) {
+      continue;
+    }
+    boundary = static_cast<const char*>(
+        std::memchr(boundary, '\n', static_cast<std::size_t>(end - boundary)));
+    if (boundary == nullptr || boundary + 1 >= end) {
+      break;
+    }
+    boundaries.push_back(boundary + 1);
+  }
+  boundaries.push_back(end);
+  return boundaries;
+}
+
+/*
+* Reads the texture maps of the materials of a MTL file. The options of the
+* maps, which come before the path, are skipped.
+*/
+void ParseMtlFile(std::string_view path, std::vector<ObjMaterial>* materials) {
+  MappedFile file;
+  if (!file.Open(path)) {
+    std::cerr << "Failed to open the material library " << path << '\n';
+    return;
+  }
+
+  const auto* it = reinterpret_cast<const char*>(file.data());
+  const char* end = it + file.size();
+  ObjMaterial* material = nullptr;
+  while (it < end) {
+    const auto* line_end = static_cast<const char*>(
+        std::memchr(it, '\n', static_cast<std::size_t>(end - it)));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+
+    SkipSpaces(&it, line_end);
+    const std::string_view keyword = ReadToken(&it, line_end);
+    if (keyword == "newmtl") {
+      materials->push_back(ObjMaterial{});
+      material = &materials->back();
+      material->name = ReadName(it, line_end);
+    }
+    else if (material != nullptr &&
+             (keyword == "map_Kd" || keyword == "map_Ks" || keyword == "map_Bump" ||
+              keyword == "map_bump" || keyword == "bump")) {
+      // The options and their arguments: -o, -s and -t take up to 3 numbers.
+      for (;;) {
+        SkipSpaces(&it, line_end);
+        if (it >= line_end || *it != '-') {
+          break;
+        }
+        const std::string_view option = ReadToken(&it, line_end);
+        const int argument_count = option == "-o" || option == "-s" || option == "-t" ? 3
+                                   : option == "-mm"                                  ? 2
+                                                                                      : 1;
+        for (int i = 0; i < argument_count; i++) {
+          SkipSpaces(&it, line_end);
+          const char* argument = it;
+          float number = 0.f;
+          // The optional numbers stop at the path.
+          if (i > 0 && (!ParseFloat(&argument, line_end, &number) ||
+                        (argument < line_end && !IsSpace(*argument)))) {
+            break;
+          }
+          ReadToken(&it, line_end);
+        }
+      }
+
+      std::string map_path(ReadName(it, line_end));
+      if (!map_path.empty()) {
+        auto& maps = keyword == "map_Kd"   ? material->diffuse_maps
+                     : keyword == "map_Ks" ? material->specular_maps
+                                           : material->normal_maps;
+        maps.push_back(std::move(map_path));
+      }
+    }
+
+    it = line_end + 1;
+  }
+}
+
+/*
+* Groups the faces in meshes like the ObjFileParser of Assimp: each object or
+* group has its own meshes, a new one is started when the material of the faces
+* changes. The statements and the faces are given in the order of the file.
+*/
+class ObjMeshGrouping {
+ public:
+  // Faces of a chunk going to a mesh.
+  struct FaceSpan {
+    std::uint32_t mesh = 0;
+    std::uint32_t chunk = 0;
+    std::uint32_t face_begin = 0;
+    std::uint32_t face_end = 0;
+  };
+
+  ObjMeshGrouping(std::string_view directory, std::vector<ObjMaterial>* materials) noexcept
+      : directory_(directory), materials_(materials) {}
+
+  void AddFaces(std::uint32_t chunk, std::uint32_t face_begin, std::uint32_t face_end) {
+    if (face_begin == face_end) {
+      return;
+    }
+    if (current_object_ == kNoObject) {
+      CreateObject("defaultobject");
+    }
+    if (current_mesh_ == kNoMesh) {
+      CreateMesh();
+    }
+    meshes_[current_mesh_].face_count += face_end - face_begin;
+    spans_.push_back(FaceSpan{current_mesh_, chunk, face_begin, face_end});
+  }
+
+  void Apply(const ObjStatement& statement) {
+    switch (statement.type) {
+      case ObjStatementType::kObject: {
+        // An object named again gets the next faces, in the current mesh.
+        const auto object = std::find_if(
+            objects_.begin(), objects_.end(),
+            [&statement](const Object& other) { return other.name == statement.name; });
+        if (object != objects_.end()) {
+          current_object_ = static_cast<std::uint32_t>(object - objects_.begin());
+        }
+        else {
+          CreateObject(statement.name);
+        }
+        break;
+      }
+      case ObjStatementType::kGroup:
+        // The groups are imported as objects.
+        if (statement.name != active_group_) {
+          CreateObject(statement.name);
+          active_group_ = statement.name;
+        }
+        break;
+      case ObjStatementType::kUseMaterial:
+        UseMaterial(statement.name);
+        break;
+      case ObjStatementType::kMaterialLibrary:
+        ParseMtlFile(directory_ + '/' + std::string(statement.name), materials_);
+        break;
+    }
+  }
+
+  /*
+  * Returns the mesh of the scene of each mesh, kNoMesh for the ones without
+  * faces, which are dropped. The meshes are ordered by object.
+  */
+  [[nodiscard]] std::vector<std::uint32_t> SceneMeshes(
+      std::vector<ObjMesh>* scene_meshes) const {
+    std::vector<std::uint32_t> scene_mesh_of(meshes_.size(), kNoMesh);
+    for (const auto& object : objects_) {
+      for (const auto mesh : object.meshes) {
+        if (meshes_[mesh].face_count == 0) {
+          continue;
+        }
+        scene_mesh_of[mesh] = static_cast<std::uint32_t>(scene_meshes->size());
+        scene_meshes->emplace_back();
+        scene_meshes->back().material = meshes_[mesh].material;
+      }
+    }
+    return scene_mesh_of;
+  }
+
+  [[nodiscard]] const std::vector<FaceSpan>& spans() const noexcept { return spans_; }
+
+ private:
+  static constexpr std::uint32_t kNoObject = ~0u;
+
+  struct Object {
+    std::string_view name{};
+    std::vector<std::uint32_t> meshes{};
+  };
+
+  struct GroupedMesh {
+    std::uint32_t material = ObjMesh::kNoMaterial;
+    std::size_t face_count = 0;
+  };
+
+  std::string directory_;
+  std::vector<ObjMaterial>* materials_ = nullptr;
+  std::vector<Object> objects_{};
+  std::vector<GroupedMesh> meshes_{};
+  std::vector<FaceSpan> spans_{};
+  std::uint32_t current_object_ = kNoObject;
+  std::uint32_t current_mesh_ = kNoMesh;
+  std::uint32_t current_material_ = ObjMesh::kNoMaterial;
+  std::string_view active_group_{};
+
+  void CreateObject(std::string_view name) {
+    current_object_ = static_cast<std::uint32_t>(objects_.size());
+    objects_.push_back(Object{name, {}});
+    CreateMesh();
+    meshes_[current_mesh_].material = current_material_;
+  }
+
+  void CreateMesh() {
+    current_mesh_ = static_cast<std::uint32_t>(meshes_.size());
+    meshes_.emplace_back();
+    // Like Assimp, a mesh created before any object is not part of the scene.
+    if (current_object_ != kNoObject) {
+      objects_[current_object_].meshes.push_back(current_mesh_);
+    }
+  }
+
+  void UseMaterial(std::string_view name) {
+    if (current_material_ != ObjMesh::kNoMaterial &&
+        (*materials_)[current_material_].name == name) {
+      return;
+    }
+
+    const auto material = std::find_if(
+        materials_->begin(), materials_->end(),
+        [name](const ObjMaterial& other) { return other.name == name; });
+    if (material != materials_->end()) {
+      current_material_ = static_cast<std::uint32_t>(material - materials_->begin());
+    }
+    else {
+      // A material missing from the libraries has no texture.
+      current_material_ = static_cast<std::uint32_t>(materials_->size());
+      materials_->push_back(ObjMaterial{std::string(name), {}, {}, {}});
+    }
+
+    if (current_mesh_ == kNoMesh ||
+        (meshes_[current_mesh_].material != ObjMesh::kNoMaterial &&
+         meshes_[current_mesh_].material != current_material_ &&
+         meshes_[current_mesh_].face_count > 0)) {
+      CreateMesh();
+    }
+    meshes_[current_mesh_].material = current_material_;
+  }
+};
+
+/*
+* The first corner of the fan of a quad in aiProcess_Triangulate, the concave
+* corner if there is one.
+*/
+std::uint32_t QuadFanStart(const glm::vec3 (&positions)[4]) noexcept {
+  for (std::uint32_t i = 0; i < 4; i++) {
+    const glm::vec3& position = positions[i];
+    const glm::vec3 left = glm::normalize(positions[(i + 3) % 4] - position);
+    const glm::vec3 diagonal = glm::normalize(positions[(i + 2) % 4] - position);
+    const glm::vec3 right = glm::normalize(positions[(i + 1) % 4] - position);
+    const float angle = std::acos(glm::dot(left, diagonal)) +
+                        std::acos(glm::dot(right, diagonal));
+    if (angle > kPi) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+glm::vec3 NormalizeOrZero(const glm::vec3& vector) noexcept {
+  const float length = glm::length(vector);
+  return length > std::numeric_limits<float>::min() ? vector / length : glm::vec3(0.f);
+}
+
+/*
+* The tangent of the triangle projected on the normal of each corner and weighted
+* by the angle of the corner, see the EvalTspace of MikkTSpace.
+* Returns the orientation of the uvs of the triangle, 1 or -1, 0 if they are
+* degenerate, in which case the tangents are null.
+*/
+std::int8_t CalculateCornerTangents(const Vertex* const (&corners)[3],
+                                    glm::vec3* tangents) noexcept {
+  const glm::vec3 edge1 = corners[1]->position - corners[0]->position;
+  const glm::vec3 edge2 = corners[2]->position - corners[0]->position;
+  const glm::vec2 uv_edge1 = corners[1]->uv - corners[0]->uv;
+  const glm::vec2 uv_edge2 = corners[2]->uv - corners[0]->uv;
+
+  const float signed_uv_area = uv_edge1.x * uv_edge2.y - uv_edge1.y * uv_edge2.x;
+  const glm::vec3 direction = uv_edge2.y * edge1 - uv_edge1.y * edge2;
+  const float direction_length = glm::length(direction);
+  if (std::abs(signed_uv_area) <= std::numeric_limits<float>::min() ||
+      direction_length <= std::numeric_limits<float>::min()) {
+    tangents[0] = tangents[1] = tangents[2] = glm::vec3(0.f);
+    return 0;
+  }
+
+  const std::int8_t orientation = signed_uv_area > 0.f ? 1 : -1;
+  const glm::vec3 tangent = direction * (static_cast<float>(orientation) / direction_length);
+
+  for (std::size_t k = 0; k < 3; k++) {
+    const glm::vec3 normal = NormalizeOrZero(corners[k]->normal);
+    const auto project = [&normal](const glm::vec3& vector) noexcept {
+      return NormalizeOrZero(vector - normal * glm::dot(normal, vector));
+    };
+
+    const glm::vec3& position = corners[k]->position;
+    const glm::vec3 previous_edge = project(corners[(k + 2) % 3]->position - position);
+    const glm::vec3 next_edge = project(corners[(k + 1) % 3]->position - position);
+    const float angle = std::acos(std::clamp(glm::dot(previous_edge, next_edge), -1.f, 1.f));
+    tangents[k] = project(tangent) * angle;
+  }
+
+  return orientation;
+}
+
+void WriteTangentFrame(const glm::vec3& tangent_sum, std::int8_t orientation,
+                       Vertex* vertex) noexcept {
+  const glm::vec3 normal = NormalizeOrZero(vertex->normal);
+  glm::vec3 tangent = NormalizeOrZero(tangent_sum);
+  if (tangent == glm::vec3(0.f)) {
+    // No triangle gives a direction, any one perpendicular to the normal.
+    const glm::vec3 axis = std::abs(normal.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f)
+                                                     : glm::vec3(0.f, 1.f, 0.f);
+    tangent = NormalizeOrZero(glm::cross(normal, axis));
+    if (tangent == glm::vec3(0.f)) {
+      tangent = glm::vec3(1.f, 0.f, 0.f);
+    }
+    orientation = 1;
+  }
+
+  vertex->tangent = tangent;
+  vertex->bitangent = glm::cross(normal, tangent) * static_cast<float>(orientation);
+}
+
+/*
+* Generates the tangents of the meshes like MikkTSpace. The corners of the
+* triangles are sorted by position, then the corners of each position are
+* grouped by mesh, uv, normal and orientation and summed, one job per range of
+* positions.
+* @param vertex_corners The indices in the file of the attributes of each vertex
+* of each mesh.
+*/
+void GenerateTangents(std::size_t position_count,
+                      const std::vector<std::vector<ObjCorner>>& vertex_corners,
+                      std::vector<ObjMesh>* meshes) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  std::vector<std::size_t> triangle_offsets(meshes->size() + 1, 0);
+  for (std::size_t m = 0; m < meshes->size(); m++) {
+    triangle_offsets[m + 1] = triangle_offsets[m] + (*meshes)[m].indices.size() / 3;
+  }
+  const std::size_t triangle_count = triangle_offsets.back();
+
+  std::vector<glm::vec3> corner_tangents(triangle_count * 3);
+  std::vector<std::int8_t> orientations(triangle_count);
+  std::vector<std::uint32_t> triangle_meshes(triangle_count);
+  ParallelFor(triangle_count, kTrianglesPerJob, [&](std::size_t begin, std::size_t end) {
+    auto m = static_cast<std::size_t>(
+        std::upper_bound(triangle_offsets.begin(), triangle_offsets.end(), begin) -
+        triangle_offsets.begin() - 1);
+    for (std::size_t t = begin; t < end; t++) {
+      while (t >= triangle_offsets[m + 1]) {
+        m++;
+      }
+      const auto& mesh = (*meshes)[m];
+      const std::size_t first_index = (t - triangle_offsets[m]) * 3;
+      const Vertex* const corners[3] = {&mesh.vertices[mesh.indices[first_index]],
+                                        &mesh.vertices[mesh.indices[first_index + 1]],
+                                        &mesh.vertices[mesh.indices[first_index + 2]]};
+      triangle_meshes[t] = static_cast<std::uint32_t>(m);
+      orientations[t] = CalculateCornerTangents(corners, &corner_tangents[t * 3]);
+    }
+  });
+
+  const auto vertex_of = [&](std::size_t corner) noexcept {
+    const std::size_t t = corner / 3;
+    const auto& mesh = (*meshes)[triangle_meshes[t]];
+    return mesh.indices[(t - triangle_offsets[triangle_meshes[t]]) * 3 + corner % 3];
+  };
+  const auto key_of = [&](std::size_t corner) noexcept -> const ObjCorner& {
+    return vertex_corners[triangle_meshes[corner / 3]][vertex_of(corner)];
+  };
+
+  // Counting sort of the corners by position, in their order.
+  std::vector<std::uint32_t> position_offsets(position_count + 1, 0);
+  for (std::size_t corner = 0; corner < triangle_count * 3; corner++) {
+    position_offsets[key_of(corner).position + 1]++;
+  }
+  for (std::size_t p = 0; p < position_count; p++) {
+    position_offsets[p + 1] += position_offsets[p];
+  }
+  std::vector<std::uint32_t> position_corners(triangle_count * 3);
+  std::vector<std::uint32_t> position_ends(position_offsets.begin(),
+                                           position_offsets.end() - 1);
+  for (std::size_t corner = 0; corner < triangle_count * 3; corner++) {
+    position_corners[position_ends[key_of(corner).position]++] =
+        static_cast<std::uint32_t>(corner);
+  }
+
+  struct TangentGroup {
+    std::uint32_t mesh;
+    std::int32_t uv;
+    std::int32_t normal;
+    std::int8_t orientation;
+    glm::vec3 sum;
+  };
+
+  // The vertices of a position are only written by the job of the position.
+  ParallelFor(position_count, kPositionsPerJob, [&](std::size_t begin, std::size_t end) {
+    std::vector<TangentGroup> groups;
+    const auto find_group = [&groups](std::uint32_t mesh, const ObjCorner& key,
+                                      std::int8_t orientation) noexcept -> TangentGroup* {
+      for (auto& group : groups) {
+        if (group.mesh == mesh && group.uv == key.uv && group.normal == key.normal &&
+            group.orientation == orientation) {
+          return &group;
+        }
+      }
+      return nullptr;
+    };
+
+    for (std::size_t p = begin; p < end; p++) {
+      groups.clear();
+      const std::uint32_t* first = position_corners.data() + position_offsets[p];
+      const std::uint32_t* last = position_corners.data() + position_offsets[p + 1];
+
+      for (const auto* corner = first; corner < last; corner++) {
+        const auto orientation = orientations[*corner / 3];
+        if (orientation == 0) {
+          continue;
+        }
+        const auto mesh = triangle_meshes[*corner / 3];
+        const auto& key = key_of(*corner);
+        auto* group = find_group(mesh, key, orientation);
+        if (group == nullptr) {
+          groups.push_back(TangentGroup{mesh, key.uv, key.normal, orientation, glm::vec3(0.f)});
+          group = &groups.back();
+        }
+        group->sum += corner_tangents[*corner];
+      }
+
+      // A vertex takes the frame of its first triangle with valid uvs, the ones
+      // of the degenerate triangles join a group of any orientation.
+      for (const bool is_degenerate : {false, true}) {
+        for (const auto* corner = first; corner < last; corner++) {
+          const auto orientation = orientations[*corner / 3];
+          if ((orientation == 0) != is_degenerate) {
+            continue;
+          }
+          const auto mesh = triangle_meshes[*corner / 3];
+          auto& vertex = (*meshes)[mesh].vertices[vertex_of(*corner)];
+          if (vertex.tangent != glm::vec3(0.f)) {
+            continue;
+          }
+
+          const auto& key = key_of(*corner);
+          const TangentGroup* group = nullptr;
+          if (is_degenerate) {
+            group = find_group(mesh, key, 1);
+            if (group == nullptr) {
+              group = find_group(mesh, key, -1);
+            }
+          }
+          else {
+            group = find_group(mesh, key, orientation);
+          }
+          WriteTangentFrame(group != nullptr ? group->sum : glm::vec3(0.f),
+                            group != nullptr ? group->orientation : 1, &vertex);
+        }
+      }
+    }
+  });
+}
+
+}  // namespace
+
+bool IsObjFilePath(std::string_view path) noexcept {
+  constexpr std::string_view kExtension = ".obj";
+  if (path.size() < kExtension.size()) {
+    return false;
+  }
+  const auto extension = path.substr(path.size() - kExtension.size());
+  return std::equal(extension.begin(), extension.end(), kExtension.begin(),
+                    [](char a, char b) {
+                      return std::tolower(static_cast<unsigned char>(a)) == b;
+                    });
+}
+
+bool ParseObjFile(std::string_view path, bool flip_uvs, ObjScene* scene) {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  *scene = ObjScene{};
+
+  MappedFile file;
+  if (!file.Open(path)) {
+    std::cerr << "Failed to open the OBJ file " << path << '\n';
+    return false;
+  }
+
+  // The chunks of lines are parsed in parallel, their attributes and corners
+  // are then merged in the order of the file.
+  const auto* data = reinterpret_cast<const char*>(file.data());
+  const auto boundaries = SplitInChunks(data, file.size());
+  const std::size_t chunk_count = boundaries.size() - 1;
+  std::vector<ObjChunk> chunks(chunk_count);
+  ParallelFor(chunk_count, 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t c = begin; c < end; c++) {
+      ParseChunk(boundaries[c], boundaries[c + 1], &chunks[c]);
+    }
+  });
+
+  for (const auto& chunk : chunks) {
+    if (!chunk.invalid_line.empty()) {
+      std::cerr << "Invalid OBJ statement in " << path << ": " << chunk.invalid_line << '\n';
+      return false;
+    }
+  }
+
+  // The attributes of the previous chunks.
+  struct ChunkBase {
+    std::size_t position = 0;
+    std::size_t uv = 0;
+    std::size_t normal = 0;
+  };
+  std::vector<ChunkBase> bases(chunk_count + 1);
+  for (std::size_t c = 0; c < chunk_count; c++) {
+    bases[c + 1].position = bases[c].position + chunks[c].positions.size();
+    bases[c + 1].uv = bases[c].uv + chunks[c].uvs.size();
+    bases[c + 1].normal = bases[c].normal + chunks[c].normals.size();
+  }
+
+  std::vector<glm::vec3> positions(bases.back().position);
+  std::vector<glm::vec2> uvs(bases.back().uv);
+  std::vector<glm::vec3> normals(bases.back().normal);
+  ParallelFor(chunk_count, 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t c = begin; c < end; c++) {
+      auto& chunk = chunks[c];
+      std::copy(chunk.positions.begin(), chunk.positions.end(),
+                positions.begin() + static_cast<std::ptrdiff_t>(bases[c].position));
+      std::copy(chunk.uvs.begin(), chunk.uvs.end(),
+                uvs.begin() + static_cast<std::ptrdiff_t>(bases[c].uv));
+      std::copy(chunk.normals.begin(), chunk.normals.end(),
+                normals.begin() + static_cast<std::ptrdiff_t>(bases[c].normal));
+
+      for (const auto& relative_corner : chunk.relative_corners) {
+        auto& corner = chunk.corners[relative_corner.corner];
+        if (relative_corner.attributes & RelativeCorner::kPosition) {
+          corner.position += static_cast<std::int32_t>(bases[c].position);
+        }
+        if (relative_corner.attributes & RelativeCorner::kUv) {
+          corner.uv += static_cast<std::int32_t>(bases[c].uv);
+        }
+        if (relative_corner.attributes & RelativeCorner::kNormal) {
+          corner.normal += static_cast<std::int32_t>(bases[c].normal);
+        }
+      }
+    }
+  });
+
+  // The faces between the statements go to the current mesh.
+  const auto last_slash = path.find_last_of('/');
+  const std::string_view directory =
+      last_slash != std::string_view::npos ? path.substr(0, last_slash) : ".";
+  ObjMeshGrouping grouping(directory, &scene->materials);
+  for (std::uint32_t c = 0; c < chunk_count; c++) {
+    std::uint32_t face = 0;
+    for (const auto& statement : chunks[c].statements) {
+      grouping.AddFaces(c, face, statement.face_count);
+      face = statement.face_count;
+      grouping.Apply(statement);
+    }
+    grouping.AddFaces(c, face, chunks[c].face_count());
+  }
+  const auto scene_mesh_of = grouping.SceneMeshes(&scene->meshes);
+
+  // Each face is written at the end of the previous faces of its mesh, in ranges
+  // of faces processed in parallel.
+  struct FaceRange {
+    std::uint32_t mesh;
+    const ObjChunk* chunk;
+    std::uint32_t face_begin;
+    std::uint32_t face_end;
+    std::size_t first_vertex;
+    std::size_t first_index;
+  };
+  std::vector<FaceRange> face_ranges;
+  std::vector<std::size_t> vertex_counts(scene->meshes.size(), 0);
+  std::vector<std::size_t> index_counts(scene->meshes.size(), 0);
+  for (const auto& span : grouping.spans()) {
+    const auto mesh = scene_mesh_of[span.mesh];
+    if (mesh == kNoMesh) {
+      continue;
+    }
+    const auto& chunk = chunks[span.chunk];
+    for (std::uint32_t face = span.face_begin; face < span.face_end;
+         face += static_cast<std::uint32_t>(kFacesPerJob)) {
+      const std::uint32_t face_end = std::min(
+          span.face_end, face + static_cast<std::uint32_t>(kFacesPerJob));
+      face_ranges.push_back(FaceRange{mesh, &chunk, face, face_end, vertex_counts[mesh],
+                                      index_counts[mesh]});
+      const std::size_t corner_count =
+          chunk.face_offsets[face_end] - chunk.face_offsets[face];
+      vertex_counts[mesh] += corner_count;
+      index_counts[mesh] += (corner_count - 2 * (face_end - face)) * 3;
+    }
+  }
+
+  std::vector<std::vector<ObjCorner>> vertex_corners(scene->meshes.size());
+  for (std::size_t m = 0; m < scene->meshes.size(); m++) {
+    scene->meshes[m].vertices.resize(vertex_counts[m]);
+    scene->meshes[m].indices.resize(index_counts[m]);
+    vertex_corners[m].resize(vertex_counts[m]);
+  }
+
+  // Like Assimp, the corners without uv get a null one when the file has uvs,
+  // which is then flipped.
+  const glm::vec2 missing_uv = !uvs.empty() && flip_uvs ? glm::vec2(0.f, 1.f)
+                                                         : glm::vec2(0.f);
+  std::atomic<bool> has_invalid_index{false};
+  ParallelFor(face_ranges.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t r = begin; r < end; r++) {
+      const auto& range = face_ranges[r];
+      auto& mesh = scene->meshes[range.mesh];
+      auto& corners = vertex_corners[range.mesh];
+      std::size_t vertex = range.first_vertex;
+      std::size_t index = range.first_index;
+
+      for (std::uint32_t face = range.face_begin; face < range.face_end; face++) {
+        const std::uint32_t first_corner = range.chunk->face_offsets[face];
+        const std::uint32_t corner_count = range.chunk->face_offsets[face + 1] - first_corner;
+
+        for (std::uint32_t k = 0; k < corner_count; k++) {
+          const auto& corner = range.chunk->corners[first_corner + k];
+          const auto is_valid = [](std::int32_t attribute, std::size_t count) noexcept {
+            return attribute >= 0 && static_cast<std::size_t>(attribute) < count;
+          };
+          if (!is_valid(corner.position, positions.size()) ||
+              (corner.uv != kMissingIndex && !is_valid(corner.uv, uvs.size())) ||
+              (corner.normal != kMissingIndex && !is_valid(corner.normal, normals.size()))) {
+            has_invalid_index = true;
+            return;
+          }
+
+          Vertex& face_vertex = mesh.vertices[vertex + k];
+          face_vertex.position = positions[corner.position];
+          face_vertex.normal = corner.normal != kMissingIndex ? normals[corner.normal]
+                                                              : glm::vec3(0.f);
+          if (corner.uv != kMissingIndex) {
+            face_vertex.uv = uvs[corner.uv];
+            if (flip_uvs) {
+              face_vertex.uv.y = 1.f - face_vertex.uv.y;
+            }
+          }
+          else {
+            face_vertex.uv = missing_uv;
+          }
+          face_vertex.tangent = glm::vec3(0.f);
+          face_vertex.bitangent = glm::vec3(0.f);
+          corners[vertex + k] = corner;
+        }
+
+        // The quads are split like aiProcess_Triangulate, the other polygons
+        // are fanned from their first corner.
+        std::uint32_t fan_start = 0;
+        if (corner_count == 4) {
+          const glm::vec3 quad[4] = {
+              mesh.vertices[vertex].position, mesh.vertices[vertex + 1].position,
+              mesh.vertices[vertex + 2].position, mesh.vertices[vertex + 3].position};
+          fan_start = QuadFanStart(quad);
+        }
+        for (std::uint32_t k = 1; k + 1 < corner_count; k++) {
+          mesh.indices[index++] = static_cast<GLuint>(vertex + fan_start);
+          mesh.indices[index++] =
+              static_cast<GLuint>(vertex + (fan_start + k) % corner_count);
+          mesh.indices[index++] =
+              static_cast<GLuint>(vertex + (fan_start + k + 1) % corner_count);
+        }
+
+        vertex += corner_count;
+      }
+    }
+  });
+
+  if (has_invalid_index) {
+    std::cerr << "Invalid OBJ face index in " << path << '\n';
+    *scene = ObjScene{};
+    return false;
+  }
+
+  GenerateTangents(positions.size(), vertex_corners, &scene->meshes);
+  return true;
+}
@@ -156,4 +156,14 @@ void Pipeline::SetMatrix4(std::string_view name,
                           const glm::mat4& mat) const noexcept {
   glUniformMatrix4fv(glGetUniformLocation(program_, name.data()), 1, GL_FALSE,
                      glm::value_ptr(mat));
-};
\ No newline at end of file
+};
+
+void Pipeline::SetUniformBlockBinding(std::string_view block_name,
+                                      GLuint binding_point) const noexcept {
+  const GLuint block_idx = glGetUniformBlockIndex(program_, block_name.data());
+  if (block_idx == GL_INVALID_INDEX) {
+    std::cerr << "Uniform block " << block_name << " not found.\n";
+    return;
+  }
+  glUniformBlockBinding(program_, block_idx, binding_point);
+}
@@ -0,0 +1,133 @@
+#include "pixel_buffer_ring.h"
+#include "gpu_memory.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <iostream>
+
+void PixelBufferRing::Create(std::size_t capacity) noexcept {
+  constexpr GLbitfield kMapFlags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr,
+                  kMapFlags);
+  mapped_data_ = static_cast<unsigned char*>(glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(capacity), kMapFlags));
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (mapped_data_ == nullptr) {
+    std::cerr << "Could not map the pixel buffer ring.\n";
+    glDeleteBuffers(1, &buffer_);
+    buffer_ = 0;
+    return;
+  }
+
+  GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, buffer_,
+                                 GpuMemoryCategory::kBuffer, capacity);
+
+  capacity_ = capacity;
+  head_ = 0;
+  tail_ = 0;
+  used_size_ = 0;
+}
+
+void PixelBufferRing::Destroy() noexcept {
+  while (!fenced_regions_.empty()) {
+    glDeleteSync(fenced_regions_.front().fence);
+    fenced_regions_.pop();
+  }
+
+  if (buffer_ != 0) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, buffer_);
+    glDeleteBuffers(1, &buffer_);
+  }
+
+  buffer_ = 0;
+  mapped_data_ = nullptr;
+  capacity_ = 0;
+  head_ = 0;
+  tail_ = 0;
+  used_size_ = 0;
+}
+
+bool PixelBufferRing::Allocate(std::size_t size, Allocation* allocation) noexcept {
+  size = (size + kAlignment - 1) & ~(kAlignment - 1);
+
+  std::lock_guard lock(mutex_);
+
+  if (mapped_data_ == nullptr || size > capacity_) {
+    return false;
+  }
+
+  if (used_size_ == 0) {
+    head_ = 0;
+    tail_ = 0;
+  }
+  else if (head_ == tail_) {
+    // The ring is full.
+    return false;
+  }
+
+  std::size_t offset = head_;
+  std::size_t consumed_size = size;
+
+  if (head_ >= tail_) {
+    if (capacity_ - head_ < size) {
+      // Wrap to the beginning of the ring, the end of the ring is skipped.
+      if (tail_ < size) {
+        return false;
+      }
+      offset = 0;
+      consumed_size = capacity_ - head_ + size;
+    }
+  }
+  else if (tail_ - head_ < size) {
+    return false;
+  }
+
+  head_ = (offset + size) % capacity_;
+  used_size_ += consumed_size;
+
+  allocation->offset = offset;
+  allocation->consumed_size = consumed_size;
+  allocation->data = mapped_data_ + offset;
+  return true;
+}
+
+void PixelBufferRing::Fence(const Allocation& allocation) noexcept {
+  fenced_regions_.push(FencedRegion{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
+                                    allocation.consumed_size});
+}
+
+void PixelBufferRing::Reclaim() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  while (!fenced_regions_.empty()) {
+    const auto& region = fenced_regions_.front();
+    const GLenum status = glClientWaitSync(region.fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      break;
+    }
+
+    glDeleteSync(region.fence);
+    Release(region.consumed_size);
+    fenced_regions_.pop();
+  }
+}
+
+void PixelBufferRing::Release(std::size_t consumed_size) noexcept {
+  std::lock_guard lock(mutex_);
+  tail_ = (tail_ + consumed_size) % capacity_;
+  used_size_ -= consumed_size;
+}
@@ -1,16 +1,83 @@
 #include "renderer.h"
 
-void Renderer::DrawMesh(const Mesh& mesh, GLenum mode) const noexcept {
-  glBindVertexArray(mesh.vao().id());
-  glDrawElements(mode, mesh.elementCount(), GL_UNSIGNED_INT, 0);
+namespace {
+
+std::size_t IndexSize(GLenum index_type) noexcept {
+  return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+}  // namespace
+
+void Renderer::DrawMesh(const Mesh& mesh, GLenum mode, std::uint32_t lod) const noexcept {
+  // The meshes of an arena are drawn from its buffers with their base vertex,
+  // which is 0 for the meshes with their own buffers.
+  std::uintptr_t offset = mesh.index_byte_offset();
+  GLsizei index_count = mesh.elementCount();
+  if (lod < mesh.lod_count()) {
+    const auto& mesh_lod = mesh.lods()[lod];
+    index_count = mesh_lod.index_count;
+    offset += static_cast<std::uintptr_t>(mesh_lod.first_index) *
+              IndexSize(mesh.index_type());
+  }
+
+  glBindVertexArray(mesh.vao_id());
+  glDrawElementsBaseVertex(mode, index_count, mesh.index_type(),
+                           reinterpret_cast<const void*>(offset), mesh.base_vertex());
   glBindVertexArray(0);
 }
 
 void Renderer::DrawInstancedMesh(const Mesh& mesh, GLuint instance_count, 
-                                 GLenum mode) const noexcept {
-  glBindVertexArray(mesh.vao().id());
-  glDrawElementsInstanced(mode, mesh.elementCount(), GL_UNSIGNED_INT, 0,
-                          instance_count);
+                                 GLenum mode, std::uint32_t lod,
+                                 GLuint base_instance) const noexcept {
+  GLsizei index_count = mesh.elementCount();
+  std::uintptr_t offset = mesh.index_byte_offset();
+  if (lod < mesh.lod_count()) {
+    const auto& mesh_lod = mesh.lods()[lod];
+    index_count = mesh_lod.index_count;
+    offset += static_cast<std::uintptr_t>(mesh_lod.first_index) *
+              IndexSize(mesh.index_type());
+  }
+
+  glBindVertexArray(mesh.vao_id());
+  glDrawElementsInstancedBaseVertexBaseInstance(mode, index_count, mesh.index_type(),
+                                                reinterpret_cast<const void*>(offset),
+                                                instance_count, mesh.base_vertex(),
+                                                base_instance);
+  glBindVertexArray(0);
+}
+
+void Renderer::DrawIndirect(const GeometryArena& arena, const GeometryDrawList& draw_list,
+                            GLenum mode) const noexcept {
+  const GLsizei short_command_count = draw_list.short_command_count();
+  const GLsizei int_command_count = draw_list.int_command_count();
+  if (short_command_count + int_command_count == 0) {
+    return;
+  }
+
+  const GLuint vao = arena.vao();
+  glBindVertexArray(vao);
+  glVertexArrayVertexBuffer(vao, GeometryArena::kDrawDataBinding,
+                            draw_list.draw_data_buffer(), 0, sizeof(glm::mat4));
+  for (GLuint column = 0; column < 4; column++) {
+    glEnableVertexArrayAttrib(vao, GeometryArena::kDrawMatrixLocation + column);
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_list.command_buffer());
+
+  if (short_command_count > 0) {
+    glMultiDrawElementsIndirect(mode, GL_UNSIGNED_SHORT, nullptr, short_command_count, 0);
+  }
+  if (int_command_count > 0) {
+    const auto int_commands_offset = static_cast<std::uintptr_t>(short_command_count) *
+                                     sizeof(DrawElementsIndirectCommand);
+    glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT,
+                                reinterpret_cast<const void*>(int_commands_offset),
+                                int_command_count, 0);
+  }
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  for (GLuint column = 0; column < 4; column++) {
+    glDisableVertexArrayAttrib(vao, GeometryArena::kDrawMatrixLocation + column);
+  }
   glBindVertexArray(0);
 }
 
@@ -21,6 +88,13 @@ void Renderer::DrawModel(const Model& model, GLenum mode) const noexcept {
   }
 }
 
+void Renderer::DrawModel(const Model& model, const glm::mat4& model_matrix,
+                         GLenum mode) const noexcept {
+  for (const auto& mesh : model.meshes()) {
+    DrawSelectedLod(mesh, model_matrix, mode);
+  }
+}
+
 void Renderer::DrawInstancedModel(const Model& model, GLuint instance_count,
                                   GLenum mode) const noexcept {
   for (const auto& mesh : model.meshes()) {
@@ -28,21 +102,44 @@ void Renderer::DrawInstancedModel(const Model& model, GLuint instance_count,
   }
 }
 
-void Renderer::DrawModelWithMaterials(const Model& model, 
-                                      const std::vector<GLuint>& textures, 
-                                      int mat_offset, GLenum mode) {
-  int offset = 0;
+void Renderer::DrawModelWithMaterials(const Model& model,
+                                      const glm::mat4& model_matrix,
+                                      MaterialSystem& material_system,
+                                      const Pipeline& pipeline,
+                                      std::size_t first_material,
+                                      std::size_t material_stride, GLenum mode) {
+  std::size_t material_idx = first_material;
   for (const auto& mesh : model.meshes()) {
-    for (int i = 0; i < 4; i++) {
-      if (i >= textures.size()) {
-        continue;
-      }
+    material_system.Bind(material_idx, pipeline);
+
+    DrawSelectedLod(mesh, model_matrix, mode);
+    material_idx += material_stride;
+  }
+}
 
-      glActiveTexture(GL_TEXTURE0 + i);
-      glBindTexture(GL_TEXTURE_2D, textures[i + offset]);
-    }
+std::uint32_t Renderer::SelectLod(const Mesh& mesh,
+                                  const glm::mat4& model_matrix) const noexcept {
+  return lod_selector_ != nullptr ? lod_selector_->Select(mesh, model_matrix) : 0;
+}
 
-    DrawMesh(mesh, mode);
-    offset += mat_offset;
+void Renderer::DrawSelectedLod(const Mesh& mesh, const glm::mat4& model_matrix,
+                               GLenum mode) const noexcept {
+  const auto lod = SelectLod(mesh, model_matrix);
+  if (lod != 0 || meshlet_culler_ == nullptr || !meshlet_culler_->is_enabled() ||
+      mesh.meshlets().empty()) {
+    DrawMesh(mesh, mode, lod);
+    return;
   }
+
+  const auto range_count = meshlet_culler_->Cull(mesh, model_matrix);
+  if (range_count == 0) {
+    return;
+  }
+
+  glBindVertexArray(mesh.vao_id());
+  glMultiDrawElementsBaseVertex(mode, meshlet_culler_->counts().data(), mesh.index_type(),
+                                meshlet_culler_->offsets().data(),
+                                static_cast<GLsizei>(range_count),
+                                meshlet_culler_->base_vertices().data());
+  glBindVertexArray(0);
 }
@@ -0,0 +1,134 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+bool IsMipmapFilter(GLint filter) noexcept {
+  return filter == GL_NEAREST_MIPMAP_NEAREST || filter == GL_LINEAR_MIPMAP_NEAREST ||
+         filter == GL_NEAREST_MIPMAP_LINEAR || filter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+}  // namespace
+
+bool SamplerParameters::operator==(const SamplerParameters& other) const noexcept {
+  return min_filter == other.min_filter && mag_filter == other.mag_filter &&
+         wrapping_param == other.wrapping_param &&
+         max_anisotropy == other.max_anisotropy;
+}
+
+std::size_t SamplerParametersHash::operator()(
+    const SamplerParameters& parameters) const noexcept {
+  std::uint32_t anisotropy_bits;
+  std::memcpy(&anisotropy_bits, &parameters.max_anisotropy, sizeof(float));
+
+  // The GL enums fit in 16 bits.
+  std::uint64_t hash = (static_cast<std::uint64_t>(parameters.min_filter & 0xFFFF) << 48) |
+                       (static_cast<std::uint64_t>(parameters.mag_filter & 0xFFFF) << 32) |
+                       (static_cast<std::uint64_t>(parameters.wrapping_param & 0xFFFF) << 16);
+  hash ^= anisotropy_bits;
+  hash *= 0x9E3779B97F4A7C15ull;
+  return static_cast<std::size_t>(hash ^ (hash >> 32));
+}
+
+SamplerParameters MakeSamplerParameters(GLint wrapping_param, GLint filtering_param,
+                                        bool has_mips, float max_anisotropy) noexcept {
+  SamplerParameters parameters;
+  parameters.wrapping_param = wrapping_param;
+
+  const bool is_linear = filtering_param == GL_LINEAR ||
+                         filtering_param == GL_LINEAR_MIPMAP_LINEAR ||
+                         filtering_param == GL_LINEAR_MIPMAP_NEAREST;
+  parameters.mag_filter = is_linear ? GL_LINEAR : GL_NEAREST;
+
+  if (!has_mips) {
+    parameters.min_filter = parameters.mag_filter;
+  }
+  else if (IsMipmapFilter(filtering_param)) {
+    parameters.min_filter = filtering_param;
+  }
+  else {
+    parameters.min_filter = is_linear ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_NEAREST;
+  }
+
+  if (has_mips && is_linear) {
+    parameters.max_anisotropy = std::max(max_anisotropy, 1.f);
+  }
+
+  return parameters;
+}
+
+float SnapAnisotropy(float max_anisotropy) noexcept {
+  if (!(max_anisotropy > 1.f)) {
+    return 1.f;
+  }
+  return std::exp2(std::floor(std::log2(std::min(max_anisotropy, 16.f))));
+}
+
+GLuint SamplerCache::Acquire(SamplerParameters parameters) noexcept {
+  std::lock_guard lock(mutex_);
+
+  if (max_supported_anisotropy_ == 0.f) {
+    max_supported_anisotropy_ = QueryMaxAnisotropy();
+  }
+  parameters.max_anisotropy = SnapAnisotropy(
+      std::clamp(parameters.max_anisotropy, 1.f, max_supported_anisotropy_));
+
+  if (const auto* sampler = samplers_.Find(parameters)) {
+    return *sampler;
+  }
+
+  GLuint sampler = 0;
+  glGenSamplers(1, &sampler);
+  glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, parameters.min_filter);
+  glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, parameters.mag_filter);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, parameters.wrapping_param);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, parameters.wrapping_param);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, parameters.wrapping_param);
+  if (parameters.max_anisotropy > 1.f) {
+    glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, parameters.max_anisotropy);
+  }
+
+  samplers_.Insert(parameters, sampler);
+  sampler_ids_.push_back(sampler);
+  return sampler;
+}
+
+void SamplerCache::Clear() noexcept {
+  std::lock_guard lock(mutex_);
+
+  glDeleteSamplers(static_cast<GLsizei>(sampler_ids_.size()), sampler_ids_.data());
+  sampler_ids_.clear();
+  samplers_ = {};
+}
+
+std::size_t SamplerCache::sampler_count() const noexcept {
+  std::lock_guard lock(mutex_);
+  return sampler_ids_.size();
+}
+
+float SamplerCache::max_supported_anisotropy() noexcept {
+  std::lock_guard lock(mutex_);
+  if (max_supported_anisotropy_ == 0.f) {
+    max_supported_anisotropy_ = QueryMaxAnisotropy();
+  }
+  return max_supported_anisotropy_;
+}
+
+float SamplerCache::QueryMaxAnisotropy() noexcept {
+  if (!GLEW_EXT_texture_filter_anisotropic && !GLEW_ARB_texture_filter_anisotropic) {
+    return 1.f;
+  }
+
+  GLfloat max_anisotropy = 1.f;
+  glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+  return std::max(max_anisotropy, 1.f);
+}
+
+SamplerCache& GetSamplerCache() noexcept {
+  static SamplerCache cache;
+  return cache;
+}
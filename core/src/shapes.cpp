@@ -1,6 +1,7 @@
 #include "shapes.h"
 
 #include <algorithm>
+#include <cmath>
 
 float Plane::CalculatePointDistanceToPlane(const glm::vec3& point) const {
   return glm::dot(normal_, point) - distance_;
@@ -34,6 +35,28 @@ bool BoundingSphere::IsOnFrustum(const Frustum& cam_frustum,
           global_sphere.IsOnOrForwardPlane(cam_frustum.bottom_face));
 }
 
+float BoundingSphere::CalculateScreenSize(const glm::mat4& model,
+                                          const glm::vec3& view_position,
+                                          float fov_y, float viewport_height) const {
+  const glm::vec3 global_scale(glm::length(model[0]), glm::length(model[1]),
+                               glm::length(model[2]));
+  const glm::vec3 global_center(model * glm::vec4(center_, 1.f));
+  const float global_radius = radius_ * std::max(std::max(global_scale.x, global_scale.y),
+                                                 global_scale.z);
+
+  const float distance = glm::length(global_center - view_position);
+
+  // The camera is inside the sphere, it covers the whole viewport.
+  if (distance <= global_radius) {
+    return viewport_height;
+  }
+
+  const float projected_radius =
+      global_radius / (std::sqrt(distance * distance - global_radius * global_radius) *
+                       std::tan(fov_y * 0.5f));
+  return std::min(projected_radius, 1.f) * viewport_height;
+}
+
 bool BoundingSphere::IsOnOrForwardPlane(const Plane& plane) const {
   const auto distance = plane.CalculatePointDistanceToPlane(center_);
   return distance > -(radius_);
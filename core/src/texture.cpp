@@ -1,4 +1,7 @@
 #include "texture.h"
+#include "block_compression.h"
+#include "gpu_memory.h"
+#include "mip_generator.h"
 
 #ifndef STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
@@ -11,27 +14,289 @@
 #include <Tracy.hpp>
 #endif  // TRACY_ENABLE
 
+// MSVC exposes the F16C instructions with /arch:AVX2.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#define TEXTURE_F16C
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TEXTURE_AVX2
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define TEXTURE_SSSE3
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <vector>
+
+namespace {
+
+bool IsMipmapFilter(GLint min_filter) noexcept {
+  return min_filter == GL_NEAREST_MIPMAP_NEAREST || min_filter == GL_LINEAR_MIPMAP_NEAREST ||
+         min_filter == GL_NEAREST_MIPMAP_LINEAR || min_filter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+// Replaces glGenerateMipmap: the mips are filtered on the CPU in linear space
+// (the driver box filters the sRGB values) and only built if the min filter
+// samples them. Returns the number of levels of the texture.
+template <typename T>
+GLsizei UploadMipChain(const T* pixels, int width, int height, int channels,
+                    GLint internal_format, GLenum format, GLenum type,
+                    GLint min_filter, bool srgb) noexcept {
+  if (pixels == nullptr || !IsMipmapFilter(min_filter)) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    return 1;
+  }
+
+  MipGenerationParameters mip_params;
+  mip_params.filter = MipFilter::kKaiser;
+  mip_params.srgb = srgb;
+  const auto mips = GenerateMipChain(pixels, width, height, channels, mip_params);
+
+  // Rows of the small mips of RGB textures are not 4 bytes aligned.
+  for (std::size_t i = 0; i < mips.size(); i++) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, CalculateUnpackAlignment(
+        static_cast<std::size_t>(mips[i].width) * channels * sizeof(T)));
+    glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i + 1), internal_format,
+                 mips[i].width, mips[i].height, 0, format, type, mips[i].pixels.data());
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(mips.size()));
+  return static_cast<GLsizei>(mips.size() + 1);
+}
+
+struct UploadFormat {
+  GLint internal_format = GL_RGBA8;
+  GLenum format = GL_RGBA;
+  GLenum type = GL_UNSIGNED_BYTE;
+};
+
+// Sized internal formats, the unsized ones let the driver choose the storage.
+// The BGRA texels are uploaded as packed integers, the fast path of the drivers.
+UploadFormat ChooseUploadFormat(int channels, bool srgb, bool bgra) noexcept {
+  switch (channels) {
+    case 1:
+      return {GL_R8, GL_RED};
+    case 2:
+      return {GL_RG8, GL_RG};
+    case 3:
+      return {srgb ? GL_SRGB8 : GL_RGB8, GL_RGB};
+    case 4:
+    default:
+      if (bgra) {
+        return {srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV};
+      }
+      return {srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, GL_RGBA};
+  }
+}
+
+constexpr std::array<GLint, 4> kHalfFloatFormats{GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F};
+
+// stb_image decodes the grey images to one channel, sampled as RRR1 like the
+// luminance textures they replace. The red channel is unchanged.
+void SetGreySwizzle(int channels) noexcept {
+  if (channels == 1) {
+    const GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+  }
+}
+
+// Uploads the level 0 of an 8 bits image and its mip chain in the bound texture.
+GLsizei UploadImage(const ImageBuffer& image, bool srgb, GLint min_filter,
+                    GLint* internal_format) noexcept {
+  const auto* pixels = std::get<unsigned char*>(image.data);
+  const auto upload_format = ChooseUploadFormat(image.channels, srgb, image.bgra);
+  *internal_format = upload_format.internal_format;
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, CalculateUnpackAlignment(
+      static_cast<std::size_t>(image.width) * image.channels));
+  glTexImage2D(GL_TEXTURE_2D, 0, upload_format.internal_format, image.width,
+               image.height, 0, upload_format.format, upload_format.type, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  SetGreySwizzle(image.channels);
+
+  return UploadMipChain(pixels, image.width, image.height, image.channels,
+                        upload_format.internal_format, upload_format.format,
+                        upload_format.type, min_filter, srgb);
+}
+
+std::uint32_t FloatBits(float value) noexcept {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(float));
+  return bits;
+}
+
+float BitsToFloat(std::uint32_t bits) noexcept {
+  float value;
+  std::memcpy(&value, &bits, sizeof(float));
+  return value;
+}
+
+// Largest finite half float.
+constexpr float kHalfMax = 65504.f;
+
+// Rounds to the nearest half float, the values above kHalfMax are clamped.
+// NaNs stay NaNs like with F16C: quiet, with their sign and the 10 high bits
+// of their payload.
+std::uint16_t FloatToHalf(float value) noexcept {
+  const std::uint32_t bits = FloatBits(std::min(std::max(value, -kHalfMax), kHalfMax));
+  const std::uint32_t sign = (bits >> 16) & 0x8000u;
+  const std::uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+  if (magnitude > 0x7F800000u) {
+    return static_cast<std::uint16_t>(sign | 0x7E00u | ((magnitude >> 13) & 0x3FFu));
+  }
+  if (magnitude < 0x38800000u) {
+    // Denormal half: the implicit bit is shifted in the mantissa, rounded to
+    // the nearest even. The values below the smallest denormal become 0.
+    if (magnitude < 0x33000000u) {
+      return static_cast<std::uint16_t>(sign);
+    }
+    const std::uint32_t exponent = magnitude >> 23;
+    const std::uint32_t mantissa = (magnitude & 0x7FFFFFu) | 0x800000u;
+    const std::uint32_t shift = 126 - exponent;
+    const std::uint32_t rounding = (1u << (shift - 1)) - 1 + ((mantissa >> shift) & 1);
+    return static_cast<std::uint16_t>(sign | ((mantissa + rounding) >> shift));
+  }
+
+  // Rebias the exponent from 127 to 15 and round the mantissa to 10 bits.
+  const std::uint32_t rebiased = magnitude - ((127u - 15u) << 23);
+  const std::uint32_t rounding = 0xFFFu + ((rebiased >> 13) & 1);
+  return static_cast<std::uint16_t>(sign | ((rebiased + rounding) >> 13));
+}
+
+// Converts the floats in place, the halves are written behind the floats read.
+void ConvertToHalf(float* pixels, std::size_t count) noexcept {
+  auto* halves = reinterpret_cast<std::uint16_t*>(pixels);
+  std::size_t i = 0;
+
+#ifdef TEXTURE_F16C
+  const __m256 max = _mm256_set1_ps(kHalfMax);
+  const __m256 min = _mm256_set1_ps(-kHalfMax);
+  for (; i + 8 <= count; i += 8) {
+    // min and max return their second operand if one is NaN, the NaNs are not
+    // clamped and are converted like by FloatToHalf.
+    const __m256 values = _mm256_min_ps(max, _mm256_max_ps(min, _mm256_loadu_ps(pixels + i)));
+    const __m128i packed = _mm256_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(halves + i), packed);
+  }
+#endif  // TEXTURE_F16C
+
+  for (; i < count; i++) {
+    halves[i] = FloatToHalf(pixels[i]);
+  }
+}
+
+// Shared exponent format of EXT_texture_shared_exponent: 9 bits mantissas
+// and a 5 bits exponent biased by 15.
+constexpr int kRgb9E5MantissaBits = 9;
+constexpr int kRgb9E5ExponentBias = 15;
+constexpr float kRgb9E5Max = 65408.f;  // 511 / 512 * 2^16.
+
+std::uint32_t PackRgb9E5(float r, float g, float b) noexcept {
+  // Negative values and NaNs become 0.
+  r = r > 0.f ? std::min(r, kRgb9E5Max) : 0.f;
+  g = g > 0.f ? std::min(g, kRgb9E5Max) : 0.f;
+  b = b > 0.f ? std::min(b, kRgb9E5Max) : 0.f;
+  const float max_channel = std::max({r, g, b});
+
+  // floor(log2(max_channel)) from the float exponent, the smallest shared
+  // exponent covers the denormals.
+  const int max_exponent =
+      std::max(static_cast<int>(FloatBits(max_channel) >> 23) - 127,
+               -kRgb9E5ExponentBias - 1);
+  int exponent = max_exponent + 1 + kRgb9E5ExponentBias;
+
+  // 2^-(exponent - bias - mantissa bits), built from its float bits.
+  const auto scale = [](int shared_exponent) {
+    return BitsToFloat(static_cast<std::uint32_t>(
+        127 - (shared_exponent - kRgb9E5ExponentBias - kRgb9E5MantissaBits)) << 23);
+  };
+
+  float channel_scale = scale(exponent);
+  if (static_cast<std::uint32_t>(max_channel * channel_scale + 0.5f) ==
+      (1u << kRgb9E5MantissaBits)) {
+    // The rounding overflows the mantissa.
+    exponent++;
+    channel_scale = scale(exponent);
+  }
+
+  const auto red = static_cast<std::uint32_t>(r * channel_scale + 0.5f);
+  const auto green = static_cast<std::uint32_t>(g * channel_scale + 0.5f);
+  const auto blue = static_cast<std::uint32_t>(b * channel_scale + 0.5f);
+  return red | (green << 9) | (blue << 18) | (static_cast<std::uint32_t>(exponent) << 27);
+}
+
+// Converts the RGB floats in place, the texels are written behind the floats read.
+void ConvertToRgb9E5(float* pixels, std::size_t texel_count) noexcept {
+  auto* texels = reinterpret_cast<std::uint32_t*>(pixels);
+  for (std::size_t i = 0; i < texel_count; i++) {
+    const float* rgb = pixels + i * 3;
+    texels[i] = PackRgb9E5(rgb[0], rgb[1], rgb[2]);
+  }
+}
+
+// Gives back the end of the pixels after a conversion to a smaller format.
+// stb_image allocates them with malloc.
+template <typename T>
+T* ShrinkPixels(float* pixels, std::size_t size) noexcept {
+  void* shrunk = std::realloc(pixels, size);
+  return static_cast<T*>(shrunk != nullptr ? shrunk : pixels);
+}
+
+void ConvertHdrPixels(ImageBuffer* image_buffer, HdrPixelFormat hdr_format) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  auto* pixels = std::get<float*>(image_buffer->data);
+  const std::size_t texel_count = static_cast<std::size_t>(image_buffer->width) *
+                                  static_cast<std::size_t>(image_buffer->height);
+
+  if (hdr_format == HdrPixelFormat::kRgb9E5 && image_buffer->channels == 3) {
+    ConvertToRgb9E5(pixels, texel_count);
+    image_buffer->data =
+        ShrinkPixels<std::uint32_t>(pixels, texel_count * sizeof(std::uint32_t));
+  }
+  else {
+    const std::size_t count = texel_count * static_cast<std::size_t>(image_buffer->channels);
+    ConvertToHalf(pixels, count);
+    image_buffer->data = ShrinkPixels<std::uint16_t>(pixels, count * sizeof(std::uint16_t));
+  }
+}
+
+}  // namespace
 
 TextureParameters::TextureParameters(std::string_view path, GLint wrap_param,
                                      GLint filter_param, bool gamma,
-                                     bool flip_y, bool hdr) noexcept
+                                     bool flip_y, bool hdr,
+                                     TextureCompression compression) noexcept
   : image_file_path(path.data()),
     wrapping_param(wrap_param),
     filtering_param(filter_param),
     gamma_corrected(gamma),
     flipped_y(flip_y),
-    hdr(hdr)
+    hdr(hdr),
+    compression(compression)
 {
 };
 
 ImageFileDecompressingJob::ImageFileDecompressingJob(
-  FileBuffer* file_buffer, ImageBuffer* img_buffer, bool flip_y, bool hdr) noexcept
+  FileBuffer* file_buffer, ImageBuffer* img_buffer, bool flip_y, bool hdr,
+  HdrPixelFormat hdr_format, PixelLayout pixel_layout) noexcept
     : Job(JobType::kImageFileDecompressing),
       file_buffer_(file_buffer),
       image_buffer_(img_buffer),
       flip_y_(flip_y),
-      hdr_(hdr)
+      hdr_(hdr),
+      hdr_format_(hdr_format),
+      pixel_layout_(pixel_layout)
 {
 }
 
@@ -43,14 +308,23 @@ void ImageFileDecompressingJob::Work() noexcept {
   stbi_set_flip_vertically_on_load(flip_y_);
 
   if (hdr_) {
-    image_buffer_->data = stbi_loadf_from_memory(file_buffer_->data, file_buffer_->size,
-                                            &image_buffer_->width, &image_buffer_->height,
-                                            &image_buffer_->channels, 0);
+    auto* pixels = stbi_loadf_from_memory(file_buffer_->data, file_buffer_->size,
+                                          &image_buffer_->width, &image_buffer_->height,
+                                          &image_buffer_->channels, 0);
+    image_buffer_->data = pixels;
+
+    // Converted here rather than by the driver on the GL thread.
+    if (pixels != nullptr && hdr_format_ != HdrPixelFormat::kFloat) {
+      ConvertHdrPixels(image_buffer_, hdr_format_);
+    }
   } 
   else {
     image_buffer_->data = stbi_load_from_memory(file_buffer_->data, file_buffer_->size,
                                            &image_buffer_->width, &image_buffer_->height,
                                            &image_buffer_->channels, 0);
+
+    // Expanded here rather than by the driver on the GL thread.
+    ExpandRgbImage(image_buffer_, pixel_layout_);
   }
 
 }
@@ -60,9 +334,6 @@ GLuint LoadTexture(std::string_view path, GLint wrapping_param,
 #ifdef TRACY_ENABLE
   ZoneScoped;
 #endif  // TRACY_ENABLE
-  // Load texture.
-  int width, height, channels;
-
   stbi_set_flip_vertically_on_load(flip_y);
 
 #ifdef TRACY_ENABLE
@@ -74,12 +345,14 @@ GLuint LoadTexture(std::string_view path, GLint wrapping_param,
 #ifdef TRACY_ENABLE
   ZoneNamedN(UnCompress, "UnCompress Texture File.", true);
 #endif
-  const auto texture_uncompress = stbi_load_from_memory(file_buffer.data, 
-      file_buffer.size, &width, &height, &channels, 0);
+  ImageBuffer image;
+  image.data = stbi_load_from_memory(file_buffer.data, file_buffer.size,
+                                     &image.width, &image.height, &image.channels, 0);
 
-  if (texture_uncompress == nullptr) {
+  if (std::get<unsigned char*>(image.data) == nullptr) {
     std::cerr << "Error in loading the image at path " << path << '\n';
   }
+  ExpandRgbImage(&image, kPreferredPixelLayout);
 
 #ifdef TRACY_ENABLE
   ZoneNamedN(UploadTexToGPU, "Upload texture to GPU.", true);
@@ -91,33 +364,18 @@ GLuint LoadTexture(std::string_view path, GLint wrapping_param,
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapping_param);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapping_param);
 
+  // The model textures keep their filtering state: the renderer samples the
+  // material arrays with the SamplerCache, these textures are never bound.
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering_param);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering_param);
 
-  GLint internal_format = GL_RGB;
-  GLenum format = GL_RGB;
-  if (channels == 1) {
-    internal_format = GL_RED;
-    format = GL_RED;
-  } 
-  else if (channels == 2) {
-    internal_format = GL_RG;
-    format = GL_RG;
-  } 
-  else if (channels == 3) {
-    internal_format = gamma ? GL_SRGB : GL_RGB;
-    format = GL_RGB;
-  } 
-  else if (channels == 4) {
-    internal_format = gamma ? GL_SRGB_ALPHA : GL_RGBA;
-    format = GL_RGBA;
-  }
-
-  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0,
-               format, GL_UNSIGNED_BYTE, texture_uncompress);
-  glGenerateMipmap(GL_TEXTURE_2D);
+  GLint internal_format = GL_RGBA8;
+  const GLsizei level_count = UploadImage(image, gamma, filtering_param, &internal_format);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, texture,
+      GpuMemoryCategory::kTexture,
+      CalculateTextureSize(internal_format, image.width, image.height, 1, level_count));
 
-  stbi_image_free(texture_uncompress);
+  FreeImageBuffer(&image);
 
   return texture;
 }
@@ -143,6 +401,8 @@ GLuint LoadHDR_Texture(std::string_view path, GLint wrapping_param,
   glBindTexture(GL_TEXTURE_2D, texture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT,
                texture_data);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, texture,
+      GpuMemoryCategory::kTexture, CalculateTextureSize(GL_RGB16F, width, height));
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapping_param);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapping_param);
 
@@ -166,14 +426,25 @@ GLuint LoadCubeMap(const std::array<std::string, 6>& faces, GLint wrapping_param
   int width, height, channels;
   stbi_set_flip_vertically_on_load(flip_y);
 
+  std::size_t face_size = 0;
   for (std::size_t i = 0; i < faces.size(); i++) {
-    auto* data = stbi_load(faces[i].c_str(), &width, &height, &channels, 0);
-
-    if (data) {
-      GLint internalFormat = channels == 3 ? GL_RGB : GL_RGBA;
-
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height,
-                   0, internalFormat, GL_UNSIGNED_BYTE, data);
+    ImageBuffer face;
+    face.data = stbi_load(faces[i].c_str(), &width, &height, &channels, 0);
+    face.width = width;
+    face.height = height;
+    face.channels = channels;
+
+    if (std::get<unsigned char*>(face.data) != nullptr) {
+      ExpandRgbImage(&face, kPreferredPixelLayout);
+      const auto upload_format = ChooseUploadFormat(face.channels, false, face.bgra);
+
+      glPixelStorei(GL_UNPACK_ALIGNMENT, CalculateUnpackAlignment(
+          static_cast<std::size_t>(width) * face.channels));
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, upload_format.internal_format,
+                   width, height, 0, upload_format.format, upload_format.type,
+                   std::get<unsigned char*>(face.data));
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      face_size = CalculateTextureSize(upload_format.internal_format, width, height);
 
       std::cout << "Loaded image with a width of " << width
                 << "px, a height of " << height << "px, and " << channels
@@ -185,7 +456,7 @@ GLuint LoadCubeMap(const std::array<std::string, 6>& faces, GLint wrapping_param
                 << std::endl;
     }
 
-    stbi_image_free(data);
+    FreeImageBuffer(&face);
   }
 
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, filtering_param);
@@ -194,6 +465,9 @@ GLuint LoadCubeMap(const std::array<std::string, 6>& faces, GLint wrapping_param
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, wrapping_param);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, wrapping_param);
 
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, texture_id,
+                                 GpuMemoryCategory::kTexture, face_size * faces.size());
+
   return texture_id;
 }
 
@@ -207,51 +481,283 @@ void LoadTextureToGpu(ImageBuffer* image_buffer, GLuint* id,
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex_param.filtering_param);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tex_param.filtering_param);
 
-  GLint internal_format = GL_RGB;
-  GLenum format = GL_RGB;
-
-  switch (image_buffer->channels) { 
-    case 1:
-      internal_format = GL_RED;
-      format = GL_RED;
-      break;
-    case 2:
-      internal_format = GL_RG;
-      format = GL_RG;
-      break;
-    case 3:
-      if (tex_param.hdr) {
-        internal_format = GL_RGB16F;
-      } 
-      else {
-        internal_format = tex_param.gamma_corrected ? GL_SRGB : GL_RGB;
-      }
-      format = GL_RGB;
-      break;
-    case 4:
-      internal_format = tex_param.gamma_corrected ? GL_SRGB_ALPHA : GL_RGBA;
-      format = GL_RGBA;
-      break;
-    default:
-      break;
+  const int channels = std::clamp(image_buffer->channels, 1, 4);
+  const auto row_texel_count = static_cast<std::size_t>(image_buffer->width) * channels;
+  const GLenum format = ChooseUploadFormat(channels, false, false).format;
+  GLint internal_format = kHalfFloatFormats[channels - 1];
+
+  GLsizei level_count = 1;
+  if (const auto* halves = std::get_if<std::uint16_t*>(&image_buffer->data)) {
+    // The packed pixels have no mip chain, the decompressing job only packs
+    // the textures sampled without mips.
+    glPixelStorei(GL_UNPACK_ALIGNMENT,
+                  CalculateUnpackAlignment(row_texel_count * sizeof(std::uint16_t)));
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image_buffer->width,
+                 image_buffer->height, 0, format, GL_HALF_FLOAT, *halves);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
   }
-
-  if (tex_param.hdr) {
+  else if (const auto* texels = std::get_if<std::uint32_t*>(&image_buffer->data)) {
+    internal_format = GL_RGB9_E5;
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image_buffer->width,
+                 image_buffer->height, 0, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, *texels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  }
+  else if (tex_param.hdr) {
+    // The float rows are always 4 bytes aligned.
     glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image_buffer->width,
                  image_buffer->height, 0, format, GL_FLOAT,
                  std::get<float*>(image_buffer->data));
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    stbi_image_free(std::get<float*>(image_buffer->data));
+    level_count = UploadMipChain(std::get<float*>(image_buffer->data),
+                                 image_buffer->width, image_buffer->height,
+                                 image_buffer->channels, internal_format, format,
+                                 GL_FLOAT, tex_param.filtering_param, false);
   } 
   else {
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image_buffer->width,
-                 image_buffer->height, 0, format, GL_UNSIGNED_BYTE,
-                 std::get<unsigned char*>(image_buffer->data));
-    glGenerateMipmap(GL_TEXTURE_2D);
+    level_count = UploadImage(*image_buffer, tex_param.gamma_corrected,
+                              tex_param.filtering_param, &internal_format);
+  }
+  FreeImageBuffer(image_buffer);
+
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, *id, GpuMemoryCategory::kTexture,
+      CalculateTextureSize(internal_format, image_buffer->width, image_buffer->height,
+                           1, level_count));
+}
+
+void ExpandRgbTexels(const unsigned char* rgb, unsigned char* dst, std::size_t count,
+                     bool bgra) noexcept {
+  std::size_t i = 0;
+
+#if defined(TEXTURE_AVX2) || defined(TEXTURE_SSSE3)
+  // 4 texels per 16 bytes lane, the loads read 4 bytes past the 12 bytes of the
+  // texels so the last ones are expanded by the scalar loop.
+  const __m128i shuffle = bgra
+      ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+      : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+#ifdef TEXTURE_AVX2
+  // The shuffles stay in their lane, each lane is loaded with 4 texels.
+  const __m256i shuffle_8 = _mm256_broadcastsi128_si256(shuffle);
+  const __m256i alpha_8 = _mm256_broadcastsi128_si256(alpha);
+  for (; i * 3 + 28 <= count * 3; i += 8) {
+    const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3));
+    const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3 + 12));
+    const __m256i texels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+                        _mm256_or_si256(_mm256_shuffle_epi8(texels, shuffle_8), alpha_8));
+  }
+#endif  // TEXTURE_AVX2
+
+  for (; i * 3 + 16 <= count * 3; i += 4) {
+    const __m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4),
+                     _mm_or_si128(_mm_shuffle_epi8(texels, shuffle), alpha));
+  }
+#endif  // TEXTURE_AVX2 || TEXTURE_SSSE3
+
+  const std::size_t red = bgra ? 2 : 0;
+  const std::size_t blue = bgra ? 0 : 2;
+  for (; i < count; i++) {
+    dst[i * 4] = rgb[i * 3 + red];
+    dst[i * 4 + 1] = rgb[i * 3 + 1];
+    dst[i * 4 + 2] = rgb[i * 3 + blue];
+    dst[i * 4 + 3] = 255;
+  }
+}
+
+void ExpandRgbImage(ImageBuffer* image_buffer, PixelLayout layout) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  auto* const* pixels = std::get_if<unsigned char*>(&image_buffer->data);
+  if (layout == PixelLayout::kAsDecoded || pixels == nullptr || *pixels == nullptr ||
+      image_buffer->channels != 3) {
+    return;
+  }
+
+  // Allocated with malloc like the pixels of stb_image, FreeImageBuffer
+  // releases both.
+  const std::size_t texel_count = static_cast<std::size_t>(image_buffer->width) *
+                                  static_cast<std::size_t>(image_buffer->height);
+  auto* expanded = static_cast<unsigned char*>(std::malloc(texel_count * 4));
+  if (expanded == nullptr) {
+    return;
+  }
+
+  ExpandRgbTexels(*pixels, expanded, texel_count, layout == PixelLayout::kBgra);
+  stbi_image_free(*pixels);
+
+  image_buffer->data = expanded;
+  image_buffer->channels = 4;
+  image_buffer->bgra = layout == PixelLayout::kBgra;
+}
+
+GLint CalculateUnpackAlignment(std::size_t row_size) noexcept {
+  for (const GLint alignment : {8, 4, 2}) {
+    if (row_size % static_cast<std::size_t>(alignment) == 0) {
+      return alignment;
+    }
+  }
+  return 1;
+}
+
+GLsizei CalculateCubeMapResolution(GLsizei equirect_width,
+                                   std::size_t memory_budget,
+                                   float bytes_per_texel) noexcept {
+  GLsizei resolution = 1;
+  while (resolution * 2 <= equirect_width / 4) {
+    resolution *= 2;
+  }
+
+  // A full mip chain adds a third of the size of the level 0.
+  const auto cubemap_size = [bytes_per_texel](GLsizei face_resolution) {
+    return 6.0 * face_resolution * face_resolution * bytes_per_texel * 4.0 / 3.0;
+  };
+
+  while (resolution > 1 && cubemap_size(resolution) > static_cast<double>(memory_budget)) {
+    resolution /= 2;
+  }
+
+  return resolution;
+}
+
+void Bc6hCubeMapCompressor::ReadBack(GLuint cubemap, GLsizei resolution,
+                                     GLint level_count) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  resolution_ = resolution;
+  level_count_ = level_count;
 
-    stbi_image_free(std::get<unsigned char*>(image_buffer->data));
+  std::size_t texel_count = 0;
+  for (GLint level = 0; level < level_count_; level++) {
+    const auto level_resolution = static_cast<std::size_t>(std::max(1, resolution_ >> level));
+    texel_count += level_resolution * level_resolution * 6;
+  }
+  const auto buffer_size = static_cast<GLsizeiptr>(texel_count * 3 * sizeof(float));
+
+  glGenBuffers(1, &pixel_buffer_);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffer_);
+  glBufferData(GL_PIXEL_PACK_BUFFER, buffer_size, nullptr, GL_STREAM_READ);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, pixel_buffer_,
+                                 GpuMemoryCategory::kBuffer,
+                                 static_cast<std::size_t>(buffer_size));
+
+  // The faces are copied in the buffer by the GPU, the render thread does not
+  // wait for them.
+  glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+  std::size_t offset = 0;
+  for (GLint level = 0; level < level_count_; level++) {
+    const auto level_resolution = static_cast<std::size_t>(std::max(1, resolution_ >> level));
+    for (GLuint face = 0; face < 6; face++) {
+      glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT,
+                    reinterpret_cast<void*>(offset));
+      offset += level_resolution * level_resolution * 3 * sizeof(float);
+    }
   }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  readback_fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  // The fence is waited for by the context of the download, it must reach the
+  // GPU without waiting for the next swap.
+  glFlush();
+}
+
+void Bc6hCubeMapCompressor::Download() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // One second, the wait is repeated until the fence is signaled.
+  constexpr GLuint64 kTimeout = 1'000'000'000;
+  while (glClientWaitSync(readback_fence_, 0, kTimeout) == GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(readback_fence_);
+  readback_fence_ = nullptr;
+
+  GLint64 buffer_size = 0;
+  glGetNamedBufferParameteri64v(pixel_buffer_, GL_BUFFER_SIZE, &buffer_size);
+  pixels_.resize(static_cast<std::size_t>(buffer_size) / sizeof(float));
+  glGetNamedBufferSubData(pixel_buffer_, 0, static_cast<GLsizeiptr>(buffer_size),
+                          pixels_.data());
+
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kBuffer, pixel_buffer_);
+  glDeleteBuffers(1, &pixel_buffer_);
+  pixel_buffer_ = 0;
+}
+
+void Bc6hCubeMapCompressor::Compress() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  std::size_t compressed_size = 0;
+  for (GLint level = 0; level < level_count_; level++) {
+    const GLsizei level_resolution = std::max(1, resolution_ >> level);
+    compressed_size += 6 * CompressedImageSize(BlockFormat::kBc6h, level_resolution,
+                                               level_resolution);
+  }
+  compressed_pixels_.resize(compressed_size);
+
+  const float* face_pixels = pixels_.data();
+  unsigned char* compressed_face = compressed_pixels_.data();
+  for (GLint level = 0; level < level_count_; level++) {
+    const GLsizei level_resolution = std::max(1, resolution_ >> level);
+    for (GLuint face = 0; face < 6; face++) {
+      CompressImageBc6h(face_pixels, level_resolution, level_resolution, 3,
+                        compressed_face);
+      face_pixels += static_cast<std::size_t>(level_resolution) * level_resolution * 3;
+      compressed_face += CompressedImageSize(BlockFormat::kBc6h, level_resolution,
+                                             level_resolution);
+    }
+  }
+
+  pixels_ = std::vector<float>();
+}
+
+void Bc6hCubeMapCompressor::Upload() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  glGenTextures(1, &compressed_cubemap_);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, compressed_cubemap_);
+
+  const unsigned char* compressed_face = compressed_pixels_.data();
+  for (GLint level = 0; level < level_count_; level++) {
+    const GLsizei level_resolution = std::max(1, resolution_ >> level);
+    const auto face_size = CompressedImageSize(BlockFormat::kBc6h, level_resolution,
+                                               level_resolution);
+    for (GLuint face = 0; face < 6; face++) {
+      glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level,
+                             GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, level_resolution,
+                             level_resolution, 0, static_cast<GLsizei>(face_size),
+                             compressed_face);
+      compressed_face += face_size;
+    }
+  }
+
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                  level_count_ > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, level_count_ - 1);
+
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, compressed_cubemap_,
+                                 GpuMemoryCategory::kTexture, compressed_pixels_.size());
+
+  compressed_pixels_ = std::vector<unsigned char>();
+}
+
+void FreeImageBuffer(ImageBuffer* image_buffer) noexcept {
+  std::visit([](auto* data) { stbi_image_free(data); }, image_buffer->data);
+  image_buffer->data = static_cast<unsigned char*>(nullptr);
 }
 
 
@@ -293,37 +799,28 @@ Texture::~Texture() {
 void Texture::Create(std::string_view path, GLint wrapping_param,
                      GLint filtering_param, bool gamma, bool flip_y) noexcept {
   // Load texture.
-  int width, height, channels;
+  ImageBuffer image;
 
   stbi_set_flip_vertically_on_load(flip_y);
-  auto texture_data = stbi_load(path.data(), &width, &height, &channels, 0);
+  image.data = stbi_load(path.data(), &image.width, &image.height, &image.channels, 0);
 
-  if (texture_data == nullptr) {
+  if (std::get<unsigned char*>(image.data) == nullptr) {
     std::cerr << "Error in loading the image at path " << path << '\n';
     std::exit(1);
   }
 
-  std::cout << "Loaded image with a width of " << width << "px, a height of "
-            << height << "px, and " << channels << "channels \n";
+  std::cout << "Loaded image with a width of " << image.width << "px, a height of "
+            << image.height << "px, and " << image.channels << "channels \n";
+  ExpandRgbImage(&image, kPreferredPixelLayout);
 
   // Give texture to GPU.
   glGenTextures(1, &id);
   glBindTexture(GL_TEXTURE_2D, id);
 
-  GLint internal_format;
-  GLenum format;
-
-  if (channels == 3) {
-    internal_format = gamma ? GL_SRGB : GL_RGB;
-    format = GL_RGB;
-  } else if (channels == 4) {
-    internal_format = gamma ? GL_SRGB_ALPHA : GL_RGBA;
-    format = GL_RGBA;
-  }
-
-  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format,
-               GL_UNSIGNED_BYTE, texture_data);
-  glGenerateMipmap(GL_TEXTURE_2D);
+  GLint internal_format = GL_RGBA8;
+  const GLsizei level_count = UploadImage(image, gamma, filtering_param, &internal_format);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, id, GpuMemoryCategory::kTexture,
+      CalculateTextureSize(internal_format, image.width, image.height, 1, level_count));
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapping_param);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapping_param);
@@ -334,10 +831,11 @@ void Texture::Create(std::string_view path, GLint wrapping_param,
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering_param);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering_param);
 
-  stbi_image_free(texture_data);
+  FreeImageBuffer(&image);
 }
 
 void Texture::Destroy() noexcept {
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, id);
   glDeleteTextures(1, &id);
   id = 0;
 }
\ No newline at end of file
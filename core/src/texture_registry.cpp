@@ -0,0 +1,225 @@
+#include "texture_registry.h"
+#include "gpu_memory.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+namespace {
+
+constexpr std::uint64_t kHashMultiplier = 0x9E3779B97F4A7C15ull;
+
+// Final mix of MurmurHash3, spreads every input bit on the whole hash.
+std::uint64_t MixHash(std::uint64_t hash) noexcept {
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+std::uint64_t CombineHash(std::uint64_t hash, std::uint64_t value) noexcept {
+  return (hash ^ MixHash(value)) * kHashMultiplier;
+}
+
+}  // namespace
+
+std::uint64_t HashContent(const unsigned char* data, std::size_t size,
+                          std::uint64_t seed) noexcept {
+  std::uint64_t hash = CombineHash(seed, size);
+
+  // 8 bytes per step, the tail is padded with zeros.
+  std::size_t i = 0;
+  for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    std::memcpy(&word, data + i, sizeof(std::uint64_t));
+    hash = (hash ^ word) * kHashMultiplier;
+    hash ^= hash >> 29;
+  }
+
+  if (i < size) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, data + i, size - i);
+    hash = (hash ^ word) * kHashMultiplier;
+  }
+
+  return MixHash(hash);
+}
+
+bool HashFileIdentity(std::string_view path, std::uint64_t* hash,
+                      std::uint64_t seed) noexcept {
+  std::error_code error;
+  const auto absolute_path = std::filesystem::absolute(path, error).lexically_normal();
+  const auto size = std::filesystem::file_size(absolute_path, error);
+  if (error) {
+    return false;
+  }
+  const auto write_time = std::filesystem::last_write_time(absolute_path, error);
+  if (error) {
+    return false;
+  }
+
+  const std::string normalized_path = absolute_path.generic_string();
+  std::uint64_t identity_hash = HashContent(
+      reinterpret_cast<const unsigned char*>(normalized_path.data()),
+      normalized_path.size(), seed);
+  identity_hash = CombineHash(identity_hash, static_cast<std::uint64_t>(size));
+  identity_hash = CombineHash(identity_hash,
+                              static_cast<std::uint64_t>(write_time.time_since_epoch().count()));
+  *hash = MixHash(identity_hash);
+  return true;
+}
+
+TextureKey::TextureKey(std::uint64_t hash, const TextureParameters& tex_param) noexcept
+    : source_hash(hash),
+      wrapping_param(tex_param.wrapping_param),
+      filtering_param(tex_param.filtering_param),
+      gamma_corrected(tex_param.gamma_corrected),
+      flipped_y(tex_param.flipped_y),
+      hdr(tex_param.hdr),
+      compression(tex_param.compression)
+{
+}
+
+bool TextureKey::operator==(const TextureKey& other) const noexcept {
+  return source_hash == other.source_hash && wrapping_param == other.wrapping_param &&
+         filtering_param == other.filtering_param &&
+         gamma_corrected == other.gamma_corrected && flipped_y == other.flipped_y &&
+         hdr == other.hdr && compression == other.compression;
+}
+
+std::size_t TextureKeyHash::operator()(const TextureKey& key) const noexcept {
+  std::uint64_t hash = key.source_hash;
+  hash = CombineHash(hash, static_cast<std::uint64_t>(key.wrapping_param));
+  hash = CombineHash(hash, static_cast<std::uint64_t>(key.filtering_param));
+  hash = CombineHash(hash, (key.gamma_corrected ? 1u : 0u) | (key.flipped_y ? 2u : 0u) |
+                           (key.hdr ? 4u : 0u) |
+                           (static_cast<std::uint64_t>(key.compression) << 3));
+  return static_cast<std::size_t>(MixHash(hash));
+}
+
+TextureHandle::TextureHandle(TextureRegistry* registry, std::uint32_t entry_idx) noexcept
+    : registry_(registry),
+      entry_idx_(entry_idx)
+{
+}
+
+TextureHandle::TextureHandle(TextureHandle&& other) noexcept
+    : registry_(other.registry_),
+      entry_idx_(other.entry_idx_)
+{
+  other.registry_ = nullptr;
+}
+
+TextureHandle& TextureHandle::operator=(TextureHandle&& other) noexcept {
+  if (this != &other) {
+    Release();
+    registry_ = other.registry_;
+    entry_idx_ = other.entry_idx_;
+    other.registry_ = nullptr;
+  }
+  return *this;
+}
+
+TextureHandle::TextureHandle(const TextureHandle& other) noexcept
+    : registry_(other.registry_),
+      entry_idx_(other.entry_idx_)
+{
+  if (registry_ != nullptr) {
+    registry_->AddReference(entry_idx_);
+  }
+}
+
+TextureHandle& TextureHandle::operator=(const TextureHandle& other) noexcept {
+  if (this != &other) {
+    Release();
+    registry_ = other.registry_;
+    entry_idx_ = other.entry_idx_;
+    if (registry_ != nullptr) {
+      registry_->AddReference(entry_idx_);
+    }
+  }
+  return *this;
+}
+
+TextureHandle::~TextureHandle() noexcept { Release(); }
+
+void TextureHandle::Release() noexcept {
+  if (registry_ != nullptr) {
+    registry_->RemoveReference(entry_idx_);
+    registry_ = nullptr;
+  }
+}
+
+GLuint TextureHandle::id() const noexcept {
+  return registry_ != nullptr ? *id_address() : 0;
+}
+
+GLuint* TextureHandle::id_address() const noexcept {
+  std::lock_guard lock(registry_->mutex_);
+  return &registry_->entries_[entry_idx_].id;
+}
+
+TextureHandle TextureRegistry::Acquire(const TextureKey& key, bool* is_new) noexcept {
+  std::lock_guard lock(mutex_);
+
+  if (const auto* entry_idx = entry_indices_.Find(key)) {
+    entries_[*entry_idx].reference_count++;
+    *is_new = false;
+    return TextureHandle(this, *entry_idx);
+  }
+
+  std::uint32_t entry_idx;
+  if (!free_entries_.empty()) {
+    entry_idx = free_entries_.back();
+    free_entries_.pop_back();
+  }
+  else {
+    entry_idx = static_cast<std::uint32_t>(entries_.size());
+    entries_.emplace_back();
+  }
+
+  entries_[entry_idx] = Entry{key, 0, 1};
+  entry_indices_.Insert(key, entry_idx);
+  *is_new = true;
+  return TextureHandle(this, entry_idx);
+}
+
+std::size_t TextureRegistry::texture_count() const noexcept {
+  std::lock_guard lock(mutex_);
+  return entry_indices_.size();
+}
+
+void TextureRegistry::AddReference(std::uint32_t entry_idx) noexcept {
+  std::lock_guard lock(mutex_);
+  entries_[entry_idx].reference_count++;
+}
+
+void TextureRegistry::RemoveReference(std::uint32_t entry_idx) noexcept {
+  std::lock_guard lock(mutex_);
+  auto& entry = entries_[entry_idx];
+  entry.reference_count--;
+  if (entry.reference_count > 0) {
+    return;
+  }
+
+  if (entry.id != 0) {
+    GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, entry.id);
+    glDeleteTextures(1, &entry.id);
+  }
+  entry_indices_.Erase(entry.key);
+  entry = Entry{};
+  free_entries_.push_back(entry_idx);
+}
+
+TextureRegistry& GetTextureRegistry() noexcept {
+  static TextureRegistry registry;
+  return registry;
+}
@@ -0,0 +1,712 @@
+#include "texture_streamer.h"
+#include "gpu_memory.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// Bytes of the level_count consecutive levels from level, which are stored from
+// the smallest one.
+CookedLevelIndex CalculateLevelBlock(const std::vector<CookedLevelIndex>& levels,
+                                     std::uint32_t level,
+                                     std::uint32_t level_count) noexcept {
+  const auto& finest = levels[level];
+  const auto& smallest = levels[level + level_count - 1];
+  CookedLevelIndex block = finest;
+  block.byte_offset = smallest.byte_offset;
+  block.byte_length = finest.byte_offset + finest.byte_length - smallest.byte_offset;
+  return block;
+}
+
+}  // namespace
+
+void TextureStreamer::Begin(std::size_t texture_count,
+                            SharedGlContext upload_context) noexcept {
+  textures_.resize(texture_count);
+  pixel_buffer_ring_.Create(kPixelBufferRingSize);
+
+  upload_context_ = std::move(upload_context);
+  has_upload_context_ = static_cast<bool>(upload_context_.make_current);
+
+  is_running_ = true;
+  is_starting_ = true;
+  reading_thread_ = std::thread(&TextureStreamer::ReadRequests, this);
+
+  // has_upload_context_ is cleared by the reading thread if its context could
+  // not be made current, the levels are then uploaded by the render thread.
+  std::unique_lock lock(mutex_);
+  requests_condition_.wait(lock, [this]() { return !is_starting_; });
+}
+
+void TextureStreamer::End() noexcept {
+  {
+    std::lock_guard lock(mutex_);
+    is_running_ = false;
+  }
+  requests_condition_.notify_all();
+
+  if (reading_thread_.joinable()) {
+    reading_thread_.join();
+  }
+
+  requests_ = {};
+  loaded_levels_ = {};
+  pixel_buffer_ring_.Destroy();
+  textures_.clear();
+  // The storages are deleted by the owners of their ids.
+  storages_.clear();
+  pending_request_count_ = 0;
+  resident_size_ = 0;
+  frame_ = 0;
+}
+
+void TextureStreamer::AddTexture(std::size_t texture_idx, const FileBuffer* cooked_buffer,
+                                 std::string cooked_path, GLuint* id,
+                                 const TextureParameters& tex_param) noexcept {
+  CookedTexture cooked_texture;
+  if (!cooked_texture.Parse(cooked_buffer->data, cooked_buffer->size)) {
+    std::cerr << "Invalid cooked texture for " << tex_param.image_file_path << '\n';
+    return;
+  }
+
+  AddStorage(id, GL_TEXTURE_2D, cooked_texture.header(), 1, tex_param.wrapping_param,
+             tex_param.filtering_param);
+  AddStreamedTexture(texture_idx, cooked_buffer, std::move(cooked_path), id, -1);
+}
+
+void TextureStreamer::AddArray(GLuint* array_id, const CookedTextureHeader& header,
+                               GLsizei layer_count, GLint wrapping_param,
+                               GLint filtering_param) noexcept {
+  AddStorage(array_id, GL_TEXTURE_2D_ARRAY, header, layer_count, wrapping_param,
+             filtering_param);
+}
+
+void TextureStreamer::AddArrayLayer(std::size_t texture_idx,
+                                    const FileBuffer* cooked_buffer,
+                                    std::string cooked_path, GLuint* array_id,
+                                    GLint layer, bool is_lazy) noexcept {
+  AddStreamedTexture(texture_idx, cooked_buffer, std::move(cooked_path), array_id,
+                     layer, is_lazy);
+}
+
+std::uint32_t TextureStreamer::CalculateMipTailLevel(
+    const CookedTextureHeader& header) noexcept {
+  for (std::uint32_t level = 0; level + 1 < header.level_count; level++) {
+    if (std::max(header.width >> level, 1u) <= kMipTailSize &&
+        std::max(header.height >> level, 1u) <= kMipTailSize) {
+      return level;
+    }
+  }
+  return header.level_count - 1;
+}
+
+std::size_t TextureStreamer::AddStorage(GLuint* id, GLenum target,
+                                        const CookedTextureHeader& header,
+                                        GLsizei layer_count, GLint wrapping_param,
+                                        GLint filtering_param) noexcept {
+  TextureStorage storage;
+  storage.id = id;
+  storage.target = target;
+  storage.header = header;
+  storage.layer_count = layer_count;
+  storage.wrapping_param = wrapping_param;
+  storage.filtering_param = filtering_param;
+  storage.tail_level = CalculateMipTailLevel(header);
+  storage.first_level = header.level_count;
+
+  *id = 0;
+  storages_.push_back(storage);
+  ResizeStorage(&storages_.back(), storage.tail_level);
+
+  return storages_.size() - 1;
+}
+
+void TextureStreamer::AddStreamedTexture(std::size_t texture_idx,
+                                         const FileBuffer* cooked_buffer,
+                                         std::string cooked_path, GLuint* id,
+                                         GLint layer, bool is_lazy) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const auto storage = std::find_if(storages_.begin(), storages_.end(),
+      [id](const TextureStorage& storage) { return storage.id == id; });
+  CookedTexture cooked_texture;
+  if (storage == storages_.end() ||
+      !cooked_texture.Parse(cooked_buffer->data, cooked_buffer->size)) {
+    std::cerr << "Invalid cooked texture " << cooked_path << '\n';
+    return;
+  }
+
+  const auto& header = cooked_texture.header();
+  const std::uint32_t tail_level = storage->tail_level;
+  if (header.level_count != storage->header.level_count ||
+      (!is_lazy && !cooked_texture.is_level_loaded(tail_level))) {
+    std::cerr << "The cooked texture " << cooked_path
+              << " does not match its storage.\n";
+    return;
+  }
+
+  auto& texture = textures_[texture_idx];
+  texture.storage_idx = storage - storages_.begin();
+  texture.id = id;
+  texture.layer = layer;
+  texture.cooked_path = std::move(cooked_path);
+  texture.header = header;
+  texture.levels.assign(&cooked_texture.level(0),
+                        &cooked_texture.level(0) + header.level_count);
+  texture.cooked_data = cooked_texture.is_level_loaded(0) ? cooked_buffer->data : nullptr;
+  texture.failed_read_count = 0;
+  texture.retry_frame = 0;
+  texture.is_level_requested = false;
+  texture.is_resident = false;
+
+  if (is_lazy) {
+    // Nothing is resident, the mip tail is requested once the texture is visible.
+    texture.resident_level = header.level_count;
+    return;
+  }
+
+  for (std::uint32_t level = tail_level; level < header.level_count; level++) {
+    UploadLevel(*id, layer, header, level - storage->first_level, texture.levels[level],
+                cooked_texture.level_data(level), 0);
+  }
+
+  SetResidentLevel(&texture, tail_level);
+}
+
+void TextureStreamer::RequestScreenSize(std::size_t texture_idx,
+                                        float screen_size) noexcept {
+  auto& texture = textures_[texture_idx];
+  texture.screen_size = std::max(texture.screen_size, screen_size);
+}
+
+void TextureStreamer::Update() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  frame_++;
+
+  // Upload the levels read since the last frame.
+  // --------------------------------------------
+  if (!has_upload_context_) {
+    pixel_buffer_ring_.Reclaim();
+  }
+
+  std::size_t uploaded_bytes = 0;
+  while (uploaded_bytes < kUploadBudgetPerFrame) {
+    LevelData level_data;
+    {
+      std::lock_guard lock(mutex_);
+      if (loaded_levels_.empty()) {
+        break;
+      }
+      level_data = std::move(loaded_levels_.front());
+      loaded_levels_.pop();
+    }
+
+    pending_request_count_--;
+    auto& texture = textures_[level_data.texture_idx];
+    auto& storage = storages_[texture.storage_idx];
+    storage.pending_request_count--;
+
+    if (!level_data.is_uploaded && level_data.data == nullptr) {
+      // The ring space is recycled in the allocation order, even if unused.
+      if (level_data.is_in_ring) {
+        pixel_buffer_ring_.Fence(level_data.allocation);
+      }
+      // The level is requested again later, until too many reads have failed.
+      texture.is_level_requested = false;
+      texture.failed_read_count++;
+      if (texture.failed_read_count < kMaxReadAttempts) {
+        texture.retry_frame = frame_ + (kFirstRetryDelay << (texture.failed_read_count - 1));
+        std::cerr << "Could not stream the level " << level_data.level << " of "
+                  << texture.cooked_path << ", retrying later.\n";
+      }
+      else {
+        texture.retry_frame = std::numeric_limits<std::uint64_t>::max();
+        std::cerr << "Could not stream the level " << level_data.level << " of "
+                  << texture.cooked_path << " after " << kMaxReadAttempts
+                  << " attempts, the texture stops streaming.\n";
+      }
+      continue;
+    }
+
+    // The levels uploaded by the reading thread only need their base level.
+    // The storage is not resized while a level of it is pending.
+    const auto block = CalculateLevelBlock(texture.levels, level_data.level,
+                                           level_data.level_count);
+    const std::uint32_t storage_level = level_data.level - storage.first_level;
+    if (level_data.is_in_ring) {
+      UploadLevels(*texture.id, texture.layer, texture.header, storage_level,
+                   &texture.levels[level_data.level], level_data.level_count, block,
+                   reinterpret_cast<const unsigned char*>(level_data.allocation.offset),
+                   pixel_buffer_ring_.buffer());
+      pixel_buffer_ring_.Fence(level_data.allocation);
+    }
+    else if (!level_data.is_uploaded) {
+      UploadLevels(*texture.id, texture.layer, texture.header, storage_level,
+                   &texture.levels[level_data.level], level_data.level_count, block,
+                   level_data.data, 0);
+    }
+    SetResidentLevel(&texture, level_data.level);
+    texture.failed_read_count = 0;
+    texture.is_level_requested = false;
+    uploaded_bytes += block.byte_length;
+  }
+
+  // Evict the least recently visible levels above the budget.
+  // ---------------------------------------------------------
+  for (std::size_t i = 0; i < textures_.size(); i++) {
+    const auto& texture = textures_[i];
+    if (texture.id != nullptr && texture.screen_size > 0.f) {
+      storages_[texture.storage_idx].last_visible_frame = frame_;
+    }
+  }
+
+  while (texture_memory_size() > memory_budget_ &&
+         EvictLeastRecentlyVisibleLevel(frame_, storages_.size())) {
+  }
+
+  // Request the next levels, the most magnified textures first.
+  // -----------------------------------------------------------
+  std::vector<std::pair<float, std::size_t>> candidates;
+  remaining_level_count_ = 0;
+
+  for (std::size_t i = 0; i < textures_.size(); i++) {
+    auto& texture = textures_[i];
+    if (texture.id == nullptr || *texture.id == 0) {
+      continue;
+    }
+
+    const bool is_waiting_retry = frame_ < texture.retry_frame;
+    if ((texture.is_resident || texture.is_level_requested) &&
+        texture.retry_frame != std::numeric_limits<std::uint64_t>::max()) {
+      remaining_level_count_ += texture.resident_level;
+    }
+    if (is_waiting_retry) {
+      continue;
+    }
+
+    if (!texture.is_resident) {
+      // The mip tail of a lazy texture is read the first frame it is visible,
+      // before any other level.
+      if (!texture.is_level_requested && texture.screen_size > 0.f) {
+        candidates.emplace_back(std::numeric_limits<float>::max(), i);
+      }
+      continue;
+    }
+
+    if (!texture.is_level_requested && texture.resident_level > 0) {
+      // Screen pixels per texel of the resident level, textures which are not
+      // visible are streamed last.
+      const float resident_height =
+          static_cast<float>(texture.levels[texture.resident_level].height);
+      candidates.emplace_back(texture.screen_size / resident_height, i);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+
+  for (const auto& [magnification, texture_idx] : candidates) {
+    if (pending_request_count_ >= kMaxPendingRequests) {
+      break;
+    }
+
+    auto& texture = textures_[texture_idx];
+    auto& storage = storages_[texture.storage_idx];
+    const std::uint32_t level = texture.is_resident ? texture.resident_level - 1
+                                                    : storage.tail_level;
+
+    if (level < storage.first_level) {
+      // The storage grows by one level, which is only done without pending
+      // uploads in it and within the budget. The visible textures can evict
+      // the storages which are not visible this frame.
+      if (storage.pending_request_count > 0) {
+        continue;
+      }
+
+      const std::size_t growth =
+          CalculateStorageSize(storage, level) - CalculateStorageSize(storage, storage.first_level);
+      const bool is_visible = texture.screen_size > 0.f;
+      while (texture_memory_size() + growth > memory_budget_ && is_visible &&
+             EvictLeastRecentlyVisibleLevel(frame_ - 1, texture.storage_idx)) {
+      }
+      if (texture_memory_size() + growth > memory_budget_) {
+        continue;
+      }
+
+      ResizeStorage(&storage, level);
+    }
+
+    RequestLevel(texture_idx);
+  }
+
+  for (auto& texture : textures_) {
+    texture.screen_size = 0.f;
+  }
+}
+
+std::size_t TextureStreamer::CalculateStorageSize(const TextureStorage& storage,
+                                                  std::uint32_t first_level) const noexcept {
+  const auto& header = storage.header;
+  return CalculateTextureSize(header.internal_format,
+                              std::max(header.width >> first_level, 1u),
+                              std::max(header.height >> first_level, 1u),
+                              storage.layer_count, header.level_count - first_level);
+}
+
+void TextureStreamer::ResizeStorage(TextureStorage* storage,
+                                    std::uint32_t first_level) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const auto& header = storage->header;
+  const GLenum target = storage->target;
+  const GLsizei level_count = header.level_count - first_level;
+  const GLsizei width = std::max(header.width >> first_level, 1u);
+  const GLsizei height = std::max(header.height >> first_level, 1u);
+
+  GLuint new_id = 0;
+  glGenTextures(1, &new_id);
+  glBindTexture(target, new_id);
+  if (target == GL_TEXTURE_2D_ARRAY) {
+    glTexStorage3D(target, level_count, header.internal_format, width, height,
+                   storage->layer_count);
+  }
+  else {
+    glTexStorage2D(target, level_count, header.internal_format, width, height);
+  }
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, storage->wrapping_param);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, storage->wrapping_param);
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, storage->filtering_param);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, storage->filtering_param);
+  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+
+  // The levels kept by both storages are copied on the GPU, with all their
+  // layers even if only some of them are resident.
+  const GLuint old_id = *storage->id;
+  if (old_id != 0) {
+    const std::uint32_t copied_level = std::max(first_level, storage->first_level);
+    for (std::uint32_t level = copied_level; level < header.level_count; level++) {
+      glCopyImageSubData(old_id, target, level - storage->first_level, 0, 0, 0,
+                         new_id, target, level - first_level, 0, 0, 0,
+                         std::max(header.width >> level, 1u),
+                         std::max(header.height >> level, 1u), storage->layer_count);
+    }
+
+    GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, old_id);
+    glDeleteTextures(1, &old_id);
+  }
+
+  if (first_level > storage->first_level && old_id != 0) {
+    evicted_level_count_ += first_level - storage->first_level;
+  }
+
+  resident_size_ -= old_id != 0 ? CalculateStorageSize(*storage, storage->first_level) : 0;
+  resident_size_ += CalculateStorageSize(*storage, first_level);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, new_id,
+                                 GpuMemoryCategory::kTexture,
+                                 CalculateStorageSize(*storage, first_level));
+
+  *storage->id = new_id;
+  storage->first_level = first_level;
+
+  // The evicted levels are not resident anymore.
+  for (auto& texture : textures_) {
+    if (texture.id == storage->id && texture.resident_level < first_level) {
+      texture.resident_level = first_level;
+    }
+  }
+  ApplyBaseLevel(*storage);
+
+  // The reading thread context uploads in the new texture.
+  if (has_upload_context_) {
+    glFlush();
+  }
+}
+
+bool TextureStreamer::EvictLeastRecentlyVisibleLevel(std::uint64_t max_visible_frame,
+                                                     std::size_t kept_storage_idx) noexcept {
+  TextureStorage* evicted_storage = nullptr;
+  for (std::size_t i = 0; i < storages_.size(); i++) {
+    auto& storage = storages_[i];
+    if (i == kept_storage_idx || storage.first_level >= storage.tail_level ||
+        storage.pending_request_count > 0 || storage.last_visible_frame > max_visible_frame) {
+      continue;
+    }
+    if (evicted_storage == nullptr ||
+        storage.last_visible_frame < evicted_storage->last_visible_frame) {
+      evicted_storage = &storage;
+    }
+  }
+
+  if (evicted_storage == nullptr) {
+    return false;
+  }
+
+  ResizeStorage(evicted_storage, evicted_storage->first_level + 1);
+  return true;
+}
+
+std::size_t TextureStreamer::resident_texture_count() const noexcept {
+  return static_cast<std::size_t>(std::count_if(textures_.begin(), textures_.end(),
+      [](const StreamedTexture& texture) { return texture.is_resident; }));
+}
+
+std::size_t TextureStreamer::streamed_texture_count() const noexcept {
+  return static_cast<std::size_t>(std::count_if(textures_.begin(), textures_.end(),
+      [](const StreamedTexture& texture) { return texture.id != nullptr; }));
+}
+
+std::size_t TextureStreamer::texture_memory_size() const noexcept {
+  return GetGpuMemoryAccountant().used_size(GpuMemoryCategory::kTexture);
+}
+
+void TextureStreamer::ReadRequests() noexcept {
+  const bool is_context_current = has_upload_context_ && upload_context_.make_current();
+  if (has_upload_context_ && !is_context_current) {
+    std::cerr << "The streamed levels are uploaded by the render thread.\n";
+  }
+  {
+    std::lock_guard lock(mutex_);
+    has_upload_context_ = is_context_current;
+    is_starting_ = false;
+  }
+  requests_condition_.notify_all();
+
+  while (true) {
+    LevelRequest request;
+    {
+      std::unique_lock lock(mutex_);
+      requests_condition_.wait(lock, [this]() {
+        return !is_running_ || !requests_.empty();
+      });
+
+      if (!is_running_) {
+        break;
+      }
+
+      request = std::move(requests_.front());
+      requests_.pop();
+    }
+
+    LevelData level_data;
+    level_data.texture_idx = request.texture_idx;
+    level_data.level = request.level;
+    level_data.level_count = request.level_count;
+
+    const std::size_t size = request.level_index.byte_length;
+    unsigned char* destination = nullptr;
+    if (pixel_buffer_ring_.Allocate(size, &level_data.allocation)) {
+      level_data.is_in_ring = true;
+      destination = level_data.allocation.data;
+    }
+
+    if (request.source != nullptr) {
+      // The copy in the ring is done here instead of by the driver in the
+      // GL thread.
+      if (level_data.is_in_ring) {
+        std::memcpy(destination, request.source, size);
+        level_data.data = destination;
+      }
+      else {
+        level_data.data = request.source;
+      }
+    }
+    else {
+      if (!level_data.is_in_ring) {
+        level_data.bytes.resize(size);
+        destination = level_data.bytes.data();
+      }
+      if (ReadCookedLevel(request.cooked_path, request.level_index, destination)) {
+        level_data.data = destination;
+      }
+    }
+
+    if (has_upload_context_) {
+      UploadReadLevel(request, &level_data);
+    }
+
+    std::lock_guard lock(mutex_);
+    loaded_levels_.push(std::move(level_data));
+  }
+
+  if (has_upload_context_) {
+    upload_context_.release();
+  }
+}
+
+void TextureStreamer::UploadReadLevel(const LevelRequest& request,
+                                      LevelData* level_data) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  if (level_data->data != nullptr) {
+    if (level_data->is_in_ring) {
+      UploadLevels(request.texture_id, request.layer, request.header,
+                   request.storage_level, request.levels.data(), request.level_count,
+                   request.level_index,
+                   reinterpret_cast<const unsigned char*>(level_data->allocation.offset),
+                   pixel_buffer_ring_.buffer());
+    }
+    else {
+      UploadLevels(request.texture_id, request.layer, request.header,
+                   request.storage_level, request.levels.data(), request.level_count,
+                   request.level_index, level_data->data, 0);
+    }
+    level_data->is_uploaded = true;
+  }
+
+  // The ring is fenced and recycled by this thread, the level is complete
+  // once the GPU is done with the copy.
+  if (level_data->is_in_ring) {
+    pixel_buffer_ring_.Fence(level_data->allocation);
+    level_data->is_in_ring = false;
+  }
+  WaitForGpuCompletion();
+  pixel_buffer_ring_.Reclaim();
+
+  level_data->bytes = {};
+}
+
+void TextureStreamer::RequestLevel(std::size_t texture_idx) noexcept {
+  auto& texture = textures_[texture_idx];
+  auto& storage = storages_[texture.storage_idx];
+
+  // The first request of a lazy texture reads its whole mip tail.
+  const std::uint32_t level = texture.is_resident ? texture.resident_level - 1
+                                                  : storage.tail_level;
+  const std::uint32_t level_count = texture.is_resident
+                                        ? 1 : texture.header.level_count - level;
+  const auto block = CalculateLevelBlock(texture.levels, level, level_count);
+
+  texture.is_level_requested = true;
+  pending_request_count_++;
+  storage.pending_request_count++;
+
+  // Just cooked textures are already in memory.
+  const unsigned char* source = texture.cooked_data != nullptr
+                                    ? texture.cooked_data + block.byte_offset
+                                    : nullptr;
+
+  std::lock_guard lock(mutex_);
+  requests_.push(LevelRequest{texture_idx, level, level_count,
+                              level - storage.first_level, texture.cooked_path, block,
+                              std::vector<CookedLevelIndex>(
+                                  texture.levels.begin() + level,
+                                  texture.levels.begin() + level + level_count),
+                              *texture.id, texture.layer, texture.header, source});
+  requests_condition_.notify_one();
+}
+
+void TextureStreamer::UploadLevel(GLuint texture_id, GLint layer,
+                                  const CookedTextureHeader& header,
+                                  std::uint32_t level,
+                                  const CookedLevelIndex& level_index,
+                                  const void* data, GLuint pixel_buffer) const noexcept {
+  const GLenum target = layer < 0 ? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY;
+  glBindTexture(target, texture_id);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+  // Rows of the small mips of RGB textures are not 4 bytes aligned.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  const auto is_compressed = (header.flags & kCookedTextureCompressed) != 0;
+  if (layer < 0) {
+    if (is_compressed) {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, level_index.width,
+                                level_index.height, header.internal_format,
+                                static_cast<GLsizei>(level_index.byte_length), data);
+    }
+    else {
+      glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, level_index.width, level_index.height,
+                      header.format, header.type, data);
+    }
+  }
+  else if (is_compressed) {
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                              level_index.width, level_index.height, 1,
+                              header.internal_format,
+                              static_cast<GLsizei>(level_index.byte_length), data);
+  }
+  else {
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, level_index.width,
+                    level_index.height, 1, header.format, header.type, data);
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::UploadLevels(GLuint texture_id, GLint layer,
+                                   const CookedTextureHeader& header,
+                                   std::uint32_t storage_level,
+                                   const CookedLevelIndex* levels,
+                                   std::uint32_t level_count,
+                                   const CookedLevelIndex& block,
+                                   const unsigned char* data,
+                                   GLuint pixel_buffer) const noexcept {
+  for (std::uint32_t i = 0; i < level_count; i++) {
+    UploadLevel(texture_id, layer, header, storage_level + i, levels[i],
+                data + (levels[i].byte_offset - block.byte_offset), pixel_buffer);
+  }
+}
+
+void TextureStreamer::SetResidentLevel(StreamedTexture* texture,
+                                       std::uint32_t level) const noexcept {
+  texture->resident_level = level;
+  texture->is_resident = true;
+  ApplyBaseLevel(storages_[texture->storage_idx]);
+}
+
+void TextureStreamer::ApplyBaseLevel(const TextureStorage& storage) const noexcept {
+  // The levels of an array are sampled in all its layers, only the ones
+  // resident in every layer can be.
+  // The layers which are not resident are not sampled.
+  std::uint32_t base_level = storage.first_level;
+  for (const auto& texture : textures_) {
+    if (texture.id == storage.id && texture.is_resident) {
+      base_level = std::max(base_level, texture.resident_level);
+    }
+  }
+
+  // The level is selected from the base level, a minimum LOD would be added
+  // to it.
+  glBindTexture(storage.target, *storage.id);
+  glTexParameteri(storage.target, GL_TEXTURE_BASE_LEVEL,
+                  static_cast<GLint>(base_level - storage.first_level));
+}
+
+CookedMipTailLoadingJob::CookedMipTailLoadingJob(std::string cooked_path,
+                                                 FileBuffer* cooked_buffer,
+                                                 std::uint32_t max_level_size) noexcept
+    : Job(JobType::kImageFileLoading),
+      cooked_path_(std::move(cooked_path)),
+      cooked_buffer_(cooked_buffer),
+      max_level_size_(max_level_size)
+{
+}
+
+void CookedMipTailLoadingJob::Work() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+  ZoneText(cooked_path_.data(), cooked_path_.size());
+#endif  // TRACY_ENABLE
+
+  if (!LoadCookedMipTail(cooked_path_, max_level_size_, cooked_buffer_)) {
+    std::cerr << "Could not read the cooked texture " << cooked_path_ << '\n';
+  }
+}
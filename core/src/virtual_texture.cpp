@@ -0,0 +1,882 @@
+#include "virtual_texture.h"
+#include "error.h"
+#include "gpu_memory.h"
+
+#ifdef TRACY_ENABLE
+#include <TracyC.h>
+
+#include <Tracy.hpp>
+#endif  // TRACY_ENABLE
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// The block compressed pages are cut on the 4x4 blocks.
+constexpr std::uint32_t kCompressedBlockDimension = 4;
+
+// Uniforms of the parameters of the virtual textures of the maps.
+constexpr std::array<std::string_view, 4> kVirtualTextureUniforms = {
+    "virtual_textures[0]", "virtual_textures[1]", "virtual_textures[2]",
+    "virtual_textures[3]"};
+
+std::uint32_t NextPowerOfTwo(std::uint32_t value) noexcept {
+  std::uint32_t power = 1;
+  while (power < value) {
+    power <<= 1;
+  }
+  return power;
+}
+
+std::uint32_t DivideRoundingUp(std::uint32_t value, std::uint32_t divisor) noexcept {
+  return (value + divisor - 1) / divisor;
+}
+
+// Index of the block of the level read at coordinate, outside of the level.
+std::uint32_t AddressBlock(std::int64_t coordinate, std::uint32_t block_count,
+                           bool repeat) noexcept {
+  const auto count = static_cast<std::int64_t>(block_count);
+  if (repeat) {
+    return static_cast<std::uint32_t>(((coordinate % count) + count) % count);
+  }
+  return static_cast<std::uint32_t>(std::clamp<std::int64_t>(coordinate, 0, count - 1));
+}
+
+}  // namespace
+
+std::string VirtualTexturePath(std::string_view source_path) {
+  return std::string(source_path) + ".vtex";
+}
+
+bool IsVirtualTextureUpToDate(std::string_view vtex_path,
+                              std::uint64_t source_hash) noexcept {
+  VirtualTextureHeader header{};
+  return ReadVirtualTextureHeader(vtex_path, &header) &&
+         header.source_hash == source_hash;
+}
+
+glm::uvec2 CalculateVirtualPageCount(const VirtualTextureHeader& header,
+                                     std::uint32_t level) noexcept {
+  const auto level_width = std::max(header.width >> level, 1u);
+  const auto level_height = std::max(header.height >> level, 1u);
+  return glm::uvec2(DivideRoundingUp(level_width, kVirtualPageContentSize),
+                    DivideRoundingUp(level_height, kVirtualPageContentSize));
+}
+
+bool TileVirtualTexture(const CookedTexture& cooked_texture, GLint wrapping_param,
+                        std::vector<unsigned char>* vtex_data) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const auto& cooked_header = cooked_texture.header();
+  const bool is_compressed = cooked_texture.is_compressed();
+  const bool repeat = wrapping_param == GL_REPEAT || wrapping_param == GL_MIRRORED_REPEAT;
+
+  VirtualTextureHeader header{};
+  header.identifier = kVirtualTextureIdentifier;
+  header.version = kVirtualTextureVersion;
+  header.internal_format = cooked_header.internal_format;
+  header.format = cooked_header.format;
+  header.type = cooked_header.type;
+  header.flags =
+      (is_compressed ? static_cast<std::uint32_t>(kVirtualTextureCompressed) : 0u) |
+      (repeat ? static_cast<std::uint32_t>(kVirtualTextureRepeat) : 0u);
+  header.width = cooked_header.width;
+  header.height = cooked_header.height;
+  header.source_hash = cooked_header.source_hash;
+
+  // The levels are paged up to the first one which fits in a page.
+  for (std::uint32_t level = 0; level < cooked_header.level_count; level++) {
+    if (!cooked_texture.is_level_loaded(level)) {
+      return false;
+    }
+    header.level_count++;
+    const auto pages = CalculateVirtualPageCount(header, level);
+    header.page_count += pages.x * pages.y;
+    if (pages.x == 1 && pages.y == 1) {
+      break;
+    }
+  }
+
+  // The uncompressed pages are cut on the texels, as blocks of 1x1 texel.
+  const std::uint32_t block_dimension = is_compressed ? kCompressedBlockDimension : 1;
+  const auto& level0 = cooked_texture.level(0);
+  const std::size_t block_size = level0.byte_length /
+      (static_cast<std::size_t>(DivideRoundingUp(level0.width, block_dimension)) *
+       DivideRoundingUp(level0.height, block_dimension));
+
+  const std::uint32_t page_blocks = kVirtualPageSize / block_dimension;
+  const std::uint32_t border_blocks = kVirtualPageBorder / block_dimension;
+  const std::uint32_t content_blocks = kVirtualPageContentSize / block_dimension;
+  header.page_byte_size = static_cast<std::uint32_t>(page_blocks * page_blocks * block_size);
+
+  vtex_data->assign(sizeof(VirtualTextureHeader) +
+                    static_cast<std::size_t>(header.page_count) * header.page_byte_size, 0);
+  std::memcpy(vtex_data->data(), &header, sizeof(VirtualTextureHeader));
+
+  unsigned char* page_data = vtex_data->data() + sizeof(VirtualTextureHeader);
+  for (std::uint32_t level = 0; level < header.level_count; level++) {
+    const auto& level_index = cooked_texture.level(level);
+    const unsigned char* level_data = cooked_texture.level_data(level);
+    const auto level_blocks_x = DivideRoundingUp(level_index.width, block_dimension);
+    const auto level_blocks_y = DivideRoundingUp(level_index.height, block_dimension);
+    const auto pages = CalculateVirtualPageCount(header, level);
+
+    for (std::uint32_t page_y = 0; page_y < pages.y; page_y++) {
+      for (std::uint32_t page_x = 0; page_x < pages.x; page_x++) {
+        for (std::uint32_t y = 0; y < page_blocks; y++) {
+          const auto source_y = AddressBlock(
+              static_cast<std::int64_t>(page_y * content_blocks + y) - border_blocks,
+              level_blocks_y, repeat);
+
+          for (std::uint32_t x = 0; x < page_blocks; x++) {
+            const auto source_x = AddressBlock(
+                static_cast<std::int64_t>(page_x * content_blocks + x) - border_blocks,
+                level_blocks_x, repeat);
+            std::memcpy(page_data, level_data +
+                        (static_cast<std::size_t>(source_y) * level_blocks_x + source_x) *
+                        block_size, block_size);
+            page_data += block_size;
+          }
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+bool ReadVirtualTextureHeader(std::string_view vtex_path,
+                              VirtualTextureHeader* header) noexcept {
+  std::ifstream file(vtex_path.data(), std::ios::binary);
+  file.read(reinterpret_cast<char*>(header), sizeof(VirtualTextureHeader));
+  return file.good() && header->identifier == kVirtualTextureIdentifier &&
+         header->version == kVirtualTextureVersion && header->level_count != 0 &&
+         header->page_count != 0;
+}
+
+VirtualTextureSystem::~VirtualTextureSystem() noexcept {
+  const auto not_destroyed = !textures_.empty() || !caches_.empty() || is_running_;
+  if (not_destroyed) {
+    LOG_ERROR("Virtual texture system not destroyed !");
+  }
+}
+
+void VirtualTextureSystem::Begin(glm::uvec2 screen_size, int worker_count) noexcept {
+  // A screen pixel samples about one texel of the visible pages, the caches
+  // hold them for every format with some margin.
+  const auto screen_pixel_count = static_cast<float>(screen_size.x) * screen_size.y;
+  const auto page_count_per_side = static_cast<std::uint32_t>(std::ceil(
+      std::sqrt(kCacheOversizeFactor * screen_pixel_count) / kVirtualPageContentSize));
+  cache_page_count_per_side_ = std::clamp(page_count_per_side, kMinCachePageCountPerSide,
+                                          kMaxCachePageCountPerSide);
+
+  is_running_ = true;
+  for (int i = 0; i < worker_count; i++) {
+    workers_.emplace_back(&VirtualTextureSystem::LoopOverJobs, this);
+  }
+}
+
+void VirtualTextureSystem::End() noexcept {
+  {
+    std::lock_guard lock(mutex_);
+    is_running_ = false;
+  }
+  jobs_condition_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+  jobs_ = {};
+  loading_pages_.clear();
+
+  auto& accountant = GetGpuMemoryAccountant();
+  for (auto& texture : textures_) {
+    accountant.Untrack(GpuObjectType::kTexture, texture.indirection_id);
+    glDeleteTextures(1, &texture.indirection_id);
+  }
+  for (auto& cache : caches_) {
+    accountant.Untrack(GpuObjectType::kTexture, cache.id);
+    glDeleteTextures(1, &cache.id);
+  }
+  for (auto& readback : readbacks_) {
+    accountant.Untrack(GpuObjectType::kBuffer, readback.buffer);
+    glDeleteBuffers(1, &readback.buffer);
+    glDeleteSync(readback.fence);
+    readback = FeedbackReadback{};
+  }
+  if (feedback_size_ != glm::uvec2(0)) {
+    feedback_fbo_.Destroy();
+    feedback_size_ = glm::uvec2(0);
+  }
+
+  textures_.clear();
+  caches_.clear();
+  material_textures_.clear();
+  requested_pages_.clear();
+}
+
+std::int32_t VirtualTextureSystem::AddTexture(std::string vtex_path) noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+  ZoneText(vtex_path.data(), vtex_path.size());
+#endif  // TRACY_ENABLE
+
+  VirtualTexture texture;
+  if (!ReadVirtualTextureHeader(vtex_path, &texture.header)) {
+    std::cerr << "Invalid virtual texture " << vtex_path << '\n';
+    return kNoVirtualTexture;
+  }
+  const auto& header = texture.header;
+
+  std::uint32_t page_count = 0;
+  for (std::uint32_t level = 0; level < header.level_count; level++) {
+    texture.level_first_pages.push_back(page_count);
+    const auto pages = CalculateVirtualPageCount(header, level);
+    page_count += pages.x * pages.y;
+  }
+  if (page_count != header.page_count) {
+    std::cerr << "Invalid page count in the virtual texture " << vtex_path << '\n';
+    return kNoVirtualTexture;
+  }
+
+  texture.vtex_path = std::move(vtex_path);
+  texture.page_states.assign(page_count, PageState::kNotResident);
+  texture.page_slots.assign(page_count, 0);
+  texture.page_used_frames.assign(page_count, 0);
+  texture.cache_idx = FindCache(header.internal_format);
+
+  const auto level0_pages = CalculateVirtualPageCount(header, 0);
+  texture.indirection_size = glm::uvec2(NextPowerOfTwo(level0_pages.x),
+                                        NextPowerOfTwo(level0_pages.y));
+
+  // One texel per page, the level count is the one of the power of two size.
+  glGenTextures(1, &texture.indirection_id);
+  glBindTexture(GL_TEXTURE_2D, texture.indirection_id);
+  glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(header.level_count), GL_RGBA8,
+                 texture.indirection_size.x, texture.indirection_size.y);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, texture.indirection_id,
+      GpuMemoryCategory::kTexture,
+      CalculateTextureSize(GL_RGBA8, texture.indirection_size.x, texture.indirection_size.y,
+                           1, static_cast<GLsizei>(header.level_count)));
+
+  const auto texture_id = static_cast<std::int32_t>(textures_.size());
+  textures_.push_back(std::move(texture));
+
+  // The tail page is read now so that the texture can always be sampled.
+  const auto tail_page_idx = page_count - 1;
+  PageLoadingJob tail_job(textures_.back().vtex_path, texture_id, tail_page_idx,
+                          sizeof(VirtualTextureHeader) +
+                          static_cast<std::uint64_t>(tail_page_idx) * header.page_byte_size,
+                          header.page_byte_size);
+  tail_job.Execute();
+  if (!tail_job.is_loaded() ||
+      !MakePageResident(texture_id, tail_page_idx, tail_job.data(), true)) {
+    std::cerr << "Could not load the tail page of " << textures_.back().vtex_path << '\n';
+  }
+
+  UpdateIndirection(&textures_.back());
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return texture_id;
+}
+
+void VirtualTextureSystem::SetMaterialTextures(
+    std::uint32_t material_idx, const std::array<std::int32_t, 4>& textures) noexcept {
+  if (material_textures_.size() <= material_idx) {
+    material_textures_.resize(material_idx + 1, {kNoVirtualTexture, kNoVirtualTexture,
+                                                 kNoVirtualTexture, kNoVirtualTexture});
+  }
+  material_textures_[material_idx] = textures;
+}
+
+void VirtualTextureSystem::CreateFeedbackBuffer(glm::uvec2 screen_size) noexcept {
+  feedback_size_ = glm::max(screen_size / kFeedbackScale, glm::uvec2(1));
+
+  FrameBufferSpecification specification;
+  specification.SetSize(feedback_size_);
+  // Material and mip level in R, texture coordinates in G.
+  specification.PushColorAttachment(
+      ColorAttachment(GL_RG32UI, GL_RG_INTEGER, GL_NEAREST, GL_CLAMP_TO_EDGE));
+  specification.SetDepthStencilAttachment(
+      DepthStencilAttachment(GL_DEPTH_COMPONENT24, GL_DEPTH_ATTACHMENT));
+  feedback_fbo_.Create(specification);
+
+  Resize(screen_size);
+}
+
+void VirtualTextureSystem::Resize(glm::uvec2 screen_size) noexcept {
+  if (feedback_size_ == glm::uvec2(0)) {
+    return;
+  }
+
+  feedback_size_ = glm::max(screen_size / kFeedbackScale, glm::uvec2(1));
+  feedback_fbo_.Resize(feedback_size_);
+
+  // The pending readbacks have the previous size, they are dropped.
+  const auto readback_size = static_cast<GLsizeiptr>(feedback_size_.x) * feedback_size_.y *
+                             2 * sizeof(std::uint32_t);
+  for (auto& readback : readbacks_) {
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    if (readback.buffer == 0) {
+      glGenBuffers(1, &readback.buffer);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, readback_size, nullptr, GL_STREAM_READ);
+    GetGpuMemoryAccountant().Track(GpuObjectType::kBuffer, readback.buffer,
+                                   GpuMemoryCategory::kBuffer,
+                                   static_cast<std::size_t>(readback_size));
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTextureSystem::BeginFeedbackPass(const Pipeline& feedback_pipeline) noexcept {
+  feedback_fbo_.Bind();
+  glViewport(0, 0, static_cast<GLsizei>(feedback_size_.x),
+             static_cast<GLsizei>(feedback_size_.y));
+
+  static constexpr std::array<GLuint, 4> kClearValue = {kEmptyFeedback, kEmptyFeedback,
+                                                        kEmptyFeedback, kEmptyFeedback};
+  glClearBufferuiv(GL_COLOR, 0, kClearValue.data());
+  glClear(GL_DEPTH_BUFFER_BIT);
+
+  // The derivatives of the texture coordinates are kFeedbackScale times larger
+  // than at the screen resolution.
+  feedback_pipeline.Bind();
+  feedback_pipeline.SetFloat("feedback_lod_bias",
+                             -std::log2(static_cast<float>(kFeedbackScale)));
+}
+
+void VirtualTextureSystem::EndFeedbackPass() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // The oldest readback is overwritten if it has not been read yet.
+  auto& readback = readbacks_[next_readback_];
+  glDeleteSync(readback.fence);
+
+  feedback_fbo_.BindRead();
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  glReadPixels(0, 0, static_cast<GLsizei>(feedback_size_.x),
+               static_cast<GLsizei>(feedback_size_.y), GL_RG_INTEGER, GL_UNSIGNED_INT,
+               nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  next_readback_ = (next_readback_ + 1) % kFeedbackReadbackCount;
+  feedback_fbo_.UnBind();
+}
+
+void VirtualTextureSystem::Bind(std::int32_t texture_id, std::size_t map,
+                                const Pipeline& pipeline) noexcept {
+  const auto& texture = textures_[texture_id];
+  const auto& header = texture.header;
+
+  // The pages are filtered by the texture parameters of the cache.
+  const auto unit = static_cast<GLuint>(map);
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, caches_[texture.cache_idx].id);
+  glBindSampler(unit, 0);
+  glActiveTexture(GL_TEXTURE0 + kIndirectionFirstUnit + unit);
+  glBindTexture(GL_TEXTURE_2D, texture.indirection_id);
+
+  pipeline.SetVec4(kVirtualTextureUniforms[map],
+                   glm::vec4(header.width, header.height, header.level_count - 1,
+                             (header.flags & kVirtualTextureRepeat) ? 1.f : 0.f));
+  pipeline.SetFloat("virtual_cache_size",
+                    static_cast<float>(cache_page_count_per_side_ * kVirtualPageSize));
+}
+
+void VirtualTextureSystem::Update() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  frame_++;
+
+  ReadFeedback();
+  UploadLoadedPages();
+
+  for (auto& texture : textures_) {
+    if (texture.is_indirection_dirty) {
+      UpdateIndirection(&texture);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+std::size_t VirtualTextureSystem::resident_page_count() const noexcept {
+  std::size_t count = 0;
+  for (const auto& cache : caches_) {
+    count += cache.used_slot_count;
+  }
+  return count;
+}
+
+std::size_t VirtualTextureSystem::page_capacity() const noexcept {
+  std::size_t capacity = 0;
+  for (const auto& cache : caches_) {
+    capacity += cache.slots.size();
+  }
+  return capacity;
+}
+
+VirtualTextureSystem::PageLoadingJob::PageLoadingJob(std::string_view vtex_path,
+                                                     std::int32_t texture_id,
+                                                     std::uint32_t page_idx,
+                                                     std::uint64_t page_offset,
+                                                     std::uint32_t page_byte_size) noexcept
+    : Job(JobType::kImageFileLoading),
+      vtex_path_(vtex_path),
+      texture_id_(texture_id),
+      page_idx_(page_idx),
+      page_offset_(page_offset),
+      data_(page_byte_size)
+{
+}
+
+void VirtualTextureSystem::PageLoadingJob::Work() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  std::ifstream file(vtex_path_.data(), std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(page_offset_));
+  file.read(reinterpret_cast<char*>(data_.data()),
+            static_cast<std::streamsize>(data_.size()));
+  is_loaded_ = file.good();
+}
+
+void VirtualTextureSystem::LoopOverJobs() noexcept {
+  while (true) {
+    Job* job = nullptr;
+    {
+      std::unique_lock lock(mutex_);
+      jobs_condition_.wait(lock, [this]() { return !is_running_ || !jobs_.empty(); });
+
+      if (!is_running_) {
+        break;
+      }
+
+      job = jobs_.front();
+      jobs_.pop();
+    }
+
+    job->Execute();
+  }
+}
+
+std::size_t VirtualTextureSystem::FindCache(GLenum internal_format) noexcept {
+  const auto cache = std::find_if(caches_.begin(), caches_.end(),
+      [internal_format](const PhysicalCache& cache) {
+        return cache.internal_format == internal_format;
+      });
+  if (cache != caches_.end()) {
+    return static_cast<std::size_t>(cache - caches_.begin());
+  }
+
+  const auto cache_size = static_cast<GLsizei>(cache_page_count_per_side_ * kVirtualPageSize);
+
+  PhysicalCache new_cache;
+  new_cache.internal_format = internal_format;
+  new_cache.slots.resize(static_cast<std::size_t>(cache_page_count_per_side_) *
+                         cache_page_count_per_side_);
+
+  // The pages are sampled at their level with bilinear filtering, the borders
+  // keep the filter inside the page.
+  glGenTextures(1, &new_cache.id);
+  glBindTexture(GL_TEXTURE_2D, new_cache.id);
+  glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, cache_size, cache_size);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, new_cache.id,
+                                 GpuMemoryCategory::kTexture,
+                                 CalculateTextureSize(internal_format, cache_size,
+                                                      cache_size));
+
+  caches_.push_back(std::move(new_cache));
+  return caches_.size() - 1;
+}
+
+bool VirtualTextureSystem::AllocateSlot(PhysicalCache* cache,
+                                        std::uint32_t* slot_idx) noexcept {
+  auto& slots = cache->slots;
+
+  if (cache->used_slot_count < slots.size()) {
+    const auto free_slot = std::find_if(slots.begin(), slots.end(),
+        [](const PhysicalCache::Slot& slot) {
+          return slot.texture_id == kNoVirtualTexture;
+        });
+    *slot_idx = static_cast<std::uint32_t>(free_slot - slots.begin());
+    cache->used_slot_count++;
+    return true;
+  }
+
+  // The pages used by the last feedback are kept, even if a finer page waits.
+  auto lru_slot = slots.end();
+  for (auto slot = slots.begin(); slot != slots.end(); ++slot) {
+    if (!slot->is_pinned && slot->last_used_frame < feedback_frame_ &&
+        (lru_slot == slots.end() || slot->last_used_frame < lru_slot->last_used_frame)) {
+      lru_slot = slot;
+    }
+  }
+  if (lru_slot == slots.end()) {
+    return false;
+  }
+
+  auto& evicted_texture = textures_[lru_slot->texture_id];
+  evicted_texture.page_states[lru_slot->page_idx] = PageState::kNotResident;
+  evicted_texture.is_indirection_dirty = true;
+
+  *slot_idx = static_cast<std::uint32_t>(lru_slot - slots.begin());
+  return true;
+}
+
+void VirtualTextureSystem::UploadPage(const VirtualTexture& texture,
+                                      const PhysicalCache& cache, std::uint32_t slot_idx,
+                                      const unsigned char* data) const noexcept {
+  const auto& header = texture.header;
+  const auto x = static_cast<GLint>((slot_idx % cache_page_count_per_side_) * kVirtualPageSize);
+  const auto y = static_cast<GLint>((slot_idx / cache_page_count_per_side_) * kVirtualPageSize);
+
+  glBindTexture(GL_TEXTURE_2D, cache.id);
+  // Rows of the RGB pages are not 4 bytes aligned.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  if (header.flags & kVirtualTextureCompressed) {
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, kVirtualPageSize, kVirtualPageSize,
+                              header.internal_format,
+                              static_cast<GLsizei>(header.page_byte_size), data);
+  }
+  else {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, kVirtualPageSize, kVirtualPageSize,
+                    header.format, header.type, data);
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+bool VirtualTextureSystem::MakePageResident(std::int32_t texture_id,
+                                            std::uint32_t page_idx,
+                                            const unsigned char* data,
+                                            bool is_pinned) noexcept {
+  auto& texture = textures_[texture_id];
+  auto& cache = caches_[texture.cache_idx];
+
+  std::uint32_t slot_idx = 0;
+  if (!AllocateSlot(&cache, &slot_idx)) {
+    texture.page_states[page_idx] = PageState::kNotResident;
+    return false;
+  }
+
+  cache.slots[slot_idx] = PhysicalCache::Slot{texture_id, page_idx, frame_, is_pinned};
+  UploadPage(texture, cache, slot_idx, data);
+
+  texture.page_states[page_idx] = PageState::kResident;
+  texture.page_slots[page_idx] = slot_idx;
+  texture.is_indirection_dirty = true;
+  loaded_page_count_++;
+
+  return true;
+}
+
+void VirtualTextureSystem::ReadFeedback() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // The most recent completed readback is read, the older ones are dropped.
+  std::size_t readback_idx = kFeedbackReadbackCount;
+  for (std::size_t i = 0; i < kFeedbackReadbackCount; i++) {
+    const auto idx = (next_readback_ + i) % kFeedbackReadbackCount;
+    const auto fence = readbacks_[idx].fence;
+    if (fence == nullptr) {
+      continue;
+    }
+
+    const auto status = glClientWaitSync(fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    if (readback_idx != kFeedbackReadbackCount) {
+      glDeleteSync(readbacks_[readback_idx].fence);
+      readbacks_[readback_idx].fence = nullptr;
+    }
+    readback_idx = idx;
+  }
+  if (readback_idx == kFeedbackReadbackCount) {
+    return;
+  }
+
+  auto& readback = readbacks_[readback_idx];
+  glDeleteSync(readback.fence);
+  readback.fence = nullptr;
+
+  const auto texel_count = static_cast<std::size_t>(feedback_size_.x) * feedback_size_.y;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  const auto* feedback = static_cast<const std::uint32_t*>(glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0,
+      static_cast<GLsizeiptr>(texel_count * 2 * sizeof(std::uint32_t)), GL_MAP_READ_BIT));
+  if (feedback == nullptr) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return;
+  }
+
+  feedback_frame_ = frame_;
+  requested_pages_.clear();
+
+  for (std::size_t i = 0; i < texel_count; i++) {
+    const auto material_lod = feedback[i * 2];
+    if (material_lod == kEmptyFeedback) {
+      continue;
+    }
+
+    const auto material_idx = material_lod & 0xFFFF;
+    if (material_idx >= material_textures_.size()) {
+      continue;
+    }
+
+    // Mip level of the texture coordinates in 8.8 fixed point, offset by 32.
+    const auto uv_lod = static_cast<float>(material_lod >> 16) / 256.f - 32.f;
+    const auto packed_uv = feedback[i * 2 + 1];
+    const auto uv = glm::vec2(static_cast<float>(packed_uv & 0xFFFF),
+                              static_cast<float>(packed_uv >> 16)) / 65535.f;
+
+    const auto& material_textures = material_textures_[material_idx];
+    for (const auto texture_id : material_textures) {
+      if (texture_id == kNoVirtualTexture) {
+        continue;
+      }
+
+      const auto& header = textures_[texture_id].header;
+      const auto lod = uv_lod + std::log2(static_cast<float>(
+                                          std::max(header.width, header.height)));
+      const auto level = static_cast<std::uint32_t>(
+          std::clamp(std::floor(lod), 0.f, static_cast<float>(header.level_count - 1)));
+
+      const auto level_size = glm::vec2(std::max(header.width >> level, 1u),
+                                        std::max(header.height >> level, 1u));
+      const auto page = glm::uvec2(uv * level_size /
+                                   static_cast<float>(kVirtualPageContentSize));
+      RequestPage(texture_id, level, page);
+    }
+  }
+
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  RequestPages();
+}
+
+void VirtualTextureSystem::RequestPage(std::int32_t texture_id, std::uint32_t level,
+                                       glm::uvec2 page) noexcept {
+  auto& texture = textures_[texture_id];
+
+  // The ancestors are the fallback of the page until it is loaded.
+  for (; level < texture.header.level_count; level++, page = glm::uvec2(page.x / 2, page.y / 2)) {
+    const auto page_idx = PageIndex(texture, level, page);
+    if (texture.page_used_frames[page_idx] == frame_) {
+      return;
+    }
+
+    texture.page_used_frames[page_idx] = frame_;
+    requested_pages_.push_back(PageRequest{texture_id, page_idx, level});
+  }
+}
+
+void VirtualTextureSystem::RequestPages() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // The coarsest pages first, the finer ones are useless without them.
+  std::sort(requested_pages_.begin(), requested_pages_.end(),
+            [](const PageRequest& lhs, const PageRequest& rhs) {
+              return lhs.level > rhs.level;
+            });
+
+  std::size_t new_job_count = 0;
+  for (const auto& request : requested_pages_) {
+    auto& texture = textures_[request.texture_id];
+    const auto state = texture.page_states[request.page_idx];
+
+    if (state == PageState::kResident) {
+      caches_[texture.cache_idx].slots[texture.page_slots[request.page_idx]]
+          .last_used_frame = frame_;
+      continue;
+    }
+    if (state == PageState::kLoading || loading_pages_.size() >= kMaxPendingPages) {
+      continue;
+    }
+
+    const auto& header = texture.header;
+    loading_pages_.push_back(std::make_unique<PageLoadingJob>(
+        texture.vtex_path, request.texture_id, request.page_idx,
+        sizeof(VirtualTextureHeader) +
+        static_cast<std::uint64_t>(request.page_idx) * header.page_byte_size,
+        header.page_byte_size));
+    texture.page_states[request.page_idx] = PageState::kLoading;
+
+    std::lock_guard lock(mutex_);
+    jobs_.push(loading_pages_.back().get());
+    new_job_count++;
+  }
+
+  if (new_job_count != 0) {
+    jobs_condition_.notify_all();
+  }
+}
+
+void VirtualTextureSystem::UploadLoadedPages() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // The jobs are kept in the request order, the coarsest pages first.
+  std::size_t upload_count = 0;
+  for (auto job = loading_pages_.begin();
+       job != loading_pages_.end() && upload_count < kMaxUploadsPerFrame;) {
+    if (!(*job)->IsDone()) {
+      ++job;
+      continue;
+    }
+
+    const auto texture_id = (*job)->texture_id();
+    const auto page_idx = (*job)->page_idx();
+    if ((*job)->is_loaded()) {
+      if (MakePageResident(texture_id, page_idx, (*job)->data(), false)) {
+        upload_count++;
+      }
+    }
+    else {
+      std::cerr << "Could not read the page " << page_idx << " of "
+                << textures_[texture_id].vtex_path << '\n';
+      textures_[texture_id].page_states[page_idx] = PageState::kNotResident;
+    }
+
+    job = loading_pages_.erase(job);
+  }
+}
+
+void VirtualTextureSystem::UpdateIndirection(VirtualTexture* texture) const noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  const auto& header = texture->header;
+  const auto tail_level = header.level_count - 1;
+
+  // From the tail to the level 0, the missing pages take the entry of their
+  // parent: the position of the finest resident ancestor and its level.
+  std::vector<unsigned char> entries, parent_entries;
+  glm::uvec2 parent_size{};
+
+  glBindTexture(GL_TEXTURE_2D, texture->indirection_id);
+  for (auto level = static_cast<std::int32_t>(tail_level); level >= 0; level--) {
+    const auto ulevel = static_cast<std::uint32_t>(level);
+    const auto size = glm::uvec2(std::max(texture->indirection_size.x >> ulevel, 1u),
+                                  std::max(texture->indirection_size.y >> ulevel, 1u));
+    const auto pages = CalculateVirtualPageCount(header, ulevel);
+    entries.assign(static_cast<std::size_t>(size.x) * size.y * 4, 0);
+
+    for (std::uint32_t y = 0; y < size.y; y++) {
+      for (std::uint32_t x = 0; x < size.x; x++) {
+        unsigned char* entry = &entries[(static_cast<std::size_t>(y) * size.x + x) * 4];
+
+        if (x < pages.x && y < pages.y) {
+          const auto page_idx = PageIndex(*texture, ulevel, glm::uvec2(x, y));
+          if (texture->page_states[page_idx] == PageState::kResident) {
+            const auto slot_idx = texture->page_slots[page_idx];
+            entry[0] = static_cast<unsigned char>(slot_idx % cache_page_count_per_side_);
+            entry[1] = static_cast<unsigned char>(slot_idx / cache_page_count_per_side_);
+            entry[2] = static_cast<unsigned char>(ulevel);
+            entry[3] = 255;
+            continue;
+          }
+        }
+
+        if (ulevel != tail_level) {
+          const auto parent_idx =
+              (static_cast<std::size_t>(y / 2) * parent_size.x + x / 2) * 4;
+          std::memcpy(entry, &parent_entries[parent_idx], 4);
+        }
+      }
+    }
+
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, static_cast<GLsizei>(size.x),
+                    static_cast<GLsizei>(size.y), GL_RGBA, GL_UNSIGNED_BYTE,
+                    entries.data());
+
+    std::swap(entries, parent_entries);
+    parent_size = size;
+  }
+
+  texture->is_indirection_dirty = false;
+}
+
+std::uint32_t VirtualTextureSystem::PageIndex(const VirtualTexture& texture,
+                                              std::uint32_t level,
+                                              glm::uvec2 page) const noexcept {
+  const auto pages = CalculateVirtualPageCount(texture.header, level);
+  page = glm::min(page, pages - glm::uvec2(1));
+  return texture.level_first_pages[level] + page.y * pages.x + page.x;
+}
+
+VirtualTextureTilingJob::VirtualTextureTilingJob(const FileBuffer* cooked_buffer,
+                                                 std::string cooked_path,
+                                                 GLint wrapping_param,
+                                                 std::string vtex_path) noexcept
+    : Job(JobType::kImageFileDecompressing),
+      cooked_buffer_(cooked_buffer),
+      cooked_path_(std::move(cooked_path)),
+      wrapping_param_(wrapping_param),
+      vtex_path_(std::move(vtex_path))
+{
+}
+
+void VirtualTextureTilingJob::Work() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+  ZoneText(vtex_path_.data(), vtex_path_.size());
+#endif  // TRACY_ENABLE
+
+  CookedTexture cooked_texture;
+  FileBuffer whole_file;
+  const bool is_whole_buffer =
+      cooked_buffer_ != nullptr &&
+      cooked_texture.Parse(cooked_buffer_->data, cooked_buffer_->size) &&
+      cooked_texture.is_level_loaded(0);
+
+  if (!is_whole_buffer) {
+    file_utility::LoadFileInBuffer(cooked_path_, &whole_file);
+    if (!cooked_texture.Parse(whole_file.data, whole_file.size)) {
+      std::cerr << "Could not read the cooked texture " << cooked_path_ << '\n';
+      return;
+    }
+  }
+
+  std::vector<unsigned char> vtex_data;
+  if (!TileVirtualTexture(cooked_texture, wrapping_param_, &vtex_data)) {
+    std::cerr << "Could not tile the cooked texture " << cooked_path_ << '\n';
+    return;
+  }
+
+  if (!file_utility::WriteFileBuffer(vtex_path_, vtex_data.data(), vtex_data.size())) {
+    std::cerr << "Could not write the virtual texture " << vtex_path_ << '\n';
+  }
+}
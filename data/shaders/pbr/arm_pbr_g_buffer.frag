@@ -1,5 +1,6 @@
 #version 300 es
 precision highp float;
+precision highp sampler2DArray;
 
 layout (location = 0) out vec4 gViewPositionMetallic;
 layout (location = 1) out vec4 gViewNormalRoughness;
@@ -10,27 +11,43 @@ in vec2 texCoords;
 in mat3 tangentToViewMatrix;
 
 struct Material {
-  sampler2D albedo_map;
-  sampler2D normal_map;
-  sampler2D ao_metallic_roughness_map;
+  sampler2DArray albedo_map;
+  sampler2DArray normal_map;
+  sampler2DArray ao_metallic_roughness_map;
 };
 
 uniform Material material;
 
+// Layer of the albedo, normal, ao_metallic_roughness and emissive maps of each
+// material in their texture array, 64 is MaterialSystem::kMaxMaterialCount.
+layout (std140) uniform MaterialLayers {
+  ivec4 material_layers[64];
+};
+
+uniform int material_index;
+
 void main()
 {    
+    ivec4 layers = material_layers[material_index];
+    vec3 albedoCoords = vec3(texCoords, float(layers.x));
+    vec3 normalCoords = vec3(texCoords, float(layers.y));
+    vec3 armCoords = vec3(texCoords, float(layers.z));
+    vec3 arm = texture(material.ao_metallic_roughness_map, armCoords).rgb;
+
     // Store the fragment position vector in the RGB channels and the
     // metallic in the A channel of the first gbuffer texture.
     gViewPositionMetallic.rgb = fragViewPos;
-    gViewPositionMetallic.a = texture(material.ao_metallic_roughness_map, texCoords).b;
+    gViewPositionMetallic.a = arm.b;
 
     // Store the per-fragment normals and roughness into the gbuffer.
-    vec3 n = texture(material.normal_map, texCoords).rgb;
-    n = n * 2.0 - 1.0; //[0,1] -> [-1,1]
+    // Normal maps are BC5 compressed (two channels), z is reconstructed.
+    vec3 n;
+    n.xy = texture(material.normal_map, normalCoords).rg * 2.0 - 1.0; //[0,1] -> [-1,1]
+    n.z = sqrt(max(1.0 - dot(n.xy, n.xy), 0.0));
     gViewNormalRoughness.rgb = normalize(tangentToViewMatrix * n);
-    gViewNormalRoughness.a = texture(material.ao_metallic_roughness_map, texCoords).g;
+    gViewNormalRoughness.a = arm.g;
 
     // Store the base color and the ambient occlusion per-fragment.
-    gAlbedoAmbientOcclusion.rgb = texture(material.albedo_map, texCoords).rgb;
-    gAlbedoAmbientOcclusion.a = texture(material.ao_metallic_roughness_map, texCoords).r;
+    gAlbedoAmbientOcclusion.rgb = texture(material.albedo_map, albedoCoords).rgb;
+    gAlbedoAmbientOcclusion.a = arm.r;
 }
\ No newline at end of file
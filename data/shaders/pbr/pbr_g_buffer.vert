@@ -2,9 +2,11 @@
 precision highp float;
 
 layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
+// Octahedral encoded normal.
+layout(location = 1) in vec2 aNormal;
 layout(location = 2) in vec2 aTexCoords;
-layout(location = 3) in vec3 aTangent;
+// Octahedral encoded tangent in xy and sign of the bitangent in z.
+layout(location = 3) in vec4 aTangent;
 
 out vec3 fragViewPos;
 out vec2 texCoords;
@@ -22,12 +24,21 @@ struct Transform{
 uniform Transform transform;
 uniform mat4 viewNormalMatrix;
 
+// Inverse of the octahedral encoding of the packed vertices.
+vec3 DecodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 void main() {
     mat3 viewNormalMatrix = mat3(viewNormalMatrix);
-    vec3 T = normalize(viewNormalMatrix * normalize(aTangent));
-    vec3 N = normalize(viewNormalMatrix * normalize(aNormal));
+    vec3 T = normalize(viewNormalMatrix * DecodeOctahedral(aTangent.xy));
+    vec3 N = normalize(viewNormalMatrix * DecodeOctahedral(aNormal));
     T = normalize(T - dot(T, N) * N); //reorthogonalize the tangent
-    vec3 B = normalize(cross(N, T));
+    vec3 B = normalize(cross(N, T)) * sign(aTangent.z);
 
     tangentToViewMatrix = mat3(T, B, N); // Don't inverse the TBN matrix.
 
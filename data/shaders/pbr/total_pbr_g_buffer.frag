@@ -29,8 +29,10 @@ void main()
     gViewPosition = fragViewPos;
 
     // Store the per-fragment normals and roughness into the gbuffer.
-    vec3 n = texture(material.normal_map, texCoords).rgb;
-    n = n * 2.0 - 1.0; //[0,1] -> [-1,1]
+    // Normal maps are BC5 compressed (two channels), z is reconstructed.
+    vec3 n;
+    n.xy = texture(material.normal_map, texCoords).rg * 2.0 - 1.0; //[0,1] -> [-1,1]
+    n.z = sqrt(max(1.0 - dot(n.xy, n.xy), 0.0));
     gViewNormal = normalize(tangentToViewMatrix * n);
 
     gAlbedo = texture(material.albedo_map, texCoords).rgb;
@@ -0,0 +1,26 @@
+#version 300 es
+precision highp float;
+precision highp int;
+
+// Read back by the VirtualTextureSystem: the material and the mip level of the
+// texture coordinates in R, the texture coordinates in G.
+layout (location = 0) out uvec2 feedback;
+
+in vec2 texCoords;
+
+uniform int material_index;
+// log2 of the ratio between the screen and the feedback resolutions, negative.
+uniform float feedback_lod_bias;
+
+void main()
+{
+    vec2 dx = dFdx(texCoords);
+    vec2 dy = dFdy(texCoords);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-20)) + feedback_lod_bias;
+
+    // 8.8 fixed point offset by 32, the texture coordinates on 16 bits.
+    uint packed_lod = uint(clamp((lod + 32.0) * 256.0, 0.0, 65535.0));
+    vec2 uv = fract(texCoords);
+    feedback = uvec2(uint(material_index) | (packed_lod << 16),
+                     uint(uv.x * 65535.0) | (uint(uv.y * 65535.0) << 16));
+}
\ No newline at end of file
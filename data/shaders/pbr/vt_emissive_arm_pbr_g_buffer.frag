@@ -0,0 +1,93 @@
+#version 300 es
+precision highp float;
+precision highp int;
+precision highp sampler2D;
+
+layout (location = 0) out vec4 gViewPositionMetallic;
+layout (location = 1) out vec4 gViewNormalRoughness;
+layout (location = 2) out vec4 gAlbedoAmbientOcclusion;
+layout (location = 3) out vec3 gEmissive;
+
+in vec3 fragViewPos;
+in vec2 texCoords;
+in mat3 tangentToViewMatrix;
+
+// Physical caches of the maps, they hold the resident pages of the virtual
+// textures of their format.
+struct Material {
+  sampler2D albedo_map;
+  sampler2D normal_map;
+  sampler2D ao_metallic_roughness_map;
+  sampler2D emissive_map;
+};
+
+uniform Material material;
+
+// Indirection of the virtual texture of each map: position of the page in the
+// physical cache, or of its finest resident ancestor, and its level.
+uniform sampler2D indirection_maps[4];
+// Width, height, last paged level and 1 if the texture is repeated, per map.
+uniform vec4 virtual_textures[4];
+// Size of the physical caches in texels.
+uniform float virtual_cache_size;
+
+// VirtualTextureSystem pages: 128 texels with a border of 4 texels.
+const float kPageSize = 128.0;
+const float kPageBorder = 4.0;
+const float kPageContentSize = 120.0;
+
+vec4 SampleVirtualLevel(sampler2D cache, sampler2D indirection, vec4 virtual_texture,
+                        vec2 uv, float level) {
+  ivec2 page = ivec2(uv * virtual_texture.xy / (exp2(level) * kPageContentSize));
+  page = min(page, textureSize(indirection, int(level)) - 1);
+  vec3 entry = floor(texelFetch(indirection, page, int(level)).xyz * 255.0 + 0.5);
+
+  // The entry can point to a coarser ancestor of the page.
+  vec2 level_texel = uv * virtual_texture.xy / exp2(entry.z);
+  vec2 page_texel = level_texel - floor(level_texel / kPageContentSize) * kPageContentSize;
+  vec2 cache_texel = entry.xy * kPageSize + kPageBorder + page_texel;
+  return textureLod(cache, cache_texel / virtual_cache_size, 0.0);
+}
+
+// Trilinear sampling of a virtual texture, the pages are filtered bilinearly.
+vec4 SampleVirtualTexture(sampler2D cache, sampler2D indirection, vec4 virtual_texture) {
+  vec2 dx = dFdx(texCoords * virtual_texture.xy);
+  vec2 dy = dFdy(texCoords * virtual_texture.xy);
+  float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, virtual_texture.z);
+  float level = floor(lod);
+
+  vec2 uv = virtual_texture.w > 0.5 ? fract(texCoords) : clamp(texCoords, 0.0, 1.0);
+  vec4 fine = SampleVirtualLevel(cache, indirection, virtual_texture, uv, level);
+  vec4 coarse = SampleVirtualLevel(cache, indirection, virtual_texture, uv,
+                                   min(level + 1.0, virtual_texture.z));
+  return mix(fine, coarse, lod - level);
+}
+
+void main()
+{    
+    vec3 arm = SampleVirtualTexture(material.ao_metallic_roughness_map,
+                                    indirection_maps[2], virtual_textures[2]).rgb;
+
+    // Store the fragment position vector in the RGB channels and the
+    // metallic in the A channel of the first gbuffer texture.
+    gViewPositionMetallic.rgb = fragViewPos;
+    gViewPositionMetallic.a = arm.b;
+
+    // Store the per-fragment normals and roughness into the gbuffer.
+    // Normal maps are BC5 compressed (two channels), z is reconstructed.
+    vec3 n;
+    n.xy = SampleVirtualTexture(material.normal_map, indirection_maps[1],
+                                virtual_textures[1]).rg * 2.0 - 1.0; //[0,1] -> [-1,1]
+    n.z = sqrt(max(1.0 - dot(n.xy, n.xy), 0.0));
+    gViewNormalRoughness.rgb = normalize(tangentToViewMatrix * n);
+    gViewNormalRoughness.a = arm.g;
+
+    // Store the base color and the ambient occlusion per-fragment.
+    gAlbedoAmbientOcclusion.rgb = SampleVirtualTexture(material.albedo_map,
+        indirection_maps[0], virtual_textures[0]).rgb;
+    gAlbedoAmbientOcclusion.a = arm.r;
+
+    // Store the emssive color.
+    gEmissive.rgb = SampleVirtualTexture(material.emissive_map, indirection_maps[3],
+                                         virtual_textures[3]).rgb;
+}
\ No newline at end of file
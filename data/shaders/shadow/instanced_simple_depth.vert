@@ -2,8 +2,8 @@
 precision highp float;
 
 layout (location = 0) in vec3 aPos;
-// location 1 to 4 are already taken by other vertex inputs.
-layout (location = 5) in mat4 aModelMatrix;
+// location 1 to 3 are already taken by other vertex inputs.
+layout (location = 4) in mat4 aModelMatrix;
 
 out vec3 fragPos; // for point shadow mapping.
 
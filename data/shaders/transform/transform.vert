@@ -2,7 +2,8 @@
 precision highp float;
 
 layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
+// Octahedral encoded normal.
+layout(location = 1) in vec2 aNormal;
 layout(location = 2) in vec2 aTexCoords;
 
 out vec3 fragPos;
@@ -18,10 +19,19 @@ struct Transform{
 uniform Transform transform;
 uniform mat4 normalMatrix;
 
+// Inverse of the octahedral encoding of the packed vertices.
+vec3 DecodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 void main() {
     vec4 worldPos = transform.model * vec4(aPos, 1.0);
     gl_Position = transform.projection * transform.view * worldPos;
     fragPos = vec3(worldPos);
-    normal = mat3(normalMatrix) * aNormal;
+    normal = mat3(normalMatrix) * DecodeOctahedral(aNormal);
     texCoords = aTexCoords;
 }
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "scene.h"
+#include "gpu_upload_thread.h"
+
+#include <vector>
 
 class Engine {
  public:
@@ -14,12 +17,29 @@ class Engine {
     clear_color_ = new_clear_color;
   }
 
+  // Loading threads upload the resources with their own shared context,
+  // instead of the main thread.
+  static constexpr bool kUseSharedGlContexts = true;
+
+  // Creates a context sharing its objects with the render context, on its own
+  // hidden window, it must be called by the main thread. Returns false if it is
+  // disabled or failed.
+  static bool CreateSharedGlContext(SharedGlContext* shared_context) noexcept;
+
  private:
+  // A context can't be current on two threads through the same window with
+  // EGL or on macOS, each shared context has its own 1x1 window.
+  struct SharedGlSurface {
+    SDL_Window* window = nullptr;
+    SDL_GLContext context = nullptr;
+  };
+
   void Begin();
   void End();
   Scene* scene_ = nullptr;
-  SDL_Window* window_ = nullptr;
+  inline static SDL_Window* window_ = nullptr;
   inline static glm::vec2 window_size_ = glm::vec2(1280, 720);
   inline static glm::vec3 clear_color_ = glm::vec3(0);
-  SDL_GLContext glRenderContext_{};
+  inline static SDL_GLContext glRenderContext_{};
+  inline static std::vector<SharedGlSurface> shared_gl_contexts_{};
 };
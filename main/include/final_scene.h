@@ -8,6 +8,12 @@
 #include "frame_buffer_object.h"
 #include "bloom_frame_buffer_object.h"
 #include "job_system.h"
+#include "cooked_texture.h"
+#include "channel_packing.h"
+#include "texture_streamer.h"
+#include "gpu_upload_thread.h"
+#include "texture_registry.h"
+#include "virtual_texture.h"
 
 #include <array>
 
@@ -15,6 +21,7 @@ enum class GeometryPipelineType {
   kGeometry, 
   kShadowMapping, 
   kPointShadowMapping,
+  kVirtualTextureFeedback,
 };
 
 struct PointLight {
@@ -31,14 +38,16 @@ struct PointLight {
 
 // Main thread's jobs.
 // These jobs are dependent of the OpenGL context so they have
-// to be executed by the main thread.
+// to be executed by the main thread, or by the GPU upload thread
+// (kGpuUpload type) when a shared context exists.
 // ----------------------------------
 class PipelineCreationJob final : public Job {
  public:
    PipelineCreationJob() noexcept = default;
    PipelineCreationJob(FileBuffer* v_shader_buff,
                        FileBuffer* f_shader_buff,
-                       Pipeline* pipeline);
+                       Pipeline* pipeline,
+                       JobType job_type = JobType::kMainThread);
    PipelineCreationJob(PipelineCreationJob&& other) noexcept = default;
    PipelineCreationJob& operator=(PipelineCreationJob&& other) noexcept = default;
    PipelineCreationJob(const PipelineCreationJob& other) noexcept =
@@ -61,7 +70,8 @@ class LoadTextureToGpuJob final : public Job {
   LoadTextureToGpuJob() noexcept = default;
   LoadTextureToGpuJob(ImageBuffer* image_buffer,
                       GLuint* texture_id,
-                      const TextureParameters& tex_param) noexcept;
+                      const TextureParameters& tex_param,
+                      JobType job_type = JobType::kMainThread) noexcept;
   LoadTextureToGpuJob(LoadTextureToGpuJob&& other) noexcept = default;
   LoadTextureToGpuJob& operator=(LoadTextureToGpuJob&& other) noexcept = default;
   LoadTextureToGpuJob(const LoadTextureToGpuJob& other) noexcept = delete;
@@ -124,7 +134,7 @@ class ModelCreationJob final : public Job {
 public:
   ModelCreationJob() noexcept = default;
   ModelCreationJob(Model* model, std::string_view file_path, bool gamma,
-                 bool flip_y) noexcept;
+                 bool flip_y, ModelImporter importer) noexcept;
   ModelCreationJob(ModelCreationJob&& other) noexcept = default;
   ModelCreationJob& operator=(ModelCreationJob&& other) noexcept = default;
   ModelCreationJob(const ModelCreationJob& other) noexcept = delete;
@@ -138,12 +148,13 @@ private:
   std::string file_path_{};
   bool gamma_ = false;
   bool flip_y_ = false;
+  ModelImporter importer_ = ModelImporter::kObjParser;
 };
 
 class LoadModelToGpuJob final : public Job {
  public:
   LoadModelToGpuJob() = default;
-  LoadModelToGpuJob(Model* model) noexcept;
+  LoadModelToGpuJob(Model* model, GeometryArena* arena, JobType job_type) noexcept;
   LoadModelToGpuJob(LoadModelToGpuJob&& other) noexcept = default;
   LoadModelToGpuJob& operator=(LoadModelToGpuJob&& other) noexcept = default;
   LoadModelToGpuJob(const LoadModelToGpuJob& other) noexcept = delete;
@@ -155,6 +166,7 @@ class LoadModelToGpuJob final : public Job {
 
  private:
   Model* model_ = nullptr;
+  GeometryArena* arena_ = nullptr;
 };
 
 class FinalScene final : public Scene {
@@ -166,9 +178,35 @@ public:
   void OnEvent(const SDL_Event& event) override;
   void DrawImGui() override;
 
+  /*
+  * @brief Prints the times of Assimp and of the OBJ parser on the models of the
+  * scene and the differences between their meshes, see Model::BenchmarkImporters.
+  */
+  static void BenchmarkModelImporters(int repeat_count);
+
 private:
+  // Importer of the models when their cooked meshes are missing or out of date.
+  static constexpr ModelImporter kModelImporter = ModelImporter::kObjParser;
+
   Renderer renderer_{};
 
+  // The levels of detail are selected per view, the shadow maps see the meshes
+  // from other distances than the camera.
+  LodSelector lod_selector_{};
+  static constexpr std::uint32_t kCameraLodView = 0;
+  static constexpr std::uint32_t kDirectionalShadowLodView = 1;
+  static constexpr std::uint32_t kPointShadowLodView = 2;
+  // Culls the meshlets of the models in the camera passes.
+  MeshletCuller meshlet_culler_{};
+
+  // The vertices and indices of the models, their shadows are drawn with one
+  // indirect draw per list. Leo Magnus is drawn without face culling.
+  GeometryArena geometry_arena_{};
+  GeometryDrawList shadow_draw_list_{};
+  GeometryDrawList double_sided_shadow_draw_list_{};
+  GeometryDrawList point_shadow_draw_list_{};
+  GeometryDrawList double_sided_point_shadow_draw_list_{};
+
   Camera camera_{};
   Frustum camera_frustum_{};
 
@@ -177,6 +215,17 @@ private:
   glm::mat4 projection_ = glm::mat4(1.0f);
 
   JobSystem job_system_{};
+  TextureStreamer texture_streamer_{};
+  // The cooked textures are only made resident the first time a mesh using
+  // them passes the frustum culling, they are read from their header before.
+  static constexpr bool kLazyTextureResidency = true;
+  // The textures of the models are sampled through virtual textures instead
+  // of the streamed texture arrays, the instanced spheres keep the arrays.
+  static constexpr bool kUseVirtualTexturing = false;
+  VirtualTextureSystem virtual_texture_system_{};
+  GpuUploadThread gpu_upload_thread_{};
+  // kGpuUpload if the uploads are done by the GPU upload thread.
+  JobType gpu_job_type_ = JobType::kMainThread;
 
   // Main thread's jobs.
   // -------------------
@@ -185,17 +234,21 @@ private:
   FunctionExecutionJob load_meshes_to_gpu_job_{};
   LoadTextureToGpuJob load_hdr_map_to_gpu_{};
   FunctionExecutionJob init_ibl_maps_job_{};
+  FunctionExecutionJob replace_ibl_maps_job_{};
   LoadModelToGpuJob load_leo_to_gpu_{};
   LoadModelToGpuJob load_sword_to_gpu_{};
   LoadModelToGpuJob load_platform_to_gpu_{};
   LoadModelToGpuJob load_chest_to_gpu_{};
+  FunctionExecutionJob update_geometry_arena_job_{};
   FunctionExecutionJob set_pipe_tex_units_job_{};
   FunctionExecutionJob create_ssao_data_job_{};
   FunctionExecutionJob apply_shadow_mapping_job_{};
   FunctionExecutionJob init_opengl_settings_job_{};
 
   std::queue<Job*> main_thread_jobs_{};
-  std::vector<LoadTextureToGpuJob> load_tex_to_gpu_jobs_{};
+  FunctionExecutionJob create_material_arrays_job_{};
+  FunctionExecutionJob download_ibl_maps_job_{};
+  FunctionExecutionJob upload_ibl_maps_job_{};
   std::vector<PipelineCreationJob> pipeline_creation_jobs_{};
 
   // Other thread's jobs.
@@ -208,8 +261,14 @@ private:
   ModelCreationJob platform_creation_job_{};
   ModelCreationJob chest_creation_job_{};
 
+  FunctionExecutionJob compress_ibl_maps_job_{};
+
   std::vector<LoadFileFromDiskJob> img_file_loading_jobs_{};
+  std::vector<CookedMipTailLoadingJob> mip_tail_loading_jobs_{};
   std::vector<ImageFileDecompressingJob> img_decompressing_jobs_{};
+  std::vector<ChannelPackingJob> channel_packing_jobs_{};
+  std::vector<TextureCookingJob> tex_cooking_jobs_{};
+  std::vector<VirtualTextureTilingJob> virtual_texture_tiling_jobs_{};
   std::vector<LoadFileFromDiskJob> shader_file_loading_jobs_{};
 
   // IBL textures creation pipelines.
@@ -221,14 +280,14 @@ private:
 
   // Geometry pipelines.
   // -------------------
-  Pipeline geometry_pipeline_;
   Pipeline instanced_geometry_pipeline_;
   Pipeline arm_geometry_pipe_;
   Pipeline emissive_arm_geometry_pipe_;
+  Pipeline vt_arm_geometry_pipe_;
+  Pipeline vt_emissive_arm_geometry_pipe_;
+  Pipeline vt_feedback_pipe_;
   Pipeline ssao_pipeline_;
   Pipeline ssao_blur_pipeline_;
-  Pipeline shadow_mapping_pipe_;
-  Pipeline point_shadow_mapping_pipe_;
   Pipeline instanced_shadow_mapping_pipe_;
   Pipeline point_instanced_shadow_mapping_pipe_;
 
@@ -260,12 +319,13 @@ private:
 
   // Materials.
   // ----------
-  Material gold_mat_;
-  Material sandstone_platform_mat_;
-
-  std::vector<GLuint> leo_magnus_textures_{};
-  std::vector<GLuint> sword_textures_{};
-  std::vector<GLuint> treasure_chest_textures_{};
+  MaterialSystem material_system_{};
+  std::size_t gold_material_ = 0;
+  std::size_t sandstone_platform_material_ = 0;
+  std::size_t treasure_chest_material_ = 0;
+  // One material per mesh.
+  std::size_t leo_magnus_first_material_ = 0;
+  std::size_t sword_material_ = 0;
 
   // Frame buffers.
   // --------------
@@ -281,9 +341,12 @@ private:
 
   // IBL textures data.
   // ------------------
-  static constexpr std::uint16_t kSkyboxResolution = 4096;
+  // Memory budget of the BC6H environment cubemap and its mip chain, its face
+  // resolution is derived from it and from the equirectangular map width.
+  static constexpr std::size_t kEnvironmentMapMemoryBudget = 16 * 1024 * 1024;
   static constexpr std::uint8_t kIrradianceMapResolution = 32;
   static constexpr std::uint8_t kPrefilterMapResolution = 128;
+  static constexpr std::uint8_t kPrefilterMapLevelCount = 5;
   static constexpr std::uint16_t kBrdfLutResolution = 512;
 
   GLuint equirectangular_map_;
@@ -291,6 +354,11 @@ private:
   GLuint irradiance_cubemap_;
   GLuint prefilter_cubemap_;
   GLuint brdf_lut_;
+  GLsizei env_cubemap_resolution_ = 0;
+  // The environment and prefilter cubemaps are compressed to BC6H after the
+  // convolutions, the uncompressed ones are used until then.
+  Bc6hCubeMapCompressor env_cubemap_compressor_{};
+  Bc6hCubeMapCompressor prefilter_cubemap_compressor_{};
 
   // Capture matrices for pre-computing IBL textures.
   // ------------------------------------------------
@@ -378,7 +446,10 @@ private:
   static constexpr float kSpacing_ = 2.5f;
 
   std::vector<glm::mat4> sphere_model_matrices_{};
-  std::vector<glm::mat4> visible_sphere_model_matrices_{};
+  // Model matrices of the drawn spheres sorted by level of detail, each level is
+  // drawn by one instanced draw call from its offset.
+  std::vector<glm::mat4> lod_sorted_sphere_model_matrices_{};
+  std::vector<std::uint32_t> sphere_lods_{};
 
   // Lights variables.
   // -----------------
@@ -397,6 +468,7 @@ private:
   // --------------
   void CreatePipelineCreationJobs() noexcept;
   void SetPipelineSamplerTexUnits() noexcept;
+  void AddGpuJob(Job* job) noexcept;
 
   void CreateMeshes() noexcept;
   void LoadMeshesToGpu() noexcept;
@@ -404,6 +476,7 @@ private:
   //void CreateModels() noexcept;
   //void LoadModelsToGpu() noexcept;
   void CreateMaterialsCreationJobs() noexcept;
+  void CreateMaterialArrays() noexcept;
 
   void CreateFrameBuffers() noexcept;
 
@@ -414,10 +487,15 @@ private:
   void CreateIrradianceCubeMap() noexcept;
   void CreatePrefilterCubeMap() noexcept;
   void CreateBrdfLut() noexcept;
+  void CreateIblCompressionJobs() noexcept;
+  void ReadBackIblCubeMaps() noexcept;
+  void ReplaceIblCubeMaps() noexcept;
 
   // Render passes.
   // --------------
   void ApplyGeometryPass() noexcept;
+  // Draws the models in the feedback buffer of the virtual texture system.
+  void ApplyVirtualTextureFeedbackPass() noexcept;
   void ApplySsaoPass() noexcept;
   void ApplyShadowMappingPass() noexcept;
   void ApplyDeferredPbrLightingPass() noexcept;
@@ -425,8 +503,25 @@ private:
   void ApplyBloomPass() noexcept;
   void ApplyHdrPass() noexcept;
 
+  /*
+  * @brief Draws the models in the camera passes. The shadow passes only queue
+  * them in their draw lists, drawn by DrawShadowCasters.
+  */
   void DrawObjectGeometry(GeometryPipelineType geometry_type) noexcept;
+  void QueueShadowCaster(const Model& model, const glm::mat4& model_matrix,
+                         GeometryDrawList* draw_list);
+  void DrawShadowCasters(const GeometryDrawList& draw_list,
+                         const GeometryDrawList& double_sided_draw_list) noexcept;
+  // Feeds the texture streamer with the size on screen of a visible mesh.
+  void RequestTexturesScreenSize(std::int8_t first_texture_idx,
+                                 std::size_t texture_count,
+                                 const BoundingSphere& bounding_sphere,
+                                 const glm::mat4& model) noexcept;
   void DrawInstancedObjectGeometry(GeometryPipelineType geometry_type) noexcept;
+  // The gold textures, the first ones, stay in the arrays for the spheres.
+  [[nodiscard]] static constexpr bool UsesVirtualTexture(std::size_t texture_idx) noexcept {
+    return kUseVirtualTexturing && texture_idx >= gold_textures_idx_ + 3;
+  }
 
   // End methods.
   // ------------
@@ -455,21 +550,21 @@ private:
       "data/shaders/pbr/brdf.vert",
       "data/shaders/pbr/brdf.frag",
       "data/shaders/pbr/pbr_g_buffer.vert",
-      "data/shaders/pbr/pbr_g_buffer.frag",
-      "data/shaders/pbr/pbr_g_buffer.vert",
       "data/shaders/pbr/arm_pbr_g_buffer.frag",
       "data/shaders/pbr/pbr_g_buffer.vert",
       "data/shaders/pbr/emissive_arm_pbr_g_buffer.frag",
       "data/shaders/pbr/instanced_pbr_g_buffer.vert",
-      "data/shaders/pbr/pbr_g_buffer.frag",
+      "data/shaders/pbr/arm_pbr_g_buffer.frag",
+      "data/shaders/pbr/pbr_g_buffer.vert",
+      "data/shaders/pbr/vt_arm_pbr_g_buffer.frag",
+      "data/shaders/pbr/pbr_g_buffer.vert",
+      "data/shaders/pbr/vt_emissive_arm_pbr_g_buffer.frag",
+      "data/shaders/pbr/pbr_g_buffer.vert",
+      "data/shaders/pbr/virtual_texture_feedback.frag",
       "data/shaders/transform/screen_transform.vert",
       "data/shaders/ssao/ssao.frag",
       "data/shaders/transform/screen_transform.vert",
       "data/shaders/ssao/ssao_blur.frag",
-      "data/shaders/shadow/simple_depth.vert",
-      "data/shaders/shadow/simple_depth.frag",
-      "data/shaders/shadow/simple_depth.vert",
-      "data/shaders/shadow/point_light_simple_depth.frag",
       "data/shaders/shadow/instanced_simple_depth.vert",
       "data/shaders/shadow/simple_depth.frag",
       "data/shaders/shadow/instanced_simple_depth.vert",
@@ -490,9 +585,43 @@ private:
   std::array<Pipeline*, pipeline_count_> pipelines_{};
   std::array<FileBuffer, shader_count_> shader_file_buffers_{};
 
-  static constexpr std::int8_t texture_count_ = 37;
+  static constexpr std::int8_t texture_count_ = 33;
+  // Index of the first texture of each object in the texture arrays.
+  static constexpr std::int8_t gold_textures_idx_ = 0;
+  static constexpr std::int8_t leo_magnus_textures_idx_ = 3;
+  static constexpr std::int8_t leo_magnus_mesh_count_ = 5;
+  static constexpr std::int8_t sword_textures_idx_ = 23;
+  static constexpr std::int8_t sandstone_platform_textures_idx_ = 27;
+  static constexpr std::int8_t treasure_chest_textures_idx_ = 30;
   std::array<FileBuffer, texture_count_> image_file_buffers_{};
   std::array<ImageBuffer, texture_count_> image_buffers{};
+
+  // ARM textures packed from separate occlusion, roughness and metallic maps
+  // before being cooked.
+  struct PackedTextureSources {
+    std::int8_t texture_idx;
+    std::array<std::string_view, kArmChannelCount> channel_paths;
+  };
+  static constexpr std::int8_t packed_texture_count_ = 2;
+  static constexpr std::array<PackedTextureSources, packed_texture_count_>
+      packed_texture_sources_{{
+    {2, {"data/textures/pbr/gold/ao.png",
+         "data/textures/pbr/gold/gold-scuffed_roughness.png",
+         "data/textures/pbr/gold/gold-scuffed_metallic.png"}},
+    {29, {"data/models/sandstone_platform/sandstone-platform1-ao.png",
+          "data/models/sandstone_platform/sandstone-platform1-roughness.png",
+          "data/models/sandstone_platform/sandstone-platform1-metallic.png"}},
+  }};
+  std::array<std::array<FileBuffer, kArmChannelCount>, packed_texture_count_>
+      channel_file_buffers_{};
+  std::array<std::array<ImageBuffer, kArmChannelCount>, packed_texture_count_>
+      channel_image_buffers_{};
+
+  std::array<FileBuffer, texture_count_> cooked_texture_buffers_{};
   std::array<TextureParameters, texture_count_> texture_inputs_{};
-  std::array<GLuint*, texture_count_> texture_ids_{};
+  // The textures sharing the content and parameters of a previous one only
+  // hold a handle on it, and use its layer and stream slot. The layers belong
+  // to the material system, the registry entries have no GPU object.
+  std::array<TextureHandle, texture_count_> texture_handles_{};
+  std::array<std::size_t, texture_count_> texture_stream_slots_{};
 };
\ No newline at end of file
@@ -2,11 +2,19 @@
 #include "final_scene.h"
 
 #include <iostream>
+#include <string_view>
+
+int main(int argc, char** argv) {
+  // Compares the model importers instead of running the scene.
+  if (argc > 1 && std::string_view(argv[1]) == "--benchmark-importers") {
+    constexpr int kRepeatCount = 5;
+    FinalScene::BenchmarkModelImporters(kRepeatCount);
+    return EXIT_SUCCESS;
+  }
 
-int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
   FinalScene scene;
   Engine engine(&scene);
   engine.Run();
 
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
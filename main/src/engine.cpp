@@ -13,6 +13,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <iostream>
 
 Engine::Engine(Scene* scene) { scene_ = scene; }
 
@@ -130,12 +131,60 @@ void Engine::Begin() {
   scene_->Begin();
 }
 
+bool Engine::CreateSharedGlContext(SharedGlContext* shared_context) noexcept {
+  if (!kUseSharedGlContexts) {
+    return false;
+  }
+
+  SDL_Window* window = SDL_CreateWindow("Shared OpenGL context", SDL_WINDOWPOS_UNDEFINED,
+                                        SDL_WINDOWPOS_UNDEFINED, 1, 1,
+                                        SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  if (window == nullptr) {
+    std::cerr << "Could not create the window of a shared OpenGL context: "
+              << SDL_GetError() << '\n';
+    return false;
+  }
+
+  // The new context is made current by its creation.
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+  SDL_GLContext context = SDL_GL_CreateContext(window);
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+  if (SDL_GL_MakeCurrent(window_, glRenderContext_) != 0) {
+    std::cerr << "Could not make the render context current again: " << SDL_GetError()
+              << '\n';
+  }
+
+  if (context == nullptr) {
+    std::cerr << "Could not create a shared OpenGL context: " << SDL_GetError() << '\n';
+    SDL_DestroyWindow(window);
+    return false;
+  }
+
+  shared_gl_contexts_.push_back(SharedGlSurface{window, context});
+
+  shared_context->make_current = [window, context]() {
+    if (SDL_GL_MakeCurrent(window, context) != 0) {
+      std::cerr << "Could not make a shared OpenGL context current: " << SDL_GetError()
+                << '\n';
+      return false;
+    }
+    return true;
+  };
+  shared_context->release = [window]() { SDL_GL_MakeCurrent(window, nullptr); };
+  return true;
+}
+
 void Engine::End() {
   scene_->End();
 
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplSDL2_Shutdown();
   ImGui::DestroyContext();
+  for (auto& shared_context : shared_gl_contexts_) {
+    SDL_GL_DeleteContext(shared_context.context);
+    SDL_DestroyWindow(shared_context.window);
+  }
+  shared_gl_contexts_.clear();
   SDL_GL_DeleteContext(glRenderContext_);
   SDL_DestroyWindow(window_);
   SDL_Quit();
@@ -1,6 +1,9 @@
 #include "final_scene.h"
 #include "engine.h"
 #include "file_utility.h"
+#include "gpu_memory.h"
+#include "mip_generator.h"
+#include "sampler.h"
 
 #include <imgui.h>
 
@@ -9,14 +12,49 @@
 #include <Tracy.hpp>
 #endif  // TRACY_ENABLE
 
+#include <algorithm>
 #include <iostream>
 #include <random>
 
+namespace {
+
+struct ModelFile {
+  std::string_view path;
+  bool gamma;
+  bool flip_y;
+};
+
+constexpr ModelFile kLeoMagnusFile{"data/models/leo_magnus/leo_magnus.obj", true, false};
+constexpr ModelFile kSwordFile{"data/models/leo_magnus/sword.obj", true, false};
+constexpr ModelFile kPlatformFile{"data/models/sandstone_platform/sandstone-platform1.obj",
+                                  true, false};
+constexpr ModelFile kChestFile{"data/models/treasure_chest/treasure_chest_2k.obj", true,
+                               true};
+
+ModelCreationJob MakeModelCreationJob(Model* model, const ModelFile& file,
+                                      ModelImporter importer) noexcept {
+  return ModelCreationJob(model, file.path, file.gamma, file.flip_y, importer);
+}
+
+}  // namespace
+
 void FinalScene::Begin() {
 #ifdef TRACY_ENABLE
   ZoneScoped;
 #endif  // TRACY_ENABLE
 
+  renderer_.set_lod_selector(&lod_selector_);
+  renderer_.set_meshlet_culler(&meshlet_culler_);
+
+  // Shared contexts, one for the loading uploads and one for the streaming.
+  // ----------------------------------------------------------------------
+  SharedGlContext upload_context, streaming_context;
+  if (Engine::CreateSharedGlContext(&upload_context) &&
+      Engine::CreateSharedGlContext(&streaming_context) &&
+      gpu_upload_thread_.Start(std::move(upload_context))) {
+    gpu_job_type_ = JobType::kGpuUpload;
+  }
+
   // Framebuffer job.
   // ----------------
   // TODO mettre tous les jobs dans le .h
@@ -52,12 +90,15 @@ void FinalScene::Begin() {
       LoadFileFromDiskJob{hdr_map_params.image_file_path, &hdr_file_buffer_,
                                    JobType::kImageFileLoading};
 
+  // The equirectangular map is only sampled at its first level, its texels are
+  // packed in 4 bytes instead of 12.
   decomp_hdr_map_ = ImageFileDecompressingJob{&hdr_file_buffer_, &hdr_image_buffer_,
-                                hdr_map_params.flipped_y, hdr_map_params.hdr};
+                                hdr_map_params.flipped_y, hdr_map_params.hdr,
+                                HdrPixelFormat::kRgb9E5};
   decomp_hdr_map_.AddDependency(&load_hdr_map_);
 
   load_hdr_map_to_gpu_ = LoadTextureToGpuJob{&hdr_image_buffer_, &equirectangular_map_,
-                                          hdr_map_params};
+                                          hdr_map_params, gpu_job_type_};
   load_hdr_map_to_gpu_.AddDependency(&decomp_hdr_map_);
 
   job_system_.AddJob(&load_hdr_map_);
@@ -65,6 +106,9 @@ void FinalScene::Begin() {
 
   set_pipe_tex_units_job_ = FunctionExecutionJob(
       [this]() { SetPipelineSamplerTexUnits(); }, JobType::kMainThread);
+  for (const auto& pipeline_creation_job : pipeline_creation_jobs_) {
+    set_pipe_tex_units_job_.AddDependency(&pipeline_creation_job);
+  }
   main_thread_jobs_.push(&set_pipe_tex_units_job_);
   create_ssao_data_job_ = FunctionExecutionJob([this]() { CreateSsaoData(); },
                                                JobType::kMainThread);
@@ -72,37 +116,44 @@ void FinalScene::Begin() {
 
     // Models initialization jobs.
   // ---------------------------
-  leo_creation_job_ = ModelCreationJob(
-      &leo_magnus_, "data/models/leo_magnus/leo_magnus.obj", true, false);
-  sword_creation_job_ = ModelCreationJob(
-      &sword_, "data/models/leo_magnus/sword.obj", true, false);
-  platform_creation_job_ = ModelCreationJob(
-      &sandstone_platform_,
-      "data/models/sandstone_platform/sandstone-platform1.obj", true, false);
-  chest_creation_job_ = ModelCreationJob(
-      &treasure_chest_, "data/models/treasure_chest/treasure_chest_2k.obj",
-      true, true);
-
-  load_leo_to_gpu_ = LoadModelToGpuJob(&leo_magnus_);
+  leo_creation_job_ = MakeModelCreationJob(&leo_magnus_, kLeoMagnusFile, kModelImporter);
+  sword_creation_job_ = MakeModelCreationJob(&sword_, kSwordFile, kModelImporter);
+  platform_creation_job_ = MakeModelCreationJob(&sandstone_platform_, kPlatformFile,
+                                                kModelImporter);
+  chest_creation_job_ = MakeModelCreationJob(&treasure_chest_, kChestFile, kModelImporter);
+
+  // The meshes are uploaded in the buffers of the arena with the shared
+  // context, only its VAO is updated by the main thread.
+  load_leo_to_gpu_ = LoadModelToGpuJob(&leo_magnus_, &geometry_arena_, gpu_job_type_);
   load_leo_to_gpu_.AddDependency(&leo_creation_job_);
-  load_sword_to_gpu_ = LoadModelToGpuJob(&sword_);
+  load_sword_to_gpu_ = LoadModelToGpuJob(&sword_, &geometry_arena_, gpu_job_type_);
   load_sword_to_gpu_.AddDependency(&sword_creation_job_);
-  load_platform_to_gpu_ = LoadModelToGpuJob(&sandstone_platform_);
+  load_platform_to_gpu_ = LoadModelToGpuJob(&sandstone_platform_, &geometry_arena_,
+                                            gpu_job_type_);
   load_platform_to_gpu_.AddDependency(&platform_creation_job_);
-  load_chest_to_gpu_ = LoadModelToGpuJob(&treasure_chest_);
+  load_chest_to_gpu_ = LoadModelToGpuJob(&treasure_chest_, &geometry_arena_,
+                                         gpu_job_type_);
   load_chest_to_gpu_.AddDependency(&chest_creation_job_);
 
+  update_geometry_arena_job_ = FunctionExecutionJob(
+      [this]() { geometry_arena_.UpdateVertexArray(); }, JobType::kMainThread);
+  for (const auto* load_model_job : {&load_leo_to_gpu_, &load_sword_to_gpu_,
+                                     &load_platform_to_gpu_, &load_chest_to_gpu_}) {
+    update_geometry_arena_job_.AddDependency(load_model_job);
+  }
+
   job_system_.AddJob(&leo_creation_job_);
   job_system_.AddJob(&sword_creation_job_);
   job_system_.AddJob(&platform_creation_job_);
   job_system_.AddJob(&chest_creation_job_);
 
-  main_thread_jobs_.push(&load_leo_to_gpu_);
-  main_thread_jobs_.push(&load_sword_to_gpu_);
-  main_thread_jobs_.push(&load_platform_to_gpu_);
-  main_thread_jobs_.push(&load_chest_to_gpu_);
+  AddGpuJob(&load_hdr_map_to_gpu_);
 
-  main_thread_jobs_.push(&load_hdr_map_to_gpu_);
+  AddGpuJob(&load_leo_to_gpu_);
+  AddGpuJob(&load_sword_to_gpu_);
+  AddGpuJob(&load_platform_to_gpu_);
+  AddGpuJob(&load_chest_to_gpu_);
+  main_thread_jobs_.push(&update_geometry_arena_job_);
 
   init_ibl_maps_job_ = FunctionExecutionJob{[this]() { CreateIblMaps(); },
                                            JobType::kMainThread};
@@ -119,17 +170,41 @@ void FinalScene::Begin() {
 
   main_thread_jobs_.push(&init_opengl_settings_job_);
 
+  if (gpu_job_type_ == JobType::kGpuUpload) {
+    texture_streamer_.Begin(texture_count_, std::move(streaming_context));
+  }
+  else {
+    texture_streamer_.Begin(texture_count_);
+  }
+  if (kUseVirtualTexturing) {
+    virtual_texture_system_.Begin(glm::uvec2(Engine::window_size()));
+  }
   CreateMaterialsCreationJobs();
+  CreateIblCompressionJobs();
 
   job_system_.LaunchWorkers(5);
 }
 
+void FinalScene::BenchmarkModelImporters(int repeat_count) {
+  for (const auto& file : {kLeoMagnusFile, kSwordFile, kPlatformFile, kChestFile}) {
+    if (!Model::BenchmarkImporters(file.path, file.flip_y, repeat_count)) {
+      std::cerr << "Failed to benchmark the importers on " << file.path << '\n';
+    }
+  }
+}
+
 void FinalScene::End() {
+  if (gpu_upload_thread_.is_running()) {
+    gpu_upload_thread_.Stop();
+  }
+  texture_streamer_.End();
+
   DestroyPipelines();
 
   DestroyMeshes();
   DestroyModels();
   DestroyMaterials();
+  lod_selector_.Clear();
 
   DestroyIblPreComputedCubeMaps();
 
@@ -158,6 +233,14 @@ void FinalScene::Update(float dt) {
       }
     }
     else {
+      // The uploads of the shared context may still be running.
+      if (gpu_upload_thread_.HasPendingJobs()) {
+        return;
+      }
+      if (gpu_upload_thread_.is_running()) {
+        gpu_upload_thread_.Stop();
+      }
+
       job_system_.JoinWorkers();
       are_all_data_loaded_ = true;
       break;
@@ -174,6 +257,11 @@ void FinalScene::Update(float dt) {
   // Draw the geometry and color data in the G-Buffer.
   ApplyGeometryPass();
 
+  // Find the pages of the virtual textures sampled by the geometry pass.
+  if (kUseVirtualTexturing) {
+    ApplyVirtualTextureFeedbackPass();
+  }
+
   // Calculate ambient occlusion based on the G-Buffer data.
   // Draw result in the SSAO frame buffers.
   ApplySsaoPass();
@@ -193,6 +281,18 @@ void FinalScene::Update(float dt) {
   // Apply tone mapping and gamma correction to the HDR color buffer.
   // Draw the result in the default framebuffer.
   ApplyHdrPass();
+
+  // Upload the texture levels streamed since the last frame and request the
+  // next ones from the screen sizes computed in the geometry pass.
+  texture_streamer_.Update();
+  if (material_system_.UpdateResidency(texture_streamer_)) {
+    material_system_.UploadMaterials();
+  }
+
+  // Same for the pages of the virtual textures, from a past feedback.
+  if (kUseVirtualTexturing) {
+    virtual_texture_system_.Update();
+  }
 }
 
 void FinalScene::OnEvent(const SDL_Event& event) { 
@@ -218,6 +318,7 @@ void FinalScene::OnEvent(const SDL_Event& event) {
         ssao_fbo_.Resize(new_size);
         ssao_blur_fbo_.Resize(new_size);
         hdr_fbo_.Resize(new_size);
+        virtual_texture_system_.Resize(new_size);
         break;
       }
       default:
@@ -374,7 +475,52 @@ void FinalScene::DrawImGui() {
       ImGui::Unindent();
     }
 
-    
+    if (ImGui::CollapsingHeader("Textures.")) {
+      ImGui::Text("Resident textures: %zu / %zu", texture_streamer_.resident_texture_count(),
+                  texture_streamer_.streamed_texture_count());
+      ImGui::Text("Streamed levels left: %zu", texture_streamer_.remaining_level_count());
+      ImGui::Text("Evicted levels: %zu", texture_streamer_.evicted_level_count());
+
+      constexpr float kMegabyte = 1024.f * 1024.f;
+      const auto& accountant = GetGpuMemoryAccountant();
+      ImGui::Text("GPU memory: %.1f MB in %zu objects",
+                  static_cast<float>(accountant.total_used_size()) / kMegabyte,
+                  accountant.object_count());
+      ImGui::Text("  Textures: %.1f MB (streamed: %.1f MB)",
+                  static_cast<float>(accountant.used_size(GpuMemoryCategory::kTexture)) /
+                      kMegabyte,
+                  static_cast<float>(texture_streamer_.resident_size()) / kMegabyte);
+      ImGui::Text("  Render targets: %.1f MB",
+                  static_cast<float>(
+                      accountant.used_size(GpuMemoryCategory::kRenderTarget)) / kMegabyte);
+      ImGui::Text("  Buffers: %.1f MB",
+                  static_cast<float>(accountant.used_size(GpuMemoryCategory::kBuffer)) /
+                      kMegabyte);
+
+      float max_anisotropy = material_system_.max_anisotropy();
+      if (ImGui::SliderFloat("Max anisotropy", &max_anisotropy, 1.f,
+                             GetSamplerCache().max_supported_anisotropy())) {
+        material_system_.set_max_anisotropy(max_anisotropy);
+      }
+      ImGui::Text("Samplers: %zu", GetSamplerCache().sampler_count());
+
+      if (kUseVirtualTexturing) {
+        ImGui::Text("Virtual textures: %zu, pages: %zu / %zu (%u per cache side)",
+                    virtual_texture_system_.texture_count(),
+                    virtual_texture_system_.resident_page_count(),
+                    virtual_texture_system_.page_capacity(),
+                    virtual_texture_system_.cache_page_count_per_side());
+        ImGui::Text("Pages loading: %zu, loaded: %zu",
+                    virtual_texture_system_.pending_page_count(),
+                    virtual_texture_system_.loaded_page_count());
+      }
+
+      int budget = static_cast<int>(texture_streamer_.memory_budget() / (1024 * 1024));
+      if (ImGui::SliderInt("Texture budget (MB)", &budget, 32, 1024)) {
+        texture_streamer_.set_memory_budget(static_cast<std::size_t>(budget) * 1024 * 1024);
+      }
+    }
+
     if (ImGui::IsWindowHovered()) {
       camera_.ChangeMouseInputsEnability(false);
     } else {
@@ -419,14 +565,14 @@ void FinalScene::CreatePipelineCreationJobs() noexcept {
 
     // Geometry pipelines.
     // -------------------
-    &geometry_pipeline_, 
     &arm_geometry_pipe_,
     &emissive_arm_geometry_pipe_,
     &instanced_geometry_pipeline_,
+    &vt_arm_geometry_pipe_,
+    &vt_emissive_arm_geometry_pipe_,
+    &vt_feedback_pipe_,
     &ssao_pipeline_,
     &ssao_blur_pipeline_,
-    &shadow_mapping_pipe_,
-    &point_shadow_mapping_pipe_,
     &instanced_shadow_mapping_pipe_,
     &point_instanced_shadow_mapping_pipe_,
 
@@ -457,7 +603,8 @@ void FinalScene::CreatePipelineCreationJobs() noexcept {
 
     if (i % 2 == 1) {
       pipeline_creation_jobs_.emplace_back(PipelineCreationJob(
-          &shader_file_buffers_[i - 1], &shader_file_buffers_[i], pipelines_[pipeline_iterator])
+          &shader_file_buffers_[i - 1], &shader_file_buffers_[i], pipelines_[pipeline_iterator],
+          gpu_job_type_)
       );
 
       pipeline_creation_jobs_[pipeline_iterator].AddDependency(&shader_file_loading_jobs_[i - 1]);
@@ -472,20 +619,22 @@ void FinalScene::CreatePipelineCreationJobs() noexcept {
   }
 
   for (auto& prog_creation_job : pipeline_creation_jobs_) {
-    main_thread_jobs_.push(&prog_creation_job);
+    AddGpuJob(&prog_creation_job);
+  }
+}
+
+void FinalScene::AddGpuJob(Job* job) noexcept {
+  if (job->type() == JobType::kGpuUpload) {
+    gpu_upload_thread_.AddJob(job);
+  }
+  else {
+    main_thread_jobs_.push(job);
   }
 }
 
 void FinalScene::SetPipelineSamplerTexUnits() noexcept {
   // Setup the sampler2D uniforms.
   // -----------------------------
-  geometry_pipeline_.Bind();
-  geometry_pipeline_.SetInt("material.albedo_map", 0);
-  geometry_pipeline_.SetInt("material.normal_map", 1);
-  geometry_pipeline_.SetInt("material.metallic_map", 2);
-  geometry_pipeline_.SetInt("material.roughness_map", 3);
-  geometry_pipeline_.SetInt("material.ao_map", 4);
-
   arm_geometry_pipe_.Bind();
   arm_geometry_pipe_.SetInt("material.albedo_map", 0);
   arm_geometry_pipe_.SetInt("material.normal_map", 1);
@@ -500,9 +649,40 @@ void FinalScene::SetPipelineSamplerTexUnits() noexcept {
   instanced_geometry_pipeline_.Bind();
   instanced_geometry_pipeline_.SetInt("material.albedo_map", 0);
   instanced_geometry_pipeline_.SetInt("material.normal_map", 1);
-  instanced_geometry_pipeline_.SetInt("material.metallic_map", 2);
-  instanced_geometry_pipeline_.SetInt("material.roughness_map", 3);
-  instanced_geometry_pipeline_.SetInt("material.ao_map", 4);
+  instanced_geometry_pipeline_.SetInt("material.ao_metallic_roughness_map", 2);
+
+  // The physical caches and the indirections of the virtual textures.
+  vt_arm_geometry_pipe_.Bind();
+  vt_arm_geometry_pipe_.SetInt("material.albedo_map", 0);
+  vt_arm_geometry_pipe_.SetInt("material.normal_map", 1);
+  vt_arm_geometry_pipe_.SetInt("material.ao_metallic_roughness_map", 2);
+  vt_arm_geometry_pipe_.SetInt("indirection_maps[0]",
+                               VirtualTextureSystem::kIndirectionFirstUnit);
+  vt_arm_geometry_pipe_.SetInt("indirection_maps[1]",
+                               VirtualTextureSystem::kIndirectionFirstUnit + 1);
+  vt_arm_geometry_pipe_.SetInt("indirection_maps[2]",
+                               VirtualTextureSystem::kIndirectionFirstUnit + 2);
+
+  vt_emissive_arm_geometry_pipe_.Bind();
+  vt_emissive_arm_geometry_pipe_.SetInt("material.albedo_map", 0);
+  vt_emissive_arm_geometry_pipe_.SetInt("material.normal_map", 1);
+  vt_emissive_arm_geometry_pipe_.SetInt("material.ao_metallic_roughness_map", 2);
+  vt_emissive_arm_geometry_pipe_.SetInt("material.emissive_map", 3);
+  vt_emissive_arm_geometry_pipe_.SetInt("indirection_maps[0]",
+                                        VirtualTextureSystem::kIndirectionFirstUnit);
+  vt_emissive_arm_geometry_pipe_.SetInt("indirection_maps[1]",
+                                        VirtualTextureSystem::kIndirectionFirstUnit + 1);
+  vt_emissive_arm_geometry_pipe_.SetInt("indirection_maps[2]",
+                                        VirtualTextureSystem::kIndirectionFirstUnit + 2);
+  vt_emissive_arm_geometry_pipe_.SetInt("indirection_maps[3]",
+                                        VirtualTextureSystem::kIndirectionFirstUnit + 3);
+
+  // The layers of the material maps in the texture arrays.
+  for (const auto* pipeline : {&arm_geometry_pipe_, &emissive_arm_geometry_pipe_,
+                               &instanced_geometry_pipeline_}) {
+    pipeline->SetUniformBlockBinding("MaterialLayers",
+                                     MaterialSystem::kLayersBindingPoint);
+  }
 
   ssao_pipeline_.Bind();
   ssao_pipeline_.SetInt("gViewPositionMetallic", 0);
@@ -544,6 +724,7 @@ void FinalScene::CreateIblMaps() noexcept {
   CreateIrradianceCubeMap();
   CreatePrefilterCubeMap();
   CreateBrdfLut();
+  ReadBackIblCubeMaps();
 }
 
 void FinalScene::CreateHdrCubemap() noexcept {
@@ -556,11 +737,21 @@ void FinalScene::CreateHdrCubemap() noexcept {
     //const auto equirectangular_map = LoadHDR_Texture("data/textures/hdr/cape_hill_4k.hdr",
     //                                                 GL_CLAMP_TO_EDGE, GL_LINEAR);
 
+    GLint equirect_width = 0;
+    glBindTexture(GL_TEXTURE_2D, equirectangular_map_);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &equirect_width);
+
+    // The cubemap is stored in BC6H at the end of the IBL maps creation,
+    // which takes 1 byte per texel.
+    env_cubemap_resolution_ = CalculateCubeMapResolution(
+        equirect_width, kEnvironmentMapMemoryBudget, 1.f);
+
     glGenTextures(1, &env_cubemap_);
     glBindTexture(GL_TEXTURE_CUBE_MAP, env_cubemap_);
     for (GLuint i = 0; i < 6; i++) {
       glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F,
-                 kSkyboxResolution, kSkyboxResolution, 0, GL_RGB, GL_FLOAT, NULL);
+                 env_cubemap_resolution_, env_cubemap_resolution_, 0, GL_RGB,
+                 GL_FLOAT, NULL);
     }
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -579,8 +770,8 @@ void FinalScene::CreateHdrCubemap() noexcept {
     glBindTexture(GL_TEXTURE_2D, equirectangular_map_);
 
     capture_fbo_.Bind();
-    capture_fbo_.Resize(glm::uvec2(kSkyboxResolution));
-    glViewport(0, 0, kSkyboxResolution, kSkyboxResolution);
+    capture_fbo_.Resize(glm::uvec2(env_cubemap_resolution_));
+    glViewport(0, 0, env_cubemap_resolution_, env_cubemap_resolution_);
 
 
     for (GLuint i = 0; i < 6; i++) {
@@ -594,10 +785,18 @@ void FinalScene::CreateHdrCubemap() noexcept {
 
     capture_fbo_.UnBind();
 
-    // Then generate mipmaps.
+    // Then generate mipmaps. The cubemap is a render target which only
+    // exists on the GPU, its mips are generated there rather than read back
+    // for the CPU generator, which is kept for the decoded and cooked images.
     glBindTexture(GL_TEXTURE_CUBE_MAP, env_cubemap_);
     glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
+    GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, env_cubemap_,
+        GpuMemoryCategory::kTexture,
+        CalculateTextureSize(GL_RGB16F, env_cubemap_resolution_, env_cubemap_resolution_, 6,
+                             CalculateMipLevelCount(env_cubemap_resolution_,
+                                                    env_cubemap_resolution_)));
+
     //glDeleteTextures(1, &equirectangular_map_);
 }
 
@@ -614,6 +813,9 @@ void FinalScene::CreateIrradianceCubeMap() noexcept {
               kIrradianceMapResolution, kIrradianceMapResolution, 0,
               GL_RGB, GL_FLOAT, NULL);
   }
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, irradiance_cubemap_,
+      GpuMemoryCategory::kTexture,
+      CalculateTextureSize(GL_RGB16F, kIrradianceMapResolution, kIrradianceMapResolution, 6));
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -667,7 +869,20 @@ void FinalScene::CreatePrefilterCubeMap() noexcept {
                   GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+  // Only the levels rendered by the prefilter pass are allocated, their
+  // content is computed by the shader.
+  for (GLint level = 1; level < kPrefilterMapLevelCount; level++) {
+    const GLsizei level_resolution = std::max(1, kPrefilterMapResolution >> level);
+    for (GLuint i = 0; i < 6; i++) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, GL_RGB16F,
+                   level_resolution, level_resolution, 0, GL_RGB, GL_FLOAT, NULL);
+    }
+  }
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, kPrefilterMapLevelCount - 1);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, prefilter_cubemap_,
+      GpuMemoryCategory::kTexture,
+      CalculateTextureSize(GL_RGB16F, kPrefilterMapResolution, kPrefilterMapResolution, 6,
+                           kPrefilterMapLevelCount));
 
   prefilter_pipeline_.Bind();
   prefilter_pipeline_.SetInt("environmentMap", 0);
@@ -678,11 +893,11 @@ void FinalScene::CreatePrefilterCubeMap() noexcept {
 
   capture_fbo_.Bind();
 
-  GLuint maxMipLevels = 5;
+  GLuint maxMipLevels = kPrefilterMapLevelCount;
   for (GLuint mip = 0; mip < maxMipLevels; mip++) {
       // reisze framebuffer according to mip-level size.
-      GLuint mipWidth  = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-      GLuint mipHeight = static_cast<unsigned int>(128 * std::pow(0.5, mip));
+      GLuint mipWidth  = static_cast<unsigned int>(kPrefilterMapResolution * std::pow(0.5, mip));
+      GLuint mipHeight = static_cast<unsigned int>(kPrefilterMapResolution * std::pow(0.5, mip));
 
       capture_fbo_.Resize(glm::uvec2(mipWidth, mipHeight));
       glViewport(0, 0, mipWidth, mipHeight);
@@ -716,6 +931,9 @@ void FinalScene::CreateBrdfLut() noexcept {
   glBindTexture(GL_TEXTURE_2D, brdf_lut_);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, kBrdfLutResolution,
                kBrdfLutResolution, 0, GL_RG, GL_FLOAT, 0);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, brdf_lut_,
+      GpuMemoryCategory::kTexture,
+      CalculateTextureSize(GL_RG16F, kBrdfLutResolution, kBrdfLutResolution));
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -736,6 +954,71 @@ void FinalScene::CreateBrdfLut() noexcept {
   capture_fbo_.UnBind();
 }
 
+void FinalScene::CreateIblCompressionJobs() noexcept {
+  // The cubemaps are read back by the IBL maps job, then downloaded and
+  // uploaded by the GPU upload thread and compressed by a worker, the render
+  // thread only swaps them. The jobs wait for the IBL maps job, they come last
+  // in their queues.
+  download_ibl_maps_job_ = FunctionExecutionJob([this]() {
+    env_cubemap_compressor_.Download();
+    prefilter_cubemap_compressor_.Download();
+  }, gpu_job_type_);
+  download_ibl_maps_job_.AddDependency(&init_ibl_maps_job_);
+
+  compress_ibl_maps_job_ = FunctionExecutionJob([this]() {
+    env_cubemap_compressor_.Compress();
+    prefilter_cubemap_compressor_.Compress();
+  }, JobType::kImageFileDecompressing);
+  compress_ibl_maps_job_.AddDependency(&download_ibl_maps_job_);
+
+  upload_ibl_maps_job_ = FunctionExecutionJob([this]() {
+    env_cubemap_compressor_.Upload();
+    prefilter_cubemap_compressor_.Upload();
+    if (gpu_job_type_ == JobType::kGpuUpload) {
+      WaitForGpuCompletion();
+    }
+  }, gpu_job_type_);
+  upload_ibl_maps_job_.AddDependency(&compress_ibl_maps_job_);
+
+  replace_ibl_maps_job_ = FunctionExecutionJob([this]() { ReplaceIblCubeMaps(); },
+                                               JobType::kMainThread);
+  replace_ibl_maps_job_.AddDependency(&upload_ibl_maps_job_);
+
+  job_system_.AddJob(&compress_ibl_maps_job_);
+  AddGpuJob(&download_ibl_maps_job_);
+  AddGpuJob(&upload_ibl_maps_job_);
+  main_thread_jobs_.push(&replace_ibl_maps_job_);
+}
+
+void FinalScene::ReadBackIblCubeMaps() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // The irradiance and prefilter convolutions sample the uncompressed
+  // environment, the cubemaps are only compressed once they are all computed.
+  const auto env_level_count =
+      static_cast<GLint>(std::log2(env_cubemap_resolution_)) + 1;
+  env_cubemap_compressor_.ReadBack(env_cubemap_, env_cubemap_resolution_,
+                                   env_level_count);
+  prefilter_cubemap_compressor_.ReadBack(prefilter_cubemap_, kPrefilterMapResolution,
+                                         kPrefilterMapLevelCount);
+}
+
+void FinalScene::ReplaceIblCubeMaps() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, env_cubemap_);
+  glDeleteTextures(1, &env_cubemap_);
+  env_cubemap_ = env_cubemap_compressor_.compressed_cubemap();
+
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, prefilter_cubemap_);
+  glDeleteTextures(1, &prefilter_cubemap_);
+  prefilter_cubemap_ = prefilter_cubemap_compressor_.compressed_cubemap();
+}
+
 void FinalScene::CreateFrameBuffers() noexcept {
 #ifdef TRACY_ENABLE
   ZoneScoped;
@@ -748,7 +1031,8 @@ void FinalScene::CreateFrameBuffers() noexcept {
   DepthStencilAttachment capture_depth_stencil_attach(GL_DEPTH_COMPONENT24,
                                                       GL_DEPTH_ATTACHMENT);
   FrameBufferSpecification capture_specification;
-  capture_specification.SetSize(glm::uvec2(kSkyboxResolution, kSkyboxResolution));
+  // Resized before every capture.
+  capture_specification.SetSize(glm::uvec2(kPrefilterMapResolution));
   capture_specification.SetDepthStencilAttachment(capture_depth_stencil_attach);
   // Color attachments are apart of the framebuffer in order to send them
   // easily to the pbr shaders.
@@ -808,6 +1092,9 @@ void FinalScene::CreateFrameBuffers() noexcept {
   glBindTexture(GL_TEXTURE_2D, shadow_map_);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, kShadowMapWidth_,
                kShadowMapHeight_, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, shadow_map_,
+      GpuMemoryCategory::kRenderTarget,
+      CalculateTextureSize(GL_DEPTH_COMPONENT, kShadowMapWidth_, kShadowMapHeight_));
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
@@ -836,6 +1123,9 @@ void FinalScene::CreateFrameBuffers() noexcept {
                    kPointShadowMapRes, kPointShadowMapRes, 0,
                    GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
   }
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, point_shadow_cubemap_,
+      GpuMemoryCategory::kRenderTarget,
+      CalculateTextureSize(GL_DEPTH_COMPONENT24, kPointShadowMapRes, kPointShadowMapRes, 6));
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -877,6 +1167,12 @@ void FinalScene::CreateFrameBuffers() noexcept {
   hdr_specification.SetDepthStencilAttachment(hdr_depth_stencil_attachment);
 
   hdr_fbo_.Create(hdr_specification);
+
+  // Virtual texturing feedback framebuffer.
+  // ---------------------------------------
+  if (kUseVirtualTexturing) {
+    virtual_texture_system_.CreateFeedbackBuffer(screen_size);
+  }
 }
 
 void FinalScene::CreateSsaoData() noexcept {
@@ -920,6 +1216,9 @@ void FinalScene::CreateSsaoData() noexcept {
   glBindTexture(GL_TEXTURE_2D, noise_texture_);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, kSsaoNoiseDimensionX_,
                kSsaoNoiseDimensionX_, 0, GL_RGB, GL_FLOAT, ssao_noise.data());
+  GetGpuMemoryAccountant().Track(GpuObjectType::kTexture, noise_texture_,
+      GpuMemoryCategory::kTexture,
+      CalculateTextureSize(GL_RGBA16F, kSsaoNoiseDimensionX_, kSsaoNoiseDimensionX_));
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -950,7 +1249,8 @@ void FinalScene::LoadMeshesToGpu() noexcept {
   // Load sphere model matrices to the GPU.
   // --------------------------------------
   sphere_model_matrices_.reserve(kSphereCount_);
-  visible_sphere_model_matrices_.reserve(kSphereCount_);
+  lod_sorted_sphere_model_matrices_.reserve(kSphereCount_);
+  sphere_lods_.resize(kSphereCount_);
 
   model_ = glm::mat4(1.f);
   model_ =
@@ -1013,18 +1313,16 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
   ZoneScoped;
 #endif  // TRACY_ENABLE
 
-  std::array<TextureParameters, texture_count_> texture_inputs{
+  texture_inputs_ = {
     // Gold Material.
     // --------------
     TextureParameters("data/textures/pbr/gold/gold-scuffed_basecolor-boosted.png", 
     GL_CLAMP_TO_EDGE, GL_LINEAR, true, false),
     TextureParameters("data/textures/pbr/gold/gold-scuffed_normal.png", 
-    GL_CLAMP_TO_EDGE, GL_LINEAR, false, false),
-    TextureParameters("data/textures/pbr/gold/gold-scuffed_metallic.png", 
-    GL_CLAMP_TO_EDGE, GL_LINEAR, false, false),
-    TextureParameters("data/textures/pbr/gold/gold-scuffed_roughness.png", 
-    GL_CLAMP_TO_EDGE, GL_LINEAR, false, false),
-    TextureParameters("data/textures/pbr/gold/ao.png", 
+    GL_CLAMP_TO_EDGE, GL_LINEAR, false, false,
+      false, TextureCompression::kBc5),
+    // Packed from the ao, roughness and metallic maps.
+    TextureParameters("data/textures/pbr/gold/gold-scuffed_arm",
     GL_CLAMP_TO_EDGE, GL_LINEAR, false, false),
 
     // Leo Magnus' textures.
@@ -1032,7 +1330,8 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
     // Grosse armure.
     // --------------
     TextureParameters("data/models/leo_magnus/leo_magnus_low_grosse_armure_BaseColor.png", GL_REPEAT, GL_LINEAR, true, true),
-    TextureParameters("data/models/leo_magnus/leo_magnus_low_grosse_armure_Normal.png", GL_REPEAT, GL_LINEAR, false, true),
+    TextureParameters("data/models/leo_magnus/leo_magnus_low_grosse_armure_Normal.png", GL_REPEAT, GL_LINEAR, false, true,
+      false, TextureCompression::kBc5),
     TextureParameters(
           "data/models/leo_magnus/leo_magnus_low_grosse_armure_OcclusionRoughnessMetallic.png",
           GL_REPEAT, GL_LINEAR, false, true),
@@ -1044,7 +1343,8 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
           "data/models/leo_magnus/leo_magnus_low_cape_BaseColor.png", GL_REPEAT,
           GL_LINEAR, true, true),
     TextureParameters("data/models/leo_magnus/leo_magnus_low_cape_Normal.png",
-                        GL_REPEAT, GL_LINEAR, false, true),
+                        GL_REPEAT, GL_LINEAR, false, true,
+      false, TextureCompression::kBc5),
     TextureParameters("data/models/leo_magnus/"
                         "leo_magnus_low_cape_OcclusionRoughnessMetallic.png",
                         GL_REPEAT, GL_LINEAR, false, true),
@@ -1056,7 +1356,8 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
           "data/models/leo_magnus/leo_magnus_low_tete_BaseColor.png", GL_REPEAT,
           GL_LINEAR, true, true),
     TextureParameters("data/models/leo_magnus/leo_magnus_low_tete_Normal.png",
-                        GL_REPEAT, GL_LINEAR, false, true),
+                        GL_REPEAT, GL_LINEAR, false, true,
+      false, TextureCompression::kBc5),
     TextureParameters("data/models/leo_magnus/"
                         "leo_magnus_low_tete_OcclusionRoughnessMetallic.png",
                         GL_REPEAT, GL_LINEAR, false, true),
@@ -1070,7 +1371,8 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
           GL_REPEAT, GL_LINEAR, true, true),
     TextureParameters(
           "data/models/leo_magnus/leo_magnus_low_pilosite_Normal.png",
-          GL_REPEAT, GL_LINEAR, false, true),
+          GL_REPEAT, GL_LINEAR, false, true,
+      false, TextureCompression::kBc5),
     TextureParameters("data/models/leo_magnus/"
           "leo_magnus_low_pilosite_OcclusionRoughnessMetallic.png",
           GL_REPEAT, GL_LINEAR, false, true),
@@ -1083,7 +1385,8 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
           GL_REPEAT, GL_LINEAR, true, true),
     TextureParameters(
           "data/models/leo_magnus/leo_magnus_low_petite_armure_Normal.png",
-          GL_REPEAT, GL_LINEAR, false, true),
+          GL_REPEAT, GL_LINEAR, false, true,
+      false, TextureCompression::kBc5),
     TextureParameters("data/models/leo_magnus/"
           "leo_magnus_low_petite_armure_OcclusionRoughnessMetallic.png",
           GL_REPEAT, GL_LINEAR, false, true),
@@ -1096,7 +1399,8 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
     TextureParameters("data/models/leo_magnus/epee_low_1001_BaseColor.png",
       GL_REPEAT, GL_LINEAR, true, true),
     TextureParameters("data/models/leo_magnus/epee_low_1001_Normal.png",
-      GL_REPEAT, GL_LINEAR, false, true),
+      GL_REPEAT, GL_LINEAR, false, true,
+      false, TextureCompression::kBc5),
     TextureParameters("data/models/leo_magnus/epee_low_1001_OcclusionRoughnessMetallic.png", 
       GL_REPEAT, GL_LINEAR, false, true),
     TextureParameters("data/models/leo_magnus/epee_low_1001_Emissive.png", 
@@ -1107,12 +1411,10 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
     TextureParameters("data/models/sandstone_platform/sandstone-platform1-albedo.png", 
       GL_REPEAT, GL_LINEAR, true, true),
     TextureParameters("data/models/sandstone_platform/sandstone-platform1-normal_ogl.png", 
-      GL_REPEAT, GL_LINEAR, false, true),
-    TextureParameters("data/models/sandstone_platform/sandstone-platform1-metallic.png", 
-      GL_REPEAT, GL_LINEAR, false, true),
-    TextureParameters("data/models/sandstone_platform/sandstone-platform1-roughness.png", 
-      GL_REPEAT, GL_LINEAR, false, true),
-    TextureParameters("data/models/sandstone_platform/sandstone-platform1-ao.png", 
+      GL_REPEAT, GL_LINEAR, false, true,
+      false, TextureCompression::kBc5),
+    // Packed from the ao, roughness and metallic maps.
+    TextureParameters("data/models/sandstone_platform/sandstone-platform1-arm",
       GL_REPEAT, GL_LINEAR, false, true),
 
     // Treasure chest textures.
@@ -1120,80 +1422,272 @@ void FinalScene::CreateMaterialsCreationJobs() noexcept {
     TextureParameters("data/models/treasure_chest/treasure_chest_diff_2k.jpg",
       GL_REPEAT, GL_LINEAR, true, false),
     TextureParameters("data/models/treasure_chest/treasure_chest_nor_gl_2k.jpg",
-      GL_REPEAT, GL_LINEAR, false, false),
+      GL_REPEAT, GL_LINEAR, false, false,
+      false, TextureCompression::kBc5),
     TextureParameters("data/models/treasure_chest/treasure_chest_arm_2k.jpg",
       GL_REPEAT, GL_LINEAR, false, false),
   };
 
-  std::array<GLuint*, texture_count_> texture_ids { 
-    &gold_mat_.albedo_map,
-    &gold_mat_.normal_map,
-    &gold_mat_.metallic_map,
-    &gold_mat_.roughness_map,
-    &gold_mat_.ao_map,
-  };
+  // The channels of the packed textures are loaded and decompressed separately.
+  constexpr auto kChannelJobCount = packed_texture_count_ * kArmChannelCount;
+  img_file_loading_jobs_.reserve(texture_count_ + kChannelJobCount);
+  img_decompressing_jobs_.reserve(texture_count_ + kChannelJobCount);
+  channel_packing_jobs_.reserve(packed_texture_count_);
+  mip_tail_loading_jobs_.reserve(texture_count_);
+  tex_cooking_jobs_.reserve(texture_count_);
+  virtual_texture_tiling_jobs_.reserve(texture_count_);
 
-  leo_magnus_textures_.resize(20, 0);
-  for (int i = 0; i < leo_magnus_textures_.size(); i++) {
-    texture_ids[i + 5] = &leo_magnus_textures_[i];
-  }
+  // For loop that creates all the jobs used to create textures for materials.
+  for (std::int8_t i = 0; i < texture_count_; i++) {
+    const auto& tex_param = texture_inputs_[i];
+    auto cooked_path = CookedTexturePath(tex_param.image_file_path);
+
+    const auto packed_sources = std::find_if(
+        packed_texture_sources_.begin(), packed_texture_sources_.end(),
+        [i](const PackedTextureSources& sources) { return sources.texture_idx == i; });
+    const bool is_packed = packed_sources != packed_texture_sources_.end();
+
+    const std::vector<std::string_view> source_paths = is_packed
+        ? std::vector<std::string_view>(packed_sources->channel_paths.begin(),
+                                        packed_sources->channel_paths.end())
+        : std::vector<std::string_view>{tex_param.image_file_path};
+
+    // The hash of the sources is stored in the cooked files, it is only
+    // computed from the identity of the sources before they are cooked.
+    std::uint64_t source_hash = 0;
+    const bool is_cooked = IsCookedTextureUpToDate(source_paths, cooked_path, tex_param,
+                                                   &source_hash);
+    if (!is_cooked) {
+      for (const auto source_path : source_paths) {
+        if (!HashFileIdentity(source_path, &source_hash, source_hash)) {
+          // Unreadable sources are not shared.
+          source_hash = HashContent(reinterpret_cast<const unsigned char*>(
+              source_path.data()), source_path.size(), source_hash);
+        }
+      }
+    }
 
-  sword_textures_.resize(4, 0);
-  for (int i = 0; i < sword_textures_.size(); i++) {
-    texture_ids[i + 25] = &sword_textures_[i];
-  }
+    // Textures with the same content and parameters are only created once.
+    // ---------------------------------------------------------------------
+    bool is_new_texture = false;
+    texture_handles_[i] = GetTextureRegistry().Acquire(
+        TextureKey(source_hash, tex_param), &is_new_texture);
+    texture_stream_slots_[i] = i;
+
+    if (!is_new_texture) {
+      const auto first_user = std::find(texture_handles_.begin(),
+                                        texture_handles_.begin() + i, texture_handles_[i]);
+      texture_stream_slots_[i] = first_user - texture_handles_.begin();
+      continue;
+    }
 
-  texture_ids[29] = &sandstone_platform_mat_.albedo_map;
-  texture_ids[30] = &sandstone_platform_mat_.normal_map;
-  texture_ids[31] = &sandstone_platform_mat_.metallic_map;
-  texture_ids[32] = &sandstone_platform_mat_.roughness_map;
-  texture_ids[33] = &sandstone_platform_mat_.ao_map;
+    const auto vtex_path = VirtualTexturePath(tex_param.image_file_path);
+    if (is_cooked && UsesVirtualTexture(i)) {
+      // Cooked files tiling job, the pages are then read at runtime.
+      // ------------------------------------------------------------
+      if (!IsVirtualTextureUpToDate(vtex_path, source_hash)) {
+        virtual_texture_tiling_jobs_.emplace_back(VirtualTextureTilingJob(
+            nullptr, cooked_path, tex_param.wrapping_param, vtex_path));
+      }
+      continue;
+    }
 
-  treasure_chest_textures_.resize(3, 0);
-  for (int i = 0; i < treasure_chest_textures_.size(); i++) {
-    texture_ids[i + 34] = &treasure_chest_textures_[i];
-  }
+    if (is_cooked) {
+      // Cooked files mip tail reading job, the other levels are streamed.
+      // -----------------------------------------------------------------
+      mip_tail_loading_jobs_.emplace_back(CookedMipTailLoadingJob(
+          cooked_path, &cooked_texture_buffers_[i],
+          kLazyTextureResidency ? 0 : TextureStreamer::kMipTailSize));
+      continue;
+    }
 
-  texture_ids_ = std::move(texture_ids);
+    const Job* image_decoding_job = nullptr;
 
-  img_file_loading_jobs_.reserve(texture_count_);
-  img_decompressing_jobs_.reserve(texture_count_);
-  load_tex_to_gpu_jobs_.reserve(texture_count_);
+    if (is_packed) {
+      // Channel maps reading, decompressing and packing jobs.
+      // -----------------------------------------------------
+      const auto packed_idx = packed_sources - packed_texture_sources_.begin();
+      auto& file_buffers = channel_file_buffers_[packed_idx];
+      auto& channel_images = channel_image_buffers_[packed_idx];
 
-  // For loop that creates all the jobs used to create textures for materials.
-  for (std::int8_t i = 0; i < texture_count_; i++) {
-    const auto& tex_param = texture_inputs[i];
+      channel_packing_jobs_.emplace_back(ChannelPackingJob(
+          {&channel_images[0], &channel_images[1], &channel_images[2]},
+          &image_buffers[i]));
 
-    // Image files reading job.
-    // ------------------------
-    img_file_loading_jobs_.emplace_back(LoadFileFromDiskJob(
-        tex_param.image_file_path, &image_file_buffers_[i], JobType::kImageFileLoading));
+      for (int c = 0; c < kArmChannelCount; c++) {
+        img_file_loading_jobs_.emplace_back(LoadFileFromDiskJob(
+            std::string(packed_sources->channel_paths[c]), &file_buffers[c],
+            JobType::kImageFileLoading));
+
+        img_decompressing_jobs_.emplace_back(ImageFileDecompressingJob(
+            &file_buffers[c], &channel_images[c], tex_param.flipped_y, false));
+        img_decompressing_jobs_.back().AddDependency(&img_file_loading_jobs_.back());
+
+        channel_packing_jobs_.back().AddDependency(&img_decompressing_jobs_.back());
+      }
+
+      image_decoding_job = &channel_packing_jobs_.back();
+    }
+    else {
+      // Image files reading job.
+      // ------------------------
+      img_file_loading_jobs_.emplace_back(LoadFileFromDiskJob(
+          tex_param.image_file_path, &image_file_buffers_[i], JobType::kImageFileLoading));
+
+      // Image files decompressing job.
+      // ------------------------------
+      img_decompressing_jobs_.emplace_back(ImageFileDecompressingJob(&image_file_buffers_[i], &image_buffers[i],
+                                          tex_param.flipped_y, tex_param.hdr));
+
+      img_decompressing_jobs_.back().AddDependency(&img_file_loading_jobs_.back());
+
+      image_decoding_job = &img_decompressing_jobs_.back();
+    }
 
-    // Image files decompressing job.
-    // ------------------------------
-    img_decompressing_jobs_.emplace_back(ImageFileDecompressingJob(&image_file_buffers_[i], &image_buffers[i],
-                                        tex_param.flipped_y, tex_param.hdr));
+    // Texture cooking job, the cooked file is used by the next launches.
+    // -----------------------------------------------------------------
+    tex_cooking_jobs_.emplace_back(TextureCookingJob(&image_buffers[i], 
+        &cooked_texture_buffers_[i], tex_param, cooked_path, source_hash));
 
-    img_decompressing_jobs_[i].AddDependency(&img_file_loading_jobs_[i]);
+    tex_cooking_jobs_.back().AddDependency(image_decoding_job);
 
-    // Texture loading to GPU job.
-    // ---------------------------
-    load_tex_to_gpu_jobs_.emplace_back(LoadTextureToGpuJob(&image_buffers[i], 
-        texture_ids[i], tex_param));
+    if (UsesVirtualTexture(i)) {
+      virtual_texture_tiling_jobs_.emplace_back(VirtualTextureTilingJob(
+          &cooked_texture_buffers_[i], cooked_path, tex_param.wrapping_param, vtex_path));
+      virtual_texture_tiling_jobs_.back().AddDependency(&tex_cooking_jobs_.back());
+    }
+  }
 
-    load_tex_to_gpu_jobs_[i].AddDependency(&img_decompressing_jobs_[i]);
+  // Texture arrays creation job, it needs the headers of all the textures to
+  // group them. Their mip tails are then uploaded in the layers, the other
+  // levels are streamed.
+  // ------------------------------------------------------------------------
+  create_material_arrays_job_ = FunctionExecutionJob(
+      [this]() { CreateMaterialArrays(); }, gpu_job_type_);
+  for (const auto& tail_reading_job : mip_tail_loading_jobs_) {
+    create_material_arrays_job_.AddDependency(&tail_reading_job);
+  }
+  for (const auto& cooking_job : tex_cooking_jobs_) {
+    create_material_arrays_job_.AddDependency(&cooking_job);
+  }
+  for (const auto& tiling_job : virtual_texture_tiling_jobs_) {
+    create_material_arrays_job_.AddDependency(&tiling_job);
   }
 
   for (auto& reading_job : img_file_loading_jobs_) {
       job_system_.AddJob(&reading_job);
   }
 
+  for (auto& tail_reading_job : mip_tail_loading_jobs_) {
+    job_system_.AddJob(&tail_reading_job);
+  }
+
   for (auto& decompressing_job : img_decompressing_jobs_) {
     job_system_.AddJob(&decompressing_job);
   }
 
-  for (auto& load_tex_to_gpu : load_tex_to_gpu_jobs_) {
-    main_thread_jobs_.push(&load_tex_to_gpu);
+  for (auto& packing_job : channel_packing_jobs_) {
+    job_system_.AddJob(&packing_job);
+  }
+
+  for (auto& cooking_job : tex_cooking_jobs_) {
+    job_system_.AddJob(&cooking_job);
+  }
+
+  for (auto& tiling_job : virtual_texture_tiling_jobs_) {
+    job_system_.AddJob(&tiling_job);
+  }
+
+  AddGpuJob(&create_material_arrays_job_);
+}
+
+void FinalScene::CreateMaterialArrays() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  // Group the textures in arrays, the duplicates use the layer of the first user.
+  // ------------------------------------------------------------------------------
+  material_system_.Begin(texture_count_,
+                         kUseVirtualTexturing ? &virtual_texture_system_ : nullptr);
+
+  for (std::size_t i = 0; i < texture_count_; i++) {
+    if (texture_stream_slots_[i] != i) {
+      continue;
+    }
+
+    if (UsesVirtualTexture(i)) {
+      const auto virtual_texture_id = virtual_texture_system_.AddTexture(
+          VirtualTexturePath(texture_inputs_[i].image_file_path));
+      if (virtual_texture_id != VirtualTextureSystem::kNoVirtualTexture) {
+        material_system_.AddVirtualTexture(i, virtual_texture_id);
+      }
+      continue;
+    }
+
+    CookedTexture cooked_texture;
+    const auto& cooked_buffer = cooked_texture_buffers_[i];
+    if (!cooked_texture.Parse(cooked_buffer.data, cooked_buffer.size)) {
+      std::cerr << "Invalid cooked texture for " << texture_inputs_[i].image_file_path
+                << '\n';
+      continue;
+    }
+    material_system_.AddTexture(i, cooked_texture.header(), texture_inputs_[i]);
+  }
+
+  material_system_.CreateArrays(&texture_streamer_);
+
+  for (std::size_t i = 0; i < texture_count_; i++) {
+    if (texture_stream_slots_[i] != i || !material_system_.has_texture(i) ||
+        material_system_.is_virtual(i)) {
+      continue;
+    }
+    texture_streamer_.AddArrayLayer(i, &cooked_texture_buffers_[i],
+                                    CookedTexturePath(texture_inputs_[i].image_file_path),
+                                    material_system_.array_id(i),
+                                    material_system_.layer(i), kLazyTextureResidency);
+  }
+
+  // Materials, the maps are in the order of MaterialMap.
+  // ----------------------------------------------------
+  const auto texture = [this](std::size_t texture_idx) {
+    return static_cast<std::int32_t>(texture_stream_slots_[texture_idx]);
+  };
+  constexpr auto kNoTexture = Material::kNoTexture;
+
+  gold_material_ = material_system_.AddMaterial(Material{{
+      texture(gold_textures_idx_), texture(gold_textures_idx_ + 1),
+      texture(gold_textures_idx_ + 2), kNoTexture}});
+
+  sandstone_platform_material_ = material_system_.AddMaterial(Material{{
+      texture(sandstone_platform_textures_idx_),
+      texture(sandstone_platform_textures_idx_ + 1),
+      texture(sandstone_platform_textures_idx_ + 2), kNoTexture}});
+
+  treasure_chest_material_ = material_system_.AddMaterial(Material{{
+      texture(treasure_chest_textures_idx_),
+      texture(treasure_chest_textures_idx_ + 1),
+      texture(treasure_chest_textures_idx_ + 2), kNoTexture}});
+
+  for (std::size_t mesh = 0; mesh < leo_magnus_mesh_count_; mesh++) {
+    const auto first = leo_magnus_textures_idx_ + mesh * kMaterialMapCount;
+    const auto material_idx = material_system_.AddMaterial(Material{{
+        texture(first), texture(first + 1), texture(first + 2), texture(first + 3)}});
+    if (mesh == 0) {
+      leo_magnus_first_material_ = material_idx;
+    }
+  }
+
+  sword_material_ = material_system_.AddMaterial(Material{{
+      texture(sword_textures_idx_), texture(sword_textures_idx_ + 1),
+      texture(sword_textures_idx_ + 2), texture(sword_textures_idx_ + 3)}});
+
+  // The lazy layers sample the placeholders until they are visible.
+  material_system_.UpdateResidency(texture_streamer_);
+  material_system_.UploadMaterials();
+
+  if (gpu_job_type_ == JobType::kGpuUpload) {
+    WaitForGpuCompletion();
   }
 }
 
@@ -1207,6 +1701,12 @@ void FinalScene::ApplyGeometryPass() noexcept {
   glEnable(GL_CULL_FACE);
   glCullFace(GL_BACK);
 
+  material_system_.BeginPass();
+
+  lod_selector_.BeginView(kCameraLodView,
+                          LodView{camera_.position(), glm::radians(camera_.fov()), 0.f,
+                                  static_cast<float>(Engine::window_size().y)});
+
   // Draw instanced meshes.
   // ----------------------
   instanced_geometry_pipeline_.Bind();
@@ -1218,18 +1718,44 @@ void FinalScene::ApplyGeometryPass() noexcept {
 
   // Draw single meshes.
   // -------------------
-  geometry_pipeline_.Bind();
+  auto& geometry_pipe = kUseVirtualTexturing ? vt_arm_geometry_pipe_ : arm_geometry_pipe_;
+  geometry_pipe.Bind();
 
-  geometry_pipeline_.SetMatrix4("transform.projection", projection_);
-  geometry_pipeline_.SetMatrix4("transform.view", view_);
+  geometry_pipe.SetMatrix4("transform.projection", projection_);
+  geometry_pipe.SetMatrix4("transform.view", view_);
 
   DrawObjectGeometry(GeometryPipelineType::kGeometry);
 
-
+  material_system_.EndPass();
 
   g_buffer_.UnBind();
 }
 
+void FinalScene::ApplyVirtualTextureFeedbackPass() noexcept {
+#ifdef TRACY_ENABLE
+  ZoneScoped;
+#endif  // TRACY_ENABLE
+
+  virtual_texture_system_.BeginFeedbackPass(vt_feedback_pipe_);
+
+  vt_feedback_pipe_.SetMatrix4("transform.projection", projection_);
+  vt_feedback_pipe_.SetMatrix4("transform.view", view_);
+
+  // The feedback pass sees the meshes with the levels of the geometry pass.
+  lod_selector_.BeginView(kCameraLodView,
+                          LodView{camera_.position(), glm::radians(camera_.fov()), 0.f,
+                                  static_cast<float>(Engine::window_size().y)});
+
+  material_system_.BeginPass();
+  DrawObjectGeometry(GeometryPipelineType::kVirtualTextureFeedback);
+  material_system_.EndPass();
+
+  virtual_texture_system_.EndFeedbackPass();
+
+  const auto screen_size = Engine::window_size();
+  glViewport(0, 0, screen_size.x, screen_size.y);
+}
+
 void FinalScene::ApplySsaoPass() noexcept {
   const auto screen_size = Engine::window_size();
   // SSAO texture creation.
@@ -1296,6 +1822,10 @@ void FinalScene::ApplyShadowMappingPass() noexcept {
       glm::vec3(0.0, 1.0, 0.0));
   light_space_matrix_ = light_projection * light_view;
 
+  lod_selector_.BeginView(kDirectionalShadowLodView,
+                          LodView{dir_light_pos_, 0.f, height * 2.f,
+                                  static_cast<float>(kShadowMapHeight_)});
+
   // Draw instanced meshes.
   // ----------------------
   instanced_shadow_mapping_pipe_.Bind();
@@ -1304,12 +1834,15 @@ void FinalScene::ApplyShadowMappingPass() noexcept {
 
   DrawInstancedObjectGeometry(GeometryPipelineType::kShadowMapping);
 
-  // Draw single meshes.
-  // -------------------
-  shadow_mapping_pipe_.Bind();
-  shadow_mapping_pipe_.SetMatrix4("lightSpaceMatrix", light_space_matrix_);
-
+  // Draw the models.
+  // ----------------
+  shadow_draw_list_.Clear();
+  double_sided_shadow_draw_list_.Clear();
   DrawObjectGeometry(GeometryPipelineType::kShadowMapping);
+  shadow_draw_list_.Upload();
+  double_sided_shadow_draw_list_.Upload();
+
+  DrawShadowCasters(shadow_draw_list_, double_sided_shadow_draw_list_);
 
   // Point light shadow mapping.
   // ---------------------------
@@ -1323,6 +1856,18 @@ void FinalScene::ApplyShadowMappingPass() noexcept {
 
   static constexpr float aspect = (float)kPointShadowMapRes / (float)kPointShadowMapRes;
 
+  // The levels only depend on the distance to the light, the six faces share them.
+  lod_selector_.BeginView(kPointShadowLodView,
+                          LodView{point_lights[0].position, glm::radians(90.f), 0.f,
+                                  static_cast<float>(kPointShadowMapRes)});
+
+  // The models are queued once for the six faces.
+  point_shadow_draw_list_.Clear();
+  double_sided_point_shadow_draw_list_.Clear();
+  DrawObjectGeometry(GeometryPipelineType::kPointShadowMapping);
+  point_shadow_draw_list_.Upload();
+  double_sided_point_shadow_draw_list_.Upload();
+
   point_instanced_shadow_mapping_pipe_.Bind();
 
   point_instanced_shadow_mapping_pipe_.SetVec3("light_pos",
@@ -1346,33 +1891,7 @@ void FinalScene::ApplyShadowMappingPass() noexcept {
     point_instanced_shadow_mapping_pipe_.SetFloat("light_far_plane", kLightFarPlane);
 
     DrawInstancedObjectGeometry(GeometryPipelineType::kShadowMapping);
-  }
-
-  point_shadow_mapping_pipe_.Bind();
-
-  point_shadow_mapping_pipe_.SetVec3("light_pos",
-                                     point_lights[0].position);
-
-  for (int i = 0; i < 6; i++) {
-    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                           GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                           point_shadow_cubemap_, 0);
-    light_view =
-        glm::lookAt(point_lights[0].position,
-                    point_lights[0].position + light_dirs_[i], light_ups_[i]);
-
-    light_projection = glm::perspective(glm::radians(90.f), aspect,
-                         kLightNearPlane, kLightFarPlane);
-
-    point_light_space_matrix_ = light_projection * light_view;
-
-    point_shadow_mapping_pipe_.SetMatrix4("lightSpaceMatrix",
-                                           point_light_space_matrix_);
-    point_shadow_mapping_pipe_.SetFloat("light_far_plane",
-                                        kLightFarPlane);
-    // simpleDepthShader_.SetVec3("lightDir", lightDirs[i]);
-
-    DrawObjectGeometry(GeometryPipelineType::kPointShadowMapping);
+    DrawShadowCasters(point_shadow_draw_list_, double_sided_point_shadow_draw_list_);
   }
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -1600,20 +2119,29 @@ void FinalScene::ApplyHdrPass() noexcept {
 
 void FinalScene::DrawObjectGeometry(GeometryPipelineType geometry_type) noexcept {
   Pipeline* current_pipeline = nullptr;
+  GeometryDrawList* shadow_draw_list = nullptr;
+  GeometryDrawList* double_sided_shadow_draw_list = nullptr;
 
   bool is_geometry_pipeline = false;
 
   switch (geometry_type) {
     case GeometryPipelineType::kGeometry:
-      current_pipeline = &geometry_pipeline_;
+      current_pipeline = kUseVirtualTexturing ? &vt_arm_geometry_pipe_ : &arm_geometry_pipe_;
+      is_geometry_pipeline = true;
+      break;
+    case GeometryPipelineType::kVirtualTextureFeedback:
+      // Drawn like the geometry pass, with one pipeline for all the materials.
+      current_pipeline = &vt_feedback_pipe_;
       is_geometry_pipeline = true;
       break;
     case GeometryPipelineType::kShadowMapping:
-      current_pipeline = &shadow_mapping_pipe_;
+      shadow_draw_list = &shadow_draw_list_;
+      double_sided_shadow_draw_list = &double_sided_shadow_draw_list_;
       is_geometry_pipeline = false;
       break;
     case GeometryPipelineType::kPointShadowMapping:
-      current_pipeline = &point_shadow_mapping_pipe_;
+      shadow_draw_list = &point_shadow_draw_list_;
+      double_sided_shadow_draw_list = &double_sided_point_shadow_draw_list_;
       is_geometry_pipeline = false;
       break;
     default:
@@ -1631,33 +2159,30 @@ void FinalScene::DrawObjectGeometry(GeometryPipelineType geometry_type) noexcept
   model_ = glm::scale(model_, glm::vec3(0.175f, 0.10, 0.175));
   
   if (is_geometry_pipeline) {
+    // The meshlets of the visible meshes are culled by the renderer.
+    meshlet_culler_.BeginView(camera_frustum_, camera_.position());
+    meshlet_culler_.set_cull_backfaces(true);
+
+    bool is_visible = false;
     for (const auto& mesh : sandstone_platform_.meshes()) {
       if (mesh.bounding_sphere().IsOnFrustum(camera_frustum_, model_)) {
-        current_pipeline->SetMatrix4("transform.model", model_);
-        current_pipeline->SetMatrix4("viewNormalMatrix",
-            glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
-        
-        sandstone_platform_mat_.Bind(GL_TEXTURE0);
-        renderer_.DrawModel(sandstone_platform_);
+        is_visible = true;
+        RequestTexturesScreenSize(sandstone_platform_textures_idx_, 3,
+                                  mesh.bounding_sphere(), model_);
       }
     }
-  }
-  else {
-    current_pipeline->SetMatrix4("transform.model", model_);
-    current_pipeline->SetMatrix4("viewNormalMatrix",
-        glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
 
-    renderer_.DrawModel(sandstone_platform_);
-  }
+    if (is_visible) {
+      current_pipeline->SetMatrix4("transform.model", model_);
+      current_pipeline->SetMatrix4("viewNormalMatrix",
+          glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
 
-  // Switch to arm pipeline if we are in geometry pass.
-  // --------------------------------------------------
-  if (is_geometry_pipeline) {
-    arm_geometry_pipe_.Bind();
-    arm_geometry_pipe_.SetMatrix4("transform.view", view_);
-    arm_geometry_pipe_.SetMatrix4("transform.projection",
-                                             projection_);
-    current_pipeline = &arm_geometry_pipe_;
+      material_system_.Bind(sandstone_platform_material_, *current_pipeline);
+      renderer_.DrawModel(sandstone_platform_, model_);
+    }
+  }
+  else {
+    QueueShadowCaster(sandstone_platform_, model_, shadow_draw_list);
   }
 
   // Draw treasure chest.
@@ -1668,32 +2193,37 @@ void FinalScene::DrawObjectGeometry(GeometryPipelineType geometry_type) noexcept
   model_ = glm::rotate(model_, glm::radians(22.5f), glm::vec3(0, 1, 0));
 
   if (is_geometry_pipeline) {
+    bool is_visible = false;
     for (const auto& mesh : treasure_chest_.meshes()) {
       if (mesh.bounding_sphere().IsOnFrustum(camera_frustum_, model_)) {
-        current_pipeline->SetMatrix4("transform.model", model_);
-        current_pipeline->SetMatrix4("viewNormalMatrix",
-            glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
-
-        renderer_.DrawModelWithMaterials(treasure_chest_,
-                                         treasure_chest_textures_, 0);
+        is_visible = true;
+        RequestTexturesScreenSize(treasure_chest_textures_idx_, 3,
+                                  mesh.bounding_sphere(), model_);
       }
     }
+
+    if (is_visible) {
+      current_pipeline->SetMatrix4("transform.model", model_);
+      current_pipeline->SetMatrix4("viewNormalMatrix",
+          glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
+
+      renderer_.DrawModelWithMaterials(treasure_chest_, model_, material_system_,
+                                       *current_pipeline, treasure_chest_material_, 0);
+    }
   }
   else {
-    current_pipeline->SetMatrix4("transform.model", model_);
-    current_pipeline->SetMatrix4("viewNormalMatrix",
-        glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
-
-    renderer_.DrawModel(treasure_chest_);
+    QueueShadowCaster(treasure_chest_, model_, shadow_draw_list);
   }
 
   // Switch to emissive arm pipeline if we are in geometry pass.
   // ------------------------------------------------------------
-  if (is_geometry_pipeline) {
-    emissive_arm_geometry_pipe_.Bind();
-    emissive_arm_geometry_pipe_.SetMatrix4("transform.view", view_);
-    emissive_arm_geometry_pipe_.SetMatrix4("transform.projection", projection_);
-    current_pipeline = &emissive_arm_geometry_pipe_;
+  if (geometry_type == GeometryPipelineType::kGeometry) {
+    auto& emissive_pipe = kUseVirtualTexturing ? vt_emissive_arm_geometry_pipe_
+                                               : emissive_arm_geometry_pipe_;
+    emissive_pipe.Bind();
+    emissive_pipe.SetMatrix4("transform.view", view_);
+    emissive_pipe.SetMatrix4("transform.projection", projection_);
+    current_pipeline = &emissive_pipe;
   }
 
   // Render Leo Magnus.
@@ -1705,22 +2235,36 @@ void FinalScene::DrawObjectGeometry(GeometryPipelineType geometry_type) noexcept
   model_ = glm::scale(model_, glm::vec3(40.f));
 
   if (is_geometry_pipeline) {
-    for (const auto& mesh : leo_magnus_.meshes()) {
+    bool is_visible = false;
+    const auto& leo_magnus_meshes = leo_magnus_.meshes();
+    for (std::size_t mesh_idx = 0; mesh_idx < leo_magnus_meshes.size(); mesh_idx++) {
+      const auto& mesh = leo_magnus_meshes[mesh_idx];
       if (mesh.bounding_sphere().IsOnFrustum(camera_frustum_, model_)) {
-        current_pipeline->SetMatrix4("transform.model", model_);
-        current_pipeline->SetMatrix4("viewNormalMatrix",
-            glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
+        is_visible = true;
 
-        renderer_.DrawModelWithMaterials(leo_magnus_, leo_magnus_textures_, 4);
+        // Only the material of the visible mesh is requested.
+        if (mesh_idx < static_cast<std::size_t>(leo_magnus_mesh_count_)) {
+          RequestTexturesScreenSize(
+              static_cast<std::int8_t>(leo_magnus_textures_idx_ + mesh_idx * kMaterialMapCount),
+              kMaterialMapCount, mesh.bounding_sphere(), model_);
+        }
       }
     }
+
+    if (is_visible) {
+      current_pipeline->SetMatrix4("transform.model", model_);
+      current_pipeline->SetMatrix4("viewNormalMatrix",
+          glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
+
+      // Drawn without face culling, its back faces are kept.
+      meshlet_culler_.set_cull_backfaces(false);
+      renderer_.DrawModelWithMaterials(leo_magnus_, model_, material_system_,
+                                       *current_pipeline, leo_magnus_first_material_, 1);
+      meshlet_culler_.set_cull_backfaces(true);
+    }
   } 
   else {
-    current_pipeline->SetMatrix4("transform.model", model_);
-    current_pipeline->SetMatrix4("viewNormalMatrix",
-        glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
-
-    renderer_.DrawModel(leo_magnus_);
+    QueueShadowCaster(leo_magnus_, model_, double_sided_shadow_draw_list);
   }
 
   // Render Leo Magnus'sword.
@@ -1734,23 +2278,29 @@ void FinalScene::DrawObjectGeometry(GeometryPipelineType geometry_type) noexcept
   model_ = glm::rotate(model_, glm::radians(45.f), glm::vec3(0.f, 1.f, 0.f));
 
   if (is_geometry_pipeline) {
+    bool is_visible = false;
     for (const auto& mesh : sword_.meshes()) {
       if (mesh.bounding_sphere().IsOnFrustum(camera_frustum_, model_)) {
-        current_pipeline->SetMatrix4("transform.model", model_);
-        current_pipeline->SetMatrix4(
-            "viewNormalMatrix",
-            glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
-
-        renderer_.DrawModelWithMaterials(sword_, sword_textures_, 0);
+        is_visible = true;
+        RequestTexturesScreenSize(sword_textures_idx_, kMaterialMapCount,
+                                  mesh.bounding_sphere(), model_);
       }
     }
+
+    if (is_visible) {
+      current_pipeline->SetMatrix4("transform.model", model_);
+      current_pipeline->SetMatrix4(
+          "viewNormalMatrix",
+          glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
+
+      renderer_.DrawModelWithMaterials(sword_, model_, material_system_,
+                                       *current_pipeline, sword_material_, 0);
+    }
+
+    meshlet_culler_.EndView();
   } 
   else {
-    current_pipeline->SetMatrix4("transform.model", model_);
-    current_pipeline->SetMatrix4("viewNormalMatrix",
-        glm::mat4(glm::transpose(glm::inverse(view_ * model_))));
-
-    renderer_.DrawModel(sword_);
+    QueueShadowCaster(sword_, model_, shadow_draw_list);
   }
 
   glCullFace(GL_BACK);
@@ -1758,40 +2308,97 @@ void FinalScene::DrawObjectGeometry(GeometryPipelineType geometry_type) noexcept
   current_pipeline = nullptr;
 }
 
+void FinalScene::QueueShadowCaster(const Model& model, const glm::mat4& model_matrix,
+                                   GeometryDrawList* draw_list) {
+  for (const auto& mesh : model.meshes()) {
+    draw_list->Add(mesh, lod_selector_.Select(mesh, model_matrix), model_matrix);
+  }
+}
+
+void FinalScene::DrawShadowCasters(const GeometryDrawList& draw_list,
+                                   const GeometryDrawList& double_sided_draw_list) noexcept {
+  // The instanced shadow pipelines read the model matrices of the draws.
+  glEnable(GL_CULL_FACE);
+  glCullFace(GL_FRONT);
+  renderer_.DrawIndirect(geometry_arena_, draw_list);
+
+  glDisable(GL_CULL_FACE);
+  renderer_.DrawIndirect(geometry_arena_, double_sided_draw_list);
+
+  glEnable(GL_CULL_FACE);
+  glCullFace(GL_BACK);
+}
+
+void FinalScene::RequestTexturesScreenSize(std::int8_t first_texture_idx,
+                                           std::size_t texture_count,
+                                           const BoundingSphere& bounding_sphere,
+                                           const glm::mat4& model) noexcept {
+  const float screen_size = bounding_sphere.CalculateScreenSize(
+      model, camera_.position(), glm::radians(camera_.fov()),
+      Engine::window_size().y);
+
+  for (std::size_t i = 0; i < texture_count; i++) {
+    texture_streamer_.RequestScreenSize(texture_stream_slots_[first_texture_idx + i],
+                                        screen_size);
+  }
+}
+
 void FinalScene::DrawInstancedObjectGeometry(GeometryPipelineType geometry_type)
     noexcept {
   const auto cull_face = geometry_type == GeometryPipelineType::kGeometry ? GL_BACK : GL_FRONT;
   glCullFace(cull_face);
 
-  gold_mat_.Bind(GL_TEXTURE0);
-
   const auto is_deferred_pipeline =
       geometry_type == GeometryPipelineType::kGeometry;
 
   if (is_deferred_pipeline) {
-    visible_sphere_model_matrices_.clear();
+    material_system_.Bind(gold_material_, instanced_geometry_pipeline_);
+  }
 
-    for (const auto& sphere_model : sphere_model_matrices_) {
-      if (sphere_.bounding_sphere().IsOnFrustum(camera_frustum_,
-                                                sphere_model)) 
-      {
-         visible_sphere_model_matrices_.push_back(sphere_model);
+  // Selects the level of each drawn sphere, the shadow maps draw all of them.
+  std::array<std::uint32_t, kMaxLodCount + 1> lod_offsets{};
+  for (std::size_t i = 0; i < sphere_model_matrices_.size(); i++) {
+    const auto& sphere_model = sphere_model_matrices_[i];
+    if (is_deferred_pipeline) {
+      if (!sphere_.bounding_sphere().IsOnFrustum(camera_frustum_, sphere_model)) {
+        sphere_lods_[i] = kMaxLodCount;
+        continue;
       }
+
+      RequestTexturesScreenSize(gold_textures_idx_, 3, sphere_.bounding_sphere(),
+                                sphere_model);
     }
-  }
 
-  const auto& buffer_data = is_deferred_pipeline 
-                               ? visible_sphere_model_matrices_
-                               : sphere_model_matrices_;
+    sphere_lods_[i] = lod_selector_.Select(sphere_, sphere_model,
+                                           static_cast<std::uint32_t>(i));
+    lod_offsets[sphere_lods_[i] + 1]++;
+  }
 
-  sphere_.SetModelMatrixBufferSubData(buffer_data.data(), buffer_data.size());
+  // Sorts the model matrices by level so that each one is drawn from a range.
+  for (std::size_t lod = 1; lod < lod_offsets.size(); lod++) {
+    lod_offsets[lod] += lod_offsets[lod - 1];
+  }
+  const auto sphere_count = lod_offsets.back();
+  lod_sorted_sphere_model_matrices_.resize(sphere_count);
+  auto lod_ends = lod_offsets;
+  for (std::size_t i = 0; i < sphere_model_matrices_.size(); i++) {
+    if (sphere_lods_[i] < kMaxLodCount) {
+      lod_sorted_sphere_model_matrices_[lod_ends[sphere_lods_[i]]++] =
+          sphere_model_matrices_[i];
+    }
+  }
 
-  const auto sphere_count = is_deferred_pipeline
-                                ? visible_sphere_model_matrices_.size()
-                                : kSphereCount_;
+  sphere_.SetModelMatrixBufferSubData(lod_sorted_sphere_model_matrices_.data(),
+                                      sphere_count);
 
   // Render spheres.
-  renderer_.DrawInstancedMesh(sphere_, sphere_count, GL_TRIANGLE_STRIP);
+  for (std::uint32_t lod = 0; lod < kMaxLodCount; lod++) {
+    const auto instance_count = lod_offsets[lod + 1] - lod_offsets[lod];
+    if (instance_count > 0) {
+      renderer_.DrawInstancedMesh(sphere_, instance_count, GL_TRIANGLE_STRIP, lod,
+                                  lod_offsets[lod]);
+    }
+  }
 
   glCullFace(GL_BACK);
 }
@@ -1802,14 +2409,14 @@ void FinalScene::DestroyPipelines() noexcept {
   prefilter_pipeline_.End();
   brdf_pipeline_.End();
 
-  geometry_pipeline_.End();
   instanced_geometry_pipeline_.End();
   arm_geometry_pipe_.End();
   emissive_arm_geometry_pipe_.End();
+  vt_arm_geometry_pipe_.End();
+  vt_emissive_arm_geometry_pipe_.End();
+  vt_feedback_pipe_.End();
   ssao_pipeline_.End();
   ssao_blur_pipeline_.End();
-  shadow_mapping_pipe_.End();
-  point_shadow_mapping_pipe_.End();
   instanced_shadow_mapping_pipe_.End();
   point_instanced_shadow_mapping_pipe_.End();
 
@@ -1824,6 +2431,11 @@ void FinalScene::DestroyPipelines() noexcept {
 }
 
 void FinalScene::DestroyIblPreComputedCubeMaps() noexcept {
+  for (const auto texture : {equirectangular_map_, env_cubemap_, irradiance_cubemap_,
+                             prefilter_cubemap_, brdf_lut_}) {
+    GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, texture);
+  }
+
   glDeleteTextures(1, &equirectangular_map_);
   glDeleteTextures(1, &env_cubemap_);
   glDeleteTextures(1, &irradiance_cubemap_);
@@ -1838,6 +2450,17 @@ void FinalScene::DestroyFrameBuffers() noexcept {
   ssao_blur_fbo_.Destroy();
   bloom_fbo_.Destroy();
   hdr_fbo_.Destroy();
+
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, shadow_map_);
+  GetGpuMemoryAccountant().Untrack(GpuObjectType::kTexture, point_shadow_cubemap_);
+  glDeleteTextures(1, &shadow_map_);
+  glDeleteTextures(1, &point_shadow_cubemap_);
+  glDeleteFramebuffers(1, &shadow_map_fbo_);
+  glDeleteFramebuffers(1, &point_shadow_map_fbo_);
+  shadow_map_ = 0;
+  point_shadow_cubemap_ = 0;
+  shadow_map_fbo_ = 0;
+  point_shadow_map_fbo_ = 0;
 }
 
 void FinalScene::DestroyMeshes() noexcept {
@@ -1851,29 +2474,29 @@ void FinalScene::DestroyModels() noexcept {
   sword_.Destroy();
   sandstone_platform_.Destroy();
   treasure_chest_.Destroy();
+
+  shadow_draw_list_.Destroy();
+  double_sided_shadow_draw_list_.Destroy();
+  point_shadow_draw_list_.Destroy();
+  double_sided_point_shadow_draw_list_.Destroy();
+  geometry_arena_.Destroy();
 }
 
 void FinalScene::DestroyMaterials() noexcept { 
-  gold_mat_.Destroy();
-  sandstone_platform_mat_.Destroy();
-
-  for (auto& tex : leo_magnus_textures_) {
-    glDeleteTextures(1, &tex);
-  }
-
-  for (auto& tex : sword_textures_) {
-    glDeleteTextures(1, &tex);
-  }
+  material_system_.End();
+  virtual_texture_system_.End();
+  GetSamplerCache().Clear();
 
-  for (auto& tex : treasure_chest_textures_) {
-    glDeleteTextures(1, &tex);
+  for (auto& texture_handle : texture_handles_) {
+    texture_handle.Release();
   }
 }
 
 LoadTextureToGpuJob::LoadTextureToGpuJob(ImageBuffer* image_buffer,
                                          GLuint* texture_id,
-                                         const TextureParameters& tex_param) noexcept
-  : Job(JobType::kMainThread), 
+                                         const TextureParameters& tex_param,
+                                         JobType job_type) noexcept
+  : Job(job_type),
     image_buffer_(image_buffer),
     texture_id_(texture_id),
     texture_param_(tex_param)
@@ -1885,6 +2508,10 @@ void LoadTextureToGpuJob::Work() noexcept {
   ZoneScoped;
 #endif  // TRACY_ENABLE
   LoadTextureToGpu(image_buffer_, texture_id_, texture_param_);
+
+  if (type_ == JobType::kGpuUpload) {
+    WaitForGpuCompletion();
+  }
 }
 
 LoadFileFromDiskJob::LoadFileFromDiskJob(std::string file_path,
@@ -1907,8 +2534,8 @@ void LoadFileFromDiskJob::Work() noexcept {
 
 PipelineCreationJob::PipelineCreationJob(
   FileBuffer* v_shader_buff,
-  FileBuffer* f_shader_buff, Pipeline* pipeline)
-  : Job(JobType::kMainThread),
+  FileBuffer* f_shader_buff, Pipeline* pipeline, JobType job_type)
+  : Job(job_type),
     vertex_shader_buffer_(v_shader_buff),
     fragment_shader_buffer_(f_shader_buff),
     pipeline_(pipeline) {}
@@ -1920,6 +2547,10 @@ void PipelineCreationJob::Work() noexcept {
 
   pipeline_->Begin(*vertex_shader_buffer_, 
       *fragment_shader_buffer_);
+
+  if (type_ == JobType::kGpuUpload) {
+    WaitForGpuCompletion();
+  }
 }
 
 FunctionExecutionJob::FunctionExecutionJob(
@@ -1935,12 +2566,14 @@ void FunctionExecutionJob::Work() noexcept {
 }
 
 ModelCreationJob::ModelCreationJob(Model* model, const std::string_view file_path,
-                               const bool gamma, const bool flip_y) noexcept
+                               const bool gamma, const bool flip_y,
+                               const ModelImporter importer) noexcept
     : Job(JobType::kModelLoading),
       model_(model),
       file_path_(file_path),
       gamma_(gamma),
-      flip_y_(flip_y)
+      flip_y_(flip_y),
+      importer_(importer)
 {
 }
 
@@ -1949,18 +2582,25 @@ void ModelCreationJob::Work() noexcept {
   ZoneScoped;
 #endif  // TRACY_ENABLE
 
-  model_->Load(file_path_, gamma_, flip_y_);
-  model_->GenerateModelSphereBoundingVolume();
+  model_->Load(file_path_, gamma_, flip_y_, importer_);
 }
 
-LoadModelToGpuJob::LoadModelToGpuJob(Model* model) noexcept :
-  Job(JobType::kMainThread),
-  model_(model) {}
+LoadModelToGpuJob::LoadModelToGpuJob(Model* model, GeometryArena* arena,
+                                     JobType job_type) noexcept :
+  Job(job_type),
+  model_(model),
+  arena_(arena) {}
 
 void LoadModelToGpuJob::Work() noexcept {
 #ifdef TRACY_ENABLE
   ZoneScoped;
 #endif  // TRACY_ENABLE
 
-  model_->LoadToGpu();
+  // Only the buffers of the arena are written, its VAO is updated by the main
+  // thread once the models are loaded.
+  model_->LoadToGpu(arena_);
+
+  if (type_ == JobType::kGpuUpload) {
+    WaitForGpuCompletion();
+  }
 }